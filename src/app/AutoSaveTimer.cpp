@@ -1,15 +1,70 @@
 #include "AutoSaveTimer.h"
 #include "MainWindow.h"
+#include "AbstractCommand.h"
 #include <QFile>
 #include <QDir>
+#include <QMutexLocker>
+#include <QMessageBox>
+#include <QStatusBar>
 #include "settings/ini_keys.h"
 #include <QDebug>
 
-QAutoSaveTimer::QAutoSaveTimer(MainWindow* obj): QTimer(obj), m_MW(obj)
+class QAutoSaveTimer::SaveTask : public AbstractCommand0<BackgroundExecutor::TaskResultPtr>
+{
+public:
+    SaveTask(QAutoSaveTimer* owner, ProjectWriter::Snapshot const& snapshot,
+             QString const& project_file, QString const& unnamed_file)
+        :   m_pOwner(owner), m_snapshot(snapshot),
+            m_projectFile(project_file), m_unnamedFile(unnamed_file) {}
+
+    // This method is called from the background thread.
+    virtual BackgroundExecutor::TaskResultPtr operator()();
+private:
+    QAutoSaveTimer* m_pOwner;
+    ProjectWriter::Snapshot m_snapshot;
+    QString m_projectFile;
+    QString m_unnamedFile;
+};
+
+class QAutoSaveTimer::SaveResult : public AbstractCommand0<void>
+{
+public:
+    explicit SaveResult(QAutoSaveTimer* owner) : m_pOwner(owner) {}
+
+    // This method is called from the main thread.
+    virtual void operator()();
+private:
+    QAutoSaveTimer* m_pOwner;
+};
+
+QAutoSaveTimer::QAutoSaveTimer(MainWindow* obj)
+    :   QTimer(obj), m_MW(obj), m_saveInProgress(false)
 {
     connect(this, SIGNAL(timeout()), this, SLOT(autoSaveProject()));
 }
 
+QAutoSaveTimer::~QAutoSaveTimer()
+{
+    waitForPendingSave();
+}
+
+void
+QAutoSaveTimer::waitForPendingSave()
+{
+    QMutexLocker const locker(&m_mutex);
+    while (m_saveInProgress) {
+        m_saveFinishedCond.wait(&m_mutex);
+    }
+}
+
+void
+QAutoSaveTimer::saveFinished()
+{
+    QMutexLocker const locker(&m_mutex);
+    m_saveInProgress = false;
+    m_saveFinishedCond.wakeAll();
+}
+
 bool
 QAutoSaveTimer::copyFileTo(const QString& sFromPath, const QString& sToPath)
 {
@@ -42,35 +97,79 @@ QAutoSaveTimer::getAutoSaveInputDir()
 void
 QAutoSaveTimer::autoSaveProject()
 {
-    blockSignals(true);
+    if (m_MW->numImages() == 0) {
+        return;
+    }
+
+    {
+        QMutexLocker const locker(&m_mutex);
+        if (m_saveInProgress) {
+            // The previous save is still being written.
+            return;
+        }
+        m_saveInProgress = true;
+    }
 
     QString const unnamed_autosave_projectFile(
         QDir::toNativeSeparators(getAutoSaveInputDir() + "/UnnamedAutoSave.Scantailor")
     );
 
-    if (m_MW->numImages() != 0) {
-        if (m_MW->projectFile().isEmpty()) {
-            m_MW->saveProjectWithFeedback(unnamed_autosave_projectFile);
-        } else {
-            QString const project_filename = m_MW->projectFile();
-            QFileInfo const project_file(project_filename);
-            QFileInfo const file_as(
-                project_file.absoluteDir(),
-                project_file.fileName() + ".as"
-            );
-            QString const file_as_path(file_as.absoluteFilePath());
-            if (m_MW->saveProjectWithFeedback(file_as_path)) {
-                QFile::remove(unnamed_autosave_projectFile);
-                if (copyFileTo(project_filename, project_filename + ".bak")) {
-                    QFile::remove(project_filename);
-                }
-                if (copyFileTo(file_as_path, project_filename)) {
-                    QFile::remove(file_as_path);
-                }
-                //QFile::remove(project_filename+".bak");
-            }
-        }
+    if (QStatusBar* sb = m_MW->statusBar()) {
+        sb->showMessage(MainWindow::tr("Saving project..."), 1000);
+    }
+
+    // Only capturing the settings has to be done here.  Serializing
+    // and writing them is left to the background thread.
+    BackgroundExecutor::TaskPtr const task(
+        new SaveTask(
+            this, m_MW->takeProjectSnapshot(),
+            m_MW->projectFile(), unnamed_autosave_projectFile
+        )
+    );
+    m_executor.enqueueTask(task);
+}
+
+bool
+QAutoSaveTimer::saveSnapshot(ProjectWriter::Snapshot const& snapshot,
+                             QString const& project_file, QString const& unnamed_file)
+{
+    if (project_file.isEmpty()) {
+        return snapshot.write(unnamed_file);
     }
 
-    blockSignals(false);
+    // The project file is replaced atomically, so it's either the old
+    // or the new one, even if we crash.  We still keep a backup of
+    // the previous version, as we always did.
+    copyFileTo(project_file, project_file + ".bak");
+    if (!snapshot.write(project_file)) {
+        return false;
+    }
+
+    QFile::remove(unnamed_file);
+    return true;
+}
+
+/*========================= QAutoSaveTimer::SaveTask =========================*/
+
+BackgroundExecutor::TaskResultPtr
+QAutoSaveTimer::SaveTask::operator()()
+{
+    bool const saved = saveSnapshot(m_snapshot, m_projectFile, m_unnamedFile);
+    m_pOwner->saveFinished();
+
+    if (saved) {
+        return BackgroundExecutor::TaskResultPtr();
+    }
+    return BackgroundExecutor::TaskResultPtr(new SaveResult(m_pOwner));
+}
+
+/*======================== QAutoSaveTimer::SaveResult ========================*/
+
+void
+QAutoSaveTimer::SaveResult::operator()()
+{
+    QMessageBox::warning(
+        m_pOwner->m_MW, MainWindow::tr("Error"),
+        MainWindow::tr("Error saving the project file!")
+    );
 }
@@ -3,23 +3,59 @@
 
 #include <QTimer>
 #include <QString>
+#include <QMutex>
+#include <QWaitCondition>
 #include <functional>
 #include "ProjectPages.h"
+#include "ProjectWriter.h"
+#include "BackgroundExecutor.h"
 
 class MainWindow;
 
+/**
+ * Periodically saves the project.  The project is captured on the GUI
+ * thread, while writing it out is done on a background thread.
+ */
 class QAutoSaveTimer : public QTimer
 {
     Q_OBJECT
 public:
     QAutoSaveTimer(MainWindow* obj);
+
+    /**
+     * Waits for a pending save, if any, to finish.
+     */
+    virtual ~QAutoSaveTimer();
+
+    /**
+     * Blocks until the save started by the last timeout, if any,
+     * is written.  Must be called from the GUI thread.
+     */
+    void waitForPendingSave();
 public slots:
     void autoSaveProject();
 private:
-    bool copyFileTo(const QString& sFromPath, const QString& sToPath);
+    class SaveTask;
+    class SaveResult;
+
+    static bool copyFileTo(const QString& sFromPath, const QString& sToPath);
     const QString getAutoSaveInputDir();
+
+    static bool saveSnapshot(ProjectWriter::Snapshot const& snapshot,
+                             QString const& project_file, QString const& unnamed_file);
+
+    void saveFinished();
 private:
     MainWindow* m_MW;
+    QMutex m_mutex;
+    QWaitCondition m_saveFinishedCond;
+    bool m_saveInProgress;
+
+    /**
+     * Declared last, so that it's destroyed first, having
+     * finished the pending save while the rest is still there.
+     */
+    BackgroundExecutor m_executor;
 };
 
 #endif // QAUTOSAVETIMER_H
@@ -21,7 +21,8 @@
 
 #include "NewOpenProjectPanel.h"
 #include "RecentProjects.h"
-#include "WorkerThread.h"
+#include "WorkerThreadPool.h"
+#include "FilterDataCache.h"
 #include "ProjectPages.h"
 #include "PageSelectionAccessor.h"
 #include "StageSequence.h"
@@ -44,6 +45,7 @@
 #include "BasicImageView.h"
 #include "ProjectWriter.h"
 #include "ProjectReader.h"
+#include "ProjectFile.h"
 #include "ThumbnailPixmapCache.h"
 #include "ThumbnailFactory.h"
 #include "ContentBoxPropagator.h"
@@ -142,7 +144,7 @@
 MainWindow::MainWindow()
     :   m_ptrPages(new ProjectPages),
         m_ptrStages(new StageSequence(m_ptrPages, newPageSelectionAccessor())),
-        m_ptrWorkerThread(new WorkerThread),
+        m_ptrWorkerPool(new WorkerThreadPool),
         m_ptrInteractiveQueue(new ProcessingTaskQueue(ProcessingTaskQueue::RANDOM_ORDER)),
         m_curFilter(0),
         m_ignoreSelectionChanges(0),
@@ -255,7 +257,7 @@ MainWindow::MainWindow()
     );
 
     connect(
-        m_ptrWorkerThread.get(),
+        m_ptrWorkerPool.get(),
         SIGNAL(taskResult(BackgroundTaskPtr,FilterResultPtr)),
         this, SLOT(filterResult(BackgroundTaskPtr,FilterResultPtr))
     );
@@ -355,7 +357,7 @@ MainWindow::~MainWindow()
     if (m_ptrBatchQueue.get()) {
         m_ptrBatchQueue->cancelAndClear();
     }
-    m_ptrWorkerThread->shutdown();
+    m_ptrWorkerPool->shutdown();
 
     removeWidgetsFromLayout(m_pImageFrameLayout);
     removeWidgetsFromLayout(m_pOptionsFrameLayout);
@@ -440,6 +442,9 @@ MainWindow::switchToNewProject(
 
     Utils::maybeCreateCacheDir(out_dir);
 
+    // Images of the previous project are of no use anymore.
+    FilterDataCache::instance().clear();
+
     m_ptrPages = pages;
     m_projectFile = project_file_path;
 
@@ -1030,10 +1035,11 @@ MainWindow::setImageWidget(
         m_pImageFrameLayout->addWidget(widget);
     } else {
         m_ptrTabbedDebugImages->addTab(widget, "Main");
+        QImage image;
         AutoRemovingFile file;
         QString label;
-        while (!(file = debug_images->retrieveNext(&label)).get().isNull()) {
-            QWidget* widget = new DebugImageView(file);
+        while (debug_images->retrieveNext(&image, &file, &label)) {
+            QWidget* widget = image.isNull() ? new DebugImageView(file) : new DebugImageView(image);
             m_imageWidgetCleanup.add(widget);
             m_ptrTabbedDebugImages->addTab(widget, label);
         }
@@ -1608,7 +1614,8 @@ MainWindow::startBatchProcessing()
 
     BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
     if (task) {
-        m_ptrWorkerThread->performTask(task);
+        m_ptrWorkerPool->performTask(task);
+        submitBatchTasksToIdleThreads();
     } else {
         stopBatchProcessing();
     }
@@ -1714,9 +1721,12 @@ MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& r
             return;
         }
 
+        // The thread that produced this result isn't counted as idle yet,
+        // so we submit one task unconditionally.
         BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
         if (task) {
-            m_ptrWorkerThread->performTask(task);
+            m_ptrWorkerPool->performTask(task);
+            submitBatchTasksToIdleThreads();
         }
 
         PageInfo const page(m_ptrBatchQueue->selectedPage());
@@ -1726,6 +1736,20 @@ MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& r
     }
 }
 
+void
+MainWindow::submitBatchTasksToIdleThreads()
+{
+    while (m_ptrWorkerPool->numIdleThreads() > 0) {
+        BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
+        if (!task) {
+            // Either nothing is left, or the remaining pages share
+            // their images with pages being processed right now.
+            break;
+        }
+        m_ptrWorkerPool->performTask(task);
+    }
+}
+
 void
 MainWindow::fixDpiDialogRequested()
 {
@@ -1775,9 +1799,7 @@ void
 MainWindow::saveProjectTriggered()
 {
     if (m_projectFile.isEmpty()) {
-        pauseAutoSaveTimer();
         saveProjectAsTriggered();
-        resumeAutoSaveTimer();
         return;
     }
 
@@ -1793,6 +1815,10 @@ MainWindow::saveProjectAsTriggered()
 {
     // XXX: this function is duplicated in OutOfMemoryDialog.
 
+    // An autosave started earlier, or while the dialog is open, could
+    // otherwise finish after us and overwrite the file we are saving to.
+    pauseAutoSaveTimer();
+
     QString project_dir;
     if (!m_projectFile.isEmpty()) {
         project_dir = QFileInfo(m_projectFile).absolutePath();
@@ -1810,6 +1836,7 @@ MainWindow::saveProjectAsTriggered()
         )
     );
     if (project_file.isEmpty()) {
+        resumeAutoSaveTimer();
         return;
     }
 
@@ -1832,6 +1859,8 @@ MainWindow::saveProjectAsTriggered()
         rp.setMostRecent(m_projectFile);
         rp.write();
     }
+
+    resumeAutoSaveTimer();
 }
 
 void
@@ -1906,8 +1935,11 @@ MainWindow::openProject(QString const& project_file)
         return;
     }
 
+    file.close();
+
     QDomDocument doc;
-    if (!doc.setContent(&file)) {
+    std::vector<QDomDocument> filter_docs;
+    if (!ProjectFile::read(project_file, doc, filter_docs)) {
         QMessageBox::warning(
             this, tr("Error"),
             tr("The project file is broken.")
@@ -1916,9 +1948,7 @@ MainWindow::openProject(QString const& project_file)
         return;
     }
 
-    file.close();
-
-    ProjectOpeningContext* context = new ProjectOpeningContext(this, project_file, doc);
+    ProjectOpeningContext* context = new ProjectOpeningContext(this, project_file, doc, filter_docs);
     connect(context, SIGNAL(done(ProjectOpeningContext*)), SLOT(projectOpened(ProjectOpeningContext*)));
     context->proceed();
 }
@@ -2368,7 +2398,7 @@ MainWindow::loadPageInteractive(PageInfo const& page)
     m_ptrInteractiveQueue->addProcessingTask(
         page, createCompositeTask(page, m_curFilter, /*batch=*/false, m_debug)
     );
-    m_ptrWorkerThread->performTask(m_ptrInteractiveQueue->takeForProcessing());
+    m_ptrWorkerPool->performTask(m_ptrInteractiveQueue->takeForProcessing());
 }
 
 void
@@ -2499,9 +2529,21 @@ MainWindow::saveProjectWithFeedback(QString const& project_file)
         return false;
     }
 
+    if (m_ptrThumbnailCache.get()) {
+        // Drop the thumbnails replaced since the last save.
+        m_ptrThumbnailCache->compactStore();
+    }
+
     return true;
 }
 
+ProjectWriter::Snapshot
+MainWindow::takeProjectSnapshot()
+{
+    ProjectWriter writer(m_ptrPages, m_selectedPage, m_outFileNameGen);
+    return writer.snapshot(m_ptrStages->filters());
+}
+
 /**
  * Note: showInsertFileDialog(BEFORE, ImageId()) is legal and means inserting at the end.
  */
@@ -3157,6 +3199,8 @@ MainWindow::pauseAutoSaveTimer()
 {
     if (m_autosave_timer != nullptr) {
         m_autosave_timer->blockSignals(true);
+        // Don't let an autosave still being written race with what follows.
+        m_autosave_timer->waitForPendingSave();
     }
 }
 
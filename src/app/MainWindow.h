@@ -51,6 +51,7 @@
 #include "ExportDialog.h"
 //end of modified by monday2000
 #include "AutoSaveTimer.h"
+#include "ProjectWriter.h"
 #include "PageSequence.h"
 #include "PageSelectionProvider.h"
 
@@ -70,7 +71,7 @@ class ProcessingIndicationWidget;
 class ImageInfo;
 class PageInfo;
 class QStackedLayout;
-class WorkerThread;
+class WorkerThreadPool;
 class ProjectReader;
 class DebugImages;
 class ContentBoxPropagator;
@@ -122,6 +123,7 @@ public:
         return m_projectFile;
     }
     bool saveProjectWithFeedback(QString const& project_file);
+    ProjectWriter::Snapshot takeProjectSnapshot();
     // AutoSave Timer / end
 
 public slots:
@@ -307,6 +309,8 @@ private:
 
     bool isBatchProcessingInProgress() const;
 
+    void submitBatchTasksToIdleThreads();
+
     bool isProjectLoaded() const;
 
     bool isBelowSelectContent() const;
@@ -388,7 +392,7 @@ private:
     OutputFileNameGenerator m_outFileNameGen;
     IntrusivePtr<ThumbnailPixmapCache> m_ptrThumbnailCache;
     std::unique_ptr<ThumbnailSequence> m_ptrThumbSequence;
-    std::unique_ptr<WorkerThread> m_ptrWorkerThread;
+    std::unique_ptr<WorkerThreadPool> m_ptrWorkerPool;
     std::unique_ptr<ProcessingTaskQueue> m_ptrBatchQueue;
     std::unique_ptr<ProcessingTaskQueue> m_ptrInteractiveQueue;
     QStackedLayout* m_pImageFrameLayout;
@@ -427,7 +431,7 @@ private:
 //Disable docking
     bool m_docking_enabled;
 
-    QTimer* m_autosave_timer;
+    QAutoSaveTimer* m_autosave_timer;
 
 #ifdef HAVE_CANBERRA
     CanberraSoundPlayer m_canberraPlayer;
@@ -27,9 +27,10 @@
 #include <assert.h>
 
 ProjectOpeningContext::ProjectOpeningContext(
-    QWidget* parent, QString const& project_file, QDomDocument const& doc)
+    QWidget* parent, QString const& project_file, QDomDocument const& doc,
+    std::vector<QDomDocument> const& filter_docs)
     :   m_projectFile(project_file),
-        m_reader(doc),
+        m_reader(doc, filter_docs),
         m_pParent(parent)
 {
 }
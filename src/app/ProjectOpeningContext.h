@@ -38,7 +38,8 @@ class ProjectOpeningContext : public QObject
     DECLARE_NON_COPYABLE(ProjectOpeningContext)
 public:
     ProjectOpeningContext(
-        QWidget* parent, QString const& project_file, QDomDocument const& doc);
+        QWidget* parent, QString const& project_file, QDomDocument const& doc,
+        std::vector<QDomDocument> const& filter_docs = std::vector<QDomDocument>());
 
     virtual ~ProjectOpeningContext();
 
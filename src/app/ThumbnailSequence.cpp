@@ -20,6 +20,8 @@
 
 #include "ThumbnailFactory.h"
 #include "IncompleteThumbnail.h"
+#include "ThumbnailBase.h"
+#include "ThumbnailPixmapCache.h"
 #include "PageSequence.h"
 #include "PageOrderProvider.h"
 #include "PageInfo.h"
@@ -43,6 +45,7 @@
 #include <QGraphicsSimpleTextItem>
 #include <QGraphicsPixmapItem>
 #include <QGraphicsView>
+#include <QScrollBar>
 #include <QStyle>
 #include <QStyleOptionGraphicsItem>
 #include <QGraphicsSceneMouseEvent>
@@ -287,6 +290,8 @@ private:
 
     void commitSceneRect();
 
+    void prefetchVisibleThumbnails();
+
     ThumbnailSequence& m_rOwner;
     QSizeF m_maxLogicalThumbSize;
     Container m_items;
@@ -620,6 +625,13 @@ void
 ThumbnailSequence::Impl::attachView(QGraphicsView* const view)
 {
     view->setScene(&m_graphicsScene);
+
+    QObject::connect(
+        view->verticalScrollBar(), &QScrollBar::valueChanged, &m_rOwner,
+        [this]() {
+            prefetchVisibleThumbnails();
+        }
+    );
 }
 
 void
@@ -995,6 +1007,7 @@ ThumbnailSequence::Impl::invalidateAllThumbnails()
     }
 
     commitSceneRect();
+    prefetchVisibleThumbnails();
 }
 
 //begin of modified by monday2000
@@ -1976,6 +1989,37 @@ ThumbnailSequence::Impl::commitSceneRect()
     }
 }
 
+/**
+ * Loads the thumbnails in the visible part of the scene in one go,
+ * rather than letting each of them request its own.
+ */
+void
+ThumbnailSequence::Impl::prefetchVisibleThumbnails()
+{
+    if (!m_ptrFactory.get()) {
+        return;
+    }
+
+    QList<QGraphicsView*> const views(m_graphicsScene.views());
+    if (views.isEmpty()) {
+        return;
+    }
+
+    QGraphicsView const* gv = views.first();
+    QRectF const visible_rect(gv->mapToScene(gv->viewport()->rect()).boundingRect());
+
+    std::vector<ImageId> image_ids;
+    for (QGraphicsItem* item : m_graphicsScene.items(visible_rect)) {
+        if (ThumbnailBase const* thumb = dynamic_cast<ThumbnailBase const*>(item)) {
+            image_ids.push_back(thumb->imageId());
+        }
+    }
+
+    if (!image_ids.empty()) {
+        m_ptrFactory->pixmapCache()->prefetch(image_ids);
+    }
+}
+
 /*==================== ThumbnailSequence::Item ======================*/
 
 ThumbnailSequence::Item::Item(PageInfo const& page_info, CompositeItem* comp_item)
@@ -39,6 +39,7 @@
 #include <string.h>
 
 #include "CommandLine.h"
+#include "MemoryBudget.h"
 
 int main(int argc, char** argv)
 {
@@ -71,6 +72,8 @@ int main(int argc, char** argv)
         return 0;
     }
 
+    MemoryBudget::instance().setLimit(qint64(cli.getMaxMemoryMb()) * 1024 * 1024);
+
     QSettings settings;
     GlobalStaticSettings::applyAppStyle(settings);
 
@@ -38,6 +38,7 @@
 #include "LoadFileTask.h"
 #include "ProjectWriter.h"
 #include "ProjectReader.h"
+#include "ProjectFile.h"
 #include "OrthogonalRotation.h"
 #include "SelectedPage.h"
 
@@ -70,10 +71,75 @@
 #include <QMap>
 #include <QImage>
 #include <QDomDocument>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <exception>
+#include <algorithm>
+#include <map>
+#include <string>
 
 #include "ConsoleBatch.h"
 #include "CommandLine.h"
 
+namespace
+{
+
+struct PageTask
+{
+    BackgroundTaskPtr task;
+    std::string filePath; // Printed when the task starts, in verbose mode.
+};
+
+/**
+ * Processes a group of pages sharing the same source image on a pool thread.
+ * Pages within a group are processed in order, just like the serial path
+ * would do, so that per-image settings (page split, orientation) are
+ * established by the first page before the second one reads them.
+ */
+class PageGroupRunnable : public QRunnable
+{
+public:
+    PageGroupRunnable(std::vector<PageTask> const& tasks, std::exception_ptr& error,
+                      int omp_threads, bool verbose, QMutex& output_mutex)
+        :   m_tasks(tasks), m_rError(error), m_ompThreads(omp_threads),
+            m_verbose(verbose), m_rOutputMutex(output_mutex)
+    {
+    }
+
+    virtual void run()
+    {
+#ifdef _OPENMP
+        // Each pool thread is an OpenMP initial thread with its own
+        // nthreads-var, so this doesn't affect other workers.
+        omp_set_num_threads(m_ompThreads);
+#endif
+        try {
+            for (PageTask const& page_task : m_tasks) {
+                if (m_verbose) {
+                    QMutexLocker const locker(&m_rOutputMutex);
+                    std::cout << "\tProcessing: " << page_task.filePath << "\n";
+                }
+                (*page_task.task)();
+            }
+        } catch (...) {
+            m_rError = std::current_exception();
+        }
+    }
+private:
+    std::vector<PageTask> m_tasks;
+    std::exception_ptr& m_rError;
+    int m_ompThreads;
+    bool m_verbose;
+    QMutex& m_rOutputMutex;
+};
+
+} // anonymous namespace
+
 ConsoleBatch::ConsoleBatch(std::vector<ImageFileInfo> const& images, QString const& output_directory, Qt::LayoutDirection const layout)
     :   batch(true), debug(true),
         m_ptrDisambiguator(new FileNameDisambiguator),
@@ -95,14 +161,15 @@ ConsoleBatch::ConsoleBatch(QString const project_file)
         throw std::runtime_error("Unable to open the project file.");
     }
 
+    file.close();
+
     QDomDocument doc;
-    if (!doc.setContent(&file)) {
+    std::vector<QDomDocument> filter_docs;
+    if (!ProjectFile::read(project_file, doc, filter_docs)) {
         throw std::runtime_error("The project file is broken.");
     }
 
-    file.close();
-
-    m_ptrReader.reset(new ProjectReader(doc));
+    m_ptrReader.reset(new ProjectReader(doc, filter_docs));
     m_ptrPages = m_ptrReader->pages();
 
     PageSelectionAccessor const accessor((IntrusivePtr<PageSelectionProvider>())); // Won't be used anyway.
@@ -211,21 +278,32 @@ ConsoleBatch::process()
     }
 
     // run filters
-    for (int j = startFilterIdx; j <= endFilterIdx; j++) {
-        if (cli.isVerbose()) {
-            std::cout << "Filter: " << (j + 1) << "\n";
-        }
+    int segmentStartIdx = startFilterIdx;
+    while (segmentStartIdx <= endFilterIdx) {
+        int const segmentEndIdx = findSegmentEnd(segmentStartIdx, endFilterIdx);
 
-        // process pages
         PageSequence page_sequence = m_ptrPages->toPageSequence(PAGE_VIEW);
-        setupFilter(j, page_sequence.asPageIdSet());
-        for (const PageInfo& page : page_sequence) {
+        for (int j = segmentStartIdx; j <= segmentEndIdx; j++) {
             if (cli.isVerbose()) {
-                std::cout << "\tProcessing: " << page.imageId().filePath().toLocal8Bit().constData() << "\n";
+                std::cout << "Filter: " << (j + 1) << "\n";
+            }
+            setupFilter(j, page_sequence.asPageIdSet());
+        }
+
+        // process pages
+        if (cli.getThreads() > 1) {
+            processPagesInParallel(page_sequence, segmentEndIdx, cli.getThreads());
+        } else {
+            for (const PageInfo& page : page_sequence) {
+                if (cli.isVerbose()) {
+                    std::cout << "\tProcessing: " << page.imageId().filePath().toLocal8Bit().constData() << "\n";
+                }
+                BackgroundTaskPtr bgTask = createCompositeTask(page, segmentEndIdx);
+                (*bgTask)();
             }
-            BackgroundTaskPtr bgTask = createCompositeTask(page, j);
-            (*bgTask)();
         }
+
+        segmentStartIdx = segmentEndIdx + 1;
     }
 
     // setup rest filters with params from cli
@@ -240,6 +318,88 @@ ConsoleBatch::process()
     }
 }
 
+// Pages are processed independently within a segment.  All pages have
+// passed the segment's last filter before the next segment starts, so
+// cross-page statistics (page_layout's aggregate content size) seen by
+// later stages are the same as in the serial case.
+void
+ConsoleBatch::processPagesInParallel(
+    PageSequence const& pages, int const last_filter_idx, int const num_threads)
+{
+    CommandLine const& cli = CommandLine::get();
+
+    // Pages are grouped by their source image, keeping the page order.
+    std::vector<std::vector<PageTask> > groups;
+    std::map<ImageId, size_t> group_by_image;
+    for (PageInfo const& page : pages) {
+        // Tasks are created on this thread, as createCompositeTask()
+        // isn't reentrant.
+        PageTask task;
+        task.task = createCompositeTask(page, last_filter_idx);
+        task.filePath = page.imageId().filePath().toLocal8Bit().constData();
+
+        std::map<ImageId, size_t>::iterator const it(group_by_image.find(page.imageId()));
+        if (it == group_by_image.end()) {
+            group_by_image[page.imageId()] = groups.size();
+            groups.push_back(std::vector<PageTask>(1, task));
+        } else {
+            groups[it->second].push_back(task);
+        }
+    }
+
+    int omp_threads = 1;
+#ifdef _OPENMP
+    omp_threads = std::max(1, omp_get_max_threads() / num_threads);
+#endif
+
+    std::vector<std::exception_ptr> errors(groups.size());
+
+    QMutex output_mutex;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(num_threads);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        pool.start(
+            new PageGroupRunnable(groups[i], errors[i], omp_threads, cli.isVerbose(), output_mutex)
+        );
+    }
+    pool.waitForDone();
+
+    // Report the error of the first failed page, as the serial path would.
+    for (std::exception_ptr const& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Filters are run in segments.  Within a segment, each page goes through
+// all of the segment's filters in a single composite task, so its source
+// image is loaded once per segment rather than once per filter.  A segment
+// ends at a barrier, a filter that all pages have to pass before any page
+// may enter the following filter:
+//  - page_split, as it may change the set of pages;
+//  - page_layout, as output needs the aggregate content size of all pages.
+// Cross-page statistics of deskew and select_content are not barriers, as
+// they are recomputed by updateStatistics() once all pages are processed.
+int
+ConsoleBatch::findSegmentEnd(int const start_filter_idx, int const end_filter_idx) const
+{
+    int const barriers[] = {
+        m_ptrStages->pageSplitFilterIdx(),
+        m_ptrStages->pageLayoutFilterIdx()
+    };
+
+    int segment_end = end_filter_idx;
+    for (int const barrier : barriers) {
+        if (barrier >= start_filter_idx && barrier < segment_end) {
+            segment_end = barrier;
+        }
+    }
+
+    return segment_end;
+}
+
 void
 ConsoleBatch::saveProject(QString const project_file)
 {
@@ -30,6 +30,7 @@
 #include "OutputFileNameGenerator.h"
 #include "PageId.h"
 #include "PageInfo.h"
+#include "PageSequence.h"
 #include "PageView.h"
 #include "ProjectPages.h"
 #include "ImageFileInfo.h"
@@ -73,6 +74,24 @@ private:
         PageInfo const& page,
         int const last_filter_idx
     );
+
+    /**
+     * Returns the index of the last filter of a processing segment
+     * starting at \p start_filter_idx.
+     */
+    int findSegmentEnd(int const start_filter_idx, int const end_filter_idx) const;
+
+    /**
+     * Runs the composite tasks for all \p pages up to \p last_filter_idx
+     * on \p num_threads threads.  Returns once all pages are processed.
+     * If any page failed, the exception of the first one (in page order)
+     * is rethrown.
+     */
+    void processPagesInParallel(
+        PageSequence const& pages,
+        int const last_filter_idx,
+        int const num_threads
+    );
 };
 
 #endif
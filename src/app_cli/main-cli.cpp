@@ -25,8 +25,38 @@
 
 #include "CommandLine.h"
 #include "ConsoleBatch.h"
+#include "StageProfiler.h"
+#include "MemoryBudget.h"
 #include "config.h"
 
+static void writeProfileReport(CommandLine const& cli)
+{
+    if (!cli.hasProfileReport()) {
+        return;
+    }
+
+    if (!StageProfiler::instance().writeReport(cli.profileReportFile())) {
+        std::cerr << "Failed to write the profile report to "
+                  << cli.profileReportFile().toStdString() << std::endl;
+    }
+}
+
+static void reportMemoryUsage(CommandLine const& cli)
+{
+    if (!cli.hasMaxMemory() && !cli.isVerbose()) {
+        return;
+    }
+
+    MemoryBudget const& budget = MemoryBudget::instance();
+    std::cout << "Peak estimated memory usage: "
+              << budget.peakReserved() / (1024 * 1024) << " MiB";
+    if (budget.limit() > 0) {
+        std::cout << " of " << budget.limit() / (1024 * 1024) << " MiB allowed, "
+                  << budget.numWaits() << " wait(s) for memory";
+    }
+    std::cout << std::endl;
+}
+
 int main(int argc, char** argv)
 {
     Q_INIT_RESOURCE(core_resources);
@@ -57,6 +87,12 @@ int main(int argc, char** argv)
         return 0;
     }
 
+    if (cli.hasProfileReport()) {
+        StageProfiler::instance().setEnabled(true);
+    }
+
+    MemoryBudget::instance().setLimit(qint64(cli.getMaxMemoryMb()) * 1024 * 1024);
+
     std::unique_ptr<ConsoleBatch> cbatch;
 
     try {
@@ -66,11 +102,15 @@ int main(int argc, char** argv)
             cbatch.reset(new ConsoleBatch(cli.images(), cli.outputDirectory(), cli.getLayoutDirection()));
         }
         cbatch->process();
+        reportMemoryUsage(cli);
     } catch (std::exception const& e) {
         std::cerr << e.what() << std::endl;
+        writeProfileReport(cli);
         exit(1);
     }
 
+    writeProfileReport(cli);
+
     if (cli.hasOutputProject()) {
         cbatch->saveProject(cli.outputProjectFile());
     }
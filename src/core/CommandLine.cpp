@@ -18,6 +18,7 @@
 */
 
 #include <cstdlib>
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
 #include <tiff.h>
@@ -26,6 +27,7 @@
 #include <QMap>
 #include <QRegularExpression>
 #include <QStringList>
+#include <QThread>
 #include "settings/ini_keys.h"
 
 #include "Dpi.h"
@@ -127,6 +129,9 @@ CommandLine::parseCli(QStringList const& argv)
     opts << "tiff-force-rgb";
     opts << "tiff-force-grayscale";
     opts << "tiff-force-keep-color-space";
+    opts << "threads";
+    opts << "max-memory";
+    opts << "profile-report";
 
     QMap<QString, QString> shortMap;
     shortMap["h"] = "help";
@@ -290,6 +295,8 @@ CommandLine::setup()
     m_pageDetectionBox = fetchPageDetectionBox();
     m_pageDetectionTolerance = fetchPageDetectionTolerance();
     m_defaultNull = fetchDefaultNull();
+    m_threads = fetchThreads();
+    m_maxMemoryMb = fetchMaxMemoryMb();
 
     QRegularExpression exp("^.*(tif|tiff|jpg|jpeg|bmp|gif|png|pbm|pgm|ppm|xbm|xpm)$", QRegularExpression::CaseInsensitiveOption);
     // setup images
@@ -405,7 +412,10 @@ CommandLine::printHelp()
     std::cout << "\t--window-title=WindowTitle\t\t-- default: project name" << std::endl;
     std::cout << "\t--page-detection-box=<widthxheight>\t\t-- in mm" << std::endl;
     std::cout << "\t\t--page-detection-tolerance=<0.0..1.0>\t-- default: 0.1" << std::endl;
-    std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6";
+    std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6" << std::endl;
+    std::cout << "\t--threads=<0|1|2|...>\t\t\t-- number of pages processed concurrently in batch mode; 0: one per CPU core; default: 1" << std::endl;
+    std::cout << "\t--max-memory=<MiB>\t\t\t-- pages wait for others to finish rather than exceed this estimated memory usage; default: no limit" << std::endl;
+    std::cout << "\t--profile-report=<file.json>\t\t-- write per-page, per-stage timing and memory usage there";
     std::cout << std::endl;
 }
 
@@ -934,6 +944,44 @@ bool CommandLine::fetchDefaultNull()
     return m_defaultNull;
 }
 
+int
+CommandLine::fetchThreads() const
+{
+    if (!hasThreads()) {
+        return 1;
+    }
+
+    bool ok = false;
+    int threads = m_options["threads"].toInt(&ok);
+    if (!ok || threads < 0) {
+        std::cout << "Invalid number of threads: " << m_options["threads"].toStdString() << std::endl;
+        return 1;
+    }
+
+    if (threads == 0) {
+        threads = std::max(1, QThread::idealThreadCount());
+    }
+
+    return threads;
+}
+
+int
+CommandLine::fetchMaxMemoryMb() const
+{
+    if (!hasMaxMemory()) {
+        return 0;
+    }
+
+    bool ok = false;
+    int const max_memory = m_options["max-memory"].toInt(&ok);
+    if (!ok || max_memory < 0) {
+        std::cout << "Invalid memory limit: " << m_options["max-memory"].toStdString() << std::endl;
+        return 0;
+    }
+
+    return max_memory;
+}
+
 void CommandLine::updateSettings()
 {
     CommandLine& cli = m_globalInstance;
@@ -62,7 +62,7 @@ public:
     }
     static void set(CommandLine const& cl);
 
-    CommandLine(QStringList const& argv, bool g = true) : m_error(false), m_gui(g), m_global(false), m_defaultNull(false)
+    CommandLine(QStringList const& argv, bool g = true) : m_error(false), m_gui(g), m_global(false), m_defaultNull(false), m_threads(1), m_maxMemoryMb(0)
     {
         CommandLine::parseCli(argv);
     }
@@ -277,6 +277,18 @@ public:
     {
         return contains("disable-check-output");
     }
+    bool hasThreads() const
+    {
+        return contains("threads") && !m_options["threads"].isEmpty();
+    }
+    bool hasMaxMemory() const
+    {
+        return contains("max-memory") && !m_options["max-memory"].isEmpty();
+    }
+    bool hasProfileReport() const
+    {
+        return contains("profile-report") && !m_options["profile-report"].isEmpty();
+    }
 
     page_split::LayoutType getLayout() const
     {
@@ -416,6 +428,21 @@ public:
     {
         return m_defaultNull;
     }
+    int getThreads() const
+    {
+        return m_threads;
+    }
+    /**
+     * \brief The memory budget for processing, in MiB.  Zero means no limit.
+     */
+    int getMaxMemoryMb() const
+    {
+        return m_maxMemoryMb;
+    }
+    QString profileReportFile() const
+    {
+        return m_options.value("profile-report");
+    }
 
     bool help()
     {
@@ -426,7 +453,7 @@ public:
     static void updateSettings();
 
 private:
-    CommandLine() : m_gui(true), m_global(false) {}
+    CommandLine() : m_gui(true), m_global(false), m_threads(1), m_maxMemoryMb(0) {}
 
     static CommandLine m_globalInstance;
     bool m_error;
@@ -437,6 +464,8 @@ private:
     QSizeF m_pageDetectionBox;
     double m_pageDetectionTolerance;
     bool m_defaultNull;
+    int m_threads;
+    int m_maxMemoryMb;
 
     bool isGlobal()
     {
@@ -537,6 +566,8 @@ private:
     QSizeF fetchPageDetectionBox() const;
     double fetchPageDetectionTolerance() const;
     bool fetchDefaultNull();
+    int fetchThreads() const;
+    int fetchMaxMemoryMb() const;
 };
 
 #endif
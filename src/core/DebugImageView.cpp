@@ -75,10 +75,26 @@ DebugImageView::DebugImageView(AutoRemovingFile file,
     addWidget(m_pPlaceholderWidget);
 }
 
+DebugImageView::DebugImageView(QImage const& image,
+                               boost::function<QWidget* (QImage const&)> const& image_view_factory, QWidget* parent)
+    :   QStackedWidget(parent),
+        m_image(image),
+        m_imageViewFactory(image_view_factory),
+        m_pPlaceholderWidget(new ProcessingIndicationWidget(this)),
+        m_isLive(false)
+{
+    addWidget(m_pPlaceholderWidget);
+}
+
 void
 DebugImageView::setLive(bool const live)
 {
     if (live && !m_isLive) {
+        if (!m_image.isNull()) {
+            m_isLive = true;
+            imageLoaded(m_image);
+            return;
+        }
         ImageViewBase::backgroundExecutor().enqueueTask(
             BackgroundExecutor::TaskPtr(new ImageLoader(this, m_file.get()))
         );
@@ -109,7 +125,7 @@ DebugImageView::imageLoaded(QImage const& image)
             image_view.reset(m_imageViewFactory(image));
         }
 
-        if (!m_file.get().isEmpty()) {
+        if (!m_file.get().isEmpty() || !m_image.isNull()) {
             QAction* save_as = new QAction(tr("Save image as..."), this);
             connect(save_as, &QAction::triggered, this, [this]() {
                 QString new_filename = QFileDialog::getSaveFileName(this, tr("Save debug image"),
@@ -137,6 +153,14 @@ DebugImageView::imageLoaded(QImage const& image)
                         }
                     }
 
+                    if (!m_image.isNull()) {
+                        // The image was never encoded, so we do it now.
+                        if (!m_image.save(new_filename, "png")) {
+                            QMessageBox::critical(nullptr, tr("File saving error"), tr("Can't write file %1").arg(new_filename));
+                        }
+                        return;
+                    }
+
                     if (!QFile::copy(m_file.get(), new_filename)) {
                         QMessageBox::critical(nullptr, tr("File saving error"), tr("Can't copy file %1 to %2").arg(m_file.get(), new_filename));
                         return;
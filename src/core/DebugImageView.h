@@ -21,12 +21,11 @@
 
 #include "AutoRemovingFile.h"
 #include <QStackedWidget>
+#include <QImage>
 #include <QWidget>
 #include <boost/intrusive/list.hpp>
 #include <boost/function.hpp>
 
-class QImage;
-
 class DebugImageView :
     public QStackedWidget,
     public boost::intrusive::list_base_hook <
@@ -39,6 +38,13 @@ public:
                    boost::function<QWidget* (QImage const&)> const& image_view_factory =
                        boost::function<QWidget* (QImage const&)>(), QWidget* parent = 0);
 
+    /**
+     * Displays an image that is already in memory.
+     */
+    DebugImageView(QImage const& image,
+                   boost::function<QWidget* (QImage const&)> const& image_view_factory =
+                       boost::function<QWidget* (QImage const&)>(), QWidget* parent = 0);
+
     /**
      * Tells this widget to either display the actual image or just
      * a placeholder.
@@ -51,6 +57,7 @@ private:
     void imageLoaded(QImage const& image);
 
     AutoRemovingFile m_file;
+    QImage m_image;
     boost::function<QWidget* (QImage const&)> m_imageViewFactory;
     QWidget* m_pPlaceholderWidget;
     bool m_isLive;
@@ -17,32 +17,151 @@
 */
 
 #include "DebugImages.h"
-#include "imageproc/BinaryImage.h"
-#include <QImage>
+#include "settings/ini_keys.h"
 #include <QImageWriter>
 #include <QTemporaryFile>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QRegExp>
 #include <QDir>
 
-void
-DebugImages::add(
-    QImage const& image, QString const& label,
-    boost::function<QWidget* (QImage const&)> const& image_view_factory)
+namespace
 {
-    QTemporaryFile file(QDir::tempPath() + "/scantailor-dbg-XXXXXX.png");
-    if (!file.open()) {
-        return;
+
+/**
+ * Encoding is slow enough to be worth doing in parallel with processing,
+ * but it shouldn't compete with the processing threads too much.
+ */
+class SpillThreadPool : public QThreadPool
+{
+public:
+    SpillThreadPool()
+    {
+        setMaxThreadCount(2);
     }
+};
 
-    AutoRemovingFile arem_file(file.fileName());
-    file.setAutoRemove(false);
+QThreadPool& spillThreadPool()
+{
+    static SpillThreadPool pool;
+    return pool;
+}
 
-    QImageWriter writer(&file, "png");
-    writer.setCompression(2); // Trade space for speed.
-    if (!writer.write(image)) {
-        return;
+} // anonymous namespace
+
+/**
+ * An image, either in memory or encoded to a file.
+ */
+class DebugImages::Item : public RefCountable
+{
+    DECLARE_NON_COPYABLE(Item)
+public:
+    Item(QImage const& image, imageproc::BinaryImage const& binary_image,
+         QString const& l, boost::function<QWidget* (QImage const&)> const& imf)
+        :   label(l), imageViewFactory(imf),
+            m_image(image), m_binaryImage(binary_image), m_retrieved(false) {}
+
+    qint64 bytesInMemory() const
+    {
+        if (!m_binaryImage.isNull()) {
+            return qint64(m_binaryImage.wordsPerLine()) * 4 * m_binaryImage.height();
+        }
+        return qint64(m_image.bytesPerLine()) * m_image.height();
+    }
+
+    /**
+     * Encodes the image to a file and drops it from memory,
+     * unless it gets retrieved in the meantime.
+     * Called from a background thread.
+     */
+    void spill();
+
+    /**
+     * Called from the thread owning DebugImages.
+     */
+    void retrieve(QImage* image, AutoRemovingFile* file);
+
+    QString const label;
+    boost::function<QWidget* (QImage const&)> const imageViewFactory;
+private:
+    QImage toQImageLocked() const
+    {
+        return m_binaryImage.isNull() ? m_image : m_binaryImage.toQImage();
     }
 
-    m_sequence.push_back(IntrusivePtr<Item>(new Item(arem_file, label, image_view_factory)));
+    QMutex m_mutex;
+    QImage m_image;
+    imageproc::BinaryImage m_binaryImage;
+    AutoRemovingFile m_file;
+    bool m_retrieved;
+};
+
+class DebugImages::SpillTask : public QRunnable
+{
+public:
+    explicit SpillTask(IntrusivePtr<Item> const& item) : m_ptrItem(item) {}
+
+    virtual void run()
+    {
+        m_ptrItem->spill();
+    }
+private:
+    IntrusivePtr<Item> m_ptrItem;
+};
+
+qint64 const DebugImages::DEFAULT_MEMORY_BUDGET = qint64(256) << 20;
+
+DebugImages::DebugImages()
+    :   m_labelFilter(labelFilterFromSettings()),
+        m_memoryBudget(DEFAULT_MEMORY_BUDGET),
+        m_bytesInMemory(0),
+        m_numSpilled(0)
+{
+}
+
+DebugImages::DebugImages(QStringList const& label_filter, qint64 const memory_budget)
+    :   m_labelFilter(label_filter),
+        m_memoryBudget(memory_budget),
+        m_bytesInMemory(0),
+        m_numSpilled(0)
+{
+}
+
+DebugImages::~DebugImages()
+{
+    // Items being spilled are kept alive by their tasks.
+}
+
+bool
+DebugImages::isWanted(QString const& label) const
+{
+    if (m_labelFilter.isEmpty()) {
+        return true;
+    }
+
+    for (QString const& pattern : m_labelFilter) {
+        if (QRegExp(pattern, Qt::CaseSensitive, QRegExp::Wildcard).exactMatch(label)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+DebugImages::add(
+    QImage const& image, QString const& label,
+    boost::function<QWidget* (QImage const&)> const& image_view_factory)
+{
+    if (isWanted(label)) {
+        addItem(
+            IntrusivePtr<Item>(
+                new Item(image, imageproc::BinaryImage(), label, image_view_factory)
+            )
+        );
+    }
 }
 
 void
@@ -50,25 +169,117 @@ DebugImages::add(
     imageproc::BinaryImage const& image, QString const& label,
     boost::function<QWidget* (QImage const&)> const& image_view_factory)
 {
-    add(image.toQImage(), label, image_view_factory);
+    if (isWanted(label)) {
+        // Converting to QImage is left for when it's needed.
+        addItem(IntrusivePtr<Item>(new Item(QImage(), image, label, image_view_factory)));
+    }
+}
+
+void
+DebugImages::addItem(IntrusivePtr<Item> const& item)
+{
+    m_sequence.push_back(item);
+    m_bytesInMemory += item->bytesInMemory();
+
+    while (m_bytesInMemory > m_memoryBudget && m_numSpilled < m_sequence.size()) {
+        IntrusivePtr<Item> const& oldest = m_sequence[m_numSpilled];
+        m_bytesInMemory -= oldest->bytesInMemory();
+        ++m_numSpilled;
+        spillThreadPool().start(new SpillTask(oldest));
+    }
 }
 
-AutoRemovingFile
-DebugImages::retrieveNext(QString* label, boost::function<QWidget* (QImage const&)>* image_view_factory)
+bool
+DebugImages::retrieveNext(
+    QImage* image, AutoRemovingFile* file, QString* label,
+    boost::function<QWidget* (QImage const&)>* image_view_factory)
 {
     if (m_sequence.empty()) {
-        return AutoRemovingFile();
+        return false;
     }
 
-    AutoRemovingFile file(m_sequence.front()->file);
+    IntrusivePtr<Item> const item(m_sequence.front());
+    m_sequence.pop_front();
+    if (m_numSpilled > 0) {
+        --m_numSpilled;
+    } else {
+        m_bytesInMemory -= item->bytesInMemory();
+    }
+
+    item->retrieve(image, file);
     if (label) {
-        *label = m_sequence.front()->label;
+        *label = item->label;
     }
     if (image_view_factory) {
-        *image_view_factory = m_sequence.front()->imageViewFactory;
+        *image_view_factory = item->imageViewFactory;
     }
 
-    m_sequence.pop_front();
+    return true;
+}
+
+QStringList
+DebugImages::labelFilterFromSettings()
+{
+    return QSettings().value(_key_debug_images_filter, QStringList()).toStringList();
+}
+
+/*=========================== DebugImages::Item =============================*/
+
+void
+DebugImages::Item::spill()
+{
+    QImage image;
+    {
+        QMutexLocker const locker(&m_mutex);
+        if (m_retrieved) {
+            return;
+        }
+        image = toQImageLocked();
+    }
+
+    QTemporaryFile file(QDir::tempPath() + "/scantailor-dbg-XXXXXX.png");
+    if (!file.open()) {
+        return;
+    }
+
+    AutoRemovingFile arem_file(file.fileName());
+    file.setAutoRemove(false);
 
-    return file;
+    QImageWriter writer(&file, "png");
+    writer.setCompression(2); // Trade space for speed.
+    if (!writer.write(image)) {
+        // The image stays in memory.
+        return;
+    }
+    file.close();
+
+    QMutexLocker const locker(&m_mutex);
+    if (!m_retrieved) {
+        m_file = arem_file;
+        m_image = QImage();
+        m_binaryImage = imageproc::BinaryImage();
+    }
+}
+
+void
+DebugImages::Item::retrieve(QImage* image, AutoRemovingFile* file)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_retrieved = true;
+
+    if (!m_file.get().isNull()) {
+        if (file) {
+            *file = m_file;
+        }
+        if (image) {
+            *image = QImage();
+        }
+    } else {
+        if (image) {
+            *image = toQImageLocked();
+        }
+        if (file) {
+            file->reset(QString());
+        }
+    }
 }
@@ -19,27 +19,60 @@
 #ifndef DEBUG_IMAGES_H_
 #define DEBUG_IMAGES_H_
 
+#include "NonCopyable.h"
 #include "RefCountable.h"
 #include "IntrusivePtr.h"
 #include "AutoRemovingFile.h"
+#include "imageproc/BinaryImage.h"
 #include <boost/function.hpp>
+#include <QImage>
 #include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <QtGlobal>
 #include <deque>
 
-class QImage;
 class QWidget;
 
-namespace imageproc
-{
-class BinaryImage;
-}
-
 /**
  * \brief A sequence of image + label pairs.
+ *
+ * Images are kept in memory, sharing their data with the caller's copy,
+ * as long as their total size stays within a budget.  Once it's exceeded,
+ * the oldest ones are encoded to temporary PNG files on a background thread,
+ * so that adding an image never waits for encoding.
+ *
+ * Only the images whose labels pass the label filter are kept.  By default
+ * the filter comes from the settings and is a list of wildcard patterns,
+ * an empty list letting everything through.  Callers producing an image
+ * just for debugging may check isWanted() first.
  */
 class DebugImages
 {
+    DECLARE_NON_COPYABLE(DebugImages)
 public:
+    /**
+     * \brief Uses the label filter from the settings.
+     */
+    DebugImages();
+
+    /**
+     * \param label_filter Wildcard patterns of labels to keep.
+     *        An empty list keeps everything.
+     * \param memory_budget The total size in bytes of images kept in memory.
+     */
+    explicit DebugImages(QStringList const& label_filter,
+                         qint64 memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    ~DebugImages();
+
+    static qint64 const DEFAULT_MEMORY_BUDGET;
+
+    /**
+     * \brief Tells whether an image with this label would be kept.
+     */
+    bool isWanted(QString const& label) const;
+
     void add(QImage const& image, QString const& label,
              boost::function<QWidget* (QImage const&)> const& image_view_factory =
                  boost::function<QWidget* (QImage const&)>());
@@ -54,26 +87,40 @@ public:
     }
 
     /**
-     * \brief Removes and returns the first item in the sequence.
+     * \brief Removes the first item in the sequence and returns its image.
      *
+     * An image that is still in memory is returned through \p image,
+     * while \p file is left null.  Otherwise, the file it was encoded to
+     * is returned through \p file, while \p image is left null.
      * The label and viewer widget factory (that may not be bound)
      * are returned by taking pointers to them as arguments.
-     * Returns a null AutoRemovingFile if image sequence is empty.
+     *
+     * \return false if the sequence is empty.
      */
-    AutoRemovingFile retrieveNext(QString* label = 0,
-                                  boost::function<QWidget* (QImage const&)>* image_view_factory = 0);
+    bool retrieveNext(QImage* image, AutoRemovingFile* file, QString* label = 0,
+                      boost::function<QWidget* (QImage const&)>* image_view_factory = 0);
 private:
-    struct Item : public RefCountable {
-        AutoRemovingFile file;
-        QString label;
-        boost::function<QWidget* (QImage const&)> imageViewFactory;
+    class Item;
+    class SpillTask;
 
-        Item(AutoRemovingFile f, QString const& l,
-             boost::function<QWidget* (QImage const&)> const& imf)
-            :   file(f), label(l), imageViewFactory(imf) {}
-    };
+    void addItem(IntrusivePtr<Item> const& item);
+
+    static QStringList labelFilterFromSettings();
 
     std::deque<IntrusivePtr<Item> > m_sequence;
+    QStringList m_labelFilter;
+    qint64 m_memoryBudget;
+
+    /**
+     * The total size of images in m_sequence that were not sent
+     * to be spilled to disk.
+     */
+    qint64 m_bytesInMemory;
+
+    /**
+     * Items before this index were sent to be spilled to disk.
+     */
+    size_t m_numSpilled;
 };
 
 #endif
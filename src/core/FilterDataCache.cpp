@@ -0,0 +1,157 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FilterDataCache.h"
+#include "settings/ini_keys.h"
+#include <QMutexLocker>
+
+FilterDataCache::Entry::Entry(
+    ImageId const& image_id, QDateTime const& file_mtime,
+    FilterData const& dt, size_t const size)
+    :   imageId(image_id),
+        fileMtime(file_mtime),
+        data(dt),
+        bytes(size)
+{
+}
+
+FilterDataCache::FilterDataCache()
+    :   m_totalBytes(0),
+        m_maxBytes(
+            size_t(QSettings().value(
+                _key_image_cache_size_mb, _key_image_cache_size_mb_def
+            ).toUInt()) << 20
+        )
+{
+}
+
+FilterDataCache&
+FilterDataCache::instance()
+{
+    // Same reasoning as in OutOfMemoryHandler::instance().
+    static FilterDataCache object;
+
+    return object;
+}
+
+std::unique_ptr<FilterData>
+FilterDataCache::get(ImageId const& image_id, QDateTime const& file_mtime)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    std::map<ImageId, LruList::iterator>::iterator const it(
+        m_entriesById.find(image_id)
+    );
+    if (it == m_entriesById.end()) {
+        return std::unique_ptr<FilterData>();
+    }
+
+    LruList::iterator const entry(it->second);
+    if (entry->fileMtime != file_mtime) {
+        // The file was replaced.
+        m_totalBytes -= entry->bytes;
+        m_lru.erase(entry);
+        m_entriesById.erase(it);
+        return std::unique_ptr<FilterData>();
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, entry);
+
+    return std::unique_ptr<FilterData>(new FilterData(entry->data));
+}
+
+void
+FilterDataCache::put(
+    ImageId const& image_id, QDateTime const& file_mtime, FilterData const& data)
+{
+    size_t const bytes = estimateBytes(data);
+
+    QMutexLocker const locker(&m_mutex);
+
+    if (bytes > m_maxBytes) {
+        // Don't evict everything else for an entry that won't fit anyway.
+        return;
+    }
+
+    std::map<ImageId, LruList::iterator>::iterator const it(
+        m_entriesById.find(image_id)
+    );
+    if (it != m_entriesById.end()) {
+        m_totalBytes -= it->second->bytes;
+        m_lru.erase(it->second);
+        m_entriesById.erase(it);
+    }
+
+    m_lru.push_front(Entry(image_id, file_mtime, data, bytes));
+    m_entriesById[image_id] = m_lru.begin();
+    m_totalBytes += bytes;
+
+    removeExcessLocked();
+}
+
+void
+FilterDataCache::clear()
+{
+    QMutexLocker const locker(&m_mutex);
+
+    m_lru.clear();
+    m_entriesById.clear();
+    m_totalBytes = 0;
+}
+
+void
+FilterDataCache::setMaxBytes(size_t const max_bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    m_maxBytes = max_bytes;
+    removeExcessLocked();
+}
+
+size_t
+FilterDataCache::maxBytes() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_maxBytes;
+}
+
+size_t
+FilterDataCache::estimateBytes(FilterData const& data)
+{
+    QImage const& orig = data.origImage();
+    QImage const& gray = data.grayImage();
+
+    size_t bytes = size_t(orig.bytesPerLine()) * orig.height();
+    if (gray.constBits() != orig.constBits()) {
+        // They share the data if the original is already grayscale.
+        bytes += size_t(gray.bytesPerLine()) * gray.height();
+    }
+
+    return bytes;
+}
+
+void
+FilterDataCache::removeExcessLocked()
+{
+    while (m_totalBytes > m_maxBytes && !m_lru.empty()) {
+        Entry const& entry = m_lru.back();
+        m_totalBytes -= entry.bytes;
+        m_entriesById.erase(entry.imageId);
+        m_lru.pop_back();
+    }
+}
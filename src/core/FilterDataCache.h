@@ -0,0 +1,96 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILTERDATACACHE_H_
+#define FILTERDATACACHE_H_
+
+#include "NonCopyable.h"
+#include "FilterData.h"
+#include "ImageId.h"
+#include <QDateTime>
+#include <QMutex>
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+
+/**
+ * \brief A memory-bounded LRU cache of decoded source images.
+ *
+ * LoadFileTask puts the FilterData it builds here, so that processing
+ * the same page again (by the next filter or after a parameter change)
+ * doesn't decode the file and convert it to grayscale once more.
+ * Entries are keyed by ImageId and the file's modification time,
+ * so replacing a file on disk invalidates its entry.
+ *
+ * \note All methods may be called from any thread, even concurrently.
+ */
+class FilterDataCache
+{
+    DECLARE_NON_COPYABLE(FilterDataCache)
+public:
+    static FilterDataCache& instance();
+
+    /**
+     * \brief Returns the cached data, or a null pointer if there is none.
+     */
+    std::unique_ptr<FilterData> get(
+        ImageId const& image_id, QDateTime const& file_mtime);
+
+    void put(ImageId const& image_id, QDateTime const& file_mtime,
+             FilterData const& data);
+
+    void clear();
+
+    /**
+     * \brief Sets the memory budget, evicting entries if necessary.
+     *
+     * Zero disables caching.
+     */
+    void setMaxBytes(size_t max_bytes);
+
+    size_t maxBytes() const;
+private:
+    struct Entry {
+        ImageId imageId;
+        QDateTime fileMtime;
+        FilterData data;
+        size_t bytes;
+
+        Entry(ImageId const& image_id, QDateTime const& file_mtime,
+              FilterData const& data, size_t bytes);
+    };
+
+    typedef std::list<Entry> LruList;
+
+    FilterDataCache();
+
+    static size_t estimateBytes(FilterData const& data);
+
+    void removeExcessLocked();
+
+    mutable QMutex m_mutex;
+
+    /** Most recently used entries go first. */
+    LruList m_lru;
+    std::map<ImageId, LruList::iterator> m_entriesById;
+    size_t m_totalBytes;
+    size_t m_maxBytes;
+};
+
+#endif
@@ -23,20 +23,41 @@
 #include "Jp2Reader.h"
 #endif
 #include "ImageId.h"
+#include "StageProfiler.h"
 #include <QImageReader>
+#include <QImageIOHandler>
 #include <QImage>
 #include <QString>
 #include <QIODevice>
 #include <QFile>
+#include <QSize>
 
 QImage
 ImageLoader::load(ImageId const& image_id)
 {
-    return load(image_id.filePath(), image_id.zeroBasedPage());
+    return loadFile(image_id.filePath(), image_id.zeroBasedPage(), QSize());
 }
 
 QImage
 ImageLoader::load(QString const& file_path, int const page_num)
+{
+    return loadFile(file_path, page_num, QSize());
+}
+
+QImage
+ImageLoader::load(QIODevice& io_dev, int const page_num)
+{
+    return loadScaledDown(io_dev, page_num, QSize());
+}
+
+QImage
+ImageLoader::loadScaledDown(ImageId const& image_id, QSize const& box)
+{
+    return loadFile(image_id.filePath(), image_id.zeroBasedPage(), box);
+}
+
+QImage
+ImageLoader::loadFile(QString const& file_path, int const page_num, QSize const& box)
 {
     QFile file(file_path);
     if (!file.open(QIODevice::ReadOnly)) {
@@ -45,17 +66,19 @@ ImageLoader::load(QString const& file_path, int const page_num)
 
     if (file_path.startsWith(":")) {
         // internally empty pages are represented as multipage image although they're just links to the same single page image in app resources
-        return load(file, 0);
+        return loadScaledDown(file, 0, box);
     }
 
-    return load(file, page_num);
+    return loadScaledDown(file, page_num, box);
 }
 
 QImage
-ImageLoader::load(QIODevice& io_dev, int const page_num)
+ImageLoader::loadScaledDown(QIODevice& io_dev, int const page_num, QSize const& box)
 {
+    ScopedStageTimer const timer("image_loader");
+
     if (TiffReader::canRead(io_dev)) {
-        return TiffReader::readImage(io_dev, page_num);
+        return TiffReader::readImage(io_dev, page_num, box);
     }
 
     if (page_num != 0) {
@@ -65,11 +88,33 @@ ImageLoader::load(QIODevice& io_dev, int const page_num)
 
 #ifdef ENABLE_OPENJPEG
     if (Jp2Reader::canRead(io_dev)) {
-        return Jp2Reader::readImage(io_dev);
+        return Jp2Reader::readImage(io_dev, box);
     }
 #endif
 
+    QImageReader reader(&io_dev);
+    QSize full_size;
+
+    // Only let the plugins that can decode at a reduced size (libjpeg's
+    // DCT scaling for JPEG) do the scaling.  Otherwise QImageReader would
+    // scale the full image itself, which is no faster than our scaling.
+    if (!box.isEmpty() && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        full_size = reader.size();
+        if (full_size.width() > box.width() || full_size.height() > box.height()) {
+            reader.setScaledSize(full_size.scaled(box, Qt::KeepAspectRatio));
+        } else {
+            full_size = QSize();
+        }
+    }
+
     QImage image;
-    QImageReader(&io_dev).read(&image);
+    reader.read(&image);
+
+    if (full_size.isValid() && !image.isNull()) {
+        // Keep the physical dimensions of the scaled down image.
+        image.setDotsPerMeterX(qRound(double(image.dotsPerMeterX()) * image.width() / full_size.width()));
+        image.setDotsPerMeterY(qRound(double(image.dotsPerMeterY()) * image.height() / full_size.height()));
+    }
+
     return image;
 }
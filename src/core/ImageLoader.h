@@ -23,6 +23,7 @@ class ImageId;
 class QImage;
 class QString;
 class QIODevice;
+class QSize;
 
 class ImageLoader
 {
@@ -32,6 +33,22 @@ public:
     static QImage load(ImageId const& image_id);
 
     static QImage load(QIODevice& io_dev, int page_num);
+
+    /**
+     * \brief Loads an image that's going to be scaled down to fit \p box.
+     *
+     * Where the format allows it (JPEG, JPEG 2000 and TIFF files having
+     * reduced resolution sub-images), a reduced resolution version is
+     * decoded instead of the full image, which is a lot faster.  It's
+     * never smaller than the full image scaled to fit \p box, so the
+     * caller still has to scale it down.  An empty \p box makes it
+     * equivalent to load().
+     */
+    static QImage loadScaledDown(ImageId const& image_id, QSize const& box);
+
+    static QImage loadScaledDown(QIODevice& io_dev, int page_num, QSize const& box);
+private:
+    static QImage loadFile(QString const& file_path, int page_num, QSize const& box);
 };
 
 #endif
@@ -0,0 +1,123 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImagePyramid.h"
+#include "imageproc/Transform.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTransform>
+#include <QRect>
+#include <QtGlobal>
+#include <list>
+#include <algorithm>
+#include <utility>
+#include <assert.h>
+#include <math.h>
+
+using namespace imageproc;
+
+namespace
+{
+
+/**
+ * The number of pyramids kept in the cache.  An image view needs
+ * one for the image it displays and another one for the alternative
+ * image, if any.  One more lets a background task prepare the next
+ * page without evicting those.
+ */
+int const MAX_CACHED_PYRAMIDS = 3;
+
+typedef std::list<std::pair<qint64, IntrusivePtr<ImagePyramid const> > > PyramidCache;
+
+QMutex cacheMutex;
+PyramidCache pyramidCache;
+
+} // anonymous namespace
+
+IntrusivePtr<ImagePyramid const>
+ImagePyramid::forImage(QImage const& image)
+{
+    qint64 const key = image.cacheKey();
+
+    {
+        QMutexLocker const locker(&cacheMutex);
+
+        for (PyramidCache::iterator it(pyramidCache.begin()); it != pyramidCache.end(); ++it) {
+            if (it->first == key) {
+                // Move it to the front, which is where the most recently used one goes.
+                pyramidCache.splice(pyramidCache.begin(), pyramidCache, it);
+                return pyramidCache.front().second;
+            }
+        }
+    }
+
+    // Building a pyramid takes a while, so we don't hold the mutex while
+    // doing that.  Two threads may end up building the same pyramid,
+    // which is harmless.
+    IntrusivePtr<ImagePyramid const> const pyramid(new ImagePyramid(image));
+
+    QMutexLocker const locker(&cacheMutex);
+
+    for (PyramidCache::value_type const& entry : pyramidCache) {
+        if (entry.first == key) {
+            return entry.second;
+        }
+    }
+
+    pyramidCache.push_front(std::make_pair(key, pyramid));
+    if (int(pyramidCache.size()) > MAX_CACHED_PYRAMIDS) {
+        pyramidCache.pop_back();
+    }
+
+    return pyramid;
+}
+
+ImagePyramid::ImagePyramid(QImage const& image)
+{
+    QImage prev(image);
+    while (std::max(prev.width(), prev.height()) >= 2 * MIN_LEVEL_DIMENSION) {
+        QRect const level_rect(0, 0, (prev.width() + 1) / 2, (prev.height() + 1) / 2);
+
+        // Area averaging with weak nearest outside pixels keeps the last
+        // row and column of odd sized levels from fading to some color.
+        m_reducedLevels.push_back(
+            transform(
+                prev, QTransform::fromScale(0.5, 0.5), level_rect,
+                OutsidePixels::assumeWeakNearest()
+            )
+        );
+        prev = m_reducedLevels.back();
+    }
+}
+
+QImage const&
+ImagePyramid::reducedLevel(int const level) const
+{
+    assert(level >= 1 && level < numLevels());
+    return m_reducedLevels[level - 1];
+}
+
+int
+ImagePyramid::levelForScale(double const scale)
+{
+    if (!(scale > 0.0) || scale > 0.5) {
+        return 0;
+    }
+
+    return int(floor(log2(1.0 / scale)));
+}
@@ -0,0 +1,85 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPYRAMID_H_
+#define IMAGEPYRAMID_H_
+
+#include "NonCopyable.h"
+#include "RefCountable.h"
+#include "IntrusivePtr.h"
+#include <QImage>
+#include <vector>
+
+/**
+ * \brief Progressively halved versions of an image.
+ *
+ * Level 0 is the image itself, and each next level has its dimensions
+ * halved (rounded up) compared to the previous one.  A pixel at level n
+ * covers exactly 2^n by 2^n pixels of the original image, so mapping
+ * level n to the original image is a pure scaling by 2^n.
+ *
+ * The pyramid doesn't keep level 0, so that a cached pyramid doesn't
+ * keep a full size image alive.  The reduced levels take about a third
+ * of the memory of the original image.
+ */
+class ImagePyramid : public RefCountable
+{
+    DECLARE_NON_COPYABLE(ImagePyramid)
+public:
+    /**
+     * \brief Returns the pyramid of \p image, building it if it's not
+     *        in the cache yet.
+     *
+     * The cache is keyed by QImage::cacheKey() and only keeps a few
+     * of the most recently used pyramids.  May be called from any thread.
+     */
+    static IntrusivePtr<ImagePyramid const> forImage(QImage const& image);
+
+    explicit ImagePyramid(QImage const& image);
+
+    /**
+     * \brief The number of levels, including level 0.
+     */
+    int numLevels() const
+    {
+        return m_reducedLevels.size() + 1;
+    }
+
+    /**
+     * \brief Returns level \p level, which must be in [1, numLevels()).
+     */
+    QImage const& reducedLevel(int level) const;
+
+    /**
+     * \brief Returns the coarsest level that doesn't have to be upscaled
+     *        to display the original image at \p scale.
+     *
+     * The result may be greater than or equal to numLevels().
+     */
+    static int levelForScale(double scale);
+private:
+    /**
+     * Levels are only built while their largest dimension
+     * is at least this many pixels.
+     */
+    static int const MIN_LEVEL_DIMENSION = 256;
+
+    std::vector<QImage> m_reducedLevels;
+};
+
+#endif
@@ -23,6 +23,8 @@
 #include "OpenGLSupport.h"
 #include "PixmapRenderer.h"
 #include "BackgroundExecutor.h"
+#include "ImagePyramid.h"
+#include "PayloadEvent.h"
 #include "Dpm.h"
 #include "Dpi.h"
 #include "ScopedIncDec.h"
@@ -32,8 +34,11 @@
 #include "config.h"
 #include "settings/globalstaticsettings.h"
 #include <QScrollBar>
-#include <QPointer>
 #include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QPaintEngine>
 #include <QPainter>
 #include <QPainterPath>
@@ -51,8 +56,12 @@
 #include <Qt>
 #include <QDebug>
 #include <algorithm>
+#include <tuple>
 #include <assert.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef ENABLE_OPENGL
 #include <QGLWidget>
@@ -61,58 +70,113 @@
 
 using namespace imageproc;
 
-class ImageViewBase::HqTransformTask :
-    public AbstractCommand0<IntrusivePtr<AbstractCommand0<void> > >,
-    public QObject
+namespace
 {
-    DECLARE_NON_COPYABLE(HqTransformTask)
+
+/**
+ * The width and height of high quality tiles, in widget pixels.
+ */
+int const HQ_TILE_SIZE = 256;
+
+/**
+ * The number of tiles kept per image view.  A tile takes 256K.
+ */
+size_t const MAX_HQ_TILES = 160;
+
+/**
+ * The translation of the tile space is rounded to 1/HQ_SUBPIXEL_STEPS of
+ * a pixel.  Otherwise, floating point errors accumulated while panning
+ * would make the tile space change every time.
+ */
+double const HQ_SUBPIXEL_STEPS = 64.0;
+
+int floorDiv(int const a, int const b)
+{
+    int const q = a / b;
+    return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+QThreadPool& hqTileThreadPool()
+{
+    static QThreadPool pool;
+    return pool;
+}
+
+} // anonymous namespace
+
+/**
+ * \brief Delivers rendered tiles to the image view, unless it's gone already.
+ */
+class ImageViewBase::HqTileSink : public RefCountable
+{
+    DECLARE_NON_COPYABLE(HqTileSink)
 public:
-    HqTransformTask(
-        ImageViewBase* image_view,
-        QImage const& image, QTransform const& xform,
-        QSize const& target_size);
+    struct Result
+    {
+        HqTileKey key;
+        HqTileTask const* task;
+        QPoint origin;
+        QImage image;
+    };
+
+    typedef PayloadEvent<Result> Event;
+
+    explicit HqTileSink(ImageViewBase* image_view) : m_pImageView(image_view) {}
+
+    /**
+     * \brief Called by the image view being destroyed.
+     */
+    void detach();
+
+    void post(Result const& result);
+private:
+    QMutex m_mutex;
+    ImageViewBase* m_pImageView;
+};
+
+class ImageViewBase::HqTileTask : public RefCountable
+{
+    DECLARE_NON_COPYABLE(HqTileTask)
+public:
+    class Runner;
+
+    HqTileTask(
+        IntrusivePtr<HqTileSink> const& sink, QImage const& image,
+        HqTileKey const& key, QRect const& tile_rect);
 
     void cancel()
     {
-        m_ptrResult->cancel();
+        m_cancelFlag.fetchAndStoreRelaxed(1);
     }
 
     bool isCancelled() const
     {
-        return m_ptrResult->isCancelled();
+        return m_cancelFlag.fetchAndAddRelaxed(0) != 0;
     }
 
-    virtual IntrusivePtr<AbstractCommand0<void> > operator()();
+    void render();
 private:
-    class Result : public AbstractCommand0<void>
-    {
-    public:
-        Result(ImageViewBase* image_view);
-
-        void setData(QPoint const& origin, QImage const& hq_image);
-
-        void cancel()
-        {
-            m_cancelFlag.fetchAndStoreRelaxed(1);
-        }
-
-        bool isCancelled() const
-        {
-            return m_cancelFlag.fetchAndAddRelaxed(0) != 0;
-        }
+    IntrusivePtr<HqTileSink> m_ptrSink;
+    QImage m_image;
+    HqTileKey m_key;
+    QRect m_tileRect;
+    mutable QAtomicInt m_cancelFlag;
+};
 
-        virtual void operator()();
-    private:
-        QPointer<ImageViewBase> m_ptrImageView;
-        QPoint m_origin;
-        QImage m_hqImage;
-        mutable QAtomicInt m_cancelFlag;
-    };
+/**
+ * \brief Runs an HqTileTask in hqTileThreadPool().
+ *
+ * The task itself is reference counted, as the image view keeps it
+ * to be able to cancel it.
+ */
+class ImageViewBase::HqTileTask::Runner : public QRunnable
+{
+public:
+    explicit Runner(IntrusivePtr<HqTileTask> const& task) : m_ptrTask(task) {}
 
-    IntrusivePtr<Result> m_ptrResult;
-    QImage m_image;
-    QTransform m_xform;
-    QSize m_targetSize;
+    virtual void run();
+private:
+    IntrusivePtr<HqTileTask> m_ptrTask;
 };
 
 /**
@@ -160,6 +224,9 @@ ImageViewBase::ImageViewBase(
     QImage const& image, ImagePixmapUnion const& downscaled_version,
     ImagePresentation const& presentation, Margins const& margins)
     :   m_image(image),
+        m_ptrHqTileSink(new HqTileSink(this)),
+        m_hqTileUseCounter(0),
+        m_hqSpaceRequested(false),
         m_virtualImageCropArea(presentation.cropArea()),
         m_virtualDisplayArea(presentation.displayArea()),
         m_imageToVirtual(presentation.transform()),
@@ -252,6 +319,8 @@ ImageViewBase::ImageViewBase(
 
 ImageViewBase::~ImageViewBase()
 {
+    m_ptrHqTileSink->detach();
+    cancelHqTiles(/*keep_requested_space=*/false);
 }
 
 void
@@ -260,16 +329,10 @@ ImageViewBase::hqTransformSetEnabled(bool const enabled)
     if (!enabled && m_hqTransformEnabled) {
         // Turning off.
         m_hqTransformEnabled = false;
-        if (m_ptrHqTransformTask.get()) {
-            m_ptrHqTransformTask->cancel();
-            m_ptrHqTransformTask.reset();
-        }
-        if (!m_hqPixmap.isNull()) {
-            m_hqPixmap = QPixmap();
-
-            if (!m_alternativeHqPixmap.isNull()) {
-                m_alternativeHqPixmap = QPixmap();
-            }
+        cancelHqTiles(/*keep_requested_space=*/false);
+        m_hqSpaceRequested = false;
+        if (!m_hqTiles.empty()) {
+            m_hqTiles.clear();
             update();
         }
     } else if (enabled && !m_hqTransformEnabled) {
@@ -301,10 +364,23 @@ ImageViewBase::createDownscaledImage(QImage const& image)
         return image;
     }
 
+    // Downscaling from a pyramid level is cheaper than from the full image,
+    // and it leaves the pyramid cached for the high quality transform.
+    QImage source(image);
+    int const level = ImagePyramid::levelForScale(
+                          std::max((double)d_w / o_w, (double)d_h / o_h)
+                      );
+    if (level > 0) {
+        IntrusivePtr<ImagePyramid const> const pyramid(ImagePyramid::forImage(image));
+        if (pyramid->numLevels() > 1) {
+            source = pyramid->reducedLevel(std::min(level, pyramid->numLevels() - 1));
+        }
+    }
+
     QTransform xform;
-    xform.scale((double)d_w / o_w, (double)d_h / o_h);
+    xform.scale((double)d_w / source.width(), (double)d_h / source.height());
     return transform(
-               image, xform, QRect(0, 0, d_w, d_h),
+               source, xform, QRect(0, 0, d_w, d_h),
                OutsidePixels::assumeColor(Qt::white)
            );
 }
@@ -498,19 +574,25 @@ ImageViewBase::paintEvent(QPaintEvent* event)
     // Disable antialiasing for large zoom levels.
     painter.setRenderHint(QPainter::SmoothPixmapTransform, pixel_width < 0.5);
 
-    if (validateHqPixmap()) {
-        // HQ pixmap maps one to one to screen pixels, so antialiasing is not necessary.
-        painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
-        painter.drawPixmap(m_hqPixmapPos, get_hq_pixmap());
-    } else {
-        scheduleHqVersionRebuild();
-
+    std::vector<HqTile const*> hq_tiles;
+    QPoint hq_offset;
+    if (!collectHqTiles(hq_tiles, hq_offset)) {
+        // Some tiles are missing, so they are covered by the low quality version.
         painter.setWorldTransform(
             m_pixmapToImage * m_imageToVirtual * m_virtualToWidget
         );
         PixmapRenderer::drawPixmap(painter, get_pixmap());
     }
 
+    if (!hq_tiles.empty()) {
+        // HQ tiles map one to one to screen pixels, so antialiasing is not necessary.
+        painter.setWorldTransform(QTransform());
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+        for (HqTile const* tile : hq_tiles) {
+            painter.drawPixmap(tile->origin + hq_offset, tile->pixmap);
+        }
+    }
+
     painter.setRenderHints(QPainter::Antialiasing, true);
     painter.setWorldMatrixEnabled(false);
 
@@ -567,6 +649,19 @@ ImageViewBase::paintEvent(QPaintEvent* event)
     maybeQueueRedraw();
 }
 
+void
+ImageViewBase::customEvent(QEvent* event)
+{
+    HqTileSink::Event* const evt = dynamic_cast<HqTileSink::Event*>(event);
+    if (!evt) {
+        QAbstractScrollArea::customEvent(event);
+        return;
+    }
+
+    HqTileSink::Result const& result = evt->payload();
+    hqTileBuilt(result.key, result.task, result.origin, result.image);
+}
+
 void
 ImageViewBase::keyPressEvent(QKeyEvent* event)
 {
@@ -1077,28 +1172,130 @@ ImageViewBase::setWidgetFocalPointWithoutMoving(QPointF const new_widget_fp)
 }
 
 /**
- * Returns true if m_hqPixmap is valid and up to date.
+ * Splits the image to widget transformation into the tile space
+ * transformation and the integer offset from tile space to widget space.
+ * Returns false if there is no tile space, because the transformation
+ * is not affine.
  */
 bool
-ImageViewBase::validateHqPixmap() const
+ImageViewBase::currentHqTileSpace(HqTileKey& space, QPoint& offset) const
 {
-    if (!m_hqTransformEnabled) {
+    QImage const& image = get_image();
+    QTransform const xform(m_imageToVirtual * m_virtualToWidget);
+    if (image.isNull() || !xform.isAffine()) {
         return false;
     }
 
-    if (get_hq_pixmap().isNull()) {
-        return false;
+    double const dx = qRound64(xform.dx() * HQ_SUBPIXEL_STEPS) / HQ_SUBPIXEL_STEPS;
+    double const dy = qRound64(xform.dy() * HQ_SUBPIXEL_STEPS) / HQ_SUBPIXEL_STEPS;
+    double const int_dx = floor(dx);
+    double const int_dy = floor(dy);
+
+    space.sourceId = image.cacheKey();
+    space.m11 = xform.m11();
+    space.m12 = xform.m12();
+    space.m21 = xform.m21();
+    space.m22 = xform.m22();
+    space.dx = dx - int_dx;
+    space.dy = dy - int_dy;
+    space.col = 0;
+    space.row = 0;
+
+    offset = QPoint((int)int_dx, (int)int_dy);
+    return true;
+}
+
+/**
+ * Returns the area covered by a tile of the current image, in tile space.
+ * Tiles at the image edges are smaller than HQ_TILE_SIZE.
+ */
+QRect
+ImageViewBase::hqTileRect(HqTileKey const& key) const
+{
+    QRect const image_rect(
+        key.transform().mapRect(QRectF(get_image().rect())).toAlignedRect()
+    );
+    QRect const grid_rect(
+        key.col * HQ_TILE_SIZE, key.row * HQ_TILE_SIZE, HQ_TILE_SIZE, HQ_TILE_SIZE
+    );
+    return grid_rect.intersected(image_rect);
+}
+
+std::vector<ImageViewBase::HqTileKey>
+ImageViewBase::visibleHqTiles(HqTileKey const& space, QPoint const& offset) const
+{
+    std::vector<HqTileKey> keys;
+
+    QRect const image_rect(
+        space.transform().mapRect(QRectF(get_image().rect())).toAlignedRect()
+    );
+    QRect const visible_rect(
+        image_rect.intersected(viewport()->rect().translated(-offset))
+    );
+    if (visible_rect.isEmpty()) {
+        return keys;
+    }
+
+    int const first_col = floorDiv(visible_rect.left(), HQ_TILE_SIZE);
+    int const last_col = floorDiv(visible_rect.right(), HQ_TILE_SIZE);
+    int const first_row = floorDiv(visible_rect.top(), HQ_TILE_SIZE);
+    int const last_row = floorDiv(visible_rect.bottom(), HQ_TILE_SIZE);
+
+    HqTileKey key(space);
+    for (key.row = first_row; key.row <= last_row; ++key.row) {
+        for (key.col = first_col; key.col <= last_col; ++key.col) {
+            keys.push_back(key);
+        }
     }
 
-    if (m_hqSourceId != get_image().cacheKey()) {
+    return keys;
+}
+
+/**
+ * Collects the cached tiles to be drawn, and requests the missing ones.
+ *
+ * \param tiles Receives the tiles to draw.
+ * \param offset Receives the offset from tile space to widget space.
+ * \return true if all the visible tiles are there.
+ */
+bool
+ImageViewBase::collectHqTiles(std::vector<HqTile const*>& tiles, QPoint& offset)
+{
+    if (!m_hqTransformEnabled) {
         return false;
     }
 
-    if (m_hqXform != m_imageToVirtual * m_virtualToWidget) {
+    HqTileKey space;
+    if (!currentHqTileSpace(space, offset)) {
         return false;
     }
 
-    return true;
+    ++m_hqTileUseCounter;
+
+    std::vector<HqTileKey> missing;
+    for (HqTileKey const& key : visibleHqTiles(space, offset)) {
+        HqTiles::iterator const it(m_hqTiles.find(key));
+        if (it == m_hqTiles.end()) {
+            missing.push_back(key);
+        } else {
+            it->second.lastUsed = m_hqTileUseCounter;
+            tiles.push_back(&it->second);
+        }
+    }
+
+    if (missing.empty()) {
+        return true;
+    }
+
+    if (m_hqSpaceRequested && space.sameSpace(m_hqRequestedSpace)) {
+        // Panning exposed new tiles.  There is no point in delaying them,
+        // as the ones we already have stay valid.
+        requestHqTiles(missing);
+    } else {
+        scheduleHqVersionRebuild();
+    }
+
+    return false;
 }
 
 void
@@ -1107,10 +1304,7 @@ ImageViewBase::scheduleHqVersionRebuild()
     QTransform const xform(m_imageToVirtual * m_virtualToWidget);
 
     if (!m_timer.isActive() || m_potentialHqXform != xform) {
-        if (m_ptrHqTransformTask.get()) {
-            m_ptrHqTransformTask->cancel();
-            m_ptrHqTransformTask.reset();
-        }
+        cancelHqTiles(/*keep_requested_space=*/false);
         m_potentialHqXform = xform;
     }
     m_timer.start();
@@ -1119,46 +1313,112 @@ ImageViewBase::scheduleHqVersionRebuild()
 void
 ImageViewBase::initiateBuildingHqVersion()
 {
-    if (validateHqPixmap()) {
+    if (!m_hqTransformEnabled) {
+        return;
+    }
+
+    HqTileKey space;
+    QPoint offset;
+    if (!currentHqTileSpace(space, offset)) {
         return;
     }
 
-    set_hq_pixmap(QPixmap());
+    m_hqRequestedSpace = space;
+    m_hqSpaceRequested = true;
 
-    if (m_ptrHqTransformTask.get()) {
-        m_ptrHqTransformTask->cancel();
-        m_ptrHqTransformTask.reset();
+    std::vector<HqTileKey> missing;
+    for (HqTileKey const& key : visibleHqTiles(space, offset)) {
+        if (m_hqTiles.find(key) == m_hqTiles.end()) {
+            missing.push_back(key);
+        }
     }
 
-    QTransform const xform(m_imageToVirtual * m_virtualToWidget);
-    IntrusivePtr<HqTransformTask> const task(
-        new HqTransformTask(this, get_image(), xform, viewport()->size())
-    );
+    requestHqTiles(missing);
+}
 
-    backgroundExecutor().enqueueTask(task);
+/**
+ * Starts rendering the tiles, unless they are being rendered already.
+ * The tiles must belong to m_hqRequestedSpace.
+ */
+void
+ImageViewBase::requestHqTiles(std::vector<HqTileKey> const& keys)
+{
+    // Tiles from other spaces won't be displayed anyway.
+    cancelHqTiles(/*keep_requested_space=*/true);
+
+    for (HqTileKey const& key : keys) {
+        if (m_pendingHqTiles.find(key) != m_pendingHqTiles.end()) {
+            continue;
+        }
 
-    m_ptrHqTransformTask = task;
-    m_hqXform = xform;
-    m_hqSourceId = get_image().cacheKey();
+        IntrusivePtr<HqTileTask> const task(
+            new HqTileTask(m_ptrHqTileSink, get_image(), key, hqTileRect(key))
+        );
+        m_pendingHqTiles[key] = task;
+        hqTileThreadPool().start(new HqTileTask::Runner(task));
+    }
+}
+
+void
+ImageViewBase::cancelHqTiles(bool const keep_requested_space)
+{
+    PendingHqTiles::iterator it(m_pendingHqTiles.begin());
+    while (it != m_pendingHqTiles.end()) {
+        if (keep_requested_space && m_hqSpaceRequested
+                && it->first.sameSpace(m_hqRequestedSpace)) {
+            ++it;
+        } else {
+            it->second->cancel();
+            m_pendingHqTiles.erase(it++);
+        }
+    }
 }
 
 /**
- * Gets called from HqTransformationTask::Result.
+ * Gets called from customEvent() when an HqTileTask finishes.
  */
 void
-ImageViewBase::hqVersionBuilt(
+ImageViewBase::hqTileBuilt(
+    HqTileKey const& key, HqTileTask const* task,
     QPoint const& origin, QImage const& image)
 {
+    PendingHqTiles::iterator const it(m_pendingHqTiles.find(key));
+    if (it == m_pendingHqTiles.end() || it->second.get() != task) {
+        // Cancelled.
+        return;
+    }
+    m_pendingHqTiles.erase(it);
+
     if (!m_hqTransformEnabled) {
         return;
     }
 
-    set_hq_pixmap(QPixmap::fromImage(image));
-    m_hqPixmapPos = origin;
-    m_ptrHqTransformTask.reset();
+    HqTile& tile = m_hqTiles[key];
+    tile.pixmap = QPixmap::fromImage(image);
+    tile.origin = origin;
+    tile.lastUsed = m_hqTileUseCounter;
+
+    evictHqTiles();
     update();
 }
 
+/**
+ * Removes the least recently drawn tiles, if there are too many of them.
+ */
+void
+ImageViewBase::evictHqTiles()
+{
+    while (m_hqTiles.size() > MAX_HQ_TILES) {
+        HqTiles::iterator lru(m_hqTiles.begin());
+        for (HqTiles::iterator it(m_hqTiles.begin()); it != m_hqTiles.end(); ++it) {
+            if (it->second.lastUsed < lru->second.lastUsed) {
+                lru = it;
+            }
+        }
+        m_hqTiles.erase(lru);
+    }
+}
+
 void
 ImageViewBase::updateStatusTipAndCursor()
 {
@@ -1210,76 +1470,130 @@ ImageViewBase::setAlternativeImage(shared_ptr<QImage> image, shared_ptr<QPixmap>
     }
 }
 
-/*==================== ImageViewBase::HqTransformTask ======================*/
+/*======================== ImageViewBase::HqTileKey ========================*/
+
+ImageViewBase::HqTileKey::HqTileKey()
+    :   sourceId(0),
+        m11(1.0), m12(0.0), m21(0.0), m22(1.0), dx(0.0), dy(0.0),
+        col(0),
+        row(0)
+{
+}
+
+QTransform
+ImageViewBase::HqTileKey::transform() const
+{
+    return QTransform(m11, m12, m21, m22, dx, dy);
+}
+
+bool
+ImageViewBase::HqTileKey::sameSpace(HqTileKey const& other) const
+{
+    return sourceId == other.sourceId
+           && m11 == other.m11 && m12 == other.m12
+           && m21 == other.m21 && m22 == other.m22
+           && dx == other.dx && dy == other.dy;
+}
+
+bool
+ImageViewBase::HqTileKey::operator<(HqTileKey const& other) const
+{
+    return std::tie(sourceId, m11, m12, m21, m22, dx, dy, row, col)
+           < std::tie(other.sourceId, other.m11, other.m12, other.m21,
+                      other.m22, other.dx, other.dy, other.row, other.col);
+}
+
+/*======================= ImageViewBase::HqTileSink ========================*/
+
+void
+ImageViewBase::HqTileSink::detach()
+{
+    QMutexLocker const locker(&m_mutex);
+    m_pImageView = 0;
+}
+
+void
+ImageViewBase::HqTileSink::post(Result const& result)
+{
+    QMutexLocker const locker(&m_mutex);
+    if (m_pImageView) {
+        QCoreApplication::postEvent(m_pImageView, new Event(result));
+    }
+}
+
+/*======================= ImageViewBase::HqTileTask ========================*/
 
-ImageViewBase::HqTransformTask::HqTransformTask(
-    ImageViewBase* image_view,
-    QImage const& image, QTransform const& xform,
-    QSize const& target_size)
-    :   m_ptrResult(new Result(image_view)),
+ImageViewBase::HqTileTask::HqTileTask(
+    IntrusivePtr<HqTileSink> const& sink, QImage const& image,
+    HqTileKey const& key, QRect const& tile_rect)
+    :   m_ptrSink(sink),
         m_image(image),
-        m_xform(xform),
-        m_targetSize(target_size)
+        m_key(key),
+        m_tileRect(tile_rect)
 {
 }
 
-IntrusivePtr<AbstractCommand0<void> >
-ImageViewBase::HqTransformTask::operator()()
+void
+ImageViewBase::HqTileTask::render()
 {
     if (isCancelled()) {
-        return IntrusivePtr<AbstractCommand0<void> >();
+        return;
     }
 
-    QRect const target_rect(
-        m_xform.map(
-            QRectF(m_image.rect())
-        ).boundingRect().toRect().intersected(
-            QRect(QPoint(0, 0), m_targetSize)
-        )
-    );
+    QTransform xform(m_key.transform());
+    QImage source(m_image);
+
+    // When zoomed out, render from the pyramid level that is closest
+    // in size, which is both faster and more accurate than area
+    // averaging lots of source pixels per tile pixel.
+    int const level = ImagePyramid::levelForScale(sqrt(fabs(xform.determinant())));
+    if (level > 0) {
+        IntrusivePtr<ImagePyramid const> const pyramid(ImagePyramid::forImage(m_image));
+        int const available_level = std::min(level, pyramid->numLevels() - 1);
+        if (available_level > 0) {
+            source = pyramid->reducedLevel(available_level);
+            double const factor = double(1 << available_level);
+            xform = QTransform::fromScale(factor, factor) * xform;
+        }
+
+        if (isCancelled()) {
+            return;
+        }
+    }
 
-    QImage hq_image(
+    QImage tile(
         transform(
-            m_image, m_xform, target_rect,
+            source, xform, m_tileRect,
             OutsidePixels::assumeWeakColor(Qt::white), QSizeF(0.0, 0.0)
         )
     );
 
-    // In many cases m_image and therefore hq_image are grayscale with
-    // a palette, but given that hq_image will be converted to a QPixmap
+    // In many cases m_image and therefore the tile are grayscale with
+    // a palette, but given that the tile will be converted to a QPixmap
     // on the GUI thread, it's better to convert it to RGB as a preparation
     // step while we are still in a background thread.
-    hq_image = hq_image.convertToFormat(
-                   hq_image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32
-               );
-
-    m_ptrResult->setData(target_rect.topLeft(), hq_image);
-
-    return m_ptrResult;
-}
-
-/*================ ImageViewBase::HqTransformTask::Result ================*/
+    tile = tile.convertToFormat(
+               tile.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32
+           );
 
-ImageViewBase::HqTransformTask::Result::Result(
-    ImageViewBase* image_view)
-    :   m_ptrImageView(image_view)
-{
+    HqTileSink::Result result;
+    result.key = m_key;
+    result.task = this;
+    result.origin = m_tileRect.topLeft();
+    result.image = tile;
+    m_ptrSink->post(result);
 }
 
 void
-ImageViewBase::HqTransformTask::Result::setData(
-    QPoint const& origin, QImage const& hq_image)
+ImageViewBase::HqTileTask::Runner::run()
 {
-    m_hqImage = hq_image;
-    m_origin = origin;
-}
+#ifdef _OPENMP
+    // Tiles are already rendered in parallel, so parallelizing
+    // imageproc::transform() as well would oversubscribe the CPU.
+    omp_set_num_threads(1);
+#endif
 
-void
-ImageViewBase::HqTransformTask::Result::operator()()
-{
-    if (m_ptrImageView && !isCancelled()) {
-        m_ptrImageView->hqVersionBuilt(m_origin, m_hqImage);
-    }
+    m_ptrTask->render();
 }
 
 /*================= ImageViewBase::TempFocalPointAdjuster =================*/
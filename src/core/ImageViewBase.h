@@ -37,8 +37,11 @@
 #include <QRectF>
 #include <Qt>
 #include <memory>
+#include <map>
+#include <vector>
 
 class QPainter;
+class QEvent;
 class BackgroundExecutor;
 class ImagePresentation;
 
@@ -75,7 +78,8 @@ public:
      *        The whole idea of having a downscaled version is
      *        to speed up real-time rendering of high-resolution
      *        images.  Note that the delayed high quality transform
-     *        operates on the original image, not the downscaled one.
+     *        operates on the original image (or its ImagePyramid),
+     *        not the downscaled one.
      * \param presentation Specifies transformation from image
      *        pixel coordinates to virtual image coordinates, along
      *        with some other properties.
@@ -112,6 +116,9 @@ public:
      * be called from a background thread, while the constructor
      * can't.
      *
+     * The image is downscaled from its ImagePyramid, which is then
+     * already cached when the high quality transform needs it.
+     *
      * \param image The input image, not null, and with DPI set correctly.
      * \return The image downscaled by an unspecified degree.
      */
@@ -285,6 +292,8 @@ public:
 protected:
     virtual void paintEvent(QPaintEvent* event);
 
+    virtual void customEvent(QEvent* event);
+
     virtual void keyPressEvent(QKeyEvent* event);
 
     virtual void keyReleaseEvent(QKeyEvent* event);
@@ -333,7 +342,8 @@ private slots:
 
     void reactToScrollBars();
 private:
-    class HqTransformTask;
+    class HqTileTask;
+    class HqTileSink;
     class TempFocalPointAdjuster;
     class TransformChangeWatcher;
 
@@ -353,11 +363,69 @@ private:
 
     QPointF centeredWidgetFocalPoint() const;
 
-    bool validateHqPixmap() const;
+    /**
+     * \brief Identifies a tile of the high quality version.
+     *
+     * Tiles are laid out on a grid in tile space, which is widget space
+     * with the integer part of the translation removed.  That way,
+     * panning doesn't invalidate the tiles, while zooming and rotating do.
+     */
+    struct HqTileKey
+    {
+        /** QImage::cacheKey() of the source image. */
+        qint64 sourceId;
+
+        /** Image to tile space transformation. */
+        double m11, m12, m21, m22, dx, dy;
+
+        int col;
+        int row;
+
+        HqTileKey();
+
+        QTransform transform() const;
+
+        /** Tells if both tiles belong to the same tile space. */
+        bool sameSpace(HqTileKey const& other) const;
+
+        bool operator<(HqTileKey const& other) const;
+    };
+
+    struct HqTile
+    {
+        QPixmap pixmap;
+
+        /** The position of the pixmap in tile space. */
+        QPoint origin;
+
+        /** The value of m_hqTileUseCounter when it was last drawn. */
+        quint64 lastUsed;
+    };
+
+    typedef std::map<HqTileKey, HqTile> HqTiles;
+
+    typedef std::map<HqTileKey, IntrusivePtr<HqTileTask> > PendingHqTiles;
+
+    bool currentHqTileSpace(HqTileKey& space, QPoint& offset) const;
+
+    QRect hqTileRect(HqTileKey const& key) const;
+
+    std::vector<HqTileKey> visibleHqTiles(
+        HqTileKey const& space, QPoint const& offset) const;
+
+    bool collectHqTiles(std::vector<HqTile const*>& tiles, QPoint& offset);
 
     void scheduleHqVersionRebuild();
 
-    void hqVersionBuilt(QPoint const& origin, QImage const& image);
+    void requestHqTiles(std::vector<HqTileKey> const& keys);
+
+    void cancelHqTiles(bool keep_requested_space);
+
+    void hqTileBuilt(
+        HqTileKey const& key, HqTileTask const* task,
+        QPoint const& origin, QImage const& image);
+
+    void evictHqTiles();
 
     void updateStatusTipAndCursor();
 
@@ -379,20 +447,6 @@ private:
         return m_displayAlternative && m_alternativePixmap ? *(m_alternativePixmap) : m_pixmap;
     }
 
-    const QPixmap& get_hq_pixmap() const
-    {
-        return m_displayAlternative ? m_alternativeHqPixmap : m_hqPixmap;
-    }
-
-    void set_hq_pixmap(const QPixmap& pixmap)
-    {
-        if (m_displayAlternative) {
-            m_alternativeHqPixmap = pixmap;
-        } else {
-            m_hqPixmap = pixmap;
-        }
-    }
-
     InteractionHandler m_rootInteractionHandler;
 
     InteractionState m_interactionState;
@@ -420,39 +474,39 @@ private:
     shared_ptr<QPixmap> m_alternativePixmap;
 
     /**
-     * The high quality, pre-transformed version of m_pixmap.
+     * The tiles of the high quality, pre-transformed version of
+     * the image.  Tiles of the alternative image and of previous
+     * zoom levels stay there until evicted.
      */
-    QPixmap m_hqPixmap;
-
-    QPixmap m_alternativeHqPixmap;
+    HqTiles m_hqTiles;
 
     /**
-     * The position, in widget coordinates, where m_hqPixmap is to be drawn.
+     * The tiles being rendered in background threads.
      */
-    QPoint m_hqPixmapPos;
+    PendingHqTiles m_pendingHqTiles;
 
     /**
-     * The transformation used to build m_hqPixmap.
-     * It's used to detect if m_hqPixmap needs to be rebuild.
+     * Delivers the rendered tiles to this object.
      */
-    QTransform m_hqXform;
+    IntrusivePtr<HqTileSink> m_ptrHqTileSink;
 
     /**
-     * Used to check if we need to extend the delay before building m_hqPixmap.
+     * Incremented on every paint, to find the least recently used tiles.
      */
-    QTransform m_potentialHqXform;
+    quint64 m_hqTileUseCounter;
 
     /**
-     * The ID (QImage::cacheKey()) of the image that was used
-     * to build m_hqPixmap.  It's used to detect if m_hqPixmap
-     * needs to be rebuilt.
+     * The tile space where tiles were last requested.  Missing tiles
+     * in the same space are requested without a delay.
      */
-    qint64 m_hqSourceId;
+    HqTileKey m_hqRequestedSpace;
+
+    bool m_hqSpaceRequested;
 
     /**
-     * The pending (if any) high quality transformation task.
+     * Used to check if we need to extend the delay before requesting tiles.
      */
-    IntrusivePtr<HqTransformTask> m_ptrHqTransformTask;
+    QTransform m_potentialHqXform;
 
     /**
      * Transformation from m_pixmap coordinates to m_image coordinates.
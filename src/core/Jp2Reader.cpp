@@ -235,6 +235,49 @@ ImageMetadataLoader::Status prepareMetadata(
     return ImageMetadataLoader::LOADED;
 }
 
+/**
+ * Returns the number of the highest resolution levels that may be skipped
+ * when decoding, without the image becoming smaller than its full size
+ * scaled to fit \p box.
+ */
+int reductionLevel(opj_codec_t* codec, opj_image_t* image, QSize const& box)
+{
+    QSize const full_size(image->comps[0].w, image->comps[0].h);
+    if (full_size.width() <= box.width() && full_size.height() <= box.height()) {
+        return 0;
+    }
+    QSize const min_size(full_size.scaled(box, Qt::KeepAspectRatio));
+
+    // A codestream with N resolution levels can be reduced by N - 1 at most.
+    int max_reduce = 0;
+    if (opj_codestream_info_v2_t* info = opj_get_cstr_info(codec)) {
+        OPJ_UINT32 num_resolutions = 0;
+        if (info->m_default_tile_info.tccp_info) {
+            num_resolutions = info->m_default_tile_info.tccp_info[0].numresolutions;
+            for (OPJ_UINT32 i = 1; i < info->nbcomps; ++i) {
+                num_resolutions = std::min(
+                    num_resolutions, info->m_default_tile_info.tccp_info[i].numresolutions
+                );
+            }
+        }
+        max_reduce = std::max<int>(0, int(num_resolutions) - 1);
+        opj_destroy_cstr_info(&info);
+    }
+
+    int reduce = 0;
+    while (reduce < max_reduce) {
+        int const next = reduce + 1;
+        int const width = (full_size.width() + (1 << next) - 1) >> next;
+        int const height = (full_size.height() + (1 << next) - 1) >> next;
+        if (width < min_size.width() || height < min_size.height()) {
+            break;
+        }
+        reduce = next;
+    }
+
+    return reduce;
+}
+
 ImageMetadataLoader::Status
 Jp2Reader::readMetadata(
         QIODevice& device,
@@ -309,7 +352,7 @@ QImage openjpegToQImage(opj_image_t* source)
 }
 
 QImage
-Jp2Reader::readImage(QIODevice& device)
+Jp2Reader::readImage(QIODevice& device, QSize const& box)
 {
     opj_stream_t* stream = nullptr;
     opj_codec_t* codec = nullptr;
@@ -329,6 +372,13 @@ Jp2Reader::readImage(QIODevice& device)
         return QImage();
     }
 
+    int const reduce = box.isEmpty() ? 0 : reductionLevel(codec, jp2_image, box);
+    if (reduce > 0) {
+        // That's what opj_dparameters_t::cp_reduce does, except we only
+        // know how much to reduce after reading the header.
+        opj_set_decoded_resolution_factor(codec, reduce);
+    }
+
     /* Get the decoded image */
     if (!(opj_decode(codec, stream, jp2_image) &&
           opj_end_decompress(codec,   stream))) {
@@ -21,6 +21,7 @@
 
 #include "ImageMetadataLoader.h"
 #include "VirtualFunction.h"
+#include <QSize>
 
 class QIODevice;
 class QImage;
@@ -41,11 +42,12 @@ public:
      *
      * \param device The device to read from.  This device must be
      *        opened for reading and must be seekable.
-     * \param page_num A zero-based page number within a multi-page
-     *        TIFF file.
+     * \param box If not empty, the image is going to be scaled down
+     *        to fit it.  The image is then decoded at the lowest
+     *        resolution level that's not smaller than that.
      * \return The resulting image, or a null image in case of failure.
      */
-    static QImage readImage(QIODevice& device);
+    static QImage readImage(QIODevice& device, QSize const& box = QSize());
 };
 
 #endif
@@ -30,16 +30,41 @@
 #include "Dpi.h"
 #include "Dpm.h"
 #include "FilterData.h"
+#include "FilterDataCache.h"
 #include "ImageLoader.h"
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
+#include "MemoryBudget.h"
 #include <QCoreApplication>
 #include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QDir>
 #include <QImage>
 #include <QString>
+#include <memory>
 #include <assert.h>
 
 using namespace imageproc;
 
+namespace
+{
+
+/**
+ * A rough estimate of the memory needed to process a page up to
+ * the output stage: the original image, the grayscale version of it
+ * FilterData keeps, and the intermediate images of the filters.
+ * The output stage adds its own estimate once it knows the output size.
+ */
+qint64 estimateMemoryUsage(ImageMetadata const& metadata)
+{
+    qint64 const num_pixels = qint64(metadata.size().width()) * metadata.size().height();
+    int const orig_bytes_per_pixel = metadata.isGrayScale() ? 1 : 4;
+    return num_pixels * (orig_bytes_per_pixel + 2);
+}
+
+} // anonymous namespace
+
 class LoadFileTask::ErrorResult : public FilterResult
 {
     Q_DECLARE_TR_FUNCTIONS(LoadFileTask)
@@ -79,7 +104,23 @@ LoadFileTask::~LoadFileTask()
 FilterResultPtr
 LoadFileTask::operator()()
 {
-    QImage image(ImageLoader::load(m_imageId));
+    ProfiledPage const profiled_page(m_imageId);
+    ScopedStageTimer const timer("load_file");
+
+    // Waits for other pages to finish if processing this one
+    // would exceed the memory budget.
+    MemoryBudget::Reservation reservation(estimateMemoryUsage(m_imageMetadata), *this);
+
+    FilterDataCache& cache = FilterDataCache::instance();
+    QDateTime const file_mtime(QFileInfo(m_imageId.filePath()).lastModified());
+
+    std::unique_ptr<FilterData> data(cache.get(m_imageId, file_mtime));
+    if (data && Dpm(data->origImage()) != Dpm(m_imageMetadata.dpi())) {
+        // The DPI was changed since the image was cached.
+        data.reset();
+    }
+
+    QImage image(data ? data->origImage() : ImageLoader::load(m_imageId));
 
     try {
         throwIfCancelled();
@@ -94,9 +135,13 @@ LoadFileTask::operator()()
             }
 
             updateImageSizeIfChanged(image);
-            overrideDpi(image);
+            if (!data) {
+                overrideDpi(image);
+                data.reset(new FilterData(image));
+                cache.put(m_imageId, file_mtime, *data);
+            }
             m_ptrThumbnailCache->ensureThumbnailExists(m_imageId, image);
-            return m_ptrNextTask->process(*this, FilterData(image));
+            return m_ptrNextTask->process(*this, *data);
         }
     } catch (CancelledException const&) {
         return FilterResultPtr();
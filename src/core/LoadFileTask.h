@@ -48,6 +48,11 @@ public:
     virtual ~LoadFileTask();
 
     virtual FilterResultPtr operator()();
+
+    ImageId const& imageId() const
+    {
+        return m_imageId;
+    }
 private:
     class ErrorResult;
 
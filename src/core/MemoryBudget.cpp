@@ -0,0 +1,227 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryBudget.h"
+#include "TaskStatus.h"
+#include <QMutexLocker>
+#include <QThreadStorage>
+
+namespace
+{
+
+/**
+ * How often the waiting tasks check if they were cancelled, in milliseconds.
+ */
+unsigned long const CANCEL_CHECK_INTERVAL = 200;
+
+struct ThreadContext
+{
+    MemoryBudget::Reservation* currentReservation;
+
+    ThreadContext() : currentReservation(0) {}
+};
+
+/**
+ * The current reservation of the calling thread.
+ *
+ * It's wrapped in a struct, as QThreadStorage deletes the pointers
+ * it holds, while reservations live on the stack.
+ */
+MemoryBudget::Reservation*& currentReservation()
+{
+    static QThreadStorage<ThreadContext> storage;
+    return storage.localData().currentReservation;
+}
+
+} // anonymous namespace
+
+MemoryBudget&
+MemoryBudget::instance()
+{
+    static MemoryBudget obj;
+    return obj;
+}
+
+MemoryBudget::MemoryBudget()
+    :   m_limit(0),
+        m_reserved(0),
+        m_peakReserved(0),
+        m_numHolders(0),
+        m_numGrowing(0),
+        m_numWaits(0)
+{
+}
+
+void
+MemoryBudget::setLimit(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_limit = bytes > 0 ? bytes : 0;
+    m_released.wakeAll();
+}
+
+qint64
+MemoryBudget::limit() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_limit;
+}
+
+qint64
+MemoryBudget::reserved() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_reserved;
+}
+
+qint64
+MemoryBudget::peakReserved() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_peakReserved;
+}
+
+int
+MemoryBudget::numWaits() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_numWaits;
+}
+
+void
+MemoryBudget::acquire(qint64 const bytes, TaskStatus const& status)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    // The tasks that are already running and want to grow go first,
+    // as they are the ones that are going to release memory.
+    if (m_numGrowing > 0 || !fitsLocked(bytes)) {
+        ++m_numWaits;
+        do {
+            m_released.wait(&m_mutex, CANCEL_CHECK_INTERVAL);
+        } while ((m_numGrowing > 0 || !fitsLocked(bytes)) && !status.isCancelled());
+    }
+
+    m_reserved += bytes;
+    ++m_numHolders;
+    updatePeakLocked();
+}
+
+void
+MemoryBudget::grow(qint64 const bytes, TaskStatus const& status)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    if (!fitsLocked(bytes)) {
+        ++m_numWaits;
+        ++m_numGrowing;
+
+        // Another task may be waiting for this one to start waiting.
+        m_released.wakeAll();
+
+        // We don't wait if all the other holders are waiting to grow,
+        // as none of them is going to release anything.
+        while (!fitsLocked(bytes) && m_numGrowing < m_numHolders && !status.isCancelled()) {
+            m_released.wait(&m_mutex, CANCEL_CHECK_INTERVAL);
+        }
+
+        --m_numGrowing;
+        m_released.wakeAll();
+    }
+
+    m_reserved += bytes;
+    updatePeakLocked();
+}
+
+void
+MemoryBudget::release(qint64 const bytes, bool const holder)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_reserved -= bytes;
+    if (holder) {
+        --m_numHolders;
+    }
+    m_released.wakeAll();
+}
+
+bool
+MemoryBudget::fitsLocked(qint64 const bytes) const
+{
+    if (m_limit == 0) {
+        return true;
+    }
+
+    // With nothing else reserved, a task too big for the limit
+    // is let through, otherwise it would never run.
+    return m_reserved == 0 || m_reserved + bytes <= m_limit;
+}
+
+void
+MemoryBudget::updatePeakLocked()
+{
+    if (m_reserved > m_peakReserved) {
+        m_peakReserved = m_reserved;
+    }
+}
+
+/*======================= MemoryBudget::Reservation =======================*/
+
+MemoryBudget::Reservation::Reservation(qint64 const bytes, TaskStatus const& status)
+    :   m_rStatus(status),
+        m_pPrev(currentReservation()),
+        m_bytes(0)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    qint64 const positive_bytes = bytes > 0 ? bytes : 0;
+
+    if (m_pPrev) {
+        // Nested reservations are simply added to the outer one,
+        // whose thread already holds a place in the budget.
+        QMutexLocker const locker(&budget.m_mutex);
+        budget.m_reserved += positive_bytes;
+        budget.updatePeakLocked();
+    } else {
+        budget.acquire(positive_bytes, status);
+    }
+
+    m_bytes = positive_bytes;
+    currentReservation() = this;
+}
+
+MemoryBudget::Reservation::~Reservation()
+{
+    currentReservation() = m_pPrev;
+    MemoryBudget::instance().release(m_bytes, !m_pPrev);
+}
+
+void
+MemoryBudget::Reservation::grow(qint64 const bytes)
+{
+    if (bytes <= 0) {
+        return;
+    }
+
+    MemoryBudget::instance().grow(bytes, m_rStatus);
+    m_bytes += bytes;
+}
+
+MemoryBudget::Reservation*
+MemoryBudget::Reservation::current()
+{
+    return currentReservation();
+}
@@ -0,0 +1,156 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORYBUDGET_H_
+#define MEMORYBUDGET_H_
+
+#include "NonCopyable.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtGlobal>
+
+class TaskStatus;
+
+/**
+ * \brief Limits the memory that tasks processing pages in parallel
+ *        are estimated to need.
+ *
+ * A task makes a Reservation of its estimated peak memory usage before
+ * it allocates anything big.  If the sum of reservations would exceed
+ * the limit, the task waits for other tasks to finish, instead of
+ * running the process out of memory.  A task that alone exceeds
+ * the limit is let through once it's the only one running.
+ *
+ * Once a task knows more about what it's going to do, it may grow its
+ * reservation.  Growing waits as well, unless all the other running
+ * tasks are waiting to grow too, in which case it goes over the limit
+ * rather than deadlocking.
+ *
+ * There is no limit by default, in which case reservations are only
+ * accounted for, to report the peak usage.
+ *
+ * \note All methods may be called from any thread, even concurrently.
+ */
+class MemoryBudget
+{
+    DECLARE_NON_COPYABLE(MemoryBudget)
+public:
+    class Reservation;
+
+    static MemoryBudget& instance();
+
+    /**
+     * \brief Sets the limit in bytes.  Zero means no limit.
+     */
+    void setLimit(qint64 bytes);
+
+    qint64 limit() const;
+
+    /**
+     * \brief The sum of the reservations that exist now.
+     */
+    qint64 reserved() const;
+
+    /**
+     * \brief The largest sum of reservations so far.
+     */
+    qint64 peakReserved() const;
+
+    /**
+     * \brief The number of times a task had to wait for memory.
+     */
+    int numWaits() const;
+private:
+    MemoryBudget();
+
+    void acquire(qint64 bytes, TaskStatus const& status);
+
+    void grow(qint64 bytes, TaskStatus const& status);
+
+    void release(qint64 bytes, bool holder);
+
+    bool fitsLocked(qint64 bytes) const;
+
+    void updatePeakLocked();
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_released;
+    qint64 m_limit;
+    qint64 m_reserved;
+    qint64 m_peakReserved;
+
+    /**
+     * The number of threads holding reservations.
+     */
+    int m_numHolders;
+
+    /**
+     * The number of holders waiting in grow().
+     */
+    int m_numGrowing;
+    int m_numWaits;
+};
+
+
+/**
+ * \brief Reserves memory from MemoryBudget for as long as it exists.
+ *
+ * While it exists, it's the current reservation of the thread it was
+ * created on, so that the code deeper in the call stack can grow it
+ * without it being passed around.  A reservation made while there is
+ * already one on the same thread doesn't wait, as the thread may
+ * be the one the other tasks are waiting for.
+ */
+class MemoryBudget::Reservation
+{
+    DECLARE_NON_COPYABLE(Reservation)
+public:
+    /**
+     * \brief Waits until \p bytes are available and reserves them.
+     *
+     * If \p status gets cancelled, it stops waiting and reserves them
+     * anyway.  The task is expected to find out it was cancelled and
+     * finish soon after.
+     */
+    Reservation(qint64 bytes, TaskStatus const& status);
+
+    ~Reservation();
+
+    /**
+     * \brief Reserves \p bytes more, waiting for them if necessary.
+     *
+     * Like the constructor, it stops waiting if the task gets cancelled.
+     */
+    void grow(qint64 bytes);
+
+    qint64 bytes() const
+    {
+        return m_bytes;
+    }
+
+    /**
+     * \brief The most recent reservation of the calling thread, or null.
+     */
+    static Reservation* current();
+private:
+    TaskStatus const& m_rStatus;
+    Reservation* m_pPrev;
+    qint64 m_bytes;
+};
+
+#endif
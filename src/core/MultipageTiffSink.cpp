@@ -0,0 +1,86 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MultipageTiffSink.h"
+
+MultipageTiffSink::MultipageTiffSink(QString const& file_path)
+    :   m_file(file_path),
+        m_numPages(0),
+        m_failed(false)
+{
+    // libtiff doesn't truncate existing files even in "w" mode.
+    if (m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        m_ptrTif.reset(new TiffWriter::TiffHandle(TiffWriter::openDevice(m_file, "wBm")));
+    }
+
+    if (!m_ptrTif || !m_ptrTif->handle()) {
+        m_ptrTif.reset();
+        m_failed = true;
+        if (m_file.isOpen()) {
+            m_file.remove();
+        }
+    }
+}
+
+MultipageTiffSink::~MultipageTiffSink()
+{
+    close();
+}
+
+bool
+MultipageTiffSink::isOpen() const
+{
+    return m_ptrTif.get() != nullptr;
+}
+
+bool
+MultipageTiffSink::addPage(QImage const& image)
+{
+    if (m_failed || !m_ptrTif) {
+        return false;
+    }
+
+    if (TiffWriter::writePage(*m_ptrTif, image, true, m_numPages, nullptr)) {
+        ++m_numPages;
+    } else {
+        m_failed = true;
+    }
+
+    return !m_failed;
+}
+
+bool
+MultipageTiffSink::close()
+{
+    if (!m_ptrTif) {
+        return false;
+    }
+
+    if (m_numPages == 0) {
+        m_failed = true;
+    }
+
+    // This closes m_file as well.
+    m_ptrTif.reset();
+
+    if (m_failed) {
+        m_file.remove();
+    }
+
+    return !m_failed;
+}
@@ -0,0 +1,86 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MULTIPAGETIFFSINK_H_
+#define MULTIPAGETIFFSINK_H_
+
+#include "NonCopyable.h"
+#include "TiffWriter.h"
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <memory>
+
+/**
+ * \brief Writes a multipage TIFF file through a single libtiff handle.
+ *
+ * Unlike calling TiffWriter::writeImage() once per page, the file
+ * isn't reopened for every page, so libtiff doesn't have to walk
+ * the chain of directories written so far.
+ *
+ * Pages are written in the order they are added.  The class isn't
+ * thread-safe: it's meant to be used by a single thread.
+ */
+class MultipageTiffSink
+{
+    DECLARE_NON_COPYABLE(MultipageTiffSink)
+public:
+    /**
+     * \brief Creates the file, or truncates an existing one.
+     *
+     * \see isOpen()
+     */
+    explicit MultipageTiffSink(QString const& file_path);
+
+    /**
+     * \brief Calls close(), if it wasn't called already.
+     */
+    ~MultipageTiffSink();
+
+    bool isOpen() const;
+
+    /**
+     * \brief Writes the next page.
+     *
+     * \param image The page image.  Writing a null image will fail.
+     * \return false if the file isn't open or writing this or
+     *         an earlier page has failed.
+     */
+    bool addPage(QImage const& image);
+
+    /**
+     * \brief Finishes the file.
+     *
+     * If anything failed, or no pages were added, the file is removed.
+     *
+     * \return true if all the added pages were written.
+     */
+    bool close();
+private:
+    QFile m_file;
+    std::unique_ptr<TiffWriter::TiffHandle> m_ptrTif;
+
+    /**
+     * The number of pages written so far.
+     */
+    int m_numPages;
+
+    bool m_failed;
+};
+
+#endif
@@ -41,8 +41,15 @@ ProcessingTaskQueue::addProcessingTask(
 BackgroundTaskPtr
 ProcessingTaskQueue::takeForProcessing()
 {
+    // Images that are being processed at the moment.  Two pages of
+    // the same image aren't processed concurrently, as the first one
+    // may establish settings (like the page layout) the second one uses.
+    std::set<ImageId> busy_images;
+
     for (Entry& ent : m_queue) {
-        if (!ent.takenForProcessing) {
+        if (ent.takenForProcessing) {
+            busy_images.insert(ent.pageInfo.imageId());
+        } else if (busy_images.find(ent.pageInfo.imageId()) == busy_images.end()) {
             ent.takenForProcessing = true;
 
             if (m_order == RANDOM_ORDER) {
@@ -71,12 +78,9 @@ ProcessingTaskQueue::processingFinished(BackgroundTaskPtr const& task)
             return;
         }
 
-        if (!it->takenForProcessing) {
-            // There is no point in looking further.
-            return;
-        }
-
-        if (it->task == task) {
+        // Entries taken for processing don't necessarily precede
+        // the rest, as takeForProcessing() may skip some of them.
+        if (it->takenForProcessing && it->task == task) {
             break;
         }
     }
@@ -23,6 +23,7 @@
 #include "BackgroundTask.h"
 #include "PageInfo.h"
 #include "PageId.h"
+#include "ImageId.h"
 #include <list>
 #include <set>
 
@@ -43,7 +44,8 @@ public:
 
     /**
      * The first task among those that haven't been already taken for processing
-     * is marked as taken and returned.  A null task will be returned if there
+     * is marked as taken and returned.  Tasks for pages whose image is already
+     * being processed are skipped.  A null task will be returned if there
      * are no such tasks.
      */
     BackgroundTaskPtr takeForProcessing();
@@ -0,0 +1,67 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
+#include "ImageId.h"
+#include "PageId.h"
+
+ProfiledPage::ProfiledPage(ImageId const& image_id)
+    :   m_active(StageProfiler::instance().isEnabled())
+{
+    if (m_active) {
+        enter(imageName(image_id));
+    }
+}
+
+ProfiledPage::ProfiledPage(PageId const& page_id)
+    :   m_active(StageProfiler::instance().isEnabled())
+{
+    if (!m_active) {
+        return;
+    }
+
+    QString name(imageName(page_id.imageId()));
+    if (page_id.subPage() != PageId::SINGLE_PAGE) {
+        name += QString(" (%1)").arg(page_id.subPageAsString());
+    }
+    enter(name);
+}
+
+ProfiledPage::~ProfiledPage()
+{
+    if (m_active) {
+        StageProfiler::setCurrentPage(m_prevPage);
+    }
+}
+
+QString
+ProfiledPage::imageName(ImageId const& image_id)
+{
+    if (image_id.isMultiPageFile()) {
+        return QString("%1 #%2").arg(image_id.filePath()).arg(image_id.page());
+    }
+    return image_id.filePath();
+}
+
+void
+ProfiledPage::enter(QString const& page)
+{
+    m_prevPage = StageProfiler::currentPage();
+    StageProfiler::setCurrentPage(page);
+}
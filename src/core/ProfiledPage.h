@@ -0,0 +1,54 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILEDPAGE_H_
+#define PROFILEDPAGE_H_
+
+#include "NonCopyable.h"
+#include <QString>
+
+class ImageId;
+class PageId;
+
+/**
+ * \brief Attributes the stages timed by StageProfiler on the current
+ *        thread to a page, for as long as the object exists.
+ *
+ * Pages are named after the file path, the page number within
+ * a multi-page file, and the sub-page, like "/scans/book.tif #3 (left)".
+ * Does nothing if profiling is disabled.
+ */
+class ProfiledPage
+{
+    DECLARE_NON_COPYABLE(ProfiledPage)
+public:
+    explicit ProfiledPage(ImageId const& image_id);
+
+    explicit ProfiledPage(PageId const& page_id);
+
+    ~ProfiledPage();
+private:
+    static QString imageName(ImageId const& image_id);
+
+    void enter(QString const& page);
+
+    QString m_prevPage;
+    bool m_active;
+};
+
+#endif
@@ -0,0 +1,516 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ProjectFile.h"
+#include "AtomicFileOverwriter.h"
+#include "settings/ini_keys.h"
+#include <QSettings>
+#include <QFile>
+#include <QBuffer>
+#include <QDataStream>
+#include <QTextStream>
+#include <QXmlStreamWriter>
+#include <QCryptographicHash>
+#include <QDomElement>
+#include <QDomNamedNodeMap>
+#include <QDomAttr>
+#include <QByteArray>
+#include <QtGlobal>
+#include <map>
+#include <set>
+#include <assert.h>
+
+/*
+ * File layout, all numbers being little endian:
+ *
+ * Header:
+ *   quint32 FILE_MAGIC
+ *   quint32 FORMAT_VERSION
+ * Records, back to back, each being a piece of UTF-8 XML compressed
+ * by qCompress().
+ * Index:
+ *   Record entry of the project document.
+ *   quint32 The number of filters.
+ *   For each filter:
+ *     QString The tag name of the filter element.
+ *     Record entry of the head.
+ *     quint32 The number of chunks.
+ *     Record entry of each chunk.
+ * Record entry:
+ *   quint64 The offset of the record.
+ *   quint32 The size of the record.
+ *   QByteArray The MD5 digest of the uncompressed record.
+ * Trailer:
+ *   quint64 The offset of the index.
+ *   quint32 FILE_MAGIC
+ *
+ * The head of a filter is "<filters><tag attributes...>", and its chunks
+ * are its child nodes.  Appending "</tag></filters>" to them gives
+ * a document with the filter's settings.
+ */
+
+namespace
+{
+
+quint32 const FILE_MAGIC = 0x50505453; // "STPP"
+quint32 const FORMAT_VERSION = 1;
+qint64 const HEADER_SIZE = 8;
+qint64 const TRAILER_SIZE = 12;
+
+/**
+ * The number of child nodes of a filter element stored in a single record.
+ * Filters have one child per page, so this is also the granularity at which
+ * compressed settings are reused on the next save.  Chunks are cut by
+ * position, which is fine as long as the pages keep their numeric IDs.
+ */
+int const NODES_PER_CHUNK = 64;
+
+struct Record
+{
+    qint64 offset;
+    quint32 size;
+    QByteArray digest;
+
+    Record() : offset(0), size(0) {}
+};
+
+struct FilterRecords
+{
+    QString tagName;
+    Record head;
+    std::vector<Record> chunks;
+};
+
+struct Index
+{
+    Record project;
+    std::vector<FilterRecords> filters;
+};
+
+void setupStream(QDataStream& strm)
+{
+    strm.setVersion(QDataStream::Qt_5_0);
+    strm.setByteOrder(QDataStream::LittleEndian);
+}
+
+QDataStream& operator<<(QDataStream& strm, Record const& record)
+{
+    return strm << quint64(record.offset) << record.size << record.digest;
+}
+
+QDataStream& operator>>(QDataStream& strm, Record& record)
+{
+    quint64 offset = 0;
+    strm >> offset >> record.size >> record.digest;
+    record.offset = offset;
+    return strm;
+}
+
+bool isBinary(QIODevice& device)
+{
+    QDataStream strm(&device);
+    setupStream(strm);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    strm >> magic >> version;
+    return strm.status() == QDataStream::Ok
+           && magic == FILE_MAGIC && version == FORMAT_VERSION;
+}
+
+bool isValidRecord(Record const& record, qint64 const index_offset)
+{
+    return record.offset >= HEADER_SIZE
+           && record.offset + record.size <= index_offset;
+}
+
+/**
+ * Reads the index of a binary file, which has to be open for reading.
+ */
+bool readIndex(QIODevice& device, Index& index)
+{
+    qint64 const file_size = device.size();
+    if (file_size < HEADER_SIZE + TRAILER_SIZE || !device.seek(file_size - TRAILER_SIZE)) {
+        return false;
+    }
+
+    QDataStream strm(&device);
+    setupStream(strm);
+
+    quint64 index_offset = 0;
+    quint32 magic = 0;
+    strm >> index_offset >> magic;
+    if (strm.status() != QDataStream::Ok || magic != FILE_MAGIC
+            || index_offset < quint64(HEADER_SIZE)
+            || index_offset > quint64(file_size - TRAILER_SIZE)
+            || !device.seek(index_offset)) {
+        return false;
+    }
+
+    quint32 num_filters = 0;
+    strm >> index.project >> num_filters;
+    if (strm.status() != QDataStream::Ok || !isValidRecord(index.project, index_offset)) {
+        return false;
+    }
+
+    for (quint32 i = 0; i < num_filters; ++i) {
+        index.filters.push_back(FilterRecords());
+        FilterRecords& filter = index.filters.back();
+
+        quint32 num_chunks = 0;
+        strm >> filter.tagName >> filter.head >> num_chunks;
+        if (strm.status() != QDataStream::Ok || !isValidRecord(filter.head, index_offset)) {
+            return false;
+        }
+
+        for (quint32 j = 0; j < num_chunks; ++j) {
+            Record chunk;
+            strm >> chunk;
+            if (strm.status() != QDataStream::Ok || !isValidRecord(chunk, index_offset)) {
+                return false;
+            }
+            filter.chunks.push_back(chunk);
+        }
+    }
+
+    return true;
+}
+
+void collectRecords(Index& index, std::vector<Record*>& records)
+{
+    records.push_back(&index.project);
+    for (FilterRecords& filter : index.filters) {
+        records.push_back(&filter.head);
+        for (Record& chunk : filter.chunks) {
+            records.push_back(&chunk);
+        }
+    }
+}
+
+QByteArray digestOf(QByteArray const& data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5);
+}
+
+/**
+ * Returns the uncompressed record, or a null array if it's broken.
+ */
+QByteArray unpackRecord(QByteArray const& file_data, Record const& record)
+{
+    QByteArray const data(
+        qUncompress(
+            reinterpret_cast<uchar const*>(file_data.constData() + record.offset),
+            record.size
+        )
+    );
+    if (data.isEmpty() || digestOf(data) != record.digest) {
+        return QByteArray();
+    }
+
+    return data;
+}
+
+QByteArray headOf(QDomElement const& filter_el)
+{
+    QByteArray head;
+    QXmlStreamWriter writer(&head);
+    writer.writeStartElement("filters");
+    if (!filter_el.isNull()) {
+        writer.writeStartElement(filter_el.tagName());
+        QDomNamedNodeMap const attrs(filter_el.attributes());
+        for (int i = 0; i < attrs.count(); ++i) {
+            QDomAttr const attr(attrs.item(i).toAttr());
+            writer.writeAttribute(attr.name(), attr.value());
+        }
+    }
+    // Closes the start tag without closing the element.
+    writer.writeCharacters(QString());
+    return head;
+}
+
+QByteArray tailOf(QString const& tag_name)
+{
+    QByteArray tail;
+    if (!tag_name.isEmpty()) {
+        tail += "</" + tag_name.toUtf8() + ">";
+    }
+    tail += "</filters>";
+    return tail;
+}
+
+std::vector<QByteArray> chunksOf(QDomElement const& filter_el)
+{
+    std::vector<QByteArray> chunks;
+
+    QDomNode node(filter_el.firstChild());
+    while (!node.isNull()) {
+        QByteArray chunk;
+        {
+            QTextStream strm(&chunk, QIODevice::WriteOnly);
+            strm.setCodec("UTF-8");
+            for (int i = 0; i < NODES_PER_CHUNK && !node.isNull(); ++i) {
+                node.save(strm, -1);
+                node = node.nextSibling();
+            }
+        }
+        chunks.push_back(chunk);
+    }
+
+    return chunks;
+}
+
+/**
+ * Reads the compressed records of an existing binary file,
+ * whose digests are in \p wanted.
+ */
+std::map<QByteArray, QByteArray>
+readReusableRecords(QString const& file_path, std::set<QByteArray> const& wanted)
+{
+    std::map<QByteArray, QByteArray> reusable;
+
+    QFile file(file_path);
+    if (!file.open(QIODevice::ReadOnly) || !isBinary(file)) {
+        return reusable;
+    }
+
+    Index index;
+    if (!readIndex(file, index)) {
+        return reusable;
+    }
+
+    std::vector<Record*> records;
+    collectRecords(index, records);
+    for (Record const* record : records) {
+        if (wanted.count(record->digest) == 0 || reusable.count(record->digest) != 0) {
+            continue;
+        }
+        if (!file.seek(record->offset)) {
+            break;
+        }
+        QByteArray const data(file.read(record->size));
+        if (data.size() != int(record->size)) {
+            break;
+        }
+        reusable[record->digest] = data;
+    }
+
+    return reusable;
+}
+
+} // anonymous namespace
+
+bool
+ProjectFile::binaryFormatEnabled()
+{
+    return QSettings().value(_key_project_binary_format, _key_project_binary_format_def).toBool();
+}
+
+bool
+ProjectFile::read(QString const& file_path, QDomDocument& project_doc,
+                  std::vector<QDomDocument>& filter_docs)
+{
+    filter_docs.clear();
+
+    QFile file(file_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray const file_data(file.readAll());
+    file.close();
+
+    QBuffer buffer;
+    buffer.setData(file_data);
+    buffer.open(QIODevice::ReadOnly);
+    if (!isBinary(buffer)) {
+        return project_doc.setContent(file_data);
+    }
+
+    Index index;
+    if (!readIndex(buffer, index)) {
+        return false;
+    }
+
+    std::vector<Record*> records;
+    collectRecords(index, records);
+    int const num_records = records.size();
+    std::vector<QByteArray> contents(num_records);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_records; ++i) {
+        contents[i] = unpackRecord(file_data, *records[i]);
+    }
+
+    for (QByteArray const& content : contents) {
+        if (content.isNull()) {
+            return false;
+        }
+    }
+
+    if (!project_doc.setContent(contents[0])) {
+        return false;
+    }
+
+    int const num_filters = index.filters.size();
+    std::vector<QByteArray> filter_xml(num_filters);
+    int next_record = 1;
+    for (int i = 0; i < num_filters; ++i) {
+        FilterRecords const& filter = index.filters[i];
+        int const end_record = next_record + 1 + filter.chunks.size();
+        for (; next_record < end_record; ++next_record) {
+            filter_xml[i] += contents[next_record];
+        }
+        filter_xml[i] += tailOf(filter.tagName);
+    }
+    contents.clear();
+
+    filter_docs.resize(num_filters);
+    std::vector<char> parsed(num_filters, 0);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_filters; ++i) {
+        parsed[i] = filter_docs[i].setContent(filter_xml[i]);
+    }
+
+    for (char const ok : parsed) {
+        if (!ok) {
+            filter_docs.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+ProjectFile::writeXml(QString const& file_path, QDomDocument const& project_doc)
+{
+    AtomicFileOverwriter overwriter;
+    QIODevice* const device = overwriter.startWriting(file_path);
+    if (!device) {
+        return false;
+    }
+
+    {
+        QTextStream strm(device);
+        project_doc.save(strm, 2);
+        strm.flush();
+        if (strm.status() != QTextStream::Ok) {
+            overwriter.abort();
+            return false;
+        }
+    }
+
+    return overwriter.commit();
+}
+
+bool
+ProjectFile::writeBinary(QString const& file_path, QDomDocument const& project_doc,
+                         std::vector<QDomDocument> const& filter_docs)
+{
+    int const num_filters = filter_docs.size();
+    Index index;
+    index.filters.resize(num_filters);
+    std::vector<QByteArray> heads(num_filters);
+    std::vector<std::vector<QByteArray> > chunks(num_filters);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_filters; ++i) {
+        QDomElement const filter_el(filter_docs[i].documentElement().firstChildElement());
+        index.filters[i].tagName = filter_el.tagName();
+        heads[i] = headOf(filter_el);
+        chunks[i] = chunksOf(filter_el);
+        index.filters[i].chunks.resize(chunks[i].size());
+    }
+
+    QByteArray const project_data(project_doc.toByteArray(-1));
+
+    std::vector<Record*> records;
+    collectRecords(index, records);
+    std::vector<QByteArray const*> contents;
+    contents.push_back(&project_data);
+    for (int i = 0; i < num_filters; ++i) {
+        contents.push_back(&heads[i]);
+        for (QByteArray const& chunk : chunks[i]) {
+            contents.push_back(&chunk);
+        }
+    }
+    assert(contents.size() == records.size());
+    int const num_records = records.size();
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_records; ++i) {
+        records[i]->digest = digestOf(*contents[i]);
+    }
+
+    std::set<QByteArray> wanted;
+    for (Record const* record : records) {
+        wanted.insert(record->digest);
+    }
+
+    // Records that are already in the file we are replacing
+    // don't have to be compressed again.
+    std::map<QByteArray, QByteArray> const reusable(readReusableRecords(file_path, wanted));
+
+    std::vector<QByteArray> packed(num_records);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_records; ++i) {
+        std::map<QByteArray, QByteArray>::const_iterator const it(
+            reusable.find(records[i]->digest)
+        );
+        if (it != reusable.end()) {
+            packed[i] = it->second;
+        } else {
+            packed[i] = qCompress(*contents[i], 1);
+        }
+    }
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* const device = overwriter.startWriting(file_path);
+    if (!device) {
+        return false;
+    }
+
+    QDataStream strm(device);
+    setupStream(strm);
+    strm << FILE_MAGIC << FORMAT_VERSION;
+
+    qint64 offset = HEADER_SIZE;
+    for (int i = 0; i < num_records; ++i) {
+        records[i]->offset = offset;
+        records[i]->size = packed[i].size();
+        strm.writeRawData(packed[i].constData(), packed[i].size());
+        offset += packed[i].size();
+    }
+
+    strm << index.project << quint32(num_filters);
+    for (FilterRecords const& filter : index.filters) {
+        strm << filter.tagName << filter.head << quint32(filter.chunks.size());
+        for (Record const& chunk : filter.chunks) {
+            strm << chunk;
+        }
+    }
+    strm << quint64(offset) << FILE_MAGIC;
+
+    if (strm.status() != QDataStream::Ok) {
+        overwriter.abort();
+        return false;
+    }
+
+    return overwriter.commit();
+}
@@ -0,0 +1,84 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROJECTFILE_H_
+#define PROJECTFILE_H_
+
+#include <QDomDocument>
+#include <QString>
+#include <vector>
+
+/**
+ * \brief Reads and writes project files in either the XML or the
+ *        binary format.
+ *
+ * The binary format holds the same XML, split into records and compressed.
+ * The project structure (files, images, pages) is one record.  The settings
+ * of each filter are split into a head record, having the filter element
+ * without its children, and records of a few dozens of its per-page
+ * elements each.  An index at the end of the file locates the records.
+ *
+ * Reading isn't lazy: all the records are decompressed when the project
+ * is opened, but each filter's settings are a separate document, so the
+ * filters are parsed in parallel.
+ *
+ * Writing still serializes the whole project.  When a binary file is
+ * overwritten, the records found in it with the same content are copied
+ * over as is rather than compressed again, which saves most of the cost
+ * of compression when few pages changed.  Pages are numbered anew on every
+ * save though, so adding or removing a page changes the records of all
+ * the pages after it.
+ */
+class ProjectFile
+{
+public:
+    /**
+     * \brief Tells whether projects are to be saved in the binary format.
+     */
+    static bool binaryFormatEnabled();
+
+    /**
+     * \brief Reads a project file in either format.
+     *
+     * \param project_doc Receives the project document.
+     * \param filter_docs For a binary file, receives a document per filter,
+     *        in the order they were saved, each having a "filters" root
+     *        element with the filter's element in it.  For an XML file,
+     *        it's left empty, as the filter settings are in \p project_doc.
+     * \return false if the file couldn't be read or is broken.
+     */
+    static bool read(QString const& file_path, QDomDocument& project_doc,
+                     std::vector<QDomDocument>& filter_docs);
+
+    /**
+     * \brief Writes a project in the XML format, replacing the file atomically.
+     */
+    static bool writeXml(QString const& file_path, QDomDocument const& project_doc);
+
+    /**
+     * \brief Writes a project in the binary format, replacing the file atomically.
+     *
+     * \param project_doc The project document.  Its "filters" element,
+     *        if any, is expected to be empty.
+     * \param filter_docs A document per filter, as returned by read().
+     */
+    static bool writeBinary(QString const& file_path, QDomDocument const& project_doc,
+                            std::vector<QDomDocument> const& filter_docs);
+};
+
+#endif
@@ -31,8 +31,10 @@
 #endif
 #include <set>
 
-ProjectReader::ProjectReader(QDomDocument const& doc)
+ProjectReader::ProjectReader(
+    QDomDocument const& doc, std::vector<QDomDocument> const& filter_docs)
     :   m_doc(doc),
+        m_filterDocs(filter_docs),
         m_ptrDisambiguator(new FileNameDisambiguator)
 {
     QDomElement project_el(m_doc.documentElement());
@@ -85,8 +87,24 @@ ProjectReader::~ProjectReader()
 void
 ProjectReader::readFilterSettings(std::vector<FilterPtr> const& filters) const
 {
-    QDomElement project_el(m_doc.documentElement());
-    QDomElement filters_el(project_el.namedItem("filters").toElement());
+    QDomDocument merged_doc;
+    QDomElement filters_el;
+    if (m_filterDocs.empty()) {
+        QDomElement project_el(m_doc.documentElement());
+        filters_el = project_el.namedItem("filters").toElement();
+    } else {
+        // Filters look up their settings by tag name, and the set of
+        // filters may have changed since the project was saved, so we
+        // put all of them together rather than going by position.
+        filters_el = merged_doc.createElement("filters");
+        merged_doc.appendChild(filters_el);
+        for (QDomDocument const& filter_doc : m_filterDocs) {
+            QDomElement const filter_el(filter_doc.documentElement().firstChildElement());
+            if (!filter_el.isNull()) {
+                filters_el.appendChild(merged_doc.importNode(filter_el, true));
+            }
+        }
+    }
 
     std::vector<FilterPtr>::const_iterator it(filters.begin());
     std::vector<FilterPtr>::const_iterator const end(filters.end());
@@ -42,7 +42,14 @@ class ProjectReader
 public:
     typedef IntrusivePtr<AbstractFilter> FilterPtr;
 
-    ProjectReader(QDomDocument const& doc);
+    /**
+     * \param doc The project document.
+     * \param filter_docs The per-filter documents of a binary project,
+     *        as returned by ProjectFile::read().  Empty for an XML project,
+     *        whose filter settings are in \p doc.
+     */
+    ProjectReader(QDomDocument const& doc,
+                  std::vector<QDomDocument> const& filter_docs = std::vector<QDomDocument>());
 
     ~ProjectReader();
 
@@ -117,6 +124,7 @@ private:
     ImageInfo getImageInfo(int id) const;
 
     QDomDocument m_doc;
+    std::vector<QDomDocument> m_filterDocs;
     QString m_outDir;
     QString m_inputDir;
     DirMap m_dirMap;
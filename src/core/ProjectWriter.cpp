@@ -25,10 +25,9 @@
 #include "ImageMetadata.h"
 #include "AbstractFilter.h"
 #include "FileNameDisambiguator.h"
+#include "ProjectFile.h"
 #include "version.h"
 #include <QtXml>
-#include <QFile>
-#include <QTextStream>
 #include <QFileInfo>
 #ifndef Q_MOC_RUN
 #include <boost/bind.hpp>
@@ -79,6 +78,12 @@ ProjectWriter::~ProjectWriter()
 
 bool
 ProjectWriter::write(QString const& file_path, std::vector<FilterPtr> const& filters) const
+{
+    return snapshot(filters).write(file_path);
+}
+
+ProjectWriter::Snapshot
+ProjectWriter::snapshot(std::vector<FilterPtr> const& filters) const
 {
 
 #if QT_VERSION > 0x050600
@@ -86,6 +91,39 @@ ProjectWriter::write(QString const& file_path, std::vector<FilterPtr> const& fil
     qSetGlobalQHashSeed(21062018);
 #endif
 
+    Snapshot snapshot;
+    snapshot.m_binary = ProjectFile::binaryFormatEnabled();
+    snapshot.m_projectDoc = buildProjectDocument();
+
+    QDomDocument& doc = snapshot.m_projectDoc;
+    QDomElement filters_el(doc.documentElement().namedItem("filters").toElement());
+
+    // In the binary format, each filter has a document of its own,
+    // so that they can be serialized and parsed independently.
+    std::vector<FilterPtr>::const_iterator it(filters.begin());
+    std::vector<FilterPtr>::const_iterator const end(filters.end());
+    for (; it != end; ++it) {
+        if (snapshot.m_binary) {
+            QDomDocument filter_doc;
+            QDomElement filter_root_el(filter_doc.createElement("filters"));
+            filter_doc.appendChild(filter_root_el);
+            filter_root_el.appendChild((*it)->saveSettings(*this, filter_doc));
+            snapshot.m_filterDocs.push_back(filter_doc);
+        } else {
+            filters_el.appendChild((*it)->saveSettings(*this, doc));
+        }
+    }
+
+#if QT_VERSION > 0x050600
+    qSetGlobalQHashSeed(-1);
+#endif
+
+    return snapshot;
+}
+
+QDomDocument
+ProjectWriter::buildProjectDocument() const
+{
     QDomDocument doc;
     QDomElement root_el(doc.createElement("project"));
     doc.appendChild(root_el);
@@ -110,27 +148,9 @@ ProjectWriter::write(QString const& file_path, std::vector<FilterPtr> const& fil
             boost::bind(&ProjectWriter::packFilePath, this, _1)
         )
     );
+    root_el.appendChild(doc.createElement("filters"));
 
-    QDomElement filters_el(doc.createElement("filters"));
-    root_el.appendChild(filters_el);
-    std::vector<FilterPtr>::const_iterator it(filters.begin());
-    std::vector<FilterPtr>::const_iterator const end(filters.end());
-    for (; it != end; ++it) {
-        filters_el.appendChild((*it)->saveSettings(*this, doc));
-    }
-
-#if QT_VERSION > 0x050600
-    qSetGlobalQHashSeed(-1);
-#endif
-
-    QFile file(file_path);
-    if (file.open(QIODevice::WriteOnly)) {
-        QTextStream strm(&file);
-        doc.save(strm, 2);
-        return true;
-    }
-
-    return false;
+    return doc;
 }
 
 QDomElement
@@ -316,3 +336,16 @@ ProjectWriter::Image::Image(PageInfo const& page, int numeric_id)
         rightHalfRemoved(page.rightHalfRemoved())
 {
 }
+
+
+/*========================= ProjectWriter::Snapshot =========================*/
+
+bool
+ProjectWriter::Snapshot::write(QString const& file_path) const
+{
+    if (m_binary) {
+        return ProjectFile::writeBinary(file_path, m_projectDoc, m_filterDocs);
+    } else {
+        return ProjectFile::writeXml(file_path, m_projectDoc);
+    }
+}
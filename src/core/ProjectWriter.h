@@ -33,6 +33,7 @@
 #include <boost/multi_index/member.hpp>
 #endif
 #include <QString>
+#include <QDomDocument>
 #include <Qt>
 #include <vector>
 #include <map>
@@ -40,7 +41,6 @@
 class AbstractFilter;
 class ProjectPages;
 class PageInfo;
-class QDomDocument;
 class QDomElement;
 
 class ProjectWriter
@@ -56,8 +56,40 @@ public:
 
     ~ProjectWriter();
 
+    /**
+     * \brief The project, captured as documents.
+     *
+     * A snapshot doesn't refer to the filters' settings, so it
+     * may be written from any thread.
+     */
+    class Snapshot
+    {
+    public:
+        Snapshot() : m_binary(false) {}
+
+        /**
+         * \brief Writes the project in the format that was selected
+         *        when the snapshot was taken, replacing the file atomically.
+         */
+        bool write(QString const& file_path) const;
+    private:
+        friend class ProjectWriter;
+
+        QDomDocument m_projectDoc;
+        std::vector<QDomDocument> m_filterDocs;
+        bool m_binary;
+    };
+
     bool write(QString const& file_path, std::vector<FilterPtr> const& filters) const;
 
+    /**
+     * \brief Captures the project and the settings of \p filters.
+     *
+     * Like write(), this has to be called from the thread
+     * that owns the filters.
+     */
+    Snapshot snapshot(std::vector<FilterPtr> const& filters) const;
+
     /**
      * \p out will be called like this: out(ImageId, numeric_image_id)
      */
@@ -148,6 +180,11 @@ private:
     >
     > Pages;
 
+    /**
+     * Builds the project document with an empty "filters" element.
+     */
+    QDomDocument buildProjectDocument() const;
+
     QDomElement processDirectories(QDomDocument& doc) const;
 
     QDomElement processFiles(QDomDocument& doc) const;
@@ -49,6 +49,11 @@ public:
 
     virtual void paint(QPainter* painter,
                        QStyleOptionGraphicsItem const* option, QWidget* widget);
+
+    ImageId const& imageId() const
+    {
+        return m_imageId;
+    }
 protected:
     /**
      * \brief A hook to allow subclasses to draw over the thumbnail.
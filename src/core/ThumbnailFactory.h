@@ -41,6 +41,11 @@ public:
     virtual ~ThumbnailFactory();
 
     std::unique_ptr<QGraphicsItem> get(PageInfo const& page_info);
+
+    IntrusivePtr<ThumbnailPixmapCache> const& pixmapCache() const
+    {
+        return m_ptrPixmapCache;
+    }
 private:
     class Collector;
 
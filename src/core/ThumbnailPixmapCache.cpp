@@ -19,21 +19,20 @@
 #include "ThumbnailPixmapCache.h"
 #include "ImageId.h"
 #include "ImageLoader.h"
-#include "AtomicFileOverwriter.h"
+#include "ThumbnailStore.h"
+#include "IntrusivePtr.h"
 #include "RelinkablePath.h"
 #include "OutOfMemoryHandler.h"
 #include "imageproc/Scale.h"
 #include "imageproc/GrayImage.h"
 #include <QCoreApplication>
-#include <QCryptographicHash>
 #include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 #include <QMutex>
 #include <QMutexLocker>
-#include <QFileInfo>
 #include <QDir>
-#include <QFile>
 #include <QString>
-#include <QChar>
 #include <QImage>
 #include <QPixmap>
 #include <QEvent>
@@ -107,7 +106,7 @@ private:
     Item& operator=(Item const& other); // Assignment is forbidden.
 };
 
-class ThumbnailPixmapCache::Impl : public QThread
+class ThumbnailPixmapCache::Impl : public QObject
 {
 public:
     Impl(QString const& thumb_dir, QSize const& max_thumb_size,
@@ -124,12 +123,15 @@ public:
     void ensureThumbnailExists(ImageId const& image_id, QImage const& image);
 
     void recreateThumbnail(ImageId const& image_id, QImage const& image);
-protected:
-    virtual void run();
 
+    void prefetch(std::vector<ImageId> const& image_ids);
+
+    void compactStore();
+protected:
     virtual void customEvent(QEvent* e);
 private:
     class LoadResultEvent;
+    class PrefetchResultEvent;
     class ItemsByKeyTag;
     class LoadQueueTag;
     class RemoveQueueTag;
@@ -147,24 +149,48 @@ private:
     typedef Container::index<LoadQueueTag>::type LoadQueue;
     typedef Container::index<RemoveQueueTag>::type RemoveQueue;
 
-    class BackgroundLoader : public QObject
+    class LoadWorker : public QRunnable
+    {
+    public:
+        LoadWorker(Impl& owner);
+
+        virtual void run();
+    private:
+        Impl& m_rOwner;
+    };
+
+    class PrefetchTask : public QRunnable
     {
     public:
-        BackgroundLoader(Impl& owner);
-    protected:
-        virtual void customEvent(QEvent* e);
+        PrefetchTask(Impl& owner, IntrusivePtr<ThumbnailStore> const& store,
+                     std::vector<ImageId> const& image_ids);
+
+        virtual void run();
     private:
         Impl& m_rOwner;
+        IntrusivePtr<ThumbnailStore> m_ptrStore;
+        std::vector<ImageId> m_imageIds;
+    };
+
+    class CompactTask : public QRunnable
+    {
+    public:
+        CompactTask(IntrusivePtr<ThumbnailStore> const& store);
+
+        virtual void run();
+    private:
+        IntrusivePtr<ThumbnailStore> m_ptrStore;
     };
 
+    void startWorkersLocked();
+
     void backgroundProcessing();
 
     static QImage loadSaveThumbnail(
-        ImageId const& image_id, QString const& thumb_dir,
+        ImageId const& image_id, IntrusivePtr<ThumbnailStore> const& store,
         QSize const& max_thumb_size);
 
-    static QString getThumbFilePath(
-        ImageId const& image_id, QString const& thumb_dir);
+    static IntrusivePtr<ThumbnailStore> createStore(QString const& thumb_dir);
 
     static QImage makeThumbnail(
         QImage const& image, QSize const& max_thumb_size);
@@ -177,6 +203,8 @@ private:
 
     void processLoadResult(LoadResultEvent* result);
 
+    void processPrefetchResult(PrefetchResultEvent* result);
+
     void removeExcessLocked();
 
     void removeItemLocked(RemoveQueue::iterator const& it);
@@ -186,7 +214,7 @@ private:
     void cachePixmapLocked(ImageId const& image_id, QPixmap const& pixmap);
 
     mutable QMutex m_mutex;
-    BackgroundLoader m_backgroundLoader;
+    QThreadPool m_threadPool;
     Container m_items;
     ItemsByKey& m_itemsByKey; /**< ImageId => Item mapping */
 
@@ -215,6 +243,7 @@ private:
     RemoveQueue::iterator m_endOfLoadedItems;
 
     QString m_thumbDir;
+    IntrusivePtr<ThumbnailStore> m_ptrStore;
     QSize m_maxThumbSize;
     int m_maxCachedPixmaps;
 
@@ -232,7 +261,14 @@ private:
      */
     int m_totalLoadAttempts;
 
-    bool m_threadStarted;
+    /**
+     * The number of LoadWorker objects started and not yet finished.
+     * Each of them loads thumbnails one by one until it runs out of
+     * QUEUED items.
+     */
+    int m_numActiveWorkers;
+    int m_maxWorkers;
+
     bool m_shuttingDown;
 };
 
@@ -269,6 +305,26 @@ private:
     ThumbnailLoadResult::Status m_status;
 };
 
+class ThumbnailPixmapCache::Impl::PrefetchResultEvent : public QEvent
+{
+public:
+    PrefetchResultEvent(std::vector<ImageId> const& image_ids,
+                        std::vector<QImage> const& thumbnails);
+
+    std::vector<ImageId> const& imageIds() const
+    {
+        return m_imageIds;
+    }
+
+    std::vector<QImage> const& thumbnails() const
+    {
+        return m_thumbnails;
+    }
+private:
+    std::vector<ImageId> m_imageIds;
+    std::vector<QImage> m_thumbnails;
+};
+
 /*========================== ThumbnailPixmapCache ===========================*/
 
 ThumbnailPixmapCache::ThumbnailPixmapCache(
@@ -327,25 +383,38 @@ ThumbnailPixmapCache::recreateThumbnail(
     m_ptrImpl->recreateThumbnail(image_id, image);
 }
 
+void
+ThumbnailPixmapCache::prefetch(std::vector<ImageId> const& image_ids)
+{
+    m_ptrImpl->prefetch(image_ids);
+}
+
+void
+ThumbnailPixmapCache::compactStore()
+{
+    m_ptrImpl->compactStore();
+}
+
 /*======================= ThumbnailPixmapCache::Impl ========================*/
 
 ThumbnailPixmapCache::Impl::Impl(
     QString const& thumb_dir, QSize const& max_thumb_size,
     int const max_cached_pixmaps, int const expiration_threshold)
-    :   m_backgroundLoader(*this),
-        m_items(),
+    :   m_items(),
         m_itemsByKey(m_items.get<ItemsByKeyTag>()),
         m_loadQueue(m_items.get<LoadQueueTag>()),
         m_removeQueue(m_items.get<RemoveQueueTag>()),
         m_endOfLoadedItems(m_removeQueue.end()),
         m_thumbDir(thumb_dir),
+        m_ptrStore(createStore(thumb_dir)),
         m_maxThumbSize(max_thumb_size),
         m_maxCachedPixmaps(max_cached_pixmaps),
         m_expirationThreshold(expiration_threshold),
         m_numQueuedItems(0),
         m_numLoadedItems(0),
         m_totalLoadAttempts(0),
-        m_threadStarted(false),
+        m_numActiveWorkers(0),
+        m_maxWorkers(qBound(1, QThread::idealThreadCount(), 8)),
         m_shuttingDown(false)
 {
     // Note that QDir::mkdir() will fail if the parent directory,
@@ -354,23 +423,18 @@ ThumbnailPixmapCache::Impl::Impl(
     // a whole bunch of bogus directories would be created.
     QDir().mkdir(m_thumbDir);
 
-    m_backgroundLoader.moveToThread(this);
+    m_threadPool.setMaxThreadCount(m_maxWorkers);
 }
 
 ThumbnailPixmapCache::Impl::~Impl()
 {
     {
         QMutexLocker const locker(&m_mutex);
-
-        if (!m_threadStarted) {
-            return;
-        }
-
         m_shuttingDown = true;
     }
 
-    quit();
-    wait();
+    // Workers finish the thumbnail they are loading and exit.
+    m_threadPool.waitForDone();
 }
 
 void
@@ -383,6 +447,7 @@ ThumbnailPixmapCache::Impl::setThumbDir(QString const& thumb_dir)
     }
 
     m_thumbDir = thumb_dir;
+    m_ptrStore = createStore(thumb_dir);
 
     for (Item const& item : m_loadQueue) {
         // This trick will make all queued tasks to expire.
@@ -425,13 +490,13 @@ ThumbnailPixmapCache::Impl::request(
     }
 
     if (load_now) {
-        QString const thumb_dir(m_thumbDir);
+        IntrusivePtr<ThumbnailStore> const store(m_ptrStore);
         QSize const max_thumb_size(m_maxThumbSize);
 
         locker.unlock();
 
         pixmap = QPixmap::fromImage(
-                     loadSaveThumbnail(image_id, thumb_dir, max_thumb_size)
+                     loadSaveThumbnail(image_id, store, max_thumb_size)
                  );
         if (pixmap.isNull()) {
             return LOAD_FAILED;
@@ -481,18 +546,8 @@ ThumbnailPixmapCache::Impl::request(
     }
     lq_it->completionHandlers.push_back(*completion_handler);
 
-    if (m_numQueuedItems++ == 0) {
-        if (m_threadStarted) {
-            // Wake the background thread up.
-            QCoreApplication::postEvent(
-                &m_backgroundLoader, new QEvent(QEvent::User)
-            );
-        } else {
-            // Start the background thread.
-            start();
-            m_threadStarted = true;
-        }
-    }
+    ++m_numQueuedItems;
+    startWorkersLocked();
 
     return QUEUED;
 }
@@ -510,22 +565,15 @@ ThumbnailPixmapCache::Impl::ensureThumbnailExists(
     }
 
     QMutexLocker locker(&m_mutex);
-    QString const thumb_dir(m_thumbDir);
+    IntrusivePtr<ThumbnailStore> const store(m_ptrStore);
     QSize const max_thumb_size(m_maxThumbSize);
     locker.unlock();
 
-    QString const thumb_file_path(getThumbFilePath(image_id, thumb_dir));
-    if (QFile::exists(thumb_file_path)) {
+    if (store->contains(image_id)) {
         return;
     }
 
-    QImage const thumbnail(makeThumbnail(image, max_thumb_size));
-
-    AtomicFileOverwriter overwriter;
-    QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-    if (iodev && thumbnail.save(iodev, "PNG")) {
-        overwriter.commit();
-    }
+    store->save(image_id, makeThumbnail(image, max_thumb_size));
 }
 
 void
@@ -541,24 +589,13 @@ ThumbnailPixmapCache::Impl::recreateThumbnail(
     }
 
     QMutexLocker locker(&m_mutex);
-    QString const thumb_dir(m_thumbDir);
+    IntrusivePtr<ThumbnailStore> const store(m_ptrStore);
     QSize const max_thumb_size(m_maxThumbSize);
     locker.unlock();
 
-    QString const thumb_file_path(getThumbFilePath(image_id, thumb_dir));
-    QImage const thumbnail(makeThumbnail(image, max_thumb_size));
-    bool thumb_written = false;
-
-    // Note that we may be called from multiple threads at the same time.
-    AtomicFileOverwriter overwriter;
-    QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-    if (iodev && thumbnail.save(iodev, "PNG")) {
-        thumb_written = overwriter.commit();
-    } else {
-        overwriter.abort();
-    }
-
-    if (!thumb_written) {
+    // Note that we may be called from multiple threads at the same time,
+    // which ThumbnailStore takes care of.
+    if (!store->save(image_id, makeThumbnail(image, max_thumb_size))) {
         return;
     }
 
@@ -588,16 +625,77 @@ ThumbnailPixmapCache::Impl::recreateThumbnail(
 }
 
 void
-ThumbnailPixmapCache::Impl::run()
+ThumbnailPixmapCache::Impl::prefetch(std::vector<ImageId> const& image_ids)
+{
+    assert(QCoreApplication::instance()->thread() == QThread::currentThread());
+
+    std::vector<ImageId> wanted;
+    IntrusivePtr<ThumbnailStore> store;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        if (m_shuttingDown) {
+            return;
+        }
+
+        for (ImageId const& image_id : image_ids) {
+            // More than that would push each other out of the cache.
+            if (int(wanted.size()) >= m_maxCachedPixmaps) {
+                break;
+            }
+
+            ItemsByKey::iterator const k_it(m_itemsByKey.find(image_id));
+            if (k_it == m_itemsByKey.end() || k_it->status == Item::QUEUED) {
+                wanted.push_back(image_id);
+            }
+        }
+
+        store = m_ptrStore;
+    }
+
+    if (wanted.empty()) {
+        return;
+    }
+
+    // Reading and decoding them would stall the GUI thread.
+    m_threadPool.start(new PrefetchTask(*this, store, wanted));
+}
+
+void
+ThumbnailPixmapCache::Impl::compactStore()
 {
-    backgroundProcessing();
-    exec(); // Wait for further processing requests (via custom events).
+    QMutexLocker const locker(&m_mutex);
+
+    if (m_shuttingDown) {
+        return;
+    }
+
+    // The destructor waits for the thread pool, so compaction
+    // is finished before the application exits.
+    m_threadPool.start(new CompactTask(m_ptrStore));
 }
 
 void
 ThumbnailPixmapCache::Impl::customEvent(QEvent* e)
 {
-    processLoadResult(dynamic_cast<LoadResultEvent*>(e));
+    if (PrefetchResultEvent* result = dynamic_cast<PrefetchResultEvent*>(e)) {
+        processPrefetchResult(result);
+    } else {
+        processLoadResult(dynamic_cast<LoadResultEvent*>(e));
+    }
+}
+
+void
+ThumbnailPixmapCache::Impl::startWorkersLocked()
+{
+    // There is no point in having more workers than QUEUED items,
+    // as a worker exits once there is nothing for it to take.
+    while (m_numActiveWorkers < m_maxWorkers
+            && m_numActiveWorkers < m_numQueuedItems) {
+        ++m_numActiveWorkers;
+        m_threadPool.start(new LoadWorker(*this));
+    }
 }
 
 void
@@ -611,13 +709,14 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
             // We are going to initialize these while holding the mutex.
             LoadQueue::iterator lq_it;
             ImageId image_id;
-            QString thumb_dir;
+            IntrusivePtr<ThumbnailStore> store;
             QSize max_thumb_size;
 
             {
                 QMutexLocker const locker(&m_mutex);
 
                 if (m_shuttingDown || m_items.empty()) {
+                    --m_numActiveWorkers;
                     break;
                 }
 
@@ -629,6 +728,10 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
                     // in the load queue, so it means there are no
                     // QUEUED items at all.
                     assert(m_numQueuedItems == 0);
+
+                    // Doing it while holding the mutex guarantees
+                    // request() starts a new worker if necessary.
+                    --m_numActiveWorkers;
                     break;
                 }
 
@@ -656,12 +759,12 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
                 ++m_totalLoadAttempts;
 
                 // Copy those while holding the mutex.
-                thumb_dir = m_thumbDir;
+                store = m_ptrStore;
                 max_thumb_size = m_maxThumbSize;
             } // mutex scope
 
             QImage const image(
-                loadSaveThumbnail(image_id, thumb_dir, max_thumb_size)
+                loadSaveThumbnail(image_id, store, max_thumb_size)
             );
 
             ThumbnailLoadResult::Status const status = image.isNull()
@@ -676,55 +779,32 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
 
 QImage
 ThumbnailPixmapCache::Impl::loadSaveThumbnail(
-    ImageId const& image_id, QString const& thumb_dir,
+    ImageId const& image_id, IntrusivePtr<ThumbnailStore> const& store,
     QSize const& max_thumb_size)
 {
-    QString const thumb_file_path(getThumbFilePath(image_id, thumb_dir));
-
-    QImage image(ImageLoader::load(thumb_file_path, 0));
+    QImage image(store->load(image_id));
     if (!image.isNull()) {
         return image;
     }
 
-    image = ImageLoader::load(image_id);
+    // Decoding at a reduced resolution is much faster where supported.
+    image = ImageLoader::loadScaledDown(image_id, max_thumb_size);
     if (image.isNull()) {
         return QImage();
     }
 
     QImage const thumbnail(makeThumbnail(image, max_thumb_size));
-    thumbnail.save(thumb_file_path, "PNG");
+    store->save(image_id, thumbnail);
 
     return thumbnail;
 }
 
-QString
-ThumbnailPixmapCache::Impl::getThumbFilePath(
-    ImageId const& image_id, QString const& thumb_dir)
+IntrusivePtr<ThumbnailStore>
+ThumbnailPixmapCache::Impl::createStore(QString const& thumb_dir)
 {
-    // Because a project may have several files with the same name (from
-    // different directories), we add a hash of the original image path
-    // to the thumbnail file name.
-
-    QByteArray const orig_path_hash(
-        QCryptographicHash::hash(
-            image_id.filePath().toUtf8(), QCryptographicHash::Md5
-        ).toHex()
-    );
-    QString const orig_path_hash_str(
-        QLatin1String(orig_path_hash.data(), orig_path_hash.size())
-    );
-
-    QFileInfo const orig_img_path(image_id.filePath());
-    QString thumb_file_path(thumb_dir);
-    thumb_file_path += QChar('/');
-    thumb_file_path += orig_img_path.baseName();
-    thumb_file_path += QChar('_');
-    thumb_file_path += QString::number(image_id.zeroBasedPage());
-    thumb_file_path += QChar('_');
-    thumb_file_path += orig_path_hash_str;
-    thumb_file_path += QLatin1String(".png");
-
-    return thumb_file_path;
+    return IntrusivePtr<ThumbnailStore>(
+               new ThumbnailStore(thumb_dir + QLatin1String("/thumbnails.pack"))
+           );
 }
 
 QImage
@@ -851,6 +931,21 @@ ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
     }
 }
 
+void
+ThumbnailPixmapCache::Impl::processPrefetchResult(PrefetchResultEvent* result)
+{
+    assert(QCoreApplication::instance()->thread() == QThread::currentThread());
+
+    // Thumbnails that aren't in the store yet are left to the workers.
+    std::vector<ImageId> const& image_ids = result->imageIds();
+    std::vector<QImage> const& thumbnails = result->thumbnails();
+    for (size_t i = 0; i < image_ids.size(); ++i) {
+        if (!thumbnails[i].isNull()) {
+            cachePixmapUnlocked(image_ids[i], QPixmap::fromImage(thumbnails[i]));
+        }
+    }
+}
+
 void
 ThumbnailPixmapCache::Impl::removeExcessLocked()
 {
@@ -1010,15 +1105,61 @@ ThumbnailPixmapCache::Impl::LoadResultEvent::~LoadResultEvent()
 {
 }
 
-/*================== ThumbnailPixmapCache::BackgroundLoader =================*/
+/*================== ThumbnailPixmapCache::Impl::LoadWorker =================*/
 
-ThumbnailPixmapCache::Impl::BackgroundLoader::BackgroundLoader(Impl& owner)
+ThumbnailPixmapCache::Impl::LoadWorker::LoadWorker(Impl& owner)
     :   m_rOwner(owner)
 {
 }
 
 void
-ThumbnailPixmapCache::Impl::BackgroundLoader::customEvent(QEvent*)
+ThumbnailPixmapCache::Impl::LoadWorker::run()
 {
     m_rOwner.backgroundProcessing();
 }
+
+/*============= ThumbnailPixmapCache::Impl::PrefetchResultEvent =============*/
+
+ThumbnailPixmapCache::Impl::PrefetchResultEvent::PrefetchResultEvent(
+    std::vector<ImageId> const& image_ids, std::vector<QImage> const& thumbnails)
+    :   QEvent(QEvent::User),
+        m_imageIds(image_ids),
+        m_thumbnails(thumbnails)
+{
+}
+
+/*================= ThumbnailPixmapCache::Impl::PrefetchTask ================*/
+
+ThumbnailPixmapCache::Impl::PrefetchTask::PrefetchTask(
+    Impl& owner, IntrusivePtr<ThumbnailStore> const& store,
+    std::vector<ImageId> const& image_ids)
+    :   m_rOwner(owner),
+        m_ptrStore(store),
+        m_imageIds(image_ids)
+{
+}
+
+void
+ThumbnailPixmapCache::Impl::PrefetchTask::run()
+{
+    try {
+        std::vector<QImage> const thumbnails(m_ptrStore->load(m_imageIds));
+        QCoreApplication::postEvent(&m_rOwner, new PrefetchResultEvent(m_imageIds, thumbnails));
+    } catch (std::bad_alloc const&) {
+        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+    }
+}
+
+/*================= ThumbnailPixmapCache::Impl::CompactTask =================*/
+
+ThumbnailPixmapCache::Impl::CompactTask::CompactTask(
+    IntrusivePtr<ThumbnailStore> const& store)
+    :   m_ptrStore(store)
+{
+}
+
+void
+ThumbnailPixmapCache::Impl::CompactTask::run()
+{
+    m_ptrStore->compact();
+}
@@ -27,6 +27,7 @@
 #include <boost/weak_ptr.hpp>
 #endif
 #include <memory>
+#include <vector>
 
 class ImageId;
 class QImage;
@@ -49,6 +50,8 @@ public:
      *
      * \param thumb_dir The directory to store thumbnails in.  If the
      *        provided directory doesn't exist, it will be created.
+     *        Thumbnails are kept in a single file there.
+     *        \see ThumbnailStore
      * \param max_size The maximum width and height for thumbnails.
      *        The actual thumbnail size is going to depend on its aspect
      *        ratio, but it won't exceed the provided maximum.
@@ -145,6 +148,30 @@ public:
      * \note This function may be called from any thread, even concurrently.
      */
     void recreateThumbnail(ImageId const& image_id, QImage const& image);
+
+    /**
+     * \brief Loads the stored thumbnails of several images at once.
+     *
+     * Meant for the thumbnails that are about to be shown.  Reading them
+     * together is faster than requesting them one by one.  Thumbnails
+     * that weren't created yet are not loaded by this function.
+     * The reading is done in the background, and the thumbnails are
+     * put into the cache once the GUI thread gets to process the result.
+     *
+     * \note This function is to be called from the GUI thread only.
+     */
+    void prefetch(std::vector<ImageId> const& image_ids);
+
+    /**
+     * \brief Removes outdated thumbnails from the disk.
+     *
+     * Thumbnails are stored in a single file, which only grows until
+     * this function is called.  The file is rewritten in the background,
+     * and this function returns right away.
+     *
+     * \note This function may be called from any thread, even concurrently.
+     */
+    void compactStore();
 private:
     class Item;
     class Impl;
@@ -0,0 +1,517 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThumbnailStore.h"
+#include "AtomicFileOverwriter.h"
+#include <QMutexLocker>
+#include <QDataStream>
+#include <QByteArray>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QVector>
+#include <QImage>
+#include <QRgb>
+#include <algorithm>
+#include <string.h>
+
+/*
+ * File layout, all numbers being little endian:
+ *
+ * Header:
+ *   quint32 FILE_MAGIC
+ *   quint32 FORMAT_VERSION
+ *   quint32 The number of index entries.
+ *   quint32 Reserved, zero.
+ *   quint64 The end of the indexed part, where scanning for records starts.
+ * Index entry:
+ *   QString The path of the source image.
+ *   qint32  The page, as in ImageId::page().
+ *   qint64  The modification time of the source image, in milliseconds.
+ *   quint64 The offset of the payload.
+ *   quint32 The length of the payload.
+ * Record:
+ *   quint32 RECORD_MAGIC
+ *   QString, qint32, qint64 As in the index entry.
+ *   quint32 The length of the payload.
+ *   The payload.
+ * Payload:
+ *   quint32 Width.
+ *   quint32 Height.
+ *   quint32 QImage::Format
+ *   QVector<QRgb> The color table.
+ *   QByteArray The pixels, row by row, without padding, as by qCompress().
+ */
+
+namespace
+{
+
+quint32 const FILE_MAGIC = 0x50485453; // "STHP"
+quint32 const RECORD_MAGIC = 0x52485453; // "STHR"
+quint32 const FORMAT_VERSION = 1;
+qint64 const HEADER_SIZE = 24;
+quint32 const MAX_DIMENSION = 16384;
+
+void setupStream(QDataStream& strm)
+{
+    strm.setVersion(QDataStream::Qt_5_0);
+    strm.setByteOrder(QDataStream::LittleEndian);
+}
+
+QByteArray fileHeader(quint32 const num_indexed, qint64 const indexed_end)
+{
+    QByteArray header;
+    QDataStream strm(&header, QIODevice::WriteOnly);
+    setupStream(strm);
+    strm << FILE_MAGIC << FORMAT_VERSION << num_indexed << quint32(0) << quint64(indexed_end);
+    return header;
+}
+
+} // anonymous namespace
+
+ThumbnailStore::ThumbnailStore(QString const& file_path)
+    :   m_filePath(file_path),
+        m_file(file_path),
+        m_fileEnd(HEADER_SIZE),
+        m_garbageBytes(0),
+        m_numUnindexed(0)
+{
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+}
+
+QImage
+ThumbnailStore::load(ImageId const& image_id)
+{
+    qint64 const source_mtime = sourceMtime(image_id);
+    QByteArray payload;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        if (!openLocked()) {
+            return QImage();
+        }
+
+        Entry const* entry = findLocked(image_id, source_mtime);
+        if (!entry || !readPayloadLocked(*entry, payload)) {
+            return QImage();
+        }
+    }
+
+    return decodeImage(payload);
+}
+
+std::vector<QImage>
+ThumbnailStore::load(std::vector<ImageId> const& image_ids)
+{
+    std::vector<qint64> source_mtimes;
+    source_mtimes.reserve(image_ids.size());
+    for (ImageId const& image_id : image_ids) {
+        source_mtimes.push_back(sourceMtime(image_id));
+    }
+
+    std::vector<QByteArray> payloads(image_ids.size());
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        if (openLocked()) {
+            // Read in the file order, to avoid seeking back and forth.
+            std::vector<std::pair<Entry const*, size_t> > found;
+            for (size_t i = 0; i < image_ids.size(); ++i) {
+                if (Entry const* entry = findLocked(image_ids[i], source_mtimes[i])) {
+                    found.push_back(std::make_pair(entry, i));
+                }
+            }
+            std::sort(
+                found.begin(), found.end(),
+                [](std::pair<Entry const*, size_t> const& lhs,
+                   std::pair<Entry const*, size_t> const& rhs) {
+                    return lhs.first->offset < rhs.first->offset;
+                }
+            );
+
+            for (std::pair<Entry const*, size_t> const& f : found) {
+                readPayloadLocked(*f.first, payloads[f.second]);
+            }
+        }
+    }
+
+    std::vector<QImage> images;
+    images.reserve(payloads.size());
+    for (QByteArray const& payload : payloads) {
+        images.push_back(payload.isEmpty() ? QImage() : decodeImage(payload));
+    }
+
+    return images;
+}
+
+bool
+ThumbnailStore::contains(ImageId const& image_id)
+{
+    qint64 const source_mtime = sourceMtime(image_id);
+
+    QMutexLocker const locker(&m_mutex);
+
+    return openLocked() && findLocked(image_id, source_mtime);
+}
+
+bool
+ThumbnailStore::save(ImageId const& image_id, QImage const& thumbnail)
+{
+    if (thumbnail.isNull()) {
+        return false;
+    }
+
+    qint64 const source_mtime = sourceMtime(image_id);
+    QByteArray const payload(encodeImage(thumbnail));
+    QByteArray const header(recordHeader(image_id, source_mtime, payload.size()));
+
+    QMutexLocker const locker(&m_mutex);
+
+    if (!openLocked()) {
+        return false;
+    }
+
+    if (!m_file.seek(m_fileEnd)
+            || m_file.write(header) != header.size()
+            || m_file.write(payload) != payload.size()
+            || !m_file.flush()) {
+        // Don't leave a partial record behind.
+        m_file.resize(m_fileEnd);
+        return false;
+    }
+
+    Entry const entry(source_mtime, m_fileEnd + header.size(), payload.size());
+    m_fileEnd = entry.offset + entry.length;
+    addEntryLocked(image_id, entry);
+    ++m_numUnindexed;
+
+    return true;
+}
+
+bool
+ThumbnailStore::compact()
+{
+    QMutexLocker const locker(&m_mutex);
+
+    if (!openLocked()) {
+        return false;
+    }
+
+    if (m_garbageBytes == 0 && m_numUnindexed == 0) {
+        return true;
+    }
+
+    // Keep the file order, so that the old file is read sequentially.
+    std::vector<Entries::const_iterator> live;
+    live.reserve(m_entries.size());
+    for (Entries::const_iterator it(m_entries.begin()); it != m_entries.end(); ++it) {
+        live.push_back(it);
+    }
+    std::sort(
+        live.begin(), live.end(),
+        [](Entries::const_iterator const& lhs, Entries::const_iterator const& rhs) {
+            return lhs->second.offset < rhs->second.offset;
+        }
+    );
+
+    // The size of the index doesn't depend on the offsets it contains,
+    // so we can lay out the records before writing it.
+    std::vector<QByteArray> record_headers;
+    record_headers.reserve(live.size());
+    qint64 index_size = 0;
+    for (Entries::const_iterator const& it : live) {
+        QByteArray const header(recordHeader(it->first, it->second.sourceMtime, it->second.length));
+        record_headers.push_back(header);
+        // An index entry is a record header without the magic number,
+        // but with the offset of the payload.
+        index_size += header.size() - 4 + 8;
+    }
+
+    QByteArray index;
+    index.reserve(index_size);
+    QDataStream index_strm(&index, QIODevice::WriteOnly);
+    setupStream(index_strm);
+
+    qint64 offset = HEADER_SIZE + index_size;
+    for (size_t i = 0; i < live.size(); ++i) {
+        Entries::const_iterator const& it = live[i];
+        offset += record_headers[i].size();
+        index_strm << it->first.filePath() << qint32(it->first.page())
+                   << it->second.sourceMtime << quint64(offset) << it->second.length;
+        offset += it->second.length;
+    }
+    qint64 const indexed_end = offset;
+
+    if (index.size() != index_size) {
+        return false;
+    }
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* dev = overwriter.startWriting(m_filePath);
+    if (!dev) {
+        return false;
+    }
+
+    QByteArray const header(fileHeader(live.size(), indexed_end));
+    if (dev->write(header) != header.size() || dev->write(index) != index.size()) {
+        return false;
+    }
+
+    QByteArray payload;
+    for (size_t i = 0; i < live.size(); ++i) {
+        if (!readPayloadLocked(live[i]->second, payload)) {
+            return false;
+        }
+        if (dev->write(record_headers[i]) != record_headers[i].size()
+                || dev->write(payload) != payload.size()) {
+            return false;
+        }
+    }
+
+    // Some platforms can't replace a file that's open.
+    m_file.close();
+    bool const committed = overwriter.commit();
+
+    return openLocked() && committed;
+}
+
+bool
+ThumbnailStore::openLocked()
+{
+    if (m_file.isOpen()) {
+        return true;
+    }
+
+    // Failing to open it is not final, as the directory may appear later.
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    readIndexLocked();
+    return true;
+}
+
+void
+ThumbnailStore::readIndexLocked()
+{
+    m_entries.clear();
+    m_garbageBytes = 0;
+    m_numUnindexed = 0;
+
+    qint64 const file_size = m_file.size();
+    QDataStream strm(&m_file);
+    setupStream(strm);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 num_indexed = 0;
+    quint32 reserved = 0;
+    quint64 indexed_end = 0;
+    strm >> magic >> version >> num_indexed >> reserved >> indexed_end;
+    if (strm.status() != QDataStream::Ok || magic != FILE_MAGIC
+            || version != FORMAT_VERSION || indexed_end > quint64(file_size)) {
+        resetLocked();
+        return;
+    }
+
+    for (quint32 i = 0; i < num_indexed; ++i) {
+        QString file_path;
+        qint32 page = 0;
+        qint64 source_mtime = 0;
+        quint64 offset = 0;
+        quint32 length = 0;
+        strm >> file_path >> page >> source_mtime >> offset >> length;
+        if (strm.status() != QDataStream::Ok || offset + length > indexed_end) {
+            resetLocked();
+            return;
+        }
+        addEntryLocked(ImageId(file_path, page), Entry(source_mtime, offset, length));
+    }
+
+    // Now scan the records appended after the last compaction.
+    qint64 pos = indexed_end;
+    while (pos < file_size && m_file.seek(pos)) {
+        quint32 record_magic = 0;
+        QString file_path;
+        qint32 page = 0;
+        qint64 source_mtime = 0;
+        quint32 length = 0;
+        strm >> record_magic >> file_path >> page >> source_mtime >> length;
+        qint64 const offset = m_file.pos();
+        if (strm.status() != QDataStream::Ok || record_magic != RECORD_MAGIC
+                || offset + length > file_size) {
+            // Most likely a record we didn't finish writing.
+            break;
+        }
+
+        addEntryLocked(ImageId(file_path, page), Entry(source_mtime, offset, length));
+        ++m_numUnindexed;
+        pos = offset + length;
+    }
+
+    m_fileEnd = pos;
+    if (m_fileEnd < file_size) {
+        m_file.resize(m_fileEnd);
+    }
+}
+
+void
+ThumbnailStore::resetLocked()
+{
+    m_entries.clear();
+    m_garbageBytes = 0;
+    m_numUnindexed = 0;
+    m_fileEnd = HEADER_SIZE;
+
+    QByteArray const header(fileHeader(0, HEADER_SIZE));
+    m_file.resize(0);
+    m_file.seek(0);
+    m_file.write(header);
+    m_file.flush();
+}
+
+void
+ThumbnailStore::addEntryLocked(ImageId const& image_id, Entry const& entry)
+{
+    std::pair<Entries::iterator, bool> const res(
+        m_entries.insert(Entries::value_type(image_id, entry))
+    );
+    if (!res.second) {
+        m_garbageBytes += res.first->second.length;
+        res.first->second = entry;
+    }
+}
+
+ThumbnailStore::Entry const*
+ThumbnailStore::findLocked(ImageId const& image_id, qint64 const source_mtime) const
+{
+    Entries::const_iterator const it(m_entries.find(image_id));
+    if (it == m_entries.end() || it->second.sourceMtime != source_mtime) {
+        return 0;
+    }
+    return &it->second;
+}
+
+bool
+ThumbnailStore::readPayloadLocked(Entry const& entry, QByteArray& payload)
+{
+    if (!m_file.seek(entry.offset)) {
+        return false;
+    }
+
+    payload = m_file.read(entry.length);
+    return payload.size() == int(entry.length);
+}
+
+QByteArray
+ThumbnailStore::recordHeader(
+    ImageId const& image_id, qint64 const source_mtime, quint32 const payload_length)
+{
+    QByteArray header;
+    QDataStream strm(&header, QIODevice::WriteOnly);
+    setupStream(strm);
+    strm << RECORD_MAGIC << image_id.filePath() << qint32(image_id.page())
+         << source_mtime << payload_length;
+    return header;
+}
+
+qint64
+ThumbnailStore::sourceMtime(ImageId const& image_id)
+{
+    QDateTime const mtime(QFileInfo(image_id.filePath()).lastModified());
+    return mtime.isValid() ? mtime.toMSecsSinceEpoch() : 0;
+}
+
+QByteArray
+ThumbnailStore::encodeImage(QImage const& image)
+{
+    QImage img(image);
+    if (img.format() != QImage::Format_Indexed8) {
+        img = img.convertToFormat(
+                  img.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32
+              );
+    }
+
+    int const width = img.width();
+    int const height = img.height();
+    int const row_bytes = width * (img.depth() / 8);
+
+    QByteArray pixels(row_bytes * height, Qt::Uninitialized);
+    char* dst = pixels.data();
+    for (int y = 0; y < height; ++y) {
+        memcpy(dst, img.constScanLine(y), row_bytes);
+        dst += row_bytes;
+    }
+
+    QByteArray payload;
+    QDataStream strm(&payload, QIODevice::WriteOnly);
+    setupStream(strm);
+    strm << quint32(width) << quint32(height) << quint32(img.format())
+         << img.colorTable() << qCompress(pixels, 1);
+    return payload;
+}
+
+QImage
+ThumbnailStore::decodeImage(QByteArray const& payload)
+{
+    QDataStream strm(payload);
+    setupStream(strm);
+
+    quint32 width = 0;
+    quint32 height = 0;
+    quint32 format = 0;
+    QVector<QRgb> color_table;
+    QByteArray compressed;
+    strm >> width >> height >> format >> color_table >> compressed;
+    if (strm.status() != QDataStream::Ok) {
+        return QImage();
+    }
+    if (width == 0 || height == 0 || width > MAX_DIMENSION || height > MAX_DIMENSION) {
+        return QImage();
+    }
+    if (format != QImage::Format_Indexed8 && format != QImage::Format_RGB32
+            && format != QImage::Format_ARGB32) {
+        return QImage();
+    }
+
+    QImage image(width, height, QImage::Format(format));
+    if (image.isNull()) {
+        return QImage();
+    }
+    if (format == QImage::Format_Indexed8) {
+        image.setColorTable(color_table);
+    }
+
+    int const row_bytes = image.width() * (image.depth() / 8);
+    QByteArray const pixels(qUncompress(compressed));
+    if (pixels.size() != row_bytes * image.height()) {
+        return QImage();
+    }
+
+    char const* src = pixels.constData();
+    for (int y = 0; y < image.height(); ++y) {
+        memcpy(image.scanLine(y), src, row_bytes);
+        src += row_bytes;
+    }
+
+    return image;
+}
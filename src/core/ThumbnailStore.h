@@ -0,0 +1,162 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THUMBNAILSTORE_H_
+#define THUMBNAILSTORE_H_
+
+#include "NonCopyable.h"
+#include "RefCountable.h"
+#include "ImageId.h"
+#include <QString>
+#include <QFile>
+#include <QMutex>
+#include <QtGlobal>
+#include <map>
+#include <vector>
+
+class QImage;
+class QByteArray;
+
+/**
+ * \brief Keeps all the thumbnails of a project in a single file.
+ *
+ * The file starts with an index of the thumbnails it had when it was
+ * last compacted, followed by the thumbnails themselves.  New and
+ * updated thumbnails are appended to the end of the file, each preceded
+ * by a record header, so that the file doesn't need to be rewritten
+ * on every change.  The records that follow the indexed part are
+ * scanned when the file is opened.
+ *
+ * Thumbnails are keyed by ImageId and are only returned if the
+ * modification time of the source image matches the one it had
+ * when the thumbnail was stored.  Pixels are stored raw, compressed
+ * with fast zlib settings, which is a lot cheaper to decode than PNG.
+ *
+ * \note All methods may be called from any thread, even concurrently.
+ */
+class ThumbnailStore : public RefCountable
+{
+    DECLARE_NON_COPYABLE(ThumbnailStore)
+public:
+    /**
+     * \brief Uses the provided file, which may not exist yet.
+     *
+     * The file is opened on first use.  While it can't be opened,
+     * the store behaves as an empty one that can't be written to.
+     */
+    explicit ThumbnailStore(QString const& file_path);
+
+    virtual ~ThumbnailStore();
+
+    QString const& filePath() const
+    {
+        return m_filePath;
+    }
+
+    /**
+     * \brief Returns the thumbnail, or a null image if it's missing
+     *        or outdated.
+     */
+    QImage load(ImageId const& image_id);
+
+    /**
+     * \brief Loads several thumbnails, reading the file in a single pass.
+     *
+     * \return The thumbnails in the order of \p image_ids.  Missing and
+     *         outdated ones are null images.
+     */
+    std::vector<QImage> load(std::vector<ImageId> const& image_ids);
+
+    /**
+     * \brief Tells whether an up to date thumbnail is there.
+     */
+    bool contains(ImageId const& image_id);
+
+    /**
+     * \brief Adds a thumbnail or replaces the existing one.
+     *
+     * \return true on success.
+     */
+    bool save(ImageId const& image_id, QImage const& thumbnail);
+
+    /**
+     * \brief Rewrites the file without the replaced thumbnails, and with
+     *        an index of all thumbnails.
+     *
+     * Does nothing if the file is already compacted.
+     *
+     * \return true on success.
+     */
+    bool compact();
+private:
+    struct Entry
+    {
+        qint64 sourceMtime;
+        qint64 offset;
+        quint32 length;
+
+        Entry(qint64 source_mtime, qint64 payload_offset, quint32 payload_length)
+            :   sourceMtime(source_mtime), offset(payload_offset),
+                length(payload_length) {}
+    };
+
+    typedef std::map<ImageId, Entry> Entries;
+
+    bool openLocked();
+
+    void readIndexLocked();
+
+    void resetLocked();
+
+    void addEntryLocked(ImageId const& image_id, Entry const& entry);
+
+    Entry const* findLocked(ImageId const& image_id, qint64 source_mtime) const;
+
+    bool readPayloadLocked(Entry const& entry, QByteArray& payload);
+
+    static QByteArray recordHeader(
+        ImageId const& image_id, qint64 source_mtime, quint32 payload_length);
+
+    static qint64 sourceMtime(ImageId const& image_id);
+
+    static QByteArray encodeImage(QImage const& image);
+
+    static QImage decodeImage(QByteArray const& payload);
+
+    QMutex m_mutex;
+    QString m_filePath;
+    QFile m_file;
+    Entries m_entries;
+
+    /**
+     * The end of the last valid record.  New records are written there.
+     */
+    qint64 m_fileEnd;
+
+    /**
+     * The total size of thumbnails that were replaced by newer ones.
+     */
+    qint64 m_garbageBytes;
+
+    /**
+     * The number of records that follow the indexed part of the file.
+     */
+    int m_numUnindexed;
+};
+
+#endif
@@ -29,9 +29,11 @@
 #include <QSize>
 #include <QDebug>
 #include <algorithm>
+#include <vector>
 #include <tiff.h>
 #include <tiffio.h>
 #include <new>
+#include <string.h>
 #include <assert.h>
 
 class TiffReader::TiffHeader
@@ -61,6 +63,8 @@ private:
 class TiffReader::TiffHandle
 {
 public:
+    TiffHandle() : m_pHandle(0) {}
+
     TiffHandle(TIFF* handle) : m_pHandle(handle) {}
 
     ~TiffHandle()
@@ -70,6 +74,14 @@ public:
         }
     }
 
+    void reset(TIFF* handle)
+    {
+        if (m_pHandle) {
+            TIFFClose(m_pHandle);
+        }
+        m_pHandle = handle;
+    }
+
     TIFF* handle() const
     {
         return m_pHandle;
@@ -290,88 +302,136 @@ static void convertAbgrToArgb(uint32 const* src, uint32* dst, int count)
     }
 }
 
-QImage
-TiffReader::readImage(QIODevice& device, int const page_num)
+namespace
 {
-    if (!device.isReadable()) {
-        return QImage();
+
+/**
+ * Scales down bands of a 32-bit image by an integer factor, averaging
+ * blocks of factor x factor pixels.  Blocks at the right and bottom
+ * edges may be smaller.
+ */
+class BandDownscaler : public VirtualFunction2<bool, QImage const&, int>
+{
+public:
+    BandDownscaler(QImage& dst, int factor, int src_height)
+        :   m_rDst(dst),
+            m_factor(factor),
+            m_srcWidth(0),
+            m_srcHeight(src_height),
+            m_sums(dst.width() * 4, 0),
+            m_rowsInSums(0) {}
+
+    virtual bool operator()(QImage const& band, int const top)
+    {
+        m_srcWidth = band.width();
+        int const height = band.height();
+        for (int y = 0; y < height; ++y) {
+            uint32 const* src = (uint32 const*)band.scanLine(y);
+            uint32* sums = &m_sums[0];
+            for (int x = 0; x < m_srcWidth; ++x) {
+                uint32 const argb = src[x];
+                uint32* sum = sums + (x / m_factor) * 4;
+                sum[0] += (argb >> 24) & 0xFF;
+                sum[1] += (argb >> 16) & 0xFF;
+                sum[2] += (argb >> 8) & 0xFF;
+                sum[3] += argb & 0xFF;
+            }
+            ++m_rowsInSums;
+
+            int const src_y = top + y;
+            if (m_rowsInSums == m_factor || src_y == m_srcHeight - 1) {
+                flushRow(src_y / m_factor);
+            }
+        }
+        return true;
     }
-    if (device.isSequential()) {
-        // libtiff needs to be able to seek.
-        return QImage();
+private:
+    void flushRow(int const dst_y)
+    {
+        uint32* dst = (uint32*)m_rDst.scanLine(dst_y);
+        int const dst_width = m_rDst.width();
+        for (int x = 0; x < dst_width; ++x) {
+            int const cols = std::min(m_factor, m_srcWidth - x * m_factor);
+            uint32 const area = cols * m_rowsInSums;
+            uint32* sum = &m_sums[x * 4];
+            uint32 const a = (sum[0] + area / 2) / area;
+            uint32 const r = (sum[1] + area / 2) / area;
+            uint32 const g = (sum[2] + area / 2) / area;
+            uint32 const b = (sum[3] + area / 2) / area;
+            dst[x] = (a << 24) | (r << 16) | (g << 8) | b;
+            sum[0] = sum[1] = sum[2] = sum[3] = 0;
+        }
+        m_rowsInSums = 0;
     }
 
-    TiffHeader header(readHeader(device));
-    if (!checkHeader(header)) {
-        return QImage();
-    }
+    QImage& m_rDst;
+    int m_factor;
+    int m_srcWidth;
+    int m_srcHeight;
+    std::vector<uint32> m_sums;
+    int m_rowsInSums;
+};
 
-    TiffHandle tif(
-        TIFFClientOpen(
-            "file", "rBm", &device, &deviceRead, &deviceWrite,
-            &deviceSeek, &deviceClose, &deviceSize,
-            &deviceMap, &deviceUnmap
-        )
-    );
-    if (!tif.handle()) {
+} // anonymous namespace
+
+QImage
+TiffReader::readImage(
+    QIODevice& device, int const page_num, QSize const& box)
+{
+    TiffHandle tif;
+    TiffHeader header;
+    if (!openPage(device, page_num, tif, header)) {
         return QImage();
     }
 
-    if (!TIFFSetDirectory(tif.handle(), page_num)) {
-        return QImage();
+    ImageMetadata const metadata(currentPageMetadata(tif));
+    QSize const full_size(metadata.size());
+
+    int factor = 1;
+    if (!box.isEmpty() &&
+            (full_size.width() > box.width() || full_size.height() > box.height())) {
+        QSize const min_size(full_size.scaled(box, Qt::KeepAspectRatio).expandedTo(QSize(1, 1)));
+        if (!selectReducedImage(tif, min_size)) {
+            factor = std::min(full_size.width() / min_size.width(),
+                              full_size.height() / min_size.height());
+        }
     }
 
     TiffInfo const info(tif, header);
 
-    ImageMetadata const metadata(currentPageMetadata(tif));
-
     QImage image;
-
-    if (info.mapsToBinaryOrIndexed8()) {
-        // Common case optimization.
-        image = extractBinaryOrIndexed8Image(tif, info);
+    if (factor > 1 && !info.mapsToBinaryOrIndexed8()) {
+        // Without a reduced resolution sub-image, a full color page
+        // would take a lot of memory, so we scale it down strip by strip.
+        image = readDownscaled(tif, info, factor);
     } else {
-        // General case.
-        image = QImage(
-                    info.width, info.height,
-                    info.samples_per_pixel == 3
-                    ? QImage::Format_RGB32 : QImage::Format_ARGB32
-                );
-        if (image.isNull()) {
-            throw std::bad_alloc();
-        }
+        image = readPageRegion(tif, info, QRect(0, 0, info.width, info.height));
+    }
 
-        // For ABGR -> ARGB conversion.
-        TiffBuffer<uint32> tmp_buffer;
-        uint32 const* src_line = 0;
+    if (!image.isNull() && !metadata.dpi().isNull() && !full_size.isEmpty()) {
+        // A reduced resolution image covers the same physical area.
+        Dpm const dpm(metadata.dpi());
+        image.setDotsPerMeterX(qRound(double(dpm.horizontal()) * image.width() / full_size.width()));
+        image.setDotsPerMeterY(qRound(double(dpm.vertical()) * image.height() / full_size.height()));
+    }
 
-        if (image.bytesPerLine() == 4 * info.width) {
-            // We can avoid creating a temporary buffer in this case.
-            if (!TIFFReadRGBAImageOriented(tif.handle(), info.width, info.height,
-                                           (uint32*)image.bits(), ORIENTATION_TOPLEFT, 0)) {
-                return QImage();
-            }
-            src_line = (uint32 const*)image.bits();
-        } else {
-            TiffBuffer<uint32>(info.width * info.height).swap(tmp_buffer);
-            if (!TIFFReadRGBAImageOriented(tif.handle(), info.width, info.height,
-                                           tmp_buffer.data(), ORIENTATION_TOPLEFT, 0)) {
-                return QImage();
-            }
-            src_line = tmp_buffer.data();
-        }
+    return image;
+}
 
-        uint32* dst_line = (uint32*)image.bits();
-        assert(image.bytesPerLine() % 4 == 0);
-        int const dst_stride = image.bytesPerLine() / 4;
-        for (int y = 0; y < info.height; ++y) {
-            convertAbgrToArgb(src_line, dst_line, info.width);
-            src_line += info.width;
-            dst_line += dst_stride;
-        }
+QImage
+TiffReader::readRegion(QIODevice& device, int const page_num, QRect const& rect)
+{
+    TiffHandle tif;
+    TiffHeader header;
+    if (!openPage(device, page_num, tif, header)) {
+        return QImage();
     }
 
-    if (!metadata.dpi().isNull()) {
+    ImageMetadata const metadata(currentPageMetadata(tif));
+    TiffInfo const info(tif, header);
+
+    QImage image(readPageRegion(tif, info, rect));
+    if (!image.isNull() && !metadata.dpi().isNull()) {
         Dpm const dpm(metadata.dpi());
         image.setDotsPerMeterX(dpm.horizontal());
         image.setDotsPerMeterY(dpm.vertical());
@@ -380,6 +440,54 @@ TiffReader::readImage(QIODevice& device, int const page_num)
     return image;
 }
 
+bool
+TiffReader::readBandsImpl(
+    QIODevice& device, int const page_num, QRect const& rect,
+    VirtualFunction2<bool, QImage const&, int>& out)
+{
+    TiffHandle tif;
+    TiffHeader header;
+    if (!openPage(device, page_num, tif, header)) {
+        return false;
+    }
+
+    TiffInfo const info(tif, header);
+    QRect const page_rect(0, 0, info.width, info.height);
+
+    return readPageBands(tif, info, rect.isNull() ? page_rect : rect, out);
+}
+
+bool
+TiffReader::openPage(
+    QIODevice& device, int const page_num, TiffHandle& tif, TiffHeader& header)
+{
+    if (!device.isReadable()) {
+        return false;
+    }
+    if (device.isSequential()) {
+        // libtiff needs to be able to seek.
+        return false;
+    }
+
+    header = readHeader(device);
+    if (!checkHeader(header)) {
+        return false;
+    }
+
+    tif.reset(
+        TIFFClientOpen(
+            "file", "rBm", &device, &deviceRead, &deviceWrite,
+            &deviceSeek, &deviceClose, &deviceSize,
+            &deviceMap, &deviceUnmap
+        )
+    );
+    if (!tif.handle()) {
+        return false;
+    }
+
+    return TIFFSetDirectory(tif.handle(), page_num) != 0;
+}
+
 TiffReader::TiffHeader
 TiffReader::readHeader(QIODevice& device)
 {
@@ -428,6 +536,62 @@ TiffReader::currentPageMetadata(TiffHandle const& tif)
     return ImageMetadata(QSize(width, height), getDpi(xres, yres, res_unit));
 }
 
+/**
+ * Switches to the smallest reduced resolution sub-image of the current
+ * page that's not smaller than \p min_size.  If there is no such
+ * sub-image, the page itself remains the current directory.
+ *
+ * \return true if a sub-image was selected.
+ */
+bool
+TiffReader::selectReducedImage(TiffHandle const& tif, QSize const& min_size)
+{
+    uint16 num_subifds = 0;
+    toff_t* subifd_offsets = 0;
+    if (!TIFFGetField(tif.handle(), TIFFTAG_SUBIFD, &num_subifds, &subifd_offsets)
+            || num_subifds == 0) {
+        return false;
+    }
+
+    // The array belongs to the current directory, which we are about to leave.
+    std::vector<toff_t> const offsets(subifd_offsets, subifd_offsets + num_subifds);
+    toff_t const page_offset = TIFFCurrentDirOffset(tif.handle());
+
+    toff_t best_offset = 0;
+    qint64 best_area = 0;
+    for (toff_t const offset : offsets) {
+        if (!TIFFSetSubDirectory(tif.handle(), offset)) {
+            continue;
+        }
+
+        uint32 subfile_type = 0;
+        uint32 width = 0, height = 0;
+        TIFFGetField(tif.handle(), TIFFTAG_SUBFILETYPE, &subfile_type);
+        TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tif.handle(), TIFFTAG_IMAGELENGTH, &height);
+        if (!(subfile_type & FILETYPE_REDUCEDIMAGE)) {
+            // Could be a thumbnail or a transparency mask.
+            continue;
+        }
+        if (int(width) < min_size.width() || int(height) < min_size.height()) {
+            continue;
+        }
+
+        qint64 const area = qint64(width) * height;
+        if (best_offset == 0 || area < best_area) {
+            best_offset = offset;
+            best_area = area;
+        }
+    }
+
+    if (best_offset != 0 && TIFFSetSubDirectory(tif.handle(), best_offset)) {
+        return true;
+    }
+
+    TIFFSetSubDirectory(tif.handle(), page_offset);
+    return false;
+}
+
 Dpi
 TiffReader::getDpi(float xres, float yres, unsigned res_unit)
 {
@@ -440,24 +604,15 @@ TiffReader::getDpi(float xres, float yres, unsigned res_unit)
     return Dpi();
 }
 
-QImage
-TiffReader::extractBinaryOrIndexed8Image(
-    TiffHandle const& tif, TiffInfo const& info)
+/**
+ * Returns the color table of a binary or indexed image, or an empty
+ * one in case of failure.
+ */
+QVector<QRgb>
+TiffReader::colorTable(TiffHandle const& tif, TiffInfo const& info)
 {
-    QImage::Format format = QImage::Format_Indexed8;
-    if (info.bits_per_sample == 1) {
-        // Because we specify B option when opening, we can
-        // always use Format_Mono, and not Format_MonoLSB.
-        format = QImage::Format_Mono;
-    }
-
-    QImage image(info.width, info.height, format);
-    if (image.isNull()) {
-        throw std::bad_alloc();
-    }
-
     int const num_colors = 1 << info.bits_per_sample;
-    image.setColorCount(num_colors);
+    QVector<QRgb> colors(num_colors);
 
     if (info.photometric == PHOTOMETRIC_PALETTE) {
         uint16* pr = 0;
@@ -465,7 +620,7 @@ TiffReader::extractBinaryOrIndexed8Image(
         uint16* pb = 0;
         TIFFGetField(tif.handle(), TIFFTAG_COLORMAP, &pr, &pg, &pb);
         if (!pr || !pg || !pb) {
-            return QImage();
+            return QVector<QRgb>();
         }
         if (info.host_big_endian != info.file_big_endian) {
             TIFFSwabArrayOfShort(pr, num_colors);
@@ -478,63 +633,361 @@ TiffReader::extractBinaryOrIndexed8Image(
             uint32 const g = (uint32)(pg[i] * f + 0.5);
             uint32 const b = (uint32)(pb[i] * f + 0.5);
             uint32 const a = 0xFF000000;
-            image.setColor(i, a | (r << 16) | (g << 8) | b);
+            colors[i] = a | (r << 16) | (g << 8) | b;
         }
     } else if (info.photometric == PHOTOMETRIC_MINISBLACK) {
         double const f = 255.0 / (num_colors - 1);
         for (int i = 0; i < num_colors; ++i) {
             int const gray = (int)(i * f + 0.5);
-            image.setColor(i, qRgb(gray, gray, gray));
+            colors[i] = qRgb(gray, gray, gray);
         }
     } else if (info.photometric == PHOTOMETRIC_MINISWHITE) {
         double const f = 255.0 / (num_colors - 1);
         int c = num_colors - 1;
         for (int i = 0; i < num_colors; ++i, --c) {
             int const gray = (int)(c * f + 0.5);
-            image.setColor(i, qRgb(gray, gray, gray));
+            colors[i] = qRgb(gray, gray, gray);
         }
     } else {
+        return QVector<QRgb>();
+    }
+
+    return colors;
+}
+
+QImage
+TiffReader::createImage(
+    TiffInfo const& info, QVector<QRgb> const& color_table, QSize const& size)
+{
+    QImage::Format format = QImage::Format_ARGB32;
+    if (info.mapsToBinaryOrIndexed8()) {
+        // Because we specify B option when opening, we can
+        // always use Format_Mono, and not Format_MonoLSB.
+        format = info.bits_per_sample == 1
+                 ? QImage::Format_Mono : QImage::Format_Indexed8;
+    } else if (info.samples_per_pixel == 3) {
+        format = QImage::Format_RGB32;
+    }
+
+    QImage image(size, format);
+    if (image.isNull()) {
+        throw std::bad_alloc();
+    }
+
+    if (info.mapsToBinaryOrIndexed8()) {
+        image.setColorTable(color_table);
+    }
+
+    return image;
+}
+
+/**
+ * Reads a rectangle of the current directory.  Only the rectangle,
+ * clipped to the page, is kept in memory.
+ */
+QImage
+TiffReader::readPageRegion(
+    TiffHandle const& tif, TiffInfo const& info, QRect const& rect)
+{
+    QRect const region(rect.intersected(QRect(0, 0, info.width, info.height)));
+    if (region.isEmpty()) {
         return QImage();
     }
 
+    QVector<QRgb> color_table;
+    if (info.mapsToBinaryOrIndexed8()) {
+        color_table = colorTable(tif, info);
+        if (color_table.isEmpty()) {
+            return QImage();
+        }
+    }
+
+    QImage image(createImage(info, color_table, region.size()));
+    if (!readRows(tif, info, region, image)) {
+        return QImage();
+    }
+
+    return image;
+}
+
+/**
+ * Reads the current directory of a 32-bit image, scaling it down
+ * by \p factor.  The full size image is never in memory.
+ */
+QImage
+TiffReader::readDownscaled(
+    TiffHandle const& tif, TiffInfo const& info, int const factor)
+{
+    QSize const size((info.width + factor - 1) / factor, (info.height + factor - 1) / factor);
+    QImage image(createImage(info, QVector<QRgb>(), size));
+
+    BandDownscaler downscaler(image, factor, info.height);
+    if (!readPageBands(tif, info, QRect(0, 0, info.width, info.height), downscaler)) {
+        return QImage();
+    }
+
+    return image;
+}
+
+bool
+TiffReader::readPageBands(
+    TiffHandle const& tif, TiffInfo const& info, QRect const& rect,
+    VirtualFunction2<bool, QImage const&, int>& out)
+{
+    QRect const region(rect.intersected(QRect(0, 0, info.width, info.height)));
+    if (region.isEmpty()) {
+        return false;
+    }
+
+    QVector<QRgb> color_table;
+    if (info.mapsToBinaryOrIndexed8()) {
+        color_table = colorTable(tif, info);
+        if (color_table.isEmpty()) {
+            return false;
+        }
+    }
+
+    // Colour pages stored bottom-up have their first strip at the bottom.
+    bool bottom_up = false;
+    if (!info.mapsToBinaryOrIndexed8()) {
+        uint16 orientation = ORIENTATION_TOPLEFT;
+        TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ORIENTATION, &orientation);
+        switch (orientation) {
+        case ORIENTATION_BOTLEFT:
+        case ORIENTATION_LEFTBOT:
+        case ORIENTATION_BOTRIGHT:
+        case ORIENTATION_RIGHTBOT:
+            bottom_up = true;
+            break;
+        }
+    }
+
+    int const band_height = bandHeight(tif, info);
+    int const end_y = region.top() + region.height();
+
+    QImage band;
+    for (int top = region.top(); top < end_y;) {
+        // Bands are aligned to strips, so that no strip is decoded twice.
+        int bottom = 0;
+        if (bottom_up) {
+            int const strip = (info.height - 1 - top) / band_height;
+            bottom = std::min(end_y, info.height - strip * band_height);
+        } else {
+            bottom = std::min(end_y, (top / band_height + 1) * band_height);
+        }
+        QSize const band_size(region.width(), bottom - top);
+        if (band.size() != band_size) {
+            band = createImage(info, color_table, band_size);
+        }
+
+        // If the previous band is still referenced by the caller,
+        // writing to this one detaches it.
+        if (!readRows(tif, info, QRect(QPoint(region.left(), top), band_size), band)) {
+            return false;
+        }
+
+        if (!out(band, top)) {
+            return false;
+        }
+        top = bottom;
+    }
+
+    return true;
+}
+
+/**
+ * Returns the number of rows it's efficient to decode at once.
+ */
+int
+TiffReader::bandHeight(TiffHandle const& tif, TiffInfo const& info)
+{
+    // Scanlines may be read in any chunks, so we limit those.
+    int const max_scanline_band_height = 256;
+
+    uint32 rows = 0;
+    if (TIFFIsTiled(tif.handle())) {
+        TIFFGetField(tif.handle(), TIFFTAG_TILELENGTH, &rows);
+    } else {
+        TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &rows);
+    }
+    if (rows == 0 || rows > uint32(info.height)) {
+        rows = info.height;
+    }
+
+    if (info.mapsToBinaryOrIndexed8()) {
+        return std::max(1, std::min(int(rows), max_scanline_band_height));
+    }
+
+    return std::max(1, int(rows));
+}
+
+/**
+ * Reads \p rect of the current directory into \p image, which has
+ * to be of the same size as \p rect and of the format createImage()
+ * returns.
+ */
+bool
+TiffReader::readRows(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& rect, QImage& image)
+{
+    if (!info.mapsToBinaryOrIndexed8()) {
+        return readRgbaRows(tif, info, rect, image);
+    }
+
     if (info.bits_per_sample == 1 || info.bits_per_sample == 8) {
-        readLines(tif, image);
+        readLines(tif, info, rect, image);
     } else {
-        readAndUnpackLines(tif, info, image);
+        readAndUnpackLines(tif, info, rect, image);
     }
 
-    return image;
+    return true;
+}
+
+bool
+TiffReader::readRgbaRows(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& rect, QImage& image)
+{
+    // TIFFRGBAImageGet() needs a contiguous raster.  That's always
+    // the case for 32-bit images, whose lines don't need any padding.
+    assert(image.bytesPerLine() == 4 * rect.width());
+
+    char emsg[1024];
+    TIFFRGBAImage img;
+    if (!TIFFRGBAImageBegin(&img, tif.handle(), 0, emsg)) {
+        return false;
+    }
+
+    // TIFFRGBAImageGet() takes row and column offsets in file coordinates
+    // and flips only the rows it decodes.  For a page stored bottom-up or
+    // right-to-left, we map the rectangle to file coordinates and put
+    // the decoded strips in the reverse order.  Like libtiff, we don't
+    // transpose the orientations that would require it.
+    bool flip_vertically = false;
+    bool flip_horizontally = false;
+    switch (img.orientation) {
+    case ORIENTATION_BOTLEFT:
+    case ORIENTATION_LEFTBOT:
+        flip_vertically = true;
+        break;
+    case ORIENTATION_TOPRIGHT:
+    case ORIENTATION_RIGHTTOP:
+        flip_horizontally = true;
+        break;
+    case ORIENTATION_BOTRIGHT:
+    case ORIENTATION_RIGHTBOT:
+        flip_vertically = true;
+        flip_horizontally = true;
+        break;
+    }
+
+    int const strip_height = bandHeight(tif, info);
+    int const width = rect.width();
+    int const file_left = flip_horizontally ? info.width - (rect.left() + width) : rect.left();
+    int const file_top = flip_vertically ? info.height - (rect.top() + rect.height()) : rect.top();
+    int const file_end_y = file_top + rect.height();
+
+    img.req_orientation = ORIENTATION_TOPLEFT;
+    img.col_offset = file_left;
+
+    bool ok = true;
+    for (int y = file_top; y < file_end_y && ok;) {
+        int const next_y = std::min(file_end_y, (y / strip_height + 1) * strip_height);
+        int const dst_y = flip_vertically ? file_end_y - next_y : y - file_top;
+        uint32* const rows = (uint32*)image.scanLine(dst_y);
+
+        img.row_offset = y;
+        ok = TIFFRGBAImageGet(&img, rows, width, next_y - y) != 0;
+        if (ok) {
+            // Converting a strip right after decoding it, while it's
+            // still in cache, and in place, rather than in a separate pass.
+            convertAbgrToArgb(rows, rows, width * (next_y - y));
+        }
+
+        y = next_y;
+    }
+
+    TIFFRGBAImageEnd(&img);
+
+    return ok;
 }
 
 void
-TiffReader::readLines(TiffHandle const& tif, QImage& image)
+TiffReader::readLines(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& rect, QImage& image)
 {
-    int const height = image.height();
+    int const top = rect.top();
+    int const height = rect.height();
+
+    if (rect.left() == 0 && rect.width() == info.width) {
+        for (int y = 0; y < height; ++y) {
+            TIFFReadScanline(tif.handle(), image.scanLine(y), top + y);
+        }
+        return;
+    }
+
+    // One more byte, for the shifting below not to go out of bounds.
+    tsize_t const line_size = TIFFScanlineSize(tif.handle());
+    TiffBuffer<uint8> buf(line_size + 1);
+    buf.data()[line_size] = 0;
+
+    if (info.bits_per_sample == 8) {
+        for (int y = 0; y < height; ++y) {
+            TIFFReadScanline(tif.handle(), buf.data(), top + y);
+            memcpy(image.scanLine(y), buf.data() + rect.left(), rect.width());
+        }
+        return;
+    }
+
+    int const num_bytes = (rect.width() + 7) / 8;
+    int const shift = rect.left() % 8;
+
     for (int y = 0; y < height; ++y) {
-        TIFFReadScanline(tif.handle(), image.scanLine(y), y);
+        TIFFReadScanline(tif.handle(), buf.data(), top + y);
+
+        uint8 const* src = buf.data() + rect.left() / 8;
+        uint8* dst = (uint8*)image.scanLine(y);
+        if (shift == 0) {
+            memcpy(dst, src, num_bytes);
+        } else {
+            for (int i = 0; i < num_bytes; ++i) {
+                dst[i] = static_cast<uint8>((src[i] << shift) | (src[i + 1] >> (8 - shift)));
+            }
+        }
     }
 }
 
 void
 TiffReader::readAndUnpackLines(
-    TiffHandle const& tif, TiffInfo const& info, QImage& image)
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& rect, QImage& image)
 {
     TiffBuffer<uint8> buf(TIFFScanlineSize(tif.handle()));
 
-    int const width = image.width();
-    int const height = image.height();
+    int const width = rect.width();
+    int const height = rect.height();
     int const bits_per_sample = info.bits_per_sample;
     unsigned const dst_mask = (1 << bits_per_sample) - 1;
+    int const first_bit = rect.left() * bits_per_sample;
 
     for (int y = 0; y < height; ++y) {
-        TIFFReadScanline(tif.handle(), buf.data(), y);
+        TIFFReadScanline(tif.handle(), buf.data(), rect.top() + y);
 
         unsigned accum = 0;
         int bits_in_accum = 0;
 
-        uint8 const* src = buf.data();
+        uint8 const* src = buf.data() + first_bit / 8;
         uint8* dst = (uint8*)image.scanLine(y);
 
+        if (first_bit % 8 != 0) {
+            // The bits above the ones we need are masked out below.
+            accum = *src;
+            bits_in_accum = 8 - first_bit % 8;
+            ++src;
+        }
+
         for (int i = width; i > 0; --i, ++dst) {
             while (bits_in_accum < bits_per_sample) {
                 accum <<= 8;
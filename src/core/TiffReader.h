@@ -21,9 +21,13 @@
 
 #include "ImageMetadataLoader.h"
 #include "VirtualFunction.h"
+#include <QSize>
+#include <QRect>
+#include <QImage>
+#include <QVector>
+#include <QColor>
 
 class QIODevice;
-class QImage;
 class ImageMetadata;
 class Dpi;
 
@@ -43,30 +47,106 @@ public:
      *        opened for reading and must be seekable.
      * \param page_num A zero-based page number within a multi-page
      *        TIFF file.
+     * \param box If not empty, the image is going to be scaled down
+     *        to fit it.  If the page has reduced resolution sub-images,
+     *        the smallest one not smaller than that is read instead.
      * \return The resulting image, or a null image in case of failure.
      */
-    static QImage readImage(QIODevice& device, int page_num = 0);
+    static QImage readImage(QIODevice& device, int page_num = 0,
+                            QSize const& box = QSize());
+
+    /**
+     * \brief Reads a rectangle of a page.
+     *
+     * Only the strips covering \p rect are decoded, and only the
+     * rectangle is kept in memory.
+     *
+     * \param rect The rectangle in page coordinates.  It's clipped
+     *        to the page.
+     * \return The image of the clipped rectangle, or a null image in case
+     *         of failure or if the rectangle doesn't intersect the page.
+     */
+    static QImage readRegion(QIODevice& device, int page_num, QRect const& rect);
+
+    /**
+     * \brief Reads a page band by band, without ever having all of it
+     *        in memory.
+     *
+     * \p out will be called like this: bool out(QImage const& band, int top),
+     * where \p top is the page row the band starts at.  Returning false
+     * from it stops the reading.  Bands follow the strips of the file and
+     * go from top to bottom.  They are as wide as \p rect, clipped to
+     * the page, or as the page if \p rect is null.
+     *
+     * \return true if all of the bands were read and accepted.
+     */
+    template<typename OutFunc>
+    static bool readBands(QIODevice& device, int page_num,
+                          OutFunc out, QRect const& rect = QRect());
 private:
     class TiffHeader;
     class TiffHandle;
     struct TiffInfo;
     template<typename T> class TiffBuffer;
 
+    static bool readBandsImpl(
+        QIODevice& device, int page_num, QRect const& rect,
+        VirtualFunction2<bool, QImage const&, int>& out);
+
+    static bool openPage(
+        QIODevice& device, int page_num, TiffHandle& tif, TiffHeader& header);
+
     static TiffHeader readHeader(QIODevice& device);
 
     static bool checkHeader(TiffHeader const& header);
 
     static ImageMetadata currentPageMetadata(TiffHandle const& tif);
 
+    static bool selectReducedImage(TiffHandle const& tif, QSize const& min_size);
+
     static Dpi getDpi(float xres, float yres, unsigned res_unit);
 
-    static QImage extractBinaryOrIndexed8Image(
-        TiffHandle const& tif, TiffInfo const& info);
+    static QVector<QRgb> colorTable(TiffHandle const& tif, TiffInfo const& info);
+
+    static QImage createImage(
+        TiffInfo const& info, QVector<QRgb> const& color_table, QSize const& size);
+
+    static QImage readPageRegion(
+        TiffHandle const& tif, TiffInfo const& info, QRect const& rect);
+
+    static QImage readDownscaled(
+        TiffHandle const& tif, TiffInfo const& info, int factor);
+
+    static bool readPageBands(
+        TiffHandle const& tif, TiffInfo const& info, QRect const& rect,
+        VirtualFunction2<bool, QImage const&, int>& out);
 
-    static void readLines(TiffHandle const& tif, QImage& image);
+    static int bandHeight(TiffHandle const& tif, TiffInfo const& info);
+
+    static bool readRows(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& rect, QImage& image);
+
+    static bool readRgbaRows(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& rect, QImage& image);
+
+    static void readLines(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& rect, QImage& image);
 
     static void readAndUnpackLines(
-        TiffHandle const& tif, TiffInfo const& info, QImage& image);
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& rect, QImage& image);
 };
 
+template<typename OutFunc>
+bool
+TiffReader::readBands(
+    QIODevice& device, int const page_num, OutFunc out, QRect const& rect)
+{
+    ProxyFunction2<OutFunc, bool, QImage const&, int> proxy(out);
+    return readBandsImpl(device, page_num, rect, proxy);
+}
+
 #endif
@@ -22,15 +22,20 @@
 #include "Dpm.h"
 #include "imageproc/Constants.h"
 #include "settings/globalstaticsettings.h"
+#include "StageProfiler.h"
 #include <QtGlobal>
 #include <QFile>
 #include <QIODevice>
 #include <QImage>
+#include <QBuffer>
+#include <QByteArray>
+#include <QAtomicInt>
 #include <QColor>
 #include <QVector>
 #include <QSize>
 #include <QDebug>
 #include <vector>
+#include <algorithm>
 #include <tiff.h>
 #include <tiffio.h>
 #include <string.h>
@@ -78,26 +83,6 @@ TiffWriter::m_reverseBitsLUT[256] = {
     0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
 };
 
-class TiffWriter::TiffHandle
-{
-public:
-    TiffHandle(TIFF* handle) : m_pHandle(handle) {}
-
-    ~TiffHandle()
-    {
-        if (m_pHandle) {
-            TIFFClose(m_pHandle);
-        }
-    }
-
-    TIFF* handle() const
-    {
-        return m_pHandle;
-    }
-private:
-    TIFF* m_pHandle;
-};
-
 static tsize_t deviceRead(thandle_t context, tdata_t data, tsize_t size)
 {
     QIODevice* dev = (QIODevice*)context;
@@ -184,25 +169,41 @@ TiffWriter::writeImage(QIODevice& device, QImage const& image, bool multipage, i
     if (image.isNull()) {
         return false;
     }
-    if (!device.isWritable()) {
+
+    TiffHandle tif(openDevice(device, (multipage && page_no > 0) ? "aBm" : "wBm"));
+    if (!tif.handle()) {
         return false;
     }
+
+    return writePage(tif, image, multipage, page_no, compression_used);
+}
+
+TIFF*
+TiffWriter::openDevice(QIODevice& device, char const* mode)
+{
+    if (!device.isWritable()) {
+        return nullptr;
+    }
     if (device.isSequential()) {
         // libtiff needs to be able to seek.
-        return false;
+        return nullptr;
     }
 
-    const QString open_mode = (multipage && page_no > 0) ? "aBm" : "wBm";
-    TiffHandle tif(
-        TIFFClientOpen(
-            // Libtiff seems to be buggy with L or H flags,
-            // so we use B.
-            "file", open_mode.toStdString().c_str(), &device, &deviceRead, &deviceWrite,
-            &deviceSeek, &deviceClose, &deviceSize,
-            &deviceMap, &deviceUnmap
-        )
-    );
-    if (!tif.handle()) {
+    return TIFFClientOpen(
+               // Libtiff seems to be buggy with L or H flags,
+               // so we use B.
+               "file", mode, &device, &deviceRead, &deviceWrite,
+               &deviceSeek, &deviceClose, &deviceSize,
+               &deviceMap, &deviceUnmap
+           );
+}
+
+bool
+TiffWriter::writePage(TiffHandle const& tif, QImage const& image, bool multipage, int page_no, QString* compression_used)
+{
+    ScopedStageTimer const timer("tiff_writer");
+
+    if (image.isNull()) {
         return false;
     }
 
@@ -387,16 +388,9 @@ TiffWriter::writeRGB32Image(
         TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
     }
 
-    int const width = image.width();
-    int const height = image.height();
-
-    std::vector<uint8_t> tmp_line(width * 3);
-
     // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
-
-    for (int y = 0; y < height; ++y) {
-        uint32_t const* p_src = (uint32_t const*)image.scanLine(y);
-        uint8_t* p_dst = &tmp_line[0];
+    LineConverter const convert = [](uint8_t const* src_line, uint8_t* p_dst, int const width) {
+        uint32_t const* p_src = (uint32_t const*)src_line;
         for (int x = 0; x < width; ++x) {
             uint32_t const ARGB = *p_src;
             p_dst[0] = static_cast<uint8_t>(ARGB >> 16);
@@ -405,9 +399,10 @@ TiffWriter::writeRGB32Image(
             ++p_src;
             p_dst += 3;
         }
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-            return false;
-        }
+    };
+
+    if (!writeLines(tif, image, image.width() * 3, convert)) {
+        return false;
     }
 
     if (multipage && (TIFFWriteDirectory(tif.handle()) == -1)) {
@@ -431,16 +426,9 @@ TiffWriter::writeARGB32Image(
         TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
     }
 
-    int const width = image.width();
-    int const height = image.height();
-
-    std::vector<uint8_t> tmp_line(width * 4);
-
     // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
-
-    for (int y = 0; y < height; ++y) {
-        uint32_t const* p_src = (uint32_t const*)image.scanLine(y);
-        uint8_t* p_dst = &tmp_line[0];
+    LineConverter const convert = [](uint8_t const* src_line, uint8_t* p_dst, int const width) {
+        uint32_t const* p_src = (uint32_t const*)src_line;
         for (int x = 0; x < width; ++x) {
             uint32_t const ARGB = *p_src;
             p_dst[0] = static_cast<uint8_t>(ARGB >> 16);
@@ -450,9 +438,10 @@ TiffWriter::writeARGB32Image(
             ++p_src;
             p_dst += 4;
         }
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-            return false;
-        }
+    };
+
+    if (!writeLines(tif, image, image.width() * 4, convert)) {
+        return false;
     }
 
     if (multipage && (TIFFWriteDirectory(tif.handle()) == -1)) {
@@ -462,21 +451,48 @@ TiffWriter::writeARGB32Image(
     return true;
 }
 
+/**
+ * The layout of strips, to encode them without touching the main TIFF handle.
+ */
+struct TiffWriter::StripFormat
+{
+    uint32 width;
+    uint16 bitsPerSample;
+    uint16 samplesPerPixel;
+    uint16 photometric;
+    uint16 fillOrder;
+    uint16 compression;
+    uint16 predictor;
+};
+
+/**
+ * Writes the image data, once the tags of the directory are set.
+ */
 bool
-TiffWriter::write8bitLines(
-    TiffHandle const& tif, QImage const& image)
+TiffWriter::writeLines(
+    TiffHandle const& tif, QImage const& image,
+    int const bytes_per_line, LineConverter const convert)
 {
     int const width = image.width();
     int const height = image.height();
 
+    int const rows_per_strip = rowsPerStrip(bytes_per_line, height);
+    TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(rows_per_strip));
+
+    uint16 compression = COMPRESSION_NONE;
+    TIFFGetField(tif.handle(), TIFFTAG_COMPRESSION, &compression);
+
+    if (height > rows_per_strip && canEncodeStripsSeparately(compression)) {
+        return writeStripsInParallel(tif, image, bytes_per_line, rows_per_strip, convert);
+    }
+
     // TIFFWriteScanline() can actually modify the data you pass it,
-    // so we have to use a temporary buffer even when no coversion
+    // so we have to use a temporary buffer even when no conversion
     // is required.
-    std::vector<uint8_t> tmp_line(width, 0);
+    std::vector<uint8_t> tmp_line(bytes_per_line, 0);
 
     for (int y = 0; y < height; ++y) {
-        uint8_t const* src_line = image.scanLine(y);
-        memcpy(&tmp_line[0], src_line, tmp_line.size());
+        convert(image.scanLine(y), &tmp_line[0], width);
         if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
             return false;
         }
@@ -485,49 +501,183 @@ TiffWriter::write8bitLines(
     return true;
 }
 
+/**
+ * Compresses strips on several threads and writes them in order
+ * with TIFFWriteRawStrip().  The strips decode to the same pixels
+ * as if they were compressed by the main TIFF handle, but the bytes
+ * aren't guaranteed to be identical.  Deflate, for one, may produce
+ * a different, though equivalent, compressed stream.
+ */
 bool
-TiffWriter::writeBinaryLinesAsIs(
-    TiffHandle const& tif, QImage const& image)
+TiffWriter::writeStripsInParallel(
+    TiffHandle const& tif, QImage const& image, int const bytes_per_line,
+    int const rows_per_strip, LineConverter const convert)
 {
+    StripFormat format;
+    format.width = image.width();
+    format.bitsPerSample = 8;
+    format.samplesPerPixel = 1;
+    format.photometric = PHOTOMETRIC_MINISBLACK;
+    format.fillOrder = FILLORDER_MSB2LSB;
+    format.compression = COMPRESSION_NONE;
+    format.predictor = PREDICTOR_NONE;
+    TIFFGetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, &format.bitsPerSample);
+    TIFFGetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, &format.samplesPerPixel);
+    TIFFGetField(tif.handle(), TIFFTAG_PHOTOMETRIC, &format.photometric);
+    TIFFGetField(tif.handle(), TIFFTAG_FILLORDER, &format.fillOrder);
+    TIFFGetField(tif.handle(), TIFFTAG_COMPRESSION, &format.compression);
+    TIFFGetField(tif.handle(), TIFFTAG_PREDICTOR, &format.predictor);
+
     int const width = image.width();
     int const height = image.height();
+    int const num_strips = (height + rows_per_strip - 1) / rows_per_strip;
+    QAtomicInt failed(0);
+
+    // Strips are compressed in parallel, but written in order,
+    // so that at most a few compressed strips are held in memory.
+    #pragma omp parallel for ordered schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        QByteArray encoded;
+        if (failed.loadAcquire() == 0) {
+            int const first_row = strip * rows_per_strip;
+            int const rows = std::min(rows_per_strip, height - first_row);
+            std::vector<uint8_t> data(size_t(rows) * bytes_per_line);
+            for (int i = 0; i < rows; ++i) {
+                convert(image.scanLine(first_row + i), &data[size_t(i) * bytes_per_line], width);
+            }
+            encoded = encodeStrip(format, rows, &data[0], data.size());
+        }
 
-    // TIFFWriteScanline() can actually modify the data you pass it,
-    // so we have to use a temporary buffer even when no conversion
-    // is required.
-    int const bpl = (width + 7) / 8;
-    std::vector<uint8_t> tmp_line(bpl, 0);
-
-    for (int y = 0; y < height; ++y) {
-        uint8_t const* src_line = image.scanLine(y);
-        memcpy(&tmp_line[0], src_line, bpl);
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-            return false;
+        #pragma omp ordered
+        {
+            if (failed.loadAcquire() == 0) {
+                if (encoded.isNull()
+                        || TIFFWriteRawStrip(tif.handle(), strip, encoded.data(), encoded.size()) == -1) {
+                    failed.storeRelease(1);
+                }
+            }
         }
     }
 
-    return true;
+    return failed.loadAcquire() == 0;
+}
+
+/**
+ * Compresses a single strip.
+ *
+ * libtiff doesn't offer its codecs separately from TIFF handles,
+ * so the strip is written as the only strip of a scratch TIFF in
+ * memory, from where the compressed bytes are taken.
+ *
+ * \return The compressed strip, or a null array on failure.
+ */
+QByteArray
+TiffWriter::encodeStrip(
+    StripFormat const& format, int const rows, uint8_t* const data, tmsize_t const size)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+
+    TiffHandle scratch(openDevice(buffer, "wBm"));
+    if (!scratch.handle()) {
+        return QByteArray();
+    }
+
+    // Palettes don't affect compression, but libtiff would insist on a colormap.
+    uint16 const photometric = format.photometric == PHOTOMETRIC_PALETTE
+                               ? uint16(PHOTOMETRIC_MINISBLACK) : format.photometric;
+
+    TIFFSetField(scratch.handle(), TIFFTAG_IMAGEWIDTH, format.width);
+    TIFFSetField(scratch.handle(), TIFFTAG_IMAGELENGTH, uint32(rows));
+    TIFFSetField(scratch.handle(), TIFFTAG_ROWSPERSTRIP, uint32(rows));
+    TIFFSetField(scratch.handle(), TIFFTAG_BITSPERSAMPLE, format.bitsPerSample);
+    TIFFSetField(scratch.handle(), TIFFTAG_SAMPLESPERPIXEL, format.samplesPerPixel);
+    TIFFSetField(scratch.handle(), TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(scratch.handle(), TIFFTAG_PHOTOMETRIC, photometric);
+    TIFFSetField(scratch.handle(), TIFFTAG_FILLORDER, format.fillOrder);
+    TIFFSetField(scratch.handle(), TIFFTAG_COMPRESSION, format.compression);
+    if (format.predictor != PREDICTOR_NONE) {
+        TIFFSetField(scratch.handle(), TIFFTAG_PREDICTOR, format.predictor);
+    }
+
+    if (TIFFWriteEncodedStrip(scratch.handle(), 0, data, size) == -1) {
+        return QByteArray();
+    }
+
+    // The strip is the last thing written so far.
+    tmsize_t const encoded_size = TIFFRawStripSize(scratch.handle(), 0);
+    if (encoded_size <= 0 || encoded_size > buffer.size()) {
+        return QByteArray();
+    }
+
+    return buffer.data().right(int(encoded_size));
 }
 
+int
+TiffWriter::rowsPerStrip(int const bytes_per_line, int const height)
+{
+    int rows = GlobalStaticSettings::m_tiff_rows_per_strip;
+    if (rows <= 0) {
+        // About 256K of uncompressed data per strip: big enough
+        // to compress well, and small enough to read parts of.
+        rows = std::max(1, (256 * 1024) / std::max(1, bytes_per_line));
+    }
+
+    return std::min(rows, std::max(1, height));
+}
+
+/**
+ * Tells if strips may be compressed independently from each other,
+ * which isn't the case with JPEG, as it shares tables between strips.
+ * Uncompressed strips aren't worth doing in parallel.
+ */
 bool
-TiffWriter::writeBinaryLinesReversed(
+TiffWriter::canEncodeStripsSeparately(uint16 const compression)
+{
+    switch (compression) {
+    case COMPRESSION_LZW:
+    case COMPRESSION_ADOBE_DEFLATE:
+    case COMPRESSION_DEFLATE:
+    case COMPRESSION_PACKBITS:
+    case COMPRESSION_CCITTFAX4:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool
+TiffWriter::write8bitLines(
     TiffHandle const& tif, QImage const& image)
 {
-    int const width = image.width();
-    int const height = image.height();
+    LineConverter const convert = [](uint8_t const* src_line, uint8_t* dst_line, int const width) {
+        memcpy(dst_line, src_line, width);
+    };
 
-    int const bpl = (width + 7) / 8;
-    std::vector<uint8_t> tmp_line(bpl, 0);
+    return writeLines(tif, image, image.width(), convert);
+}
 
-    for (int y = 0; y < height; ++y) {
-        uint8_t const* src_line = image.scanLine(y);
+bool
+TiffWriter::writeBinaryLinesAsIs(
+    TiffHandle const& tif, QImage const& image)
+{
+    LineConverter const convert = [](uint8_t const* src_line, uint8_t* dst_line, int const width) {
+        memcpy(dst_line, src_line, (width + 7) / 8);
+    };
+
+    return writeLines(tif, image, (image.width() + 7) / 8, convert);
+}
+
+bool
+TiffWriter::writeBinaryLinesReversed(
+    TiffHandle const& tif, QImage const& image)
+{
+    LineConverter const convert = [](uint8_t const* src_line, uint8_t* dst_line, int const width) {
+        int const bpl = (width + 7) / 8;
         for (int i = 0; i < bpl; ++i) {
-            tmp_line[i] = m_reverseBitsLUT[src_line[i]];
+            dst_line[i] = m_reverseBitsLUT[src_line[i]];
         }
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-            return false;
-        }
-    }
+    };
 
-    return true;
+    return writeLines(tif, image, (image.width() + 7) / 8, convert);
 }
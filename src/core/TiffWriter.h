@@ -22,11 +22,14 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <tiff.h>
+#include <tiffio.h>
 
 class QIODevice;
 class QString;
 class QImage;
+class QByteArray;
 class Dpm;
+class MultipageTiffSink;
 
 class TiffWriter
 {
@@ -60,9 +63,48 @@ public:
      */
 
 private:
+    friend class MultipageTiffSink;
+
+    class TiffHandle
+    {
+    public:
+        TiffHandle(TIFF* handle) : m_pHandle(handle) {}
+
+        ~TiffHandle()
+        {
+            if (m_pHandle) {
+                TIFFClose(m_pHandle);
+            }
+        }
+
+        TIFF* handle() const
+        {
+            return m_pHandle;
+        }
+    private:
+        TiffHandle(TiffHandle const&);
+        TiffHandle& operator=(TiffHandle const&);
+
+        TIFF* m_pHandle;
+    };
+
     static bool writeImage(QIODevice& device, QImage const& image, bool multipage = false, int page_no = 0, QString* compression_used = nullptr);
 
-    class TiffHandle;
+    /**
+     * \brief Opens libtiff on top of an IO device.
+     *
+     * \param mode "wBm" to create a new file or "aBm" to append to one.
+     * \return The libtiff handle, or null on failure.
+     */
+    static TIFF* openDevice(QIODevice& device, char const* mode);
+
+    /**
+     * \brief Writes the image as the current directory of an open TIFF.
+     *
+     * For multipage files, the directory is finished, so that
+     * the next image goes to a new one.
+     */
+    static bool writePage(TiffHandle const& tif, QImage const& image, bool multipage, int page_no, QString* compression_used);
 
     static void setDpm(TiffHandle const& tif, Dpm const& dpm);
 
@@ -74,6 +116,28 @@ private:
 
     static bool writeARGB32Image(TiffHandle const& tif, QImage const& image, bool multipage, int compression = COMPRESSION_LZW);
 
+    struct StripFormat;
+
+    /**
+     * Converts a line of a QImage to the sample layout libtiff expects.
+     */
+    typedef void (*LineConverter)(uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    static bool writeLines(
+        TiffHandle const& tif, QImage const& image,
+        int bytes_per_line, LineConverter convert);
+
+    static bool writeStripsInParallel(
+        TiffHandle const& tif, QImage const& image, int bytes_per_line,
+        int rows_per_strip, LineConverter convert);
+
+    static QByteArray encodeStrip(
+        StripFormat const& format, int rows, uint8_t* data, tmsize_t size);
+
+    static int rowsPerStrip(int bytes_per_line, int height);
+
+    static bool canEncodeStripsSeparately(uint16 compression);
+
     static bool write8bitLines(
         TiffHandle const& tif, QImage const& image);
 
@@ -24,6 +24,9 @@
 #include <QEvent>
 #include "settings/ini_keys.h"
 #include <QtGlobal> // For Q_OS_LINUX
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <new>
 #include <assert.h>
 
@@ -42,7 +45,7 @@ public:
         ThreadRestartRequired
     };
 
-    Dispatcher(Impl& owner);
+    Dispatcher(Impl& owner, int omp_threads);
 
     UpdatePriorityResult updateThreadPriority(BackgroundTask const& task);
 
@@ -53,6 +56,7 @@ private:
     void processTask(BackgroundTaskPtr const& task);
 
     Impl& m_rOwner;
+    int m_ompThreads;
 
     /**
      * This one will be set if we decide we need to restart
@@ -66,7 +70,7 @@ class WorkerThread::Impl : public QThread
 public:
     enum { NormalExit = 0, ExitForRestart };
 
-    Impl(WorkerThread& owner);
+    Impl(WorkerThread& owner, int omp_threads);
 
     ~Impl();
 
@@ -119,9 +123,9 @@ private:
 
 /*=============================== WorkerThread ==============================*/
 
-WorkerThread::WorkerThread(QObject* parent)
+WorkerThread::WorkerThread(QObject* parent, int const omp_threads)
     :   QObject(parent),
-        m_ptrImpl(new Impl(*this))
+        m_ptrImpl(new Impl(*this, omp_threads))
 {
 }
 
@@ -150,10 +154,17 @@ WorkerThread::emitTaskResult(
     emit taskResult(task, result);
 }
 
+void
+WorkerThread::emitTaskFinished(BackgroundTaskPtr const& task)
+{
+    emit taskFinished(task);
+}
+
 /*======================== WorkerThread::Dispatcher ========================*/
 
-WorkerThread::Dispatcher::Dispatcher(Impl& owner)
-    :   m_rOwner(owner)
+WorkerThread::Dispatcher::Dispatcher(Impl& owner, int const omp_threads)
+    :   m_rOwner(owner),
+        m_ompThreads(omp_threads)
 {
 }
 
@@ -238,27 +249,36 @@ WorkerThread::Dispatcher::customEvent(QEvent* event)
 void
 WorkerThread::Dispatcher::processTask(BackgroundTaskPtr const& task)
 {
-    if (task->isCancelled()) {
-        return;
+#ifdef _OPENMP
+    // The thread may have been restarted since the last task,
+    // and a new thread starts with the default.
+    if (m_ompThreads > 0) {
+        omp_set_num_threads(m_ompThreads);
     }
+#endif
+
+    FilterResultPtr result;
 
-    try {
-        FilterResultPtr const result((*task)());
-        if (result) {
-            QCoreApplication::postEvent(
-                &m_rOwner, new TaskResultEvent(task, result)
-            );
+    if (!task->isCancelled()) {
+        try {
+            result = (*task)();
+        } catch (std::bad_alloc const&) {
+            OutOfMemoryHandler::instance().handleOutOfMemorySituation();
         }
-    } catch (std::bad_alloc const&) {
-        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
     }
+
+    // The event is posted even without a result, so that
+    // taskFinished() is emitted for every task.
+    QCoreApplication::postEvent(
+        &m_rOwner, new TaskResultEvent(task, result)
+    );
 }
 
 /*========================== WorkerThread::Impl ============================*/
 
-WorkerThread::Impl::Impl(WorkerThread& owner)
+WorkerThread::Impl::Impl(WorkerThread& owner, int const omp_threads)
     :   m_rOwner(owner),
-        m_dispatcher(*this),
+        m_dispatcher(*this, omp_threads),
         m_threadStarted(false)
 {
     m_dispatcher.moveToThread(this);
@@ -299,7 +319,10 @@ WorkerThread::Impl::customEvent(QEvent* event)
     }
 
     if (TaskResultEvent* evt = dynamic_cast<TaskResultEvent*>(event)) {
-        m_rOwner.emitTaskResult(evt->task(), evt->result());
+        if (evt->result()) {
+            m_rOwner.emitTaskResult(evt->task(), evt->result());
+        }
+        m_rOwner.emitTaskFinished(evt->task());
     }
 }
 
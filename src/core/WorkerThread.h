@@ -30,7 +30,11 @@ class WorkerThread : public QObject
     Q_OBJECT
     DECLARE_NON_COPYABLE(WorkerThread)
 public:
-    WorkerThread(QObject* parent = 0);
+    /**
+     * \param omp_threads The number of threads OpenMP loops in tasks
+     *        may use.  Zero means the OpenMP default.
+     */
+    WorkerThread(QObject* parent = 0, int omp_threads = 0);
 
     ~WorkerThread();
 
@@ -44,10 +48,23 @@ public:
 public slots:
     void performTask(BackgroundTaskPtr const& task);
 signals:
+    /**
+     * \brief Emitted for tasks that produced a result.
+     */
     void taskResult(BackgroundTaskPtr const& task, FilterResultPtr const& result);
+
+    /**
+     * \brief Emitted for every task, after taskResult(), if any.
+     *
+     * This includes tasks that were cancelled or failed.  Once this signal
+     * is emitted, the thread is ready to take another task.
+     */
+    void taskFinished(BackgroundTaskPtr const& task);
 private:
     void emitTaskResult(BackgroundTaskPtr const& task, FilterResultPtr const& result);
 
+    void emitTaskFinished(BackgroundTaskPtr const& task);
+
     class Impl;
     class Dispatcher;
     class PerformTaskEvent;
@@ -0,0 +1,170 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkerThreadPool.h"
+#include "WorkerThread.h"
+#include "LoadFileTask.h"
+#include "settings/ini_keys.h"
+#include <QThread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <algorithm>
+#include <assert.h>
+
+namespace
+{
+
+/**
+ * Tasks of other kinds aren't tied to an image, and get a null ImageId.
+ */
+ImageId imageIdOf(BackgroundTask const& task)
+{
+    if (LoadFileTask const* load_task = dynamic_cast<LoadFileTask const*>(&task)) {
+        return load_task->imageId();
+    }
+    return ImageId();
+}
+
+} // anonymous namespace
+
+WorkerThreadPool::WorkerThreadPool(int num_threads, QObject* parent)
+    :   QObject(parent)
+{
+    if (num_threads <= 0) {
+        num_threads = defaultNumThreads();
+    }
+
+    // Split the cores between the workers, as each of them may run
+    // OpenMP loops, the same way the command line version does.
+    int omp_threads = 0;
+#ifdef _OPENMP
+    omp_threads = std::max(1, omp_get_max_threads() / num_threads);
+#endif
+
+    for (int i = 0; i < num_threads; ++i) {
+        WorkerThread* thread = new WorkerThread(this, omp_threads);
+        connect(
+            thread, SIGNAL(taskResult(BackgroundTaskPtr,FilterResultPtr)),
+            this, SIGNAL(taskResult(BackgroundTaskPtr,FilterResultPtr))
+        );
+        connect(
+            thread, SIGNAL(taskFinished(BackgroundTaskPtr)),
+            this, SLOT(threadFinishedTask(BackgroundTaskPtr))
+        );
+        m_threads.push_back(thread);
+        m_idleThreads.push_back(thread);
+    }
+}
+
+WorkerThreadPool::~WorkerThreadPool()
+{
+    shutdown();
+}
+
+int
+WorkerThreadPool::defaultNumThreads()
+{
+    int num_threads = QSettings().value(
+        _key_batch_processing_threads, _key_batch_processing_threads_def
+    ).toInt();
+    if (num_threads <= 0) {
+        num_threads = QThread::idealThreadCount();
+    }
+    return std::max(1, num_threads);
+}
+
+void
+WorkerThreadPool::shutdown()
+{
+    m_pendingTasks.clear();
+    m_idleThreads.clear();
+    m_busyImages.clear();
+
+    for (WorkerThread* thread : m_threads) {
+        thread->shutdown();
+    }
+}
+
+void
+WorkerThreadPool::performTask(BackgroundTaskPtr const& task)
+{
+    if (!task) {
+        return;
+    }
+
+    if (task->type() == BackgroundTask::INTERACTIVE) {
+        // Put it after other interactive tasks but ahead of batch ones.
+        std::deque<BackgroundTaskPtr>::iterator it(m_pendingTasks.begin());
+        while (it != m_pendingTasks.end() && (*it)->type() == BackgroundTask::INTERACTIVE) {
+            ++it;
+        }
+        m_pendingTasks.insert(it, task);
+    } else {
+        m_pendingTasks.push_back(task);
+    }
+
+    dispatchPendingTasks();
+}
+
+void
+WorkerThreadPool::threadFinishedTask(BackgroundTaskPtr const& task)
+{
+    WorkerThread* thread = qobject_cast<WorkerThread*>(sender());
+    assert(thread);
+
+    if (std::find(m_threads.begin(), m_threads.end(), thread) == m_threads.end()) {
+        return;
+    }
+
+    m_busyImages.erase(imageIdOf(*task));
+    m_idleThreads.push_back(thread);
+    dispatchPendingTasks();
+}
+
+void
+WorkerThreadPool::dispatchPendingTasks()
+{
+    std::deque<BackgroundTaskPtr>::iterator it(m_pendingTasks.begin());
+    while (!m_idleThreads.empty() && it != m_pendingTasks.end()) {
+        BackgroundTaskPtr const task(*it);
+
+        if (task->isCancelled()) {
+            // No point in occupying a thread with it.
+            it = m_pendingTasks.erase(it);
+            continue;
+        }
+
+        ImageId const image_id(imageIdOf(*task));
+        if (!image_id.isNull()) {
+            if (m_busyImages.find(image_id) != m_busyImages.end()) {
+                // Wait for the task already processing this image,
+                // but let the tasks behind this one go ahead.
+                ++it;
+                continue;
+            }
+            m_busyImages.insert(image_id);
+        }
+
+        it = m_pendingTasks.erase(it);
+
+        WorkerThread* thread = m_idleThreads.back();
+        m_idleThreads.pop_back();
+        thread->performTask(task);
+    }
+}
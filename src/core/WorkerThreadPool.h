@@ -0,0 +1,103 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKERTHREADPOOL_H_
+#define WORKERTHREADPOOL_H_
+
+#include "NonCopyable.h"
+#include "BackgroundTask.h"
+#include "FilterResult.h"
+#include "ImageId.h"
+#include <QObject>
+#include <deque>
+#include <vector>
+#include <set>
+
+class WorkerThread;
+
+/**
+ * \brief A set of WorkerThread objects sharing a queue of tasks.
+ *
+ * The interface mirrors that of WorkerThread.  Tasks that can't be
+ * started right away because all threads are busy are queued, with
+ * INTERACTIVE tasks going ahead of BATCH ones.
+ *
+ * At most one task per image runs at a time.  A cancelled task keeps
+ * running until it notices it was cancelled, and a task for the same
+ * image submitted in the meantime would be writing the same files and
+ * settings, so it's held back until the cancelled one finishes.
+ *
+ * \note All methods are to be called from the GUI thread only.
+ */
+class WorkerThreadPool : public QObject
+{
+    Q_OBJECT
+    DECLARE_NON_COPYABLE(WorkerThreadPool)
+public:
+    /**
+     * \param num_threads The number of worker threads.  Zero means
+     *        the value from the application settings, or one thread
+     *        per CPU core if that's not set.
+     */
+    WorkerThreadPool(int num_threads = 0, QObject* parent = 0);
+
+    ~WorkerThreadPool();
+
+    /**
+     * \brief Drops the queued tasks, waits for the running ones to finish
+     *        and stops the threads.
+     */
+    void shutdown();
+
+    int numThreads() const
+    {
+        return static_cast<int>(m_threads.size());
+    }
+
+    /**
+     * \brief The number of threads not currently processing a task.
+     *
+     * Batch processing uses this to decide how many tasks to submit.
+     */
+    int numIdleThreads() const
+    {
+        return static_cast<int>(m_idleThreads.size());
+    }
+
+    static int defaultNumThreads();
+public slots:
+    void performTask(BackgroundTaskPtr const& task);
+signals:
+    /** \see WorkerThread::taskResult() */
+    void taskResult(BackgroundTaskPtr const& task, FilterResultPtr const& result);
+private slots:
+    void threadFinishedTask(BackgroundTaskPtr const& task);
+private:
+    void dispatchPendingTasks();
+
+    std::vector<WorkerThread*> m_threads;
+    std::vector<WorkerThread*> m_idleThreads;
+    std::deque<BackgroundTaskPtr> m_pendingTasks;
+
+    /**
+     * Images that have a task running on one of the threads.
+     */
+    std::set<ImageId> m_busyImages;
+};
+
+#endif
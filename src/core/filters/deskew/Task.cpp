@@ -26,6 +26,8 @@
 #include "DebugImages.h"
 #include "filters/select_content/Task.h"
 #include "FilterUiInterface.h"
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
 #include "ImageView.h"
 #include "FilterData.h"
 #include "Dpi.h"
@@ -109,6 +111,9 @@ Task::~Task()
 FilterResultPtr
 Task::process(TaskStatus const& status, FilterData const& data)
 {
+    ProfiledPage const profiled_page(m_pageId);
+    ScopedStageTimer const timer("deskew");
+
     status.throwIfCancelled();
 
     Dependencies const deps(data.xform().preCropArea(), data.xform().preRotation());
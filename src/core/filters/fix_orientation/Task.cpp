@@ -26,6 +26,8 @@
 #include "TaskStatus.h"
 #include "ImageView.h"
 #include "FilterUiInterface.h"
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
 #include <QImage>
 #include <iostream>
 
@@ -80,6 +82,9 @@ Task::process(TaskStatus const& status, FilterData const& data)
 {
     // This function is executed from the worker thread.
 
+    ProfiledPage const profiled_page(m_imageId);
+    ScopedStageTimer const timer("fix_orientation");
+
     status.throwIfCancelled();
 
     ImageTransformation xform(data.xform());
@@ -216,10 +216,15 @@ DespeckleView::despeckleDone(
     if (dbg && !dbg->empty()) {
         std::unique_ptr<TabbedDebugImages> tab_widget(new TabbedDebugImages);
         tab_widget->addTab(widget.release(), "Main");
+        QImage image;
         AutoRemovingFile file;
         QString label;
-        while (!(file = dbg->retrieveNext(&label)).get().isNull()) {
-            tab_widget->addTab(new DebugImageView(file), label);
+        while (dbg->retrieveNext(&image, &file, &label)) {
+            if (image.isNull()) {
+                tab_widget->addTab(new DebugImageView(file), label);
+            } else {
+                tab_widget->addTab(new DebugImageView(image), label);
+            }
         }
         widget = std::move(tab_widget);
     }
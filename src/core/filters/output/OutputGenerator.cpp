@@ -26,6 +26,8 @@
 #include "EstimateBackground.h"
 #include "Despeckle.h"
 #include "RenderParams.h"
+#include "StageImageCache.h"
+#include "StageProfiler.h"
 #include "dewarping/DistortionModel.h"
 #include "Dpi.h"
 #include "Dpm.h"
@@ -68,6 +70,8 @@
 #include <boost/shared_ptr.hpp>
 #endif
 #include <QImage>
+#include <QByteArray>
+#include <QDataStream>
 #include <QSize>
 #include <QPoint>
 #include <QRect>
@@ -252,7 +256,8 @@ OutputGenerator::OutputGenerator(
         m_xform(xform),
         m_outRect(xform.resultingRect().toAlignedRect()),
         m_contentRect(xform.transform().map(content_rect_phys).boundingRect().toAlignedRect()),
-        m_despeckleLevel(despeckle_level)
+        m_despeckleLevel(despeckle_level),
+        m_pStageCache(0)
 {
     /*
     std::cout << "m_outRect.left(): " << m_outRect.left() << " right(): " << m_outRect.right() << " top: " << m_outRect.top() << " bottom: " << m_outRect.bottom() << std::endl;
@@ -303,6 +308,8 @@ OutputGenerator::process(
     IntrusivePtr<Settings>* p_settings
 ) const
 {
+    ScopedStageTimer const timer("output.generate");
+
     QImage image(
         processImpl(
             status, input, picture_zones, fill_zones,
@@ -322,6 +329,78 @@ OutputGenerator::process(
     return image;
 }
 
+QImage
+OutputGenerator::redespeckle(
+    TaskStatus const& status, QImage const& output,
+    BinaryImage const& old_speckles,
+    BinaryImage* speckles_image, DebugImages* const dbg) const
+{
+    ScopedStageTimer const timer("output.redespeckle");
+
+    QSize const target_size(m_outRect.size().expandedTo(QSize(1, 1)));
+    if (output.size() != target_size) {
+        return QImage();
+    }
+
+    BinaryImage bw_content(output);
+    if (!old_speckles.isNull()) {
+        if (old_speckles.size() != target_size) {
+            return QImage();
+        }
+        rasterOp<RopOr<RopSrc, RopDst> >(bw_content, old_speckles);
+    }
+
+    status.throwIfCancelled();
+
+    maybeDespeckleInPlace(
+        bw_content, m_outRect, m_outRect, m_despeckleLevel,
+        speckles_image, m_dpi, status, dbg
+    );
+
+    QImage image(bw_content.toQImage());
+
+    Dpm const output_dpm(m_dpi);
+    image.setDotsPerMeterX(output_dpm.horizontal());
+    image.setDotsPerMeterY(output_dpm.vertical());
+
+    return image;
+}
+
+QByteArray
+OutputGenerator::stageCacheParams(
+    FilterData const& input, QRect const& target_rect) const
+{
+    // The transformation already accounts for the output DPI.
+    QByteArray params;
+    QDataStream strm(&params, QIODevice::WriteOnly);
+    strm << m_xform.transform() << m_xform.resultingPreCropArea() << target_rect
+         << input.origImage().size() << qint32(input.origImage().format());
+    return params;
+}
+
+QImage
+OutputGenerator::loadStageImage(
+    PageId const* page_id, char const* stage,
+    QByteArray const& params, DebugImages const* dbg) const
+{
+    if (!m_pStageCache || !page_id || dbg) {
+        // With debugging on, we want to see every step.
+        return QImage();
+    }
+
+    return m_pStageCache->load(*page_id, QLatin1String(stage), params);
+}
+
+void
+OutputGenerator::storeStageImage(
+    PageId const* page_id, char const* stage,
+    QByteArray const& params, QImage const& image) const
+{
+    if (m_pStageCache && page_id) {
+        m_pStageCache->store(*page_id, QLatin1String(stage), params, image);
+    }
+}
+
 QSize
 OutputGenerator::outputImageSize() const
 {
@@ -341,6 +420,8 @@ OutputGenerator::normalizeIlluminationGray(
     QTransform const& xform, QRect const& target_rect,
     GrayImage* background, DebugImages* const dbg)
 {
+    ScopedStageTimer const timer("output.normalize_illumination");
+
     GrayImage to_be_normalized(
         transformToGray(
             input, xform, target_rect, OutsidePixels::assumeWeakNearest()
@@ -364,22 +445,47 @@ OutputGenerator::normalizeIlluminationGray(
 
     status.throwIfCancelled();
 
-    GrayImage bg_img(bg_ps.render(to_be_normalized.size()));
+    // The background is only kept as a whole image if someone wants to
+    // see it.  Otherwise it's rendered a row at a time and consumed right
+    // away, saving a full size buffer and a pass over it.
+    GrayImage bg_img;
+    if (background || (dbg && dbg->isWanted("background"))) {
+        bg_img = GrayImage(to_be_normalized.size());
+    }
+
+    PolynomialSurface::RowRenderer const bg_renderer(bg_ps, to_be_normalized.size());
+    int const width = to_be_normalized.width();
+    int const height = to_be_normalized.height();
+    uint8_t* const norm_data = to_be_normalized.data(); // never call .data() inside omp
+    int const norm_stride = to_be_normalized.stride();
+    uint8_t* const bg_data = bg_img.isNull() ? 0 : bg_img.data();
+    int const bg_stride = bg_img.isNull() ? 0 : bg_img.stride();
+
+    #pragma omp parallel
+    {
+        std::vector<uint8_t> bg_line(bg_data ? 0 : width);
+
+        #pragma omp for schedule(static)
+        for (int y = 0; y < height; ++y) {
+            uint8_t* const bg = bg_data ? bg_data + y * bg_stride : &bg_line[0];
+            bg_renderer.renderRow(y, bg);
+
+            uint8_t* const line = norm_data + y * norm_stride;
+            for (int x = 0; x < width; ++x) {
+                line[x] = RaiseAboveBackground::transform(line[x], bg[x]);
+            }
+        }
+    }
+
     if (dbg) {
         dbg->add(bg_img, "background");
+        dbg->add(to_be_normalized, "normalized_illumination");
     }
     if (background) {
         *background = bg_img;
     }
 
-    status.throwIfCancelled();
-
-    grayRasterOp<RaiseAboveBackground>(bg_img, to_be_normalized);
-    if (dbg) {
-        dbg->add(bg_img, "normalized_illumination");
-    }
-
-    return bg_img;
+    return to_be_normalized;
 }
 
 imageproc::BinaryImage
@@ -388,6 +494,8 @@ OutputGenerator::estimateBinarizationMask(
     QRect const& source_rect, QRect const& source_sub_rect,
     DebugImages* const dbg) const
 {
+    ScopedStageTimer const timer("output.binarization_mask");
+
     assert(source_rect.contains(source_sub_rect));
 
     // If we need to strip some of the margins from a grayscale
@@ -709,16 +817,29 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
     QPolygonF normalize_illumination_crop_area(m_xform.resultingPreCropArea());
     normalize_illumination_crop_area.translate(-normalize_illumination_rect.topLeft());
 
+    // The results of geometric transformation and illumination normalization
+    // don't depend on binarization or despeckling settings, so they may be
+    // reused when only those settings change.
+    QByteArray const stage_params(stageCacheParams(input, normalize_illumination_rect));
+
     if (render_params.normalizeIllumination() || render_params.mixedOutput()) {
-        maybe_normalized = normalizeIlluminationGray(
-                               status, input.grayImage(), orig_image_crop_area,
-                               m_xform.transform(), normalize_illumination_rect, 0, dbg
-                           );
+        maybe_normalized = loadStageImage(p_pageId, "normalized", stage_params, dbg);
+        if (maybe_normalized.isNull()) {
+            maybe_normalized = normalizeIlluminationGray(
+                                   status, input.grayImage(), orig_image_crop_area,
+                                   m_xform.transform(), normalize_illumination_rect, 0, dbg
+                               );
+            storeStageImage(p_pageId, "normalized", stage_params, maybe_normalized);
+        }
     } else {
-        maybe_normalized = transform(
-                               input.origImage(), m_xform.transform(),
-                               normalize_illumination_rect, OutsidePixels::assumeColor(Qt::white)
-                           );
+        maybe_normalized = loadStageImage(p_pageId, "orig_xform", stage_params, dbg);
+        if (maybe_normalized.isNull()) {
+            maybe_normalized = transform(
+                                   input.origImage(), m_xform.transform(),
+                                   normalize_illumination_rect, OutsidePixels::assumeColor(Qt::white)
+                               );
+            storeStageImage(p_pageId, "orig_xform", stage_params, maybe_normalized);
+        }
     }
 
     status.throwIfCancelled();
@@ -865,13 +986,17 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
         QImage tmp;
         if (!input.origImage().allGray()) {
             assert(maybe_normalized.format() == QImage::Format_Indexed8);
-            tmp = (
-                      transform(
-                          input.origImage(), m_xform.transform(),
-                          normalize_illumination_rect,
-                          OutsidePixels::assumeColor(Qt::white)
-                      )
-                  );
+            tmp = loadStageImage(p_pageId, "orig_xform", stage_params, dbg);
+            if (tmp.isNull()) {
+                tmp = (
+                          transform(
+                              input.origImage(), m_xform.transform(),
+                              normalize_illumination_rect,
+                              OutsidePixels::assumeColor(Qt::white)
+                          )
+                      );
+                storeStageImage(p_pageId, "orig_xform", stage_params, tmp);
+            }
 
             status.throwIfCancelled();
 
@@ -1510,7 +1635,7 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
             setupTrivialDistortionModel(distortion_model);
         }
 
-        if (dbg) {
+        if (dbg && dbg->isWanted("marginal dewarping")) {
             QImage out_image(bw_image.toQImage().convertToFormat(QImage::Format_RGB32));
             for (int i = 0; i <= top_spline.numSegments(); i++) {
                 drawPoint(out_image, top_spline.controlPointPosition(i));
@@ -1790,6 +1915,8 @@ OutputGenerator::dewarp(
     QTransform const& src_to_output, DistortionModel const& distortion_model,
     DepthPerception const& depth_perception, QColor const& bg_color) const
 {
+    ScopedStageTimer const timer("output.dewarp");
+
     CylindricalSurfaceDewarper const dewarper(
         createDewarper(distortion_model, orig_to_src, depth_perception.value())
     );
@@ -1882,6 +2009,8 @@ OutputGenerator::detectPictures(
     GrayImage const& input_300dpi, TaskStatus const& status,
     DebugImages* const dbg)
 {
+    ScopedStageTimer const timer("output.detect_pictures");
+
     // We stretch the range of gray levels to cover the whole
     // range of [0, 255].  We do it because we want text
     // and background to be equally far from the center
@@ -1956,6 +2085,8 @@ OutputGenerator::detectPictures(
 QImage
 OutputGenerator::smoothToGrayscale(QImage const& src, Dpi const& dpi)
 {
+    ScopedStageTimer const timer("output.smooth_to_grayscale");
+
     int const min_dpi = std::min(dpi.horizontal(), dpi.vertical());
     int window;
     int degree;
@@ -2037,6 +2168,8 @@ BinaryImage
 OutputGenerator::binarize(QImage const& image,
                           QPolygonF const& crop_area, BinaryImage const* mask, const int* adjustment) const
 {
+    ScopedStageTimer const timer("output.binarize");
+
     QPainterPath path;
     path.addPolygon(crop_area);
 
@@ -2088,6 +2221,8 @@ OutputGenerator::maybeDespeckleInPlace(
     DespeckleLevel const level, BinaryImage* speckles_img,
     Dpi const& dpi, TaskStatus const& status, DebugImages* dbg) const
 {
+    ScopedStageTimer const timer("output.despeckle");
+
     QRect const src_rect(mask_rect.translated(-image_rect.topLeft()));
     QRect const dst_rect(mask_rect);
 
@@ -2133,6 +2268,8 @@ void
 OutputGenerator::morphologicalSmoothInPlace(
     BinaryImage& bin_img, TaskStatus const& status)
 {
+    ScopedStageTimer const timer("output.morphological_smoothing");
+
     // When removing black noise, remove small ones first.
 
     {
@@ -30,6 +30,7 @@
 #ifndef Q_MOC_RUN
 #include <boost/function.hpp>
 #endif
+#include <QByteArray>
 #include <QSize>
 #include <QRect>
 #include <QTransform>
@@ -87,6 +88,8 @@ enum BinarizationMask {
     BINARIZATION_MASK_ERASER3 = 4
 };
 
+class StageImageCache;
+
 class OutputGenerator
 {
 public:
@@ -96,6 +99,18 @@ public:
         ImageTransformation const& xform,
         QPolygonF const& content_rect_phys);
 
+    /**
+     * \brief Makes process() reuse intermediate images stored on disk.
+     *
+     * The cache is only consulted if process() is also given a PageId.
+     * The object must outlive the calls to process().  Passing null
+     * turns the caching off, which is the default.
+     */
+    void setStageCache(StageImageCache const* cache)
+    {
+        m_pStageCache = cache;
+    }
+
     /**
      * \brief Produce the output image.
      *
@@ -136,6 +151,31 @@ public:
         PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr
     ) const;
 
+    /**
+     * \brief Redo despeckling of a previously produced output image.
+     *
+     * Despeckling is the last operation affecting B/W content, so the
+     * image it was applied to is the union of the output and the speckles
+     * that were removed from it.  Starting from there gives the same result
+     * as process() would, as long as the output is black and white,
+     * there are no fill zones, and no deskewing took place after dewarping.
+     *
+     * \param status For asynchronous task cancellation.
+     * \param output The output image produced by process().
+     * \param old_speckles The speckles image produced along with \p output,
+     *        or a null image if despeckling was off.
+     * \param speckles_image If provided, the new speckles will be written
+     *        there, the same way process() does it.
+     * \param dbg An optional sink for debugging images.
+     * \return The new output image, or a null image if \p output or
+     *         \p old_speckles don't correspond to the current parameters.
+     */
+    QImage redespeckle(
+        TaskStatus const& status, QImage const& output,
+        imageproc::BinaryImage const& old_speckles,
+        imageproc::BinaryImage* speckles_image = 0,
+        DebugImages* dbg = 0) const;
+
     QSize outputImageSize() const;
 
     /**
@@ -224,6 +264,17 @@ private:
     static void fillMarginsInPlace(
         QImage& image, QPolygonF const& content_poly, QColor const& color);
 
+    QByteArray stageCacheParams(
+        FilterData const& input, QRect const& target_rect) const;
+
+    QImage loadStageImage(
+        PageId const* page_id, char const* stage,
+        QByteArray const& params, DebugImages const* dbg) const;
+
+    void storeStageImage(
+        PageId const* page_id, char const* stage,
+        QByteArray const& params, QImage const& image) const;
+
     static imageproc::GrayImage normalizeIlluminationGray(
         TaskStatus const& status,
         QImage const& input, QPolygonF const& area_to_consider,
@@ -317,6 +368,8 @@ private:
     QRect m_contentRect;
 
     DespeckleLevel m_despeckleLevel;
+
+    StageImageCache const* m_pStageCache;
 };
 
 } // namespace output
@@ -127,6 +127,14 @@ OutputImageParams::matches(OutputImageParams const& other) const
     return true;
 }
 
+bool
+OutputImageParams::matchesExceptDespeckleLevel(OutputImageParams const& other) const
+{
+    OutputImageParams other_with_our_level(other);
+    other_with_our_level.m_despeckleLevel = m_despeckleLevel;
+    return matches(other_with_our_level);
+}
+
 bool
 OutputImageParams::colorParamsMatch(
     ColorParams const& cp1, DespeckleLevel const dl1,
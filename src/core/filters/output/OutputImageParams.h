@@ -96,6 +96,11 @@ public:
      *        to avoid re-generating the output image.
      */
     bool matches(OutputImageParams const& other) const;
+
+    /**
+     * \brief Same as matches(), except despeckling levels are allowed to differ.
+     */
+    bool matchesExceptDespeckleLevel(OutputImageParams const& other) const;
 private:
     class PartialXform
     {
@@ -0,0 +1,204 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StageImageCache.h"
+#include "PageId.h"
+#include "ImageId.h"
+#include "AtomicFileOverwriter.h"
+#include "settings/ini_keys.h"
+#include "imageproc/GrayImage.h"
+#include <QCryptographicHash>
+#include <QSettings>
+#include <QByteArray>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QStringList>
+#include <QImage>
+#include <QImageWriter>
+#include <QFile>
+#include <QDir>
+
+namespace output
+{
+
+namespace
+{
+
+/**
+ * The PNG text key marking images that were premultiplied before
+ * being stored.  PNG has no such thing, so they are stored unpremultiplied.
+ */
+char const PREMULTIPLIED_KEY[] = "ScanTailorPremultiplied";
+
+/**
+ * Makes a pattern for QDir::entryList() matching the names
+ * starting with \p prefix, which may have wildcard characters in it.
+ */
+QString prefixPattern(QString const& prefix)
+{
+    QString pattern;
+    pattern.reserve(prefix.size() + 8);
+    for (QChar const ch : prefix) {
+        if (ch == QChar('*') || ch == QChar('?') || ch == QChar('[')) {
+            pattern += QChar('[');
+            pattern += ch;
+            pattern += QChar(']');
+        } else {
+            pattern += ch;
+        }
+    }
+    pattern += QLatin1String("*.png");
+    return pattern;
+}
+
+} // anonymous namespace
+
+StageImageCache::StageImageCache(QString const& cache_dir)
+    :   m_cacheDir(cache_dir)
+{
+}
+
+bool
+StageImageCache::isEnabled()
+{
+    return QSettings().value(
+               _key_output_stage_cache, _key_output_stage_cache_def
+           ).toBool();
+}
+
+QImage
+StageImageCache::load(
+    PageId const& page_id, QString const& stage, QByteArray const& params) const
+{
+    QString const file_path(
+        filePrefix(page_id, stage) + paramsHash(page_id, params) + QLatin1String(".png")
+    );
+
+    QImage image;
+    if (!QFile::exists(file_path) || !image.load(file_path, "PNG")) {
+        return QImage();
+    }
+
+    switch (image.format()) {
+    case QImage::Format_RGB32:
+        return image;
+    case QImage::Format_ARGB32:
+        if (!image.text(QLatin1String(PREMULTIPLIED_KEY)).isEmpty()) {
+            return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+        return image;
+    case QImage::Format_Indexed8:
+    case QImage::Format_Grayscale8:
+        if (image.allGray()) {
+            return imageproc::GrayImage(image).toQImage();
+        }
+    // fall through
+    default:
+        // Not something we could have written.
+        return QImage();
+    }
+}
+
+void
+StageImageCache::store(
+    PageId const& page_id, QString const& stage,
+    QByteArray const& params, QImage const& image) const
+{
+    if (image.isNull() || !QDir().mkpath(m_cacheDir)) {
+        return;
+    }
+
+    QString const prefix(filePrefix(page_id, stage));
+    QString const file_path(prefix + paramsHash(page_id, params) + QLatin1String(".png"));
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* iodev = overwriter.startWriting(file_path);
+    if (!iodev) {
+        return;
+    }
+
+    QImageWriter writer(iodev, "PNG");
+    // These files are written and read back often, so we trade
+    // some disk space for speed by asking for light compression.
+    writer.setQuality(80);
+    if (image.format() == QImage::Format_ARGB32_Premultiplied) {
+        writer.setText(QLatin1String(PREMULTIPLIED_KEY), QLatin1String("1"));
+    }
+    if (!writer.write(image) || !overwriter.commit()) {
+        overwriter.abort();
+        return;
+    }
+
+    // Remove the images produced with different parameters.  The cache
+    // directory is shared by all pages, so we only list those of ours.
+    QDir const dir(m_cacheDir);
+    QString const prefix_name(QFileInfo(prefix).fileName());
+    QString const our_name(QFileInfo(file_path).fileName());
+    for (QString const& name : dir.entryList(
+                QStringList(prefixPattern(prefix_name)), QDir::Files)) {
+        if (name.startsWith(prefix_name) && name != our_name) {
+            QFile::remove(dir.absoluteFilePath(name));
+        }
+    }
+}
+
+QString
+StageImageCache::filePrefix(PageId const& page_id, QString const& stage) const
+{
+    // Like thumbnails, include a hash of the full path, as a project
+    // may have several files with the same name in different directories.
+    ImageId const& image_id = page_id.imageId();
+    QByteArray const path_hash(
+        QCryptographicHash::hash(
+            image_id.filePath().toUtf8(), QCryptographicHash::Md5
+        ).toHex()
+    );
+
+    QString prefix(m_cacheDir);
+    prefix += QChar('/');
+    prefix += QFileInfo(image_id.filePath()).baseName();
+    prefix += QChar('_');
+    prefix += QString::number(image_id.zeroBasedPage());
+    prefix += QChar('_');
+    prefix += page_id.subPageAsString();
+    prefix += QChar('_');
+    prefix += QLatin1String(path_hash.data(), path_hash.size());
+    prefix += QChar('_');
+    prefix += stage;
+    prefix += QChar('_');
+
+    return prefix;
+}
+
+QString
+StageImageCache::paramsHash(PageId const& page_id, QByteArray const& params)
+{
+    QFileInfo const file_info(page_id.imageId().filePath());
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(params);
+    hash.addData(
+        QByteArray::number(file_info.lastModified().toMSecsSinceEpoch())
+    );
+    hash.addData(QByteArray::number(file_info.size()));
+
+    QByteArray const hex(hash.result().toHex());
+    return QLatin1String(hex.data(), hex.size());
+}
+
+} // namespace output
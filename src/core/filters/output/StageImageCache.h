@@ -0,0 +1,90 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUT_STAGEIMAGECACHE_H_
+#define OUTPUT_STAGEIMAGECACHE_H_
+
+#include "NonCopyable.h"
+#include <QString>
+
+class PageId;
+class QByteArray;
+class QImage;
+
+namespace output
+{
+
+/**
+ * \brief A persistent cache of intermediate images produced by OutputGenerator.
+ *
+ * Producing the output image involves transforming the source image into
+ * output coordinates and normalizing its illumination.  Those steps only
+ * depend on the page geometry and not on things like the binarization
+ * threshold or despeckling level, so when only the latter are changed,
+ * their results may be loaded from disk instead of being computed again.
+ *
+ * Each page keeps at most one image per stage.  Its file name includes
+ * a hash of the parameters the image was produced with, so a change in
+ * those parameters simply results in a miss and then in the old file
+ * being replaced.  The modification time of the source file is always
+ * a part of those parameters.
+ *
+ * \note Methods may be called from multiple threads concurrently,
+ *       provided they work with different pages.
+ */
+class StageImageCache
+{
+    DECLARE_NON_COPYABLE(StageImageCache)
+public:
+    explicit StageImageCache(QString const& cache_dir);
+
+    /**
+     * \brief Whether the cache was turned on in application settings.
+     */
+    static bool isEnabled();
+
+    /**
+     * \brief Loads the image produced by \p stage with \p params.
+     *
+     * \return The cached image, or a null image if there is none.
+     *         8-bit images are returned as grayscale Format_Indexed8.
+     *         Images stored as Format_ARGB32_Premultiplied come back in
+     *         that format, though, being stored unpremultiplied, their
+     *         semi-transparent pixels may differ by rounding.
+     */
+    QImage load(PageId const& page_id, QString const& stage,
+                QByteArray const& params) const;
+
+    /**
+     * \brief Stores the image, replacing the one for the same page and stage.
+     *
+     * Failures are silently ignored.
+     */
+    void store(PageId const& page_id, QString const& stage,
+               QByteArray const& params, QImage const& image) const;
+private:
+    QString filePrefix(PageId const& page_id, QString const& stage) const;
+
+    static QString paramsHash(PageId const& page_id, QByteArray const& params);
+
+    QString m_cacheDir;
+};
+
+} // namespace output
+
+#endif
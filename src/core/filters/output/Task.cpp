@@ -54,6 +54,11 @@
 #include "ThumbnailPixmapCache.h"
 #include "DebugImages.h"
 #include "OutputGenerator.h"
+#include "StageImageCache.h"
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
+#include "MemoryBudget.h"
+#include "settings/globalstaticsettings.h"
 #include "TiffWriter.h"
 #include "ImageLoader.h"
 #include "ErrorWidget.h"
@@ -84,6 +89,45 @@ using namespace dewarping;
 namespace output
 {
 
+namespace
+{
+
+/**
+ * Grows the memory reservation of the page being processed by a rough
+ * estimate of what OutputGenerator needs on top of the source images.
+ */
+void reserveOutputMemory(QSize const& output_size, Params const& params)
+{
+    MemoryBudget::Reservation* const reservation = MemoryBudget::Reservation::current();
+    if (!reservation) {
+        return;
+    }
+
+    // Bytes per output pixel: the transformed source image and
+    // the output image, plus the masks of mixed mode.
+    int bytes_per_pixel = 0;
+    switch (params.colorParams().colorMode()) {
+    case ColorParams::BLACK_AND_WHITE:
+        bytes_per_pixel = 2;
+        break;
+    case ColorParams::COLOR_GRAYSCALE:
+        bytes_per_pixel = 8;
+        break;
+    case ColorParams::MIXED:
+        bytes_per_pixel = 10;
+        break;
+    }
+
+    if (params.dewarpingMode() != DewarpingMode::OFF) {
+        // The dewarped copy of the transformed image.
+        bytes_per_pixel += 4;
+    }
+
+    reservation->grow(qint64(output_size.width()) * output_size.height() * bytes_per_pixel);
+}
+
+} // anonymous namespace
+
 class Task::UiUpdater : public FilterResult
 {
     Q_DECLARE_TR_FUNCTIONS(output::Task::UiUpdater)
@@ -188,6 +232,9 @@ Task::process(
     TaskStatus const& status, FilterData const& data,
     QPolygonF const& content_rect_phys)
 {
+    ProfiledPage const profiled_page(m_pageId);
+    ScopedStageTimer const timer("output");
+
     status.throwIfCancelled();
 
     Params params(m_ptrSettings->getParams(m_pageId));
@@ -241,11 +288,16 @@ Task::process(
         m_ptrSettings->setFillZones(m_pageId, new_zones);
     }
 
-    OutputGenerator const generator(
+    OutputGenerator generator(
         params.outputDpi(), params.colorParams(), params.despeckleLevel(),
         new_xform, content_rect_phys
     );
 
+    StageImageCache const stage_cache(Utils::stageCacheDir(m_outFileNameGen.outDir()));
+    if (StageImageCache::isEnabled()) {
+        generator.setStageCache(&stage_cache);
+    }
+
     OutputImageParams new_output_image_params(
         generator.outputImageSize(), generator.outputContentRect(),
         new_xform, params.outputDpi(), params.colorParams(),
@@ -291,6 +343,8 @@ Task::process(
         // OutputGenerator will write a new distortion model
         // there, if dewarping mode is AUTO.
 
+        reserveOutputMemory(generator.outputImageSize(), params);
+
         out_img = generator.process(
                       status, data, new_picture_zones, new_fill_zones,
                       params.dewarpingMode(), distortion_model,
@@ -317,6 +371,19 @@ Task::process(
         m_ptrSettings->setParams(m_pageId, p);
     }
 
+    // Despeckling is the last operation affecting B/W content, so if
+    // the despeckling level is the only thing that changed, the output
+    // may be rebuilt from the output and speckles files we already have.
+    // That's not the case if fill zones were applied on top of it, or if
+    // the output was deskewed after dewarping.
+    bool const despeckling_is_last =
+        params.colorParams().colorMode() == ColorParams::BLACK_AND_WHITE
+        && new_fill_zones.empty()
+        && (params.dewarpingMode() == DewarpingMode::OFF
+            || !GlobalStaticSettings::m_dewarpAutoDeskewAfterDewarp);
+    bool need_redespeckle = false;
+    bool need_stored_speckles = need_speckles_image;
+
     do { // Just to be able to break from it.
 
         std::unique_ptr<OutputParams> stored_output_params(
@@ -328,9 +395,17 @@ Task::process(
             break;
         }
 
-        if (!stored_output_params->outputImageParams().matches(new_output_image_params)) {
-            need_reprocess = true;
-            break;
+        OutputImageParams const& stored_image_params = stored_output_params->outputImageParams();
+        if (!stored_image_params.matches(new_output_image_params)) {
+            if (!despeckling_is_last
+                    || !stored_image_params.matchesExceptDespeckleLevel(new_output_image_params)) {
+                need_reprocess = true;
+                break;
+            }
+
+            need_redespeckle = true;
+            // If despeckling was off, there are no speckles to restore.
+            need_stored_speckles = stored_image_params.despeckleLevel() != DESPECKLE_OFF;
         }
 
         if (!PictureZoneComparator::equal(stored_output_params->pictureZones(), new_picture_zones)) {
@@ -372,7 +447,7 @@ Task::process(
             }
         }
 
-        if (need_speckles_image) {
+        if (need_stored_speckles) {
             if (!speckles_file_info.exists()) {
                 need_reprocess = true;
                 break;
@@ -404,7 +479,7 @@ Task::process(
             need_reprocess = automask_img.isNull() || automask_img.size() != out_img.size();
         }
 
-        if (need_speckles_image && !need_reprocess) {
+        if (need_stored_speckles && !need_reprocess) {
             QFile speckles_file(speckles_file_path);
             if (speckles_file.open(QIODevice::ReadOnly)) {
                 speckles_img = BinaryImage(ImageLoader::load(speckles_file, 0));
@@ -413,16 +488,29 @@ Task::process(
         }
     }
 
-    if (need_reprocess) {
-        // Even in batch processing mode we should still write automask, because it
-        // will be needed when we view the results back in interactive mode.
-        // The same applies even more to speckles file, as we need it not only
-        // for visualization purposes, but also for re-doing despeckling at
-        // different levels without going through the whole output generation process.
-        bool const write_automask = render_params.mixedOutput();
-        bool const write_speckles_file = params.despeckleLevel() != DESPECKLE_OFF &&
-                                         params.colorParams().colorMode() != ColorParams::COLOR_GRAYSCALE;
+    // Even in batch processing mode we should still write automask, because it
+    // will be needed when we view the results back in interactive mode.
+    // The same applies even more to speckles file, as we need it not only
+    // for visualization purposes, but also for re-doing despeckling at
+    // different levels without going through the whole output generation process.
+    bool const write_automask = render_params.mixedOutput();
+    bool const write_speckles_file = params.despeckleLevel() != DESPECKLE_OFF &&
+                                     params.colorParams().colorMode() != ColorParams::COLOR_GRAYSCALE;
+
+    if (need_redespeckle && !need_reprocess) {
+        BinaryImage new_speckles_img;
+        out_img = generator.redespeckle(
+                      status, out_img, speckles_img,
+                      write_speckles_file ? &new_speckles_img : nullptr,
+                      m_ptrDbg.get()
+                  );
+        speckles_img.swap(new_speckles_img);
+        need_reprocess = out_img.isNull();
+    } else {
+        need_redespeckle = false;
+    }
 
+    if (need_reprocess) {
         automask_img = BinaryImage();
         speckles_img = BinaryImage();
 
@@ -433,6 +521,8 @@ Task::process(
         // OutputGenerator will write a new distortion model
         // there, if dewarping mode is AUTO.
 
+        reserveOutputMemory(generator.outputImageSize(), params);
+
         out_img = generator.process(
                       status, data, new_picture_zones, new_fill_zones,
                       params.dewarpingMode(), distortion_model,
@@ -455,7 +545,9 @@ Task::process(
             m_ptrSettings->setParams(m_pageId, params);
             new_output_image_params.setDistortionModel(distortion_model);
         }
+    }
 
+    if (need_reprocess || need_redespeckle) {
         if (write_speckles_file && speckles_img.isNull()) {
             // Even if despeckling didn't actually take place, we still need
             // to write an empty speckles file.  Making it a special case
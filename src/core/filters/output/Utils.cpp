@@ -43,6 +43,12 @@ Utils::specklesDir(QString const& out_dir)
     return QDir(out_dir).absoluteFilePath("cache/speckles");
 }
 
+QString
+Utils::stageCacheDir(QString const& out_dir)
+{
+    return QDir(out_dir).absoluteFilePath("cache/stages");
+}
+
 QTransform
 Utils::scaleFromToDpi(Dpi const& from, Dpi const& to)
 {
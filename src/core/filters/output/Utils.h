@@ -35,6 +35,8 @@ public:
 
     static QString specklesDir(QString const& out_dir);
 
+    static QString stageCacheDir(QString const& out_dir);
+
     static QTransform scaleFromToDpi(Dpi const& from, Dpi const& to);
 };
 
@@ -24,6 +24,8 @@
 #include "Params.h"
 #include "Utils.h"
 #include "FilterUiInterface.h"
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
 #include "TaskStatus.h"
 #include "FilterData.h"
 #include "ImageView.h"
@@ -94,6 +96,9 @@ Task::process(
     TaskStatus const& status, FilterData const& data,
     QRectF const& page_rect, QRectF const& content_rect)
 {
+    ProfiledPage const profiled_page(m_pageId);
+    ScopedStageTimer const timer("page_layout");
+
     status.throwIfCancelled();
 
     QSizeF const content_size_mm(
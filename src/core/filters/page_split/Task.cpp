@@ -39,6 +39,8 @@
 #include "ImageView.h"
 #include "FilterUiInterface.h"
 #include "DebugImages.h"
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
 #include <QImage>
 #include <QObject>
 #include <QDebug>
@@ -119,6 +121,9 @@ Task::~Task()
 FilterResultPtr
 Task::process(TaskStatus const& status, FilterData const& data)
 {
+    ProfiledPage const profiled_page(m_pageInfo.imageId());
+    ScopedStageTimer const timer("page_split");
+
     status.throwIfCancelled();
 
     Settings::Record record(m_ptrSettings->getPageRecord(m_pageInfo.imageId()));
@@ -322,7 +322,7 @@ ContentBoxFinder::findContentBox(
         text_mask = estimateTextMask(content, content_blocks, dbg);
     }
 
-    if (dbg) {
+    if (dbg && dbg->isWanted("text_mask")) {
         QImage text_mask_visualized(content.size(), QImage::Format_ARGB32_Premultiplied);
         text_mask_visualized.fill(0xffffffff); // Opaque white.
 
@@ -753,7 +753,7 @@ ContentBoxFinder::estimateTextMask(
         SEDM(content, SEDM::DIST_TO_BLACK, SEDM::DIST_TO_NO_BORDERS)
         .findPeaksDestructive()
     );
-    if (dbg) {
+    if (dbg && dbg->isWanted("ueps")) {
         QImage canvas(content_blocks.toQImage().convertToFormat(QImage::Format_ARGB32_Premultiplied));
         QPainter painter;
         painter.begin(&canvas);
@@ -1193,9 +1193,16 @@ ContentBoxFinder::trim(
 {
     can_retry_grouped = false;
 
+    // The visualization is drawn on as we go, so it's only worth
+    // building if one of the images it ends up in is wanted.
+    bool const visualize = dbg && (
+        dbg->isWanted("trim_too_much") || dbg->isWanted("trimmed") ||
+        dbg->isWanted("not_trimmed")
+    );
+
     QImage visualized;
 
-    if (dbg) {
+    if (visualize) {
         visualized = QImage(
                          content_blocks.size(),
                          QImage::Format_ARGB32_Premultiplied
@@ -1225,7 +1232,7 @@ ContentBoxFinder::trim(
             break;
         }
 
-        if (dbg) {
+        if (visualize) {
             QPainter painter(&visualized);
             painter.setPen(Qt::NoPen);
             painter.setBrush(QColor(0x5f, 0xdf, 0x57, 50));
@@ -1332,7 +1339,7 @@ ContentBoxFinder::trim(
 
     if (sum_dist_to_garbage < sum_dist_to_others) {
         garbage.add(content, removed_area);
-        if (dbg) {
+        if (visualize) {
             QPainter painter(&visualized);
             painter.setPen(Qt::NoPen);
             painter.setBrush(QColor(0x5f, 0xdf, 0x57, 50));
@@ -1344,7 +1351,7 @@ ContentBoxFinder::trim(
         }
         return new_area;
     } else {
-        if (dbg) {
+        if (visualize) {
             QPainter painter(&visualized);
             painter.setPen(Qt::NoPen);
             painter.setBrush(QColor(0x5f, 0xdf, 0x57, 50));
@@ -29,6 +29,8 @@
 #include "ContentBoxFinder.h"
 #include "PageFinder.h"
 #include "FilterUiInterface.h"
+#include "ProfiledPage.h"
+#include "StageProfiler.h"
 #include "ImageView.h"
 #include "OrthogonalRotation.h"
 #include "ImageTransformation.h"
@@ -92,6 +94,9 @@ Task::~Task()
 FilterResultPtr
 Task::process(TaskStatus const& status, FilterData const& data)
 {
+    ProfiledPage const profiled_page(m_pageId);
+    ScopedStageTimer const timer("select_content");
+
     status.throwIfCancelled();
 
     Dependencies const deps(data.xform().resultingPreCropArea());
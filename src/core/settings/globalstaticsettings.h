@@ -77,6 +77,7 @@ public:
     static int m_tiff_compression_color_id;
     static int m_binrization_threshold_control_default;
     static bool m_use_horizontal_predictor;
+    static int m_tiff_rows_per_strip;
     static bool m_disable_bw_smoothing;
     static qreal m_zone_editor_min_angle;
     static float m_picture_detection_sensitivity;
@@ -71,6 +71,12 @@ static const bool _key_batch_dialog_start_from_current_def = true;
 static const char* _key_batch_dialog_remember_choice = "batch_dialog/remember_choice";
 static const bool _key_batch_dialog_remember_choice_def = false;
 static const char* _key_batch_processing_priority = "settings/batch_processing_priority";
+static const char* _key_batch_processing_threads = "settings/batch_processing_threads";
+static const int _key_batch_processing_threads_def = 0; // one per CPU core
+static const char* _key_image_cache_size_mb = "settings/image_cache_size_mb";
+static const unsigned int _key_image_cache_size_mb_def = 512;
+static const char* _key_output_stage_cache = "settings/output_stage_cache";
+static const bool _key_output_stage_cache_def = false;
 
 /* Thumbnails */
 
@@ -227,8 +233,11 @@ static const char* _key_autosave_enabled = "auto-save_project/enabled";
 static const bool _key_autosave_enabled_def = false;
 static const char* _key_autosave_time_period_min = "auto-save_project/time_period_min";
 static const int _key_autosave_time_period_min_def = 5;
+static const char* _key_project_binary_format = "project/binary_format";
+static const bool _key_project_binary_format_def = false;
 static const char* _key_debug_enabled = "debug_mode/enabled";
 static const bool _key_debug_enabled_def = false;
+static const char* _key_debug_images_filter = "debug_mode/images_filter"; // wildcard patterns of labels, empty - all
 static const char* _key_dpi_predefined_list = "dpi/predefined_list";
 static const char* _key_dpi_predefined_list_def = "300x300,400x400,600x600";
 static const char* _key_dpi_change_list = "dpi/change_dpi_list";
@@ -264,6 +273,8 @@ static const char* _key_tiff_compr_horiz_pred = "tiff_compression/use_horizontal
 static const bool _key_tiff_compr_horiz_pred_def = false;
 static const char* _key_tiff_compr_show_all = "tiff_compression/show_all";
 static const bool _key_tiff_compr_show_all_def = false;
+static const char* _key_tiff_rows_per_strip = "tiff_compression/rows_per_strip";
+static const int _key_tiff_rows_per_strip_def = 0; // 0 - choose automatically
 
 static const char* _key_mode_bw_disable_smoothing = "mode_bw/disable_smoothing";
 static const bool _key_mode_bw_disable_smoothing_def = false;
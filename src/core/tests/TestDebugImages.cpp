@@ -0,0 +1,181 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DebugImages.h"
+#include "AutoRemovingFile.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/BWColor.h"
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <QColor>
+#include <QFile>
+#include <vector>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace Tests
+{
+
+using namespace imageproc;
+
+BOOST_AUTO_TEST_SUITE(DebugImagesTestSuite);
+
+static QImage randomImage(int const width, int const height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            image.setPixel(x, y, qRgb(rand() & 0xff, rand() & 0xff, rand() & 0xff));
+        }
+    }
+    return image;
+}
+
+static BinaryImage randomBinaryImage(int const width, int const height)
+{
+    BinaryImage image(width, height, WHITE);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (rand() & 1) {
+                image.setPixel(x, y, BLACK);
+            }
+        }
+    }
+    return image;
+}
+
+static bool samePixels(QImage const& lhs, QImage const& rhs)
+{
+    return lhs.convertToFormat(QImage::Format_RGB32) == rhs.convertToFormat(QImage::Format_RGB32);
+}
+
+/**
+ * Retrieves the next item, wherever it ended up, and checks it's \p expected.
+ */
+static bool retrieveAndCompare(DebugImages& dbg, QImage const& expected, QString const& expected_label)
+{
+    QImage image;
+    AutoRemovingFile file;
+    QString label;
+    if (!dbg.retrieveNext(&image, &file, &label)) {
+        return false;
+    }
+
+    if (label != expected_label) {
+        return false;
+    }
+
+    if (image.isNull()) {
+        // It was spilled to disk before we came for it.
+        if (file.get().isNull() || !QFile::exists(file.get())) {
+            return false;
+        }
+        image = QImage(file.get());
+    } else if (!file.get().isNull()) {
+        // Either the image or the file, never both.
+        return false;
+    }
+
+    return samePixels(image, expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_label_filter)
+{
+    DebugImages dbg(QStringList() << "keep*");
+    BOOST_CHECK(dbg.isWanted("keep_me"));
+    BOOST_CHECK(!dbg.isWanted("drop_me"));
+
+    dbg.add(randomImage(8, 8), "drop_me");
+    BOOST_CHECK(dbg.empty());
+
+    QImage const image(randomImage(8, 8));
+    dbg.add(image, "keep_me");
+    BOOST_REQUIRE(!dbg.empty());
+    BOOST_CHECK(retrieveAndCompare(dbg, image, "keep_me"));
+    BOOST_CHECK(dbg.empty());
+
+    DebugImages const unfiltered((QStringList()));
+    BOOST_CHECK(unfiltered.isWanted("anything"));
+}
+
+BOOST_AUTO_TEST_CASE(test_in_memory)
+{
+    DebugImages dbg((QStringList()));
+
+    QImage const image(randomImage(20, 10));
+    BinaryImage const binary_image(randomBinaryImage(33, 17));
+    dbg.add(image, "color");
+    dbg.add(binary_image, "binary");
+
+    QImage retrieved;
+    AutoRemovingFile file;
+    QString label;
+
+    BOOST_REQUIRE(dbg.retrieveNext(&retrieved, &file, &label));
+    BOOST_CHECK(label == "color");
+    BOOST_CHECK(file.get().isNull());
+    BOOST_CHECK(retrieved == image);
+
+    BOOST_REQUIRE(dbg.retrieveNext(&retrieved, &file, &label));
+    BOOST_CHECK(label == "binary");
+    BOOST_CHECK(file.get().isNull());
+    BOOST_CHECK(samePixels(retrieved, binary_image.toQImage()));
+
+    BOOST_CHECK(!dbg.retrieveNext(&retrieved, &file, &label));
+}
+
+BOOST_AUTO_TEST_CASE(test_retrieve_while_spilling)
+{
+    // With no memory budget, every image is sent to be spilled as soon
+    // as it's added.  Retrieving right away races with the spilling,
+    // and whichever way the race goes, we must get the image back,
+    // either from memory or from a file.
+    DebugImages dbg(QStringList(), 0);
+
+    for (int i = 0; i < 200; ++i) {
+        QString const label(QString::number(i));
+        if (i % 2 == 0) {
+            QImage const image(randomImage(64, 48));
+            dbg.add(image, label);
+            BOOST_REQUIRE(retrieveAndCompare(dbg, image, label));
+        } else {
+            BinaryImage const image(randomBinaryImage(67, 45));
+            dbg.add(image, label);
+            BOOST_REQUIRE(retrieveAndCompare(dbg, image.toQImage(), label));
+        }
+    }
+
+    // Let several spills be in flight at once, and retrieve them in order.
+    std::vector<QImage> images;
+    for (int i = 0; i < 20; ++i) {
+        images.push_back(randomImage(64, 48));
+        dbg.add(images.back(), QString::number(i));
+    }
+    for (int i = 0; i < 20; ++i) {
+        BOOST_REQUIRE(retrieveAndCompare(dbg, images[i], QString::number(i)));
+    }
+
+    BOOST_CHECK(dbg.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
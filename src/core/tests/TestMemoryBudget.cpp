@@ -0,0 +1,335 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryBudget.h"
+#include "TaskStatus.h"
+#include <QThread>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QtGlobal>
+#include <vector>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace Tests
+{
+
+BOOST_AUTO_TEST_SUITE(MemoryBudgetTestSuite);
+
+namespace
+{
+
+/**
+ * How long a thread that is expected to wait is given to prove otherwise,
+ * in milliseconds.
+ */
+unsigned long const SETTLE_TIME = 300;
+
+/**
+ * How long a thread that is expected to finish may take, in milliseconds.
+ */
+unsigned long const FINISH_TIMEOUT = 10000;
+
+class Status : public TaskStatus
+{
+public:
+    virtual void cancel()
+    {
+        m_cancelFlag.fetchAndStoreRelaxed(1);
+    }
+
+    virtual bool isCancelled() const
+    {
+        return m_cancelFlag.fetchAndAddRelaxed(0) != 0;
+    }
+
+    virtual void throwIfCancelled() const {}
+private:
+    mutable QAtomicInt m_cancelFlag;
+};
+
+/**
+ * Sets the limit of the global budget for the duration of a test.
+ */
+class LimitSetter
+{
+public:
+    explicit LimitSetter(qint64 bytes)
+    {
+        MemoryBudget::instance().setLimit(bytes);
+    }
+
+    ~LimitSetter()
+    {
+        MemoryBudget::instance().setLimit(0);
+    }
+};
+
+/**
+ * Reserves memory, signals it did, optionally waits for a go-ahead
+ * and grows the reservation.
+ */
+class ReservingThread : public QThread
+{
+public:
+    ReservingThread(qint64 bytes, qint64 grow_by, QSemaphore* reserved, QSemaphore* go)
+        :   m_bytes(bytes), m_growBy(grow_by), m_pReserved(reserved), m_pGo(go),
+            m_hadCurrent(false) {}
+
+    bool done() const
+    {
+        return m_done.fetchAndAddRelaxed(0) != 0;
+    }
+
+    Status& status()
+    {
+        return m_status;
+    }
+
+    /**
+     * Whether the thread had a current reservation before making its own.
+     */
+    bool hadCurrent() const
+    {
+        return m_hadCurrent;
+    }
+protected:
+    virtual void run()
+    {
+        m_hadCurrent = MemoryBudget::Reservation::current() != 0;
+
+        MemoryBudget::Reservation reservation(m_bytes, m_status);
+        if (m_pReserved) {
+            m_pReserved->release();
+        }
+        if (m_pGo) {
+            m_pGo->acquire();
+        }
+        if (m_growBy > 0) {
+            reservation.grow(m_growBy);
+        }
+        m_done.fetchAndStoreRelaxed(1);
+    }
+private:
+    Status m_status;
+    qint64 m_bytes;
+    qint64 m_growBy;
+    QSemaphore* m_pReserved;
+    QSemaphore* m_pGo;
+    bool m_hadCurrent;
+    mutable QAtomicInt m_done;
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(test_acquire_grow_release)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    LimitSetter const limit(1000);
+    Status status;
+    int const waits_before = budget.numWaits();
+
+    BOOST_REQUIRE(budget.reserved() == 0);
+    BOOST_CHECK(!MemoryBudget::Reservation::current());
+
+    {
+        MemoryBudget::Reservation reservation(300, status);
+        BOOST_CHECK(MemoryBudget::Reservation::current() == &reservation);
+        BOOST_CHECK(reservation.bytes() == 300);
+        BOOST_CHECK(budget.reserved() == 300);
+
+        reservation.grow(200);
+        BOOST_CHECK(reservation.bytes() == 500);
+        BOOST_CHECK(budget.reserved() == 500);
+
+        // The only holder goes over the limit rather than waiting forever.
+        reservation.grow(1000);
+        BOOST_CHECK(budget.reserved() == 1500);
+        BOOST_CHECK(budget.peakReserved() >= 1500);
+
+        // Negative sizes are ignored.
+        reservation.grow(-100);
+        BOOST_CHECK(reservation.bytes() == 1500);
+    }
+
+    BOOST_CHECK(budget.reserved() == 0);
+    BOOST_CHECK(!MemoryBudget::Reservation::current());
+
+    {
+        // A task too big for the limit runs when it's alone.
+        MemoryBudget::Reservation const reservation(5000, status);
+        BOOST_CHECK(budget.reserved() == 5000);
+    }
+
+    BOOST_CHECK(budget.reserved() == 0);
+    BOOST_CHECK(budget.numWaits() == waits_before);
+}
+
+BOOST_AUTO_TEST_CASE(test_nested_reservations)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    LimitSetter const limit(1000);
+    Status status;
+    int const waits_before = budget.numWaits();
+
+    {
+        MemoryBudget::Reservation outer(600, status);
+
+        {
+            // This doesn't fit, but waiting would mean waiting for ourselves.
+            MemoryBudget::Reservation inner(800, status);
+            BOOST_CHECK(MemoryBudget::Reservation::current() == &inner);
+            BOOST_CHECK(budget.reserved() == 1400);
+
+            inner.grow(100);
+            BOOST_CHECK(budget.reserved() == 1500);
+        }
+
+        BOOST_CHECK(MemoryBudget::Reservation::current() == &outer);
+        BOOST_CHECK(budget.reserved() == 600);
+
+        // The current reservation is per thread.
+        ReservingThread thread(0, 0, 0, 0);
+        thread.start();
+        BOOST_REQUIRE(thread.wait(FINISH_TIMEOUT));
+        BOOST_CHECK(!thread.hadCurrent());
+        BOOST_CHECK(MemoryBudget::Reservation::current() == &outer);
+
+        {
+            MemoryBudget::Reservation const inner(100, status);
+            BOOST_CHECK(budget.reserved() == 700);
+        }
+
+        outer.grow(100);
+        BOOST_CHECK(budget.reserved() == 700);
+    }
+
+    BOOST_CHECK(!MemoryBudget::Reservation::current());
+    BOOST_CHECK(budget.reserved() == 0);
+    BOOST_CHECK(budget.numWaits() == waits_before);
+}
+
+BOOST_AUTO_TEST_CASE(test_acquire_waits_for_release)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    LimitSetter const limit(1000);
+    Status status;
+    int const waits_before = budget.numWaits();
+
+    ReservingThread* thread = 0;
+    {
+        MemoryBudget::Reservation const reservation(800, status);
+
+        thread = new ReservingThread(500, 0, 0, 0);
+        thread->start();
+        QThread::msleep(SETTLE_TIME);
+        BOOST_CHECK(!thread->done());
+        BOOST_CHECK(budget.reserved() == 800);
+    }
+
+    BOOST_CHECK(thread->wait(FINISH_TIMEOUT));
+    BOOST_CHECK(thread->done());
+    delete thread;
+
+    BOOST_CHECK(budget.numWaits() == waits_before + 1);
+    BOOST_CHECK(budget.reserved() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_cancelled_acquire_stops_waiting)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    LimitSetter const limit(1000);
+    Status status;
+
+    MemoryBudget::Reservation const reservation(900, status);
+
+    ReservingThread thread(500, 0, 0, 0);
+    thread.start();
+    QThread::msleep(SETTLE_TIME);
+    BOOST_CHECK(!thread.done());
+
+    thread.status().cancel();
+    BOOST_CHECK(thread.wait(FINISH_TIMEOUT));
+    BOOST_CHECK(thread.done());
+    BOOST_CHECK(budget.reserved() == 900);
+}
+
+BOOST_AUTO_TEST_CASE(test_grow_waits_for_release)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    LimitSetter const limit(1000);
+    Status status;
+
+    QSemaphore reserved;
+    ReservingThread* thread = 0;
+    {
+        MemoryBudget::Reservation const reservation(500, status);
+
+        // This holder isn't growing, so it's going to release memory
+        // at some point, and the thread has to wait for that.
+        thread = new ReservingThread(400, 300, &reserved, 0);
+        thread->start();
+        reserved.acquire();
+        QThread::msleep(SETTLE_TIME);
+        BOOST_CHECK(!thread->done());
+        BOOST_CHECK(budget.reserved() == 900);
+    }
+
+    BOOST_CHECK(thread->wait(FINISH_TIMEOUT));
+    BOOST_CHECK(thread->done());
+    delete thread;
+
+    BOOST_CHECK(budget.reserved() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_grow_does_not_deadlock)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    LimitSetter const limit(1000);
+
+    // Every holder wants to grow past the limit.  Neither of them is
+    // going to release anything while waiting, so one has to go over
+    // the limit, and the other one follows once it's done.
+    for (int num_threads = 2; num_threads <= 4; ++num_threads) {
+        QSemaphore reserved;
+        QSemaphore go;
+        std::vector<ReservingThread*> threads;
+        for (int i = 0; i < num_threads; ++i) {
+            threads.push_back(new ReservingThread(250, 800, &reserved, &go));
+            threads.back()->start();
+        }
+
+        // The first reservations fit, so everyone holds one before growing.
+        reserved.acquire(num_threads);
+        BOOST_CHECK(budget.reserved() == 250 * num_threads);
+        go.release(num_threads);
+
+        for (ReservingThread* thread : threads) {
+            BOOST_CHECK(thread->wait(FINISH_TIMEOUT));
+            BOOST_CHECK(thread->done());
+            delete thread;
+        }
+
+        BOOST_CHECK(budget.reserved() == 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
@@ -0,0 +1,303 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ProjectFile.h"
+#include <QDomDocument>
+#include <QDomElement>
+#include <QDomNode>
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QTemporaryDir>
+#include <vector>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace Tests
+{
+
+BOOST_AUTO_TEST_SUITE(ProjectFileTestSuite);
+
+namespace
+{
+
+/**
+ * Enough pages for the filters to be split into several chunks.
+ */
+int const NUM_PAGES = 150;
+
+QDomElement pageElement(QDomDocument& doc, int const page_id, QString const& value)
+{
+    QDomElement page_el(doc.createElement("page"));
+    page_el.setAttribute("id", page_id);
+    QDomElement params_el(doc.createElement("params"));
+    params_el.setAttribute("value", value);
+    params_el.appendChild(doc.createTextNode("text & <markup>"));
+    page_el.appendChild(params_el);
+    return page_el;
+}
+
+/**
+ * Builds an XML project with the filter settings in it.
+ */
+QDomDocument createProject(int const num_pages)
+{
+    QDomDocument doc;
+    QDomElement project_el(doc.createElement("project"));
+    project_el.setAttribute("outputDirectory", "/tmp/out");
+    doc.appendChild(project_el);
+
+    QDomElement pages_el(doc.createElement("pages"));
+    for (int i = 0; i < num_pages; ++i) {
+        QDomElement page_el(doc.createElement("page"));
+        page_el.setAttribute("id", i + 1);
+        page_el.setAttribute("imageId", i + 1);
+        pages_el.appendChild(page_el);
+    }
+    project_el.appendChild(pages_el);
+
+    QDomElement filters_el(doc.createElement("filters"));
+    project_el.appendChild(filters_el);
+
+    QDomElement deskew_el(doc.createElement("deskew"));
+    deskew_el.setAttribute("average", "0.5");
+    for (int i = 0; i < num_pages; ++i) {
+        deskew_el.appendChild(pageElement(doc, i + 1, QString::number(i * 0.25)));
+    }
+    filters_el.appendChild(deskew_el);
+
+    // A filter without any per-page settings.
+    QDomElement empty_el(doc.createElement("fix-orientation"));
+    filters_el.appendChild(empty_el);
+
+    QDomElement output_el(doc.createElement("output"));
+    for (int i = 0; i < num_pages; i += 3) {
+        output_el.appendChild(pageElement(doc, i + 1, QString("page %1").arg(i)));
+    }
+    filters_el.appendChild(output_el);
+
+    return doc;
+}
+
+/**
+ * Moves the filter settings out of \p project_doc into a document
+ * per filter, the way ProjectWriter does for the binary format.
+ */
+std::vector<QDomDocument> splitFilters(QDomDocument& project_doc)
+{
+    std::vector<QDomDocument> filter_docs;
+
+    QDomElement filters_el(project_doc.documentElement().namedItem("filters").toElement());
+    while (!filters_el.firstChild().isNull()) {
+        QDomNode const filter_node(filters_el.removeChild(filters_el.firstChild()));
+
+        QDomDocument filter_doc;
+        QDomElement root_el(filter_doc.createElement("filters"));
+        filter_doc.appendChild(root_el);
+        root_el.appendChild(filter_doc.importNode(filter_node, true));
+        filter_docs.push_back(filter_doc);
+    }
+
+    return filter_docs;
+}
+
+/**
+ * Puts the per-filter documents back into \p project_doc.
+ */
+void mergeFilters(QDomDocument& project_doc, std::vector<QDomDocument> const& filter_docs)
+{
+    QDomElement filters_el(project_doc.documentElement().namedItem("filters").toElement());
+    for (QDomDocument const& filter_doc : filter_docs) {
+        QDomElement const filter_el(filter_doc.documentElement().firstChildElement());
+        filters_el.appendChild(project_doc.importNode(filter_el, true));
+    }
+}
+
+QByteArray readFile(QString const& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+bool writeFile(QString const& path, QByteArray const& data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    return file.write(data) == data.size();
+}
+
+bool readBack(QString const& path, QString& xml)
+{
+    QDomDocument project_doc;
+    std::vector<QDomDocument> filter_docs;
+    if (!ProjectFile::read(path, project_doc, filter_docs)) {
+        return false;
+    }
+    mergeFilters(project_doc, filter_docs);
+    xml = project_doc.toString(-1);
+    return true;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(test_xml_binary_xml)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    QString const xml_path(dir.path() + "/project.xml");
+    QString const binary_path(dir.path() + "/project.bin");
+    QString const xml_again_path(dir.path() + "/project_again.xml");
+
+    QDomDocument const original(createProject(NUM_PAGES));
+    BOOST_REQUIRE(ProjectFile::writeXml(xml_path, original));
+
+    QDomDocument project_doc;
+    std::vector<QDomDocument> filter_docs;
+    BOOST_REQUIRE(ProjectFile::read(xml_path, project_doc, filter_docs));
+    BOOST_CHECK(filter_docs.empty());
+    BOOST_CHECK(project_doc.toString(-1) == original.toString(-1));
+
+    filter_docs = splitFilters(project_doc);
+    BOOST_REQUIRE(filter_docs.size() == 3);
+    BOOST_REQUIRE(ProjectFile::writeBinary(binary_path, project_doc, filter_docs));
+    BOOST_CHECK(readFile(binary_path).left(64) != readFile(xml_path).left(64));
+
+    QDomDocument binary_project_doc;
+    std::vector<QDomDocument> binary_filter_docs;
+    BOOST_REQUIRE(ProjectFile::read(binary_path, binary_project_doc, binary_filter_docs));
+    BOOST_REQUIRE(binary_filter_docs.size() == filter_docs.size());
+    for (size_t i = 0; i < filter_docs.size(); ++i) {
+        BOOST_CHECK(binary_filter_docs[i].toString(-1) == filter_docs[i].toString(-1));
+    }
+
+    mergeFilters(binary_project_doc, binary_filter_docs);
+    BOOST_REQUIRE(ProjectFile::writeXml(xml_again_path, binary_project_doc));
+
+    QString xml;
+    BOOST_REQUIRE(readBack(xml_again_path, xml));
+    BOOST_CHECK(xml == original.toString(-1));
+}
+
+BOOST_AUTO_TEST_CASE(test_overwrite_reuses_unchanged_records)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    QString const path(dir.path() + "/project.bin");
+
+    QDomDocument project_doc(createProject(NUM_PAGES));
+    std::vector<QDomDocument> filter_docs(splitFilters(project_doc));
+    BOOST_REQUIRE(ProjectFile::writeBinary(path, project_doc, filter_docs));
+    QByteArray const old_data(readFile(path));
+
+    // Change a page near the end of the first filter.  The records
+    // before it are taken from the file being replaced.
+    QDomElement deskew_el(filter_docs[0].documentElement().firstChildElement());
+    QDomElement last_page_el(deskew_el.lastChildElement());
+    last_page_el.firstChildElement().setAttribute("value", "changed");
+    BOOST_REQUIRE(ProjectFile::writeBinary(path, project_doc, filter_docs));
+    QByteArray const new_data(readFile(path));
+
+    BOOST_REQUIRE(old_data.size() > 1000);
+    BOOST_CHECK(new_data != old_data);
+    BOOST_CHECK(new_data.left(1000) == old_data.left(1000));
+
+    QDomDocument expected(project_doc.cloneNode(true).toDocument());
+    mergeFilters(expected, filter_docs);
+    QString xml;
+    BOOST_REQUIRE(readBack(path, xml));
+    BOOST_CHECK(xml == expected.toString(-1));
+
+    // Saving the same thing again gives the same file.
+    BOOST_REQUIRE(ProjectFile::writeBinary(path, project_doc, filter_docs));
+    BOOST_CHECK(readFile(path) == new_data);
+
+    // A broken file being replaced is not a reason to fail.
+    BOOST_REQUIRE(writeFile(path, new_data.left(new_data.size() / 2)));
+    BOOST_REQUIRE(ProjectFile::writeBinary(path, project_doc, filter_docs));
+    BOOST_CHECK(readFile(path) == new_data);
+}
+
+BOOST_AUTO_TEST_CASE(test_broken_binary_files)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    QString const path(dir.path() + "/project.bin");
+    QString const broken_path(dir.path() + "/broken.bin");
+
+    QDomDocument project_doc(createProject(NUM_PAGES));
+    std::vector<QDomDocument> filter_docs(splitFilters(project_doc));
+    BOOST_REQUIRE(ProjectFile::writeBinary(path, project_doc, filter_docs));
+    QByteArray const data(readFile(path));
+    BOOST_REQUIRE(data.size() > 100);
+
+    QDomDocument doc;
+    std::vector<QDomDocument> docs;
+
+    // The trailer is the index offset followed by the magic.
+    int const trailer_pos = data.size() - 12;
+
+    // Truncated trailer.
+    BOOST_REQUIRE(writeFile(broken_path, data.left(data.size() - 5)));
+    BOOST_CHECK(!ProjectFile::read(broken_path, doc, docs));
+
+    // Truncated index.
+    BOOST_REQUIRE(writeFile(broken_path, data.left(trailer_pos - 10) + data.mid(trailer_pos)));
+    BOOST_CHECK(!ProjectFile::read(broken_path, doc, docs));
+
+    // Index offset pointing past the end of the file.
+    QByteArray bad_offset(data);
+    bad_offset[trailer_pos + 3] = char(0x7f);
+    BOOST_REQUIRE(writeFile(broken_path, bad_offset));
+    BOOST_CHECK(!ProjectFile::read(broken_path, doc, docs));
+
+    // Index offset pointing to the first record.
+    QByteArray shifted_offset(data);
+    shifted_offset[trailer_pos] = char(8);
+    for (int i = 1; i < 8; ++i) {
+        shifted_offset[trailer_pos + i] = char(0);
+    }
+    BOOST_REQUIRE(writeFile(broken_path, shifted_offset));
+    BOOST_CHECK(!ProjectFile::read(broken_path, doc, docs));
+
+    // Broken magic in the trailer.
+    QByteArray bad_magic(data);
+    bad_magic[data.size() - 1] = char(~bad_magic[data.size() - 1]);
+    BOOST_REQUIRE(writeFile(broken_path, bad_magic));
+    BOOST_CHECK(!ProjectFile::read(broken_path, doc, docs));
+
+    // A corrupted record.
+    QByteArray bad_record(data);
+    bad_record[20] = char(~bad_record[20]);
+    BOOST_REQUIRE(writeFile(broken_path, bad_record));
+    BOOST_CHECK(!ProjectFile::read(broken_path, doc, docs));
+    BOOST_CHECK(docs.empty());
+
+    // The original is still fine.
+    BOOST_CHECK(ProjectFile::read(path, doc, docs));
+    BOOST_CHECK(docs.size() == filter_docs.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
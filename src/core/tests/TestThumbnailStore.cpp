@@ -0,0 +1,196 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThumbnailStore.h"
+#include "ImageId.h"
+#include "IntrusivePtr.h"
+#include <QImage>
+#include <QString>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QDateTime>
+#include <QColor>
+#include <QtGlobal>
+#include <vector>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace Tests
+{
+
+BOOST_AUTO_TEST_SUITE(ThumbnailStoreTestSuite);
+
+static QImage randomRgbImage(int const width, int const height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            image.setPixel(x, y, qRgb(rand() & 0xff, rand() & 0xff, rand() & 0xff));
+        }
+    }
+    return image;
+}
+
+static QImage randomGrayImage(int const width, int const height)
+{
+    QImage image(width, height, QImage::Format_Indexed8);
+    image.setColorCount(256);
+    for (int i = 0; i < 256; ++i) {
+        image.setColor(i, qRgb(i, i, i));
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            image.setPixel(x, y, rand() & 0xff);
+        }
+    }
+    return image;
+}
+
+/**
+ * Thumbnails are only returned while their source image is unchanged,
+ * so every ImageId has to refer to an existing file.
+ */
+static bool createSourceFile(QString const& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return file.write("source", 6) == 6;
+}
+
+BOOST_AUTO_TEST_CASE(test_save_load_compact)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    QString const source1(dir.path() + "/page1.png");
+    QString const source2(dir.path() + "/pages.tif");
+    BOOST_REQUIRE(createSourceFile(source1));
+    BOOST_REQUIRE(createSourceFile(source2));
+
+    ImageId const id1(source1);
+    ImageId const id2(source2, 1);
+    ImageId const id3(source2, 2);
+    ImageId const missing_id(dir.path() + "/missing.png");
+
+    QImage const image1(randomRgbImage(40, 30));
+    QImage const image2(randomGrayImage(25, 35));
+    QImage const image3(randomRgbImage(17, 9));
+    QImage const replacement1(randomRgbImage(30, 40));
+
+    QString const store_path(dir.path() + "/thumbs.dat");
+
+    {
+        IntrusivePtr<ThumbnailStore> const store(new ThumbnailStore(store_path));
+        BOOST_CHECK(!store->contains(id1));
+        BOOST_CHECK(store->load(id1).isNull());
+
+        BOOST_REQUIRE(store->save(id1, image1));
+        BOOST_REQUIRE(store->save(id2, image2));
+        BOOST_REQUIRE(store->save(id3, image3));
+        BOOST_CHECK(store->contains(id1));
+        BOOST_CHECK(store->contains(id2));
+        BOOST_CHECK(!store->contains(missing_id));
+
+        BOOST_CHECK(store->load(id1) == image1);
+        BOOST_CHECK(store->load(id2) == image2);
+
+        // The replaced thumbnail stays in the file until compaction.
+        BOOST_REQUIRE(store->save(id1, replacement1));
+        BOOST_CHECK(store->load(id1) == replacement1);
+
+        BOOST_REQUIRE(store->compact());
+        BOOST_CHECK(store->load(id1) == replacement1);
+        BOOST_CHECK(store->load(id2) == image2);
+        BOOST_CHECK(store->load(id3) == image3);
+    }
+
+    {
+        // Everything is in the index now.
+        IntrusivePtr<ThumbnailStore> const store(new ThumbnailStore(store_path));
+
+        std::vector<ImageId> ids;
+        ids.push_back(id3);
+        ids.push_back(missing_id);
+        ids.push_back(id1);
+        ids.push_back(id2);
+        std::vector<QImage> const images(store->load(ids));
+        BOOST_REQUIRE(images.size() == ids.size());
+        BOOST_CHECK(images[0] == image3);
+        BOOST_CHECK(images[1].isNull());
+        BOOST_CHECK(images[2] == replacement1);
+        BOOST_CHECK(images[3] == image2);
+
+        // This one follows the indexed part of the file.
+        BOOST_REQUIRE(store->save(id2, image1));
+    }
+
+    {
+        // The record appended after compaction is found by scanning.
+        IntrusivePtr<ThumbnailStore> const store(new ThumbnailStore(store_path));
+        BOOST_CHECK(store->load(id1) == replacement1);
+        BOOST_CHECK(store->load(id2) == image1);
+        BOOST_CHECK(store->load(id3) == image3);
+
+        BOOST_REQUIRE(store->compact());
+        BOOST_CHECK(store->load(id2) == image1);
+    }
+
+    {
+        IntrusivePtr<ThumbnailStore> const store(new ThumbnailStore(store_path));
+        BOOST_CHECK(store->load(id1) == replacement1);
+        BOOST_CHECK(store->load(id2) == image1);
+        BOOST_CHECK(store->load(id3) == image3);
+    }
+}
+
+#if QT_VERSION >= 0x050A00
+BOOST_AUTO_TEST_CASE(test_outdated_thumbnail)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    QString const source(dir.path() + "/page.png");
+    BOOST_REQUIRE(createSourceFile(source));
+    ImageId const id(source);
+
+    IntrusivePtr<ThumbnailStore> const store(
+        new ThumbnailStore(dir.path() + "/thumbs.dat")
+    );
+    BOOST_REQUIRE(store->save(id, randomRgbImage(10, 10)));
+    BOOST_REQUIRE(store->contains(id));
+
+    // Pretend the source image was modified.
+    QFile file(source);
+    BOOST_REQUIRE(file.open(QIODevice::ReadWrite));
+    QDateTime const mtime(QFileInfo(source).lastModified());
+    BOOST_REQUIRE(file.setFileTime(mtime.addSecs(10), QFileDevice::FileModificationTime));
+    file.close();
+
+    BOOST_CHECK(!store->contains(id));
+    BOOST_CHECK(store->load(id).isNull());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
@@ -0,0 +1,272 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TiffReader.h"
+#include <QImage>
+#include <QFile>
+#include <QString>
+#include <QSize>
+#include <QRect>
+#include <QTemporaryDir>
+#include <QColor>
+#include <vector>
+#include <tiff.h>
+#include <tiffio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace Tests
+{
+
+BOOST_AUTO_TEST_SUITE(TiffReaderTestSuite);
+
+static QImage randomRgbImage(int const width, int const height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            image.setPixel(x, y, qRgb(rand() & 0xff, rand() & 0xff, rand() & 0xff));
+        }
+    }
+    return image;
+}
+
+/**
+ * Writes an 8-bit RGB TIFF with the given orientation, storing the rows
+ * and the columns of \p image in the order the orientation implies.
+ */
+static bool writeRgbTiff(
+    QString const& path, QImage const& image, uint16 const orientation, int const rows_per_strip)
+{
+    TIFF* tif = TIFFOpen(QFile::encodeName(path).constData(), "w");
+    if (!tif) {
+        return false;
+    }
+
+    int const width = image.width();
+    int const height = image.height();
+    bool const bottom_up = orientation == ORIENTATION_BOTLEFT || orientation == ORIENTATION_BOTRIGHT;
+    bool const right_to_left = orientation == ORIENTATION_TOPRIGHT || orientation == ORIENTATION_BOTRIGHT;
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, uint32(width));
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, uint32(height));
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, uint16(8));
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, uint16(3));
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, uint16(PHOTOMETRIC_RGB));
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, uint16(PLANARCONFIG_CONTIG));
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, orientation);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, uint32(rows_per_strip));
+
+    bool ok = true;
+    std::vector<uint8> line(width * 3);
+    for (int file_y = 0; file_y < height && ok; ++file_y) {
+        int const y = bottom_up ? height - 1 - file_y : file_y;
+        for (int file_x = 0; file_x < width; ++file_x) {
+            int const x = right_to_left ? width - 1 - file_x : file_x;
+            QRgb const rgb = image.pixel(x, y);
+            line[file_x * 3] = static_cast<uint8>(qRed(rgb));
+            line[file_x * 3 + 1] = static_cast<uint8>(qGreen(rgb));
+            line[file_x * 3 + 2] = static_cast<uint8>(qBlue(rgb));
+        }
+        ok = TIFFWriteScanline(tif, &line[0], file_y, 0) == 1;
+    }
+
+    TIFFClose(tif);
+    return ok;
+}
+
+static QImage readTiff(QString const& path, QSize const& box = QSize())
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+    return TiffReader::readImage(file, 0, box);
+}
+
+BOOST_AUTO_TEST_CASE(test_rgb_orientations)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    // The height isn't a multiple of the strip height,
+    // so the first and the last strips differ in size.
+    QImage const image(randomRgbImage(37, 29));
+
+    static uint16 const orientations[] = {
+        ORIENTATION_TOPLEFT, ORIENTATION_BOTLEFT,
+        ORIENTATION_TOPRIGHT, ORIENTATION_BOTRIGHT
+    };
+
+    for (uint16 const orientation : orientations) {
+        QString const path(dir.path() + QString("/rgb_%1.tif").arg(orientation));
+        BOOST_REQUIRE(writeRgbTiff(path, image, orientation, 4));
+        BOOST_CHECK_MESSAGE(readTiff(path) == image, "orientation " << orientation);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_downscaled_bottom_up_rgb)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    QImage const image(randomRgbImage(64, 50));
+
+    QString const top_down_path(dir.path() + "/top_down.tif");
+    QString const bottom_up_path(dir.path() + "/bottom_up.tif");
+    BOOST_REQUIRE(writeRgbTiff(top_down_path, image, ORIENTATION_TOPLEFT, 3));
+    BOOST_REQUIRE(writeRgbTiff(bottom_up_path, image, ORIENTATION_BOTLEFT, 3));
+
+    // Without reduced resolution sub-images, colour pages are scaled
+    // down band by band.
+    QSize const box(32, 25);
+    QImage const top_down(readTiff(top_down_path, box));
+    QImage const bottom_up(readTiff(bottom_up_path, box));
+
+    BOOST_REQUIRE(top_down.size() == box);
+    BOOST_CHECK(bottom_up == top_down);
+}
+
+/**
+ * Reads bands of \p rect and puts them together.  Checks that the bands
+ * follow each other and, if \p strip_height is given, that they don't
+ * cross the strips of a bottom-up file.
+ */
+static QImage readBandsTogether(
+    QString const& path, QRect const& rect, int const page_height, int const strip_height = 0)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+
+    QImage result(rect.size(), QImage::Format_RGB32);
+    int next_top = rect.top();
+    bool ok = true;
+
+    auto out = [&](QImage const& band, int const top) {
+        int const bottom = top + band.height();
+        if (top != next_top || band.width() != rect.width()
+                || bottom > rect.top() + rect.height()) {
+            ok = false;
+            return false;
+        }
+        if (strip_height > 0 && (page_height - bottom) % strip_height != 0
+                && bottom != rect.top() + rect.height()) {
+            ok = false;
+        }
+        QImage const rgb_band(band.convertToFormat(QImage::Format_RGB32));
+        for (int y = 0; y < rgb_band.height(); ++y) {
+            memcpy(result.scanLine(top - rect.top() + y), rgb_band.scanLine(y), rect.width() * 4);
+        }
+        next_top = bottom;
+        return true;
+    };
+
+    if (!TiffReader::readBands(file, 0, out, rect) || !ok
+            || next_top != rect.top() + rect.height()) {
+        return QImage();
+    }
+
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_region_across_strips)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    QImage const image(randomRgbImage(37, 29));
+
+    static uint16 const orientations[] = {
+        ORIENTATION_TOPLEFT, ORIENTATION_BOTLEFT, ORIENTATION_BOTRIGHT
+    };
+
+    // Starts and ends in the middle of strips, and crosses a few of them.
+    QRect const rect(5, 3, 20, 11);
+
+    // Sticks out of the page, so it's clipped.
+    QRect const clipped_rect(30, 20, 20, 20);
+
+    for (uint16 const orientation : orientations) {
+        QString const path(dir.path() + QString("/rgb_%1.tif").arg(orientation));
+        BOOST_REQUIRE(writeRgbTiff(path, image, orientation, 4));
+
+        QFile file(path);
+        BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+
+        BOOST_CHECK_MESSAGE(
+            TiffReader::readRegion(file, 0, rect) == image.copy(rect),
+            "orientation " << orientation
+        );
+        BOOST_CHECK_MESSAGE(
+            TiffReader::readRegion(file, 0, clipped_rect) == image.copy(QRect(30, 20, 7, 9)),
+            "orientation " << orientation
+        );
+        BOOST_CHECK(TiffReader::readRegion(file, 0, QRect(40, 0, 10, 10)).isNull());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_bands)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    QImage const image(randomRgbImage(37, 29));
+    QRect const rect(2, 5, 30, 17);
+    QRect const page_rect(image.rect());
+
+    QString const top_down_path(dir.path() + "/top_down.tif");
+    BOOST_REQUIRE(writeRgbTiff(top_down_path, image, ORIENTATION_TOPLEFT, 4));
+    BOOST_CHECK(readBandsTogether(top_down_path, rect, image.height()) == image.copy(rect));
+    BOOST_CHECK(readBandsTogether(top_down_path, page_rect, image.height()) == image);
+
+    // The first strip of this one is at the bottom of the page.
+    QString const bottom_up_path(dir.path() + "/bottom_up.tif");
+    BOOST_REQUIRE(writeRgbTiff(bottom_up_path, image, ORIENTATION_BOTLEFT, 4));
+    BOOST_CHECK(readBandsTogether(bottom_up_path, rect, image.height(), 4) == image.copy(rect));
+    BOOST_CHECK(readBandsTogether(bottom_up_path, page_rect, image.height(), 4) == image);
+}
+
+BOOST_AUTO_TEST_CASE(test_bands_early_stop)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    QImage const image(randomRgbImage(37, 29));
+    QString const path(dir.path() + "/rgb.tif");
+    BOOST_REQUIRE(writeRgbTiff(path, image, ORIENTATION_TOPLEFT, 4));
+
+    QFile file(path);
+    BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+
+    int num_calls = 0;
+    auto out = [&num_calls](QImage const&, int) {
+        return ++num_calls < 2;
+    };
+
+    BOOST_CHECK(!TiffReader::readBands(file, 0, out));
+    BOOST_CHECK(num_calls == 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
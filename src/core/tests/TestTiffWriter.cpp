@@ -0,0 +1,225 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TiffWriter.h"
+#include "TiffReader.h"
+#include "settings/globalstaticsettings.h"
+#include <QImage>
+#include <QFile>
+#include <QString>
+#include <QTemporaryDir>
+#include <QVector>
+#include <initializer_list>
+#include <tiff.h>
+#include <tiffio.h>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace Tests
+{
+
+BOOST_AUTO_TEST_SUITE(TiffWriterTestSuite);
+
+/**
+ * Overrides the TIFF settings used by TiffWriter and restores
+ * them when going out of scope.
+ */
+class TiffSettingsGuard
+{
+public:
+    TiffSettingsGuard(int compression, bool predictor, int rows_per_strip)
+        :   m_bwCompression(GlobalStaticSettings::m_tiff_compression_bw_id),
+            m_colorCompression(GlobalStaticSettings::m_tiff_compression_color_id),
+            m_predictor(GlobalStaticSettings::m_use_horizontal_predictor),
+            m_rowsPerStrip(GlobalStaticSettings::m_tiff_rows_per_strip)
+    {
+        GlobalStaticSettings::m_tiff_compression_bw_id = compression;
+        GlobalStaticSettings::m_tiff_compression_color_id = compression;
+        GlobalStaticSettings::m_use_horizontal_predictor = predictor;
+        GlobalStaticSettings::m_tiff_rows_per_strip = rows_per_strip;
+    }
+
+    ~TiffSettingsGuard()
+    {
+        GlobalStaticSettings::m_tiff_compression_bw_id = m_bwCompression;
+        GlobalStaticSettings::m_tiff_compression_color_id = m_colorCompression;
+        GlobalStaticSettings::m_use_horizontal_predictor = m_predictor;
+        GlobalStaticSettings::m_tiff_rows_per_strip = m_rowsPerStrip;
+    }
+private:
+    int m_bwCompression;
+    int m_colorCompression;
+    bool m_predictor;
+    int m_rowsPerStrip;
+};
+
+static QImage randomRgbImage(int const width, int const height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            image.setPixel(x, y, qRgb(rand() & 0xff, rand() & 0xff, rand() & 0xff));
+        }
+    }
+    return image;
+}
+
+/**
+ * A grayscale image with smooth areas, where the predictor matters,
+ * and noisy ones.
+ */
+static QImage grayscaleImage(int const width, int const height)
+{
+    QVector<QRgb> palette(256);
+    for (int i = 0; i < 256; ++i) {
+        palette[i] = qRgb(i, i, i);
+    }
+
+    QImage image(width, height, QImage::Format_Indexed8);
+    image.setColorTable(palette);
+    for (int y = 0; y < height; ++y) {
+        uchar* line = image.scanLine(y);
+        for (int x = 0; x < width; ++x) {
+            line[x] = static_cast<uchar>(x < width / 2 ? (x + y) & 0xff : rand() & 0xff);
+        }
+    }
+    return image;
+}
+
+static QImage bitonalImage(int const width, int const height, QImage::Format const format)
+{
+    QImage image(width, height, format);
+    image.setColorTable(QVector<QRgb>() << qRgb(0xff, 0xff, 0xff) << qRgb(0, 0, 0));
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            // Runs of black and white, as G4 would see in text.
+            image.setPixel(x, y, ((x / 3 + y / 2) % 5 == 0 || rand() % 17 == 0) ? 1 : 0);
+        }
+    }
+    return image;
+}
+
+/**
+ * Compares the colors of the pixels, so that the pixel format
+ * the image is read back as doesn't matter.
+ */
+static bool sameColors(QImage const& a, QImage const& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (int y = 0; y < a.height(); ++y) {
+        for (int x = 0; x < a.width(); ++x) {
+            if ((a.pixel(x, y) & 0x00ffffff) != (b.pixel(x, y) & 0x00ffffff)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int numberOfStrips(QString const& path)
+{
+    TIFF* tif = TIFFOpen(QFile::encodeName(path).constData(), "r");
+    if (!tif) {
+        return 0;
+    }
+    int const num_strips = int(TIFFNumberOfStrips(tif));
+    TIFFClose(tif);
+    return num_strips;
+}
+
+/**
+ * Writes \p image with TiffWriter and reads it back with TiffReader.
+ * The height of the test images isn't a multiple of the strip height,
+ * so the last strip is shorter than the rest.
+ */
+static void checkRoundTrip(
+    QTemporaryDir const& dir, QImage const& image,
+    int const compression, bool const predictor)
+{
+    int const rows_per_strip = 8;
+    BOOST_REQUIRE(image.height() % rows_per_strip != 0);
+
+    TiffSettingsGuard const guard(compression, predictor, rows_per_strip);
+
+    QString const path(
+        dir.path() + QString("/%1_%2_%3.tif")
+        .arg(compression).arg(int(predictor)).arg(int(image.format()))
+    );
+    BOOST_REQUIRE(TiffWriter::writeImage(path, image));
+
+    // More than one strip means they were compressed in parallel.
+    BOOST_CHECK_EQUAL(numberOfStrips(path), (image.height() + rows_per_strip - 1) / rows_per_strip);
+
+    QFile file(path);
+    BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+    QImage const read_back(TiffReader::readImage(file));
+    BOOST_CHECK_MESSAGE(
+        sameColors(read_back, image),
+        "compression " << compression << ", predictor " << predictor
+        << ", format " << int(image.format())
+    );
+}
+
+BOOST_AUTO_TEST_CASE(test_lzw_round_trip)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    for (bool const predictor : { false, true }) {
+        checkRoundTrip(dir, grayscaleImage(45, 53), COMPRESSION_LZW, predictor);
+        checkRoundTrip(dir, randomRgbImage(45, 53), COMPRESSION_LZW, predictor);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_deflate_round_trip)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    for (int const compression : { COMPRESSION_ADOBE_DEFLATE, COMPRESSION_DEFLATE }) {
+        checkRoundTrip(dir, grayscaleImage(45, 53), compression, false);
+        checkRoundTrip(dir, randomRgbImage(45, 53), compression, true);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_packbits_round_trip)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    checkRoundTrip(dir, grayscaleImage(45, 53), COMPRESSION_PACKBITS, false);
+    checkRoundTrip(dir, randomRgbImage(45, 53), COMPRESSION_PACKBITS, false);
+    checkRoundTrip(dir, bitonalImage(45, 53, QImage::Format_Mono), COMPRESSION_PACKBITS, false);
+}
+
+BOOST_AUTO_TEST_CASE(test_g4_round_trip)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+
+    checkRoundTrip(dir, bitonalImage(45, 53, QImage::Format_Mono), COMPRESSION_CCITTFAX4, false);
+    checkRoundTrip(dir, bitonalImage(45, 53, QImage::Format_MonoLSB), COMPRESSION_CCITTFAX4, false);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
@@ -43,6 +43,8 @@
 #include <exception>
 #include <iterator>
 #include <limits>
+#include <utility>
+#include <vector>
 #include <math.h>
 #include <assert.h>
 
@@ -88,8 +90,18 @@ public:
     RansacAlgo(std::vector<TracedCurve> const& all_curves)
         : m_rAllCurves(all_curves) {}
 
-    void buildAndAssessModel(
-        TracedCurve const* top_curve, TracedCurve const* bottom_curve);
+    /**
+     * \brief Queues a pair of curves to be assessed by assessModels().
+     */
+    void addModel(TracedCurve const* top_curve, TracedCurve const* bottom_curve);
+
+    /**
+     * \brief Assesses the queued models in parallel and updates the best one.
+     *
+     * Ties are resolved in favour of the model that was queued first,
+     * so the outcome is the same as assessing the models one by one.
+     */
+    void assessModels();
 
     RansacModel& bestModel()
     {
@@ -101,11 +113,20 @@ public:
         return m_bestModel;
     }
 private:
+    typedef std::pair<TracedCurve const*, TracedCurve const*> CurvePair;
+
+    /**
+     * Returns the total error of a model, or NumericTraits<double>::max()
+     * if a model can't be built from the given curves.
+     */
+    double calcModelError(TracedCurve const* top_curve, TracedCurve const* bottom_curve) const;
+
     double calcReferenceHeight(
         CylindricalSurfaceDewarper const& dewarper, QPointF const& loc);
 
     RansacModel m_bestModel;
     std::vector<TracedCurve> const& m_rAllCurves;
+    std::vector<CurvePair> m_pendingModels;
 };
 
 class DistortionModelBuilder::BadCurve : public std::exception
@@ -208,7 +229,7 @@ DistortionModelBuilder::tryBuildModel(DebugImages* dbg, QImage const* dbg_backgr
     for (int i = 0; i < std::min<int>(3, num_curves); ++i) {
         for (int j = std::max<int>(0, num_curves - 3); j < num_curves; ++j) {
             if (i < j) {
-                ransac.buildAndAssessModel(&ordered_curves[i], &ordered_curves[j]);
+                ransac.addModel(&ordered_curves[i], &ordered_curves[j]);
             }
         }
     }
@@ -223,10 +244,12 @@ DistortionModelBuilder::tryBuildModel(DebugImages* dbg, QImage const* dbg_backgr
             std::swap(i, j);
         }
         if (i < j) {
-            ransac.buildAndAssessModel(&ordered_curves[i], &ordered_curves[j]);
+            ransac.addModel(&ordered_curves[i], &ordered_curves[j]);
         }
     }
 
+    ransac.assessModels();
+
     if (dbg && dbg_background) {
         dbg->add(visualizeTrimmedPolylines(*dbg_background, ordered_curves), "trimmed_polylines");
         dbg->add(visualizeModel(*dbg_background, ordered_curves, ransac.bestModel()), "distortion_model");
@@ -480,15 +503,44 @@ DistortionModelBuilder::fitExtendedSpline(
 /*============================== RansacAlgo ============================*/
 
 void
-DistortionModelBuilder::RansacAlgo::buildAndAssessModel(
+DistortionModelBuilder::RansacAlgo::addModel(
     TracedCurve const* top_curve, TracedCurve const* bottom_curve)
+{
+    m_pendingModels.push_back(CurvePair(top_curve, bottom_curve));
+}
+
+void
+DistortionModelBuilder::RansacAlgo::assessModels()
+{
+    int const num_models = m_pendingModels.size();
+    std::vector<double> errors(num_models);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_models; ++i) {
+        errors[i] = calcModelError(m_pendingModels[i].first, m_pendingModels[i].second);
+    }
+
+    for (int i = 0; i < num_models; ++i) {
+        if (errors[i] < m_bestModel.totalError) {
+            m_bestModel.topCurve = m_pendingModels[i].first;
+            m_bestModel.bottomCurve = m_pendingModels[i].second;
+            m_bestModel.totalError = errors[i];
+        }
+    }
+
+    m_pendingModels.clear();
+}
+
+double
+DistortionModelBuilder::RansacAlgo::calcModelError(
+    TracedCurve const* top_curve, TracedCurve const* bottom_curve) const
 try
 {
     DistortionModel model;
     model.setTopCurve(Curve(top_curve->extendedPolyline));
     model.setBottomCurve(Curve(bottom_curve->extendedPolyline));
     if (!model.isValid()) {
-        return;
+        return NumericTraits<double>::max();
     }
 
     double const depth_perception = 2.0; // Doesn't matter much here.
@@ -551,14 +603,11 @@ try
         }
     }
 
-    if (error < m_bestModel.totalError) {
-        m_bestModel.topCurve = top_curve;
-        m_bestModel.bottomCurve = bottom_curve;
-        m_bestModel.totalError = error;
-    }
+    return error;
 } catch (std::runtime_error const&)
 {
     // Probably CylindricalSurfaceDewarper didn't like something.
+    return NumericTraits<double>::max();
 }
 #if 0
 double
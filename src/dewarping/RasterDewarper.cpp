@@ -28,6 +28,8 @@
 #include <QSize>
 #include <QRect>
 #include <QDebug>
+#include <algorithm>
+#include <vector>
 #include <math.h>
 
 #define INTERP_NONE 0
@@ -165,261 +167,267 @@ void dewarpGeneric(
 
 #elif INTERPOLATION_METHOD == INTERP_AREA_MAPPING
 
+/**
+ * \brief Computes a destination pixel by mixing the source pixels
+ *        covered by its quadrilateral.
+ *
+ * The corners of the quadrilateral are the grid points, in source
+ * image coordinates, of the top-left, top-right, bottom-right and
+ * bottom-left corners of the destination pixel.
+ */
 template<typename ColorMixer, typename PixelType>
-void areaMapGeneratrix(
+PixelType areaMapPixel(
     PixelType const* const src_data, QSize const src_size,
-    int const src_stride, PixelType* p_dst,
-    QSize const dst_size, int const dst_stride,
-    PixelType const bg_color,
-    std::vector<Vec2f> const& prev_grid_column,
-    std::vector<Vec2f> const& next_grid_column)
+    int const src_stride, PixelType const bg_color,
+    Vec2f const& top_left, Vec2f const& top_right,
+    Vec2f const& bottom_right, Vec2f const& bottom_left)
 {
     int const sw = src_size.width();
     int const sh = src_size.height();
-    int const dst_height = dst_size.height();
 
-    Vec2f const* src_left_points = &prev_grid_column[0];
-    Vec2f const* src_right_points = &next_grid_column[0];
-
-    Vec2f f_src32_quad[4];
-
-    for (int dst_y = 0; dst_y < dst_height; ++dst_y) {
-        // Take a mid-point of each edge, pre-multiply by 32,
-        // write the result to f_src32_quad. 16 comes from 32*0.5
-        f_src32_quad[0] = 16.0f * (src_left_points[0] + src_right_points[0]);
-        f_src32_quad[1] = 16.0f * (src_right_points[0] + src_right_points[1]);
-        f_src32_quad[2] = 16.0f * (src_right_points[1] + src_left_points[1]);
-        f_src32_quad[3] = 16.0f * (src_left_points[0] + src_left_points[1]);
-        ++src_left_points;
-        ++src_right_points;
-
-        // Calculate the bounding box of src_quad.
-
-        float f_src32_left = f_src32_quad[0][0];
-        float f_src32_top = f_src32_quad[0][1];
-        float f_src32_right = f_src32_left;
-        float f_src32_bottom = f_src32_top;
-
-        for (int i = 1; i < 4; ++i) {
-            Vec2f const pt(f_src32_quad[i]);
-            if (pt[0] < f_src32_left) {
-                f_src32_left = pt[0];
-            } else if (pt[0] > f_src32_right) {
-                f_src32_right = pt[0];
-            }
-            if (pt[1] < f_src32_top) {
-                f_src32_top = pt[1];
-            } else if (pt[1] > f_src32_bottom) {
-                f_src32_bottom = pt[1];
-            }
+    // Take a mid-point of each edge, pre-multiply by 32,
+    // write the result to f_src32_quad. 16 comes from 32*0.5
+    Vec2f const f_src32_quad[4] = {
+        16.0f * (top_left + top_right),
+        16.0f * (top_right + bottom_right),
+        16.0f * (bottom_right + bottom_left),
+        16.0f * (top_left + bottom_left)
+    };
+
+    // Calculate the bounding box of src_quad.
+
+    float f_src32_left = f_src32_quad[0][0];
+    float f_src32_top = f_src32_quad[0][1];
+    float f_src32_right = f_src32_left;
+    float f_src32_bottom = f_src32_top;
+
+    for (int i = 1; i < 4; ++i) {
+        Vec2f const pt(f_src32_quad[i]);
+        if (pt[0] < f_src32_left) {
+            f_src32_left = pt[0];
+        } else if (pt[0] > f_src32_right) {
+            f_src32_right = pt[0];
         }
-
-        if (f_src32_top < -32.0f * 10000.0f || f_src32_left < -32.0f * 10000.0f ||
-                f_src32_bottom > 32.0f * (float(sh) + 10000.f) ||
-                f_src32_right > 32.0f * (float(sw) + 10000.f)) {
-            // This helps to prevent integer overflows.
-            *p_dst = bg_color;
-            p_dst += dst_stride;
-            continue;
+        if (pt[1] < f_src32_top) {
+            f_src32_top = pt[1];
+        } else if (pt[1] > f_src32_bottom) {
+            f_src32_bottom = pt[1];
         }
+    }
 
-        // Note: the code below is more or less the same as in transformGeneric()
-        // in imageproc/Transform.cpp
-
-        // Note that without using floor() and ceil()
-        // we can't guarantee that src_bottom >= src_top
-        // and src_right >= src_left.
-        int src32_left = (int)floor(f_src32_left);
-        int src32_right = (int)ceil(f_src32_right);
-        int src32_top = (int)floor(f_src32_top);
-        int src32_bottom = (int)ceil(f_src32_bottom);
-        int src_left = src32_left >> 5;
-        int src_right = (src32_right - 1) >> 5; // inclusive
-        int src_top = src32_top >> 5;
-        int src_bottom = (src32_bottom - 1) >> 5; // inclusive
-        assert(src_bottom >= src_top);
-        assert(src_right >= src_left);
-
-        if (src_bottom < 0 || src_right < 0 || src_left >= sw || src_top >= sh) {
-            // Completely outside of src image.
-            *p_dst = bg_color;
-            p_dst += dst_stride;
-            continue;
-        }
+    if (f_src32_top < -32.0f * 10000.0f || f_src32_left < -32.0f * 10000.0f ||
+            f_src32_bottom > 32.0f * (float(sh) + 10000.f) ||
+            f_src32_right > 32.0f * (float(sw) + 10000.f)) {
+        // This helps to prevent integer overflows.
+        return bg_color;
+    }
 
-        /*
-         * Note that (intval / 32) is not the same as (intval >> 5).
-         * The former rounds towards zero, while the latter rounds towards
-         * negative infinity.
-         * Likewise, (intval % 32) is not the same as (intval & 31).
-         * The following expression:
-         * top_fraction = 32 - (src32_top & 31);
-         * works correctly with both positive and negative src32_top.
-         */
-
-        unsigned background_area = 0;
-
-        if (src_top < 0) {
-            unsigned const top_fraction = 32 - (src32_top & 31);
-            unsigned const hor_fraction = src32_right - src32_left;
-            background_area += top_fraction * hor_fraction;
-            unsigned const full_pixels_ver = -1 - src_top;
-            background_area += hor_fraction * (full_pixels_ver << 5);
-            src_top = 0;
-            src32_top = 0;
-        }
-        if (src_bottom >= sh) {
-            unsigned const bottom_fraction = src32_bottom - (src_bottom << 5);
-            unsigned const hor_fraction = src32_right - src32_left;
-            background_area += bottom_fraction * hor_fraction;
-            unsigned const full_pixels_ver = src_bottom - sh;
-            background_area += hor_fraction * (full_pixels_ver << 5);
-            src_bottom = sh - 1; // inclusive
-            src32_bottom = sh << 5; // exclusive
-        }
-        if (src_left < 0) {
-            unsigned const left_fraction = 32 - (src32_left & 31);
-            unsigned const vert_fraction = src32_bottom - src32_top;
-            background_area += left_fraction * vert_fraction;
-            unsigned const full_pixels_hor = -1 - src_left;
-            background_area += vert_fraction * (full_pixels_hor << 5);
-            src_left = 0;
-            src32_left = 0;
-        }
-        if (src_right >= sw) {
-            unsigned const right_fraction = src32_right - (src_right << 5);
-            unsigned const vert_fraction = src32_bottom - src32_top;
-            background_area += right_fraction * vert_fraction;
-            unsigned const full_pixels_hor = src_right - sw;
-            background_area += vert_fraction * (full_pixels_hor << 5);
-            src_right = sw - 1; // inclusive
-            src32_right = sw << 5; // exclusive
-        }
-        assert(src_bottom >= src_top);
-        assert(src_right >= src_left);
+    // Note: the code below is more or less the same as in transformGeneric()
+    // in imageproc/Transform.cpp
+
+    // Note that without using floor() and ceil()
+    // we can't guarantee that src_bottom >= src_top
+    // and src_right >= src_left.
+    int src32_left = (int)floor(f_src32_left);
+    int src32_right = (int)ceil(f_src32_right);
+    int src32_top = (int)floor(f_src32_top);
+    int src32_bottom = (int)ceil(f_src32_bottom);
+    int src_left = src32_left >> 5;
+    int src_right = (src32_right - 1) >> 5; // inclusive
+    int src_top = src32_top >> 5;
+    int src_bottom = (src32_bottom - 1) >> 5; // inclusive
+    assert(src_bottom >= src_top);
+    assert(src_right >= src_left);
+
+    if (src_bottom < 0 || src_right < 0 || src_left >= sw || src_top >= sh) {
+        // Completely outside of src image.
+        return bg_color;
+    }
 
-        ColorMixer mixer;
-        //if (weak_background) {
-        //  background_area = 0;
-        //} else {
-        mixer.add(bg_color, background_area);
-        //}
+    /*
+     * Note that (intval / 32) is not the same as (intval >> 5).
+     * The former rounds towards zero, while the latter rounds towards
+     * negative infinity.
+     * Likewise, (intval % 32) is not the same as (intval & 31).
+     * The following expression:
+     * top_fraction = 32 - (src32_top & 31);
+     * works correctly with both positive and negative src32_top.
+     */
 
-        unsigned const left_fraction = 32 - (src32_left & 31);
+    unsigned background_area = 0;
+
+    if (src_top < 0) {
         unsigned const top_fraction = 32 - (src32_top & 31);
-        unsigned const right_fraction = src32_right - (src_right << 5);
+        unsigned const hor_fraction = src32_right - src32_left;
+        background_area += top_fraction * hor_fraction;
+        unsigned const full_pixels_ver = -1 - src_top;
+        background_area += hor_fraction * (full_pixels_ver << 5);
+        src_top = 0;
+        src32_top = 0;
+    }
+    if (src_bottom >= sh) {
         unsigned const bottom_fraction = src32_bottom - (src_bottom << 5);
+        unsigned const hor_fraction = src32_right - src32_left;
+        background_area += bottom_fraction * hor_fraction;
+        unsigned const full_pixels_ver = src_bottom - sh;
+        background_area += hor_fraction * (full_pixels_ver << 5);
+        src_bottom = sh - 1; // inclusive
+        src32_bottom = sh << 5; // exclusive
+    }
+    if (src_left < 0) {
+        unsigned const left_fraction = 32 - (src32_left & 31);
+        unsigned const vert_fraction = src32_bottom - src32_top;
+        background_area += left_fraction * vert_fraction;
+        unsigned const full_pixels_hor = -1 - src_left;
+        background_area += vert_fraction * (full_pixels_hor << 5);
+        src_left = 0;
+        src32_left = 0;
+    }
+    if (src_right >= sw) {
+        unsigned const right_fraction = src32_right - (src_right << 5);
+        unsigned const vert_fraction = src32_bottom - src32_top;
+        background_area += right_fraction * vert_fraction;
+        unsigned const full_pixels_hor = src_right - sw;
+        background_area += vert_fraction * (full_pixels_hor << 5);
+        src_right = sw - 1; // inclusive
+        src32_right = sw << 5; // exclusive
+    }
+    assert(src_bottom >= src_top);
+    assert(src_right >= src_left);
+
+    ColorMixer mixer;
+    //if (weak_background) {
+    //  background_area = 0;
+    //} else {
+    mixer.add(bg_color, background_area);
+    //}
+
+    unsigned const left_fraction = 32 - (src32_left & 31);
+    unsigned const top_fraction = 32 - (src32_top & 31);
+    unsigned const right_fraction = src32_right - (src_right << 5);
+    unsigned const bottom_fraction = src32_bottom - (src_bottom << 5);
+
+    assert(left_fraction + right_fraction + (src_right - src_left - 1) * 32 == static_cast<unsigned>(src32_right - src32_left));
+    assert(top_fraction + bottom_fraction + (src_bottom - src_top - 1) * 32 == static_cast<unsigned>(src32_bottom - src32_top));
+
+    unsigned const src_area = (src32_bottom - src32_top) * (src32_right - src32_left);
+    if (src_area == 0) {
+        return bg_color;
+    }
 
-        assert(left_fraction + right_fraction + (src_right - src_left - 1) * 32 == static_cast<unsigned>(src32_right - src32_left));
-        assert(top_fraction + bottom_fraction + (src_bottom - src_top - 1) * 32 == static_cast<unsigned>(src32_bottom - src32_top));
-
-        unsigned const src_area = (src32_bottom - src32_top) * (src32_right - src32_left);
-        if (src_area == 0) {
-            *p_dst = bg_color;
-            p_dst += dst_stride;
-            continue;
-        }
-
-        PixelType const* src_line = &src_data[src_top * src_stride];
-
-        if (src_top == src_bottom) {
-            if (src_left == src_right) {
-                // dst pixel maps to a single src pixel
-                PixelType const c = src_line[src_left];
-                if (background_area == 0) {
-                    // common case optimization
-                    *p_dst = c;
-                    p_dst += dst_stride;
-                    continue;
-                }
-                mixer.add(c, src_area);
-            } else {
-                // dst pixel maps to a horizontal line of src pixels
-                unsigned const vert_fraction = src32_bottom - src32_top;
-                unsigned const left_area = vert_fraction * left_fraction;
-                unsigned const middle_area = vert_fraction << 5;
-                unsigned const right_area = vert_fraction * right_fraction;
-
-                mixer.add(src_line[src_left], left_area);
-
-                for (int sx = src_left + 1; sx < src_right; ++sx) {
-                    mixer.add(src_line[sx], middle_area);
-                }
+    PixelType const* src_line = &src_data[src_top * src_stride];
 
-                mixer.add(src_line[src_right], right_area);
+    if (src_top == src_bottom) {
+        if (src_left == src_right) {
+            // dst pixel maps to a single src pixel
+            PixelType const c = src_line[src_left];
+            if (background_area == 0) {
+                // common case optimization
+                return c;
             }
-        } else if (src_left == src_right) {
-            // dst pixel maps to a vertical line of src pixels
-            unsigned const hor_fraction = src32_right - src32_left;
-            unsigned const top_area = hor_fraction * top_fraction;
-            unsigned const middle_area = hor_fraction << 5;
-            unsigned const bottom_area =  hor_fraction * bottom_fraction;
-
-            src_line += src_left;
-            mixer.add(*src_line, top_area);
-
-            src_line += src_stride;
+            mixer.add(c, src_area);
+        } else {
+            // dst pixel maps to a horizontal line of src pixels
+            unsigned const vert_fraction = src32_bottom - src32_top;
+            unsigned const left_area = vert_fraction * left_fraction;
+            unsigned const middle_area = vert_fraction << 5;
+            unsigned const right_area = vert_fraction * right_fraction;
 
-            for (int sy = src_top + 1; sy < src_bottom; ++sy) {
-                mixer.add(*src_line, middle_area);
-                src_line += src_stride;
-            }
+            mixer.add(src_line[src_left], left_area);
 
-            mixer.add(*src_line, bottom_area);
-        } else {
-            // dst pixel maps to a block of src pixels
-            unsigned const top_area = top_fraction << 5;
-            unsigned const bottom_area = bottom_fraction << 5;
-            unsigned const left_area = left_fraction << 5;
-            unsigned const right_area = right_fraction << 5;
-            unsigned const topleft_area = top_fraction * left_fraction;
-            unsigned const topright_area = top_fraction * right_fraction;
-            unsigned const bottomleft_area = bottom_fraction * left_fraction;
-            unsigned const bottomright_area = bottom_fraction * right_fraction;
-
-            // process the top-left corner
-            mixer.add(src_line[src_left], topleft_area);
-
-            // process the top line (without corners)
             for (int sx = src_left + 1; sx < src_right; ++sx) {
-                mixer.add(src_line[sx], top_area);
+                mixer.add(src_line[sx], middle_area);
             }
 
-            // process the top-right corner
-            mixer.add(src_line[src_right], topright_area);
+            mixer.add(src_line[src_right], right_area);
+        }
+    } else if (src_left == src_right) {
+        // dst pixel maps to a vertical line of src pixels
+        unsigned const hor_fraction = src32_right - src32_left;
+        unsigned const top_area = hor_fraction * top_fraction;
+        unsigned const middle_area = hor_fraction << 5;
+        unsigned const bottom_area =  hor_fraction * bottom_fraction;
 
-            src_line += src_stride;
+        src_line += src_left;
+        mixer.add(*src_line, top_area);
 
-            // process middle lines
-            for (int sy = src_top + 1; sy < src_bottom; ++sy) {
-                mixer.add(src_line[src_left], left_area);
+        src_line += src_stride;
 
-                for (int sx = src_left + 1; sx < src_right; ++sx) {
-                    mixer.add(src_line[sx], 32 * 32);
-                }
+        for (int sy = src_top + 1; sy < src_bottom; ++sy) {
+            mixer.add(*src_line, middle_area);
+            src_line += src_stride;
+        }
 
-                mixer.add(src_line[src_right], right_area);
+        mixer.add(*src_line, bottom_area);
+    } else {
+        // dst pixel maps to a block of src pixels
+        unsigned const top_area = top_fraction << 5;
+        unsigned const bottom_area = bottom_fraction << 5;
+        unsigned const left_area = left_fraction << 5;
+        unsigned const right_area = right_fraction << 5;
+        unsigned const topleft_area = top_fraction * left_fraction;
+        unsigned const topright_area = top_fraction * right_fraction;
+        unsigned const bottomleft_area = bottom_fraction * left_fraction;
+        unsigned const bottomright_area = bottom_fraction * right_fraction;
+
+        // process the top-left corner
+        mixer.add(src_line[src_left], topleft_area);
+
+        // process the top line (without corners)
+        for (int sx = src_left + 1; sx < src_right; ++sx) {
+            mixer.add(src_line[sx], top_area);
+        }
 
-                src_line += src_stride;
-            }
+        // process the top-right corner
+        mixer.add(src_line[src_right], topright_area);
 
-            // process bottom-left corner
-            mixer.add(src_line[src_left], bottomleft_area);
+        src_line += src_stride;
+
+        // process middle lines
+        for (int sy = src_top + 1; sy < src_bottom; ++sy) {
+            mixer.add(src_line[src_left], left_area);
 
-            // process the bottom line (without corners)
             for (int sx = src_left + 1; sx < src_right; ++sx) {
-                mixer.add(src_line[sx], bottom_area);
+                mixer.add(src_line[sx], 32 * 32);
             }
 
-            // process the bottom-right corner
-            mixer.add(src_line[src_right], bottomright_area);
+            mixer.add(src_line[src_right], right_area);
+
+            src_line += src_stride;
         }
 
-        *p_dst = mixer.mix(src_area + background_area);
-        p_dst += dst_stride;
+        // process bottom-left corner
+        mixer.add(src_line[src_left], bottomleft_area);
+
+        // process the bottom line (without corners)
+        for (int sx = src_left + 1; sx < src_right; ++sx) {
+            mixer.add(src_line[sx], bottom_area);
+        }
+
+        // process the bottom-right corner
+        mixer.add(src_line[src_right], bottomright_area);
     }
+
+    return mixer.mix(src_area + background_area);
 }
 
+/**
+ * \brief The mapping of a vertical grid line to the source image.
+ *
+ * Grid point y of the line is at origin + vec * homog(model_y(y)).
+ */
+struct GridColumn
+{
+    Vec2f origin;
+    Vec2f vec;
+    HomographicTransform<1, float> homog;
+
+    explicit GridColumn(CylindricalSurfaceDewarper::Generatrix const& generatrix)
+        :   origin(generatrix.imgLine.p1()),
+            vec(generatrix.imgLine.p2() - generatrix.imgLine.p1()),
+            homog(generatrix.pln2img.mat()) {}
+};
+
 template<typename ColorMixer, typename PixelType>
 void dewarpGeneric(
     PixelType const* const src_data, QSize const src_size,
@@ -428,8 +436,6 @@ void dewarpGeneric(
     CylindricalSurfaceDewarper const& distortion_model,
     QRectF const& model_domain, PixelType const bg_color)
 {
-    int const src_width = src_size.width();
-    int const src_height = src_size.height();
     int const dst_width = dst_size.width();
     int const dst_height = dst_size.height();
 
@@ -441,32 +447,59 @@ void dewarpGeneric(
     float const model_domain_top = model_domain.top();
     float const model_y_scale = 1.0 / (model_domain.bottom() - model_domain.top());
 
-    std::vector<Vec2f> prev_grid_column(dst_height + 1);
-    std::vector<Vec2f> next_grid_column(dst_height + 1);
-
+    // Mapping a generatrix is expensive, and State makes it cheaper
+    // when done left to right, so we do that sequentially, once per
+    // grid column.  There is one more grid column than destination pixels.
+    std::vector<GridColumn> columns;
+    columns.reserve(dst_width + 1);
     for (int dst_x = 0; dst_x <= dst_width; ++dst_x) {
         double const model_x = (dst_x - model_domain_left) * model_x_scale;
-        CylindricalSurfaceDewarper::Generatrix const generatrix(
-            distortion_model.mapGeneratrix(model_x, state)
-        );
+        columns.push_back(GridColumn(distortion_model.mapGeneratrix(model_x, state)));
+    }
 
-        HomographicTransform<1, float> const homog(generatrix.pln2img.mat());
-        Vec2f const origin(generatrix.imgLine.p1());
-        Vec2f const vec(generatrix.imgLine.p2() - generatrix.imgLine.p1());
-        for (int dst_y = 0; dst_y <= dst_height; ++dst_y) {
+    // The destination is rendered tile by tile, row by row within a tile,
+    // so that both the destination and the source are accessed mostly
+    // sequentially.  A tile's grid points are computed exactly as
+    // they would be when going column by column, so the result doesn't
+    // depend on the tile layout or the number of threads.
+    int const tile_w = 256;
+    int const tile_h = 32;
+    int const tiles_hor = (dst_width + tile_w - 1) / tile_w;
+    int const tiles_ver = (dst_height + tile_h - 1) / tile_h;
+    int const num_tiles = tiles_hor * tiles_ver;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < num_tiles; ++tile) {
+        int const tile_left = (tile % tiles_hor) * tile_w;
+        int const tile_top = (tile / tiles_hor) * tile_h;
+        int const tile_right = std::min(dst_width, tile_left + tile_w);
+        int const tile_bottom = std::min(dst_height, tile_top + tile_h);
+        int const grid_w = tile_right - tile_left + 1;
+
+        // Grid points of the top and the bottom edges of the current row.
+        std::vector<Vec2f> top_points(grid_w);
+        std::vector<Vec2f> bottom_points(grid_w);
+
+        for (int dst_y = tile_top; dst_y <= tile_bottom; ++dst_y) {
             float const model_y = (float(dst_y) - model_domain_top) * model_y_scale;
-            next_grid_column[dst_y] = origin + vec * homog(model_y);
-        }
+            for (int i = 0; i < grid_w; ++i) {
+                GridColumn const& column = columns[tile_left + i];
+                bottom_points[i] = column.origin + column.vec * column.homog(model_y);
+            }
 
-        if (dst_x != 0) {
-            areaMapGeneratrix<ColorMixer, PixelType>(
-                src_data, src_size, src_stride,
-                dst_data + dst_x - 1, dst_size, dst_stride,
-                bg_color, prev_grid_column, next_grid_column
-            );
-        }
+            if (dst_y != tile_top) {
+                PixelType* const dst_line = dst_data + (dst_y - 1) * dst_stride;
+                for (int i = 0; i < grid_w - 1; ++i) {
+                    dst_line[tile_left + i] = areaMapPixel<ColorMixer, PixelType>(
+                                                  src_data, src_size, src_stride, bg_color,
+                                                  top_points[i], top_points[i + 1],
+                                                  bottom_points[i + 1], bottom_points[i]
+                                              );
+                }
+            }
 
-        prev_grid_column.swap(next_grid_column);
+            top_points.swap(bottom_points);
+        }
     }
 }
 
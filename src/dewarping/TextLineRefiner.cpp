@@ -144,6 +144,8 @@ TextLineRefiner::refine(
         dbg->add(visualizeSnakes(snakes), "initial_snakes");
     }
 
+    int const num_snakes = snakes.size();
+
     Grid<float> gradient(m_image.width(), m_image.height(), /*padding=*/0);
 
     // Start with a rather strong blur.
@@ -151,8 +153,10 @@ TextLineRefiner::refine(
     float v_sigma = (4.0f / 200.f) * m_dpi.vertical();
     calcBlurredGradient(gradient, h_sigma, v_sigma);
 
-    for (Snake& snake : snakes) {
-        evolveSnake(snake, gradient, ON_CONVERGENCE_STOP);
+    // Snakes evolve independently of each other, reading the gradient only.
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_snakes; ++i) {
+        evolveSnake(snakes[i], gradient, ON_CONVERGENCE_STOP);
     }
     if (dbg) {
         dbg->add(visualizeSnakes(snakes, &gradient), "evolved_snakes1");
@@ -163,8 +167,9 @@ TextLineRefiner::refine(
     v_sigma *= 0.5f;
     calcBlurredGradient(gradient, h_sigma, v_sigma);
 
-    for (Snake& snake : snakes) {
-        evolveSnake(snake, gradient, ON_CONVERGENCE_GO_FINER);
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_snakes; ++i) {
+        evolveSnake(snakes[i], gradient, ON_CONVERGENCE_GO_FINER);
     }
     if (dbg) {
         dbg->add(visualizeSnakes(snakes, &gradient), "evolved_snakes2");
@@ -21,6 +21,7 @@
 #include "ImageLoader.h"
 #include "ImageSplitOps.h"
 #include "TiffWriter.h"
+#include "MultipageTiffSink.h"
 #include "settings/globalstaticsettings.h"
 #ifdef _OPENMP
 #include <omp.h>
@@ -168,32 +169,33 @@ ExportThread::run()
 
             }
 
-            int page_no = 0;
+            // All the images of a page go to a single file in multipage mode.
+            // It's kept open until they are all written, rather than being
+            // reopened for appending every image.
+            std::unique_ptr<MultipageTiffSink> multipage_sink(
+                m_settings.export_to_multipage ? new MultipageTiffSink(out_file_path_no_split) : nullptr
+            );
+            auto writeImage = [&](QString const& single_page_path, QImage const& image) {
+                if (multipage_sink) {
+                    multipage_sink->addPage(image);
+                } else {
+                    TiffWriter::writeImage(single_page_path, image);
+                }
+            };
 
             if (m_settings.mode.testFlag(ExportMode::WholeImage)) {
-                TiffWriter::writeImage(out_file_path_no_split,
-                                       m_settings.page_gen_tweaks.testFlag(PageGenTweak::IgnoreOutputProcessingStage) ? m_orig_fore_subscan : out_img,
-                                       m_settings.export_to_multipage, page_no);
-                if (m_settings.export_to_multipage) {
-                    page_no++;
-                }
+                writeImage(out_file_path_no_split,
+                           m_settings.page_gen_tweaks.testFlag(PageGenTweak::IgnoreOutputProcessingStage) ? m_orig_fore_subscan : out_img);
             }
 
             if (img_foreground) {
                 QString out_filepath_foreground = text_dir + QDir::separator() + name + ".tif";
-                TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_foreground,
-                                       *img_foreground,
-                                       m_settings.export_to_multipage,
-                                       page_no++
-                                       );
+                writeImage(out_filepath_foreground, *img_foreground);
             }
             if (img_background && (!only_bw || m_settings.generate_blank_back_subscans)) {
                 QString out_filepath_background = m_settings.use_sep_suffix_for_pics ? ".sep.tif" : ".tif";
                 out_filepath_background = pic_dir + QDir::separator() + name + out_filepath_background;
-                TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_background,
-                                       *img_background,
-                                       m_settings.export_to_multipage,
-                                       page_no++);
+                writeImage(out_filepath_background, *img_background);
             }
 
             if (m_settings.mode.testFlag(ExportMode::AutoMask)) {
@@ -202,21 +204,16 @@ ExportThread::run()
                 QImage automask_img = (QFile::exists(filepath_automask)) ? ImageLoader::load(filepath_automask) :
                                                                            ImageSplitOps::GenerateBlankImage(out_img, out_img.format(), 0x00000000);
                 QString out_filepath_mask = mask_dir + QDir::separator() + name + ".auto.tif";
-                TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_mask,
-                                       automask_img,
-                                       m_settings.export_to_multipage,
-                                       page_no);
-                if (m_settings.export_to_multipage) {
-                    page_no++;
-                }
+                writeImage(out_filepath_mask, automask_img);
             }
 
             if (img_mask) {
                 QString out_filepath_mask = mask_dir + QDir::separator() + name + ".tif";
-                TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_mask,
-                                       *img_mask,
-                                       m_settings.export_to_multipage,
-                                       page_no++);
+                writeImage(out_filepath_mask, *img_mask);
+            }
+
+            if (multipage_sink) {
+                multipage_sink->close();
             }
 
             emit imageProcessed();
@@ -0,0 +1,347 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StageProfiler.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QThreadStorage>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#endif
+
+namespace
+{
+
+struct ThreadContext
+{
+    QString page;
+    ScopedStageTimer* innermostTimer;
+
+    ThreadContext() : innermostTimer(0) {}
+};
+
+ThreadContext& threadContext()
+{
+    static QThreadStorage<ThreadContext> storage;
+    return storage.localData();
+}
+
+#ifdef _WIN32
+double fileTimeToMs(FILETIME const& ft)
+{
+    ULARGE_INTEGER value;
+    value.LowPart = ft.dwLowDateTime;
+    value.HighPart = ft.dwHighDateTime;
+
+    // FILETIME is in 100 nanosecond units.
+    return value.QuadPart * 1e-4;
+}
+#else
+double timevalToMs(timeval const& tv)
+{
+    return tv.tv_sec * 1e3 + tv.tv_usec * 1e-3;
+}
+#endif
+
+QJsonObject stageToJson(
+    QString const& stage, int const calls, double const wall_ms, double const self_wall_ms,
+    double const cpu_ms, double const self_cpu_ms)
+{
+    QJsonObject obj;
+    obj["stage"] = stage;
+    obj["calls"] = calls;
+    obj["wall_ms"] = wall_ms;
+    obj["self_wall_ms"] = self_wall_ms;
+    obj["cpu_ms"] = cpu_ms;
+    obj["self_cpu_ms"] = self_cpu_ms;
+    return obj;
+}
+
+} // anonymous namespace
+
+StageProfiler::StageRecord::StageRecord(QString const& stage_name)
+    :   stage(stage_name),
+        calls(0),
+        wallMs(0.0),
+        selfWallMs(0.0),
+        cpuMs(0.0),
+        selfCpuMs(0.0)
+{
+}
+
+StageProfiler::StageProfiler()
+    :   m_enabled(0),
+        m_cpuMsWhenEnabled(0.0)
+{
+}
+
+StageProfiler&
+StageProfiler::instance()
+{
+    static StageProfiler object;
+
+    return object;
+}
+
+void
+StageProfiler::setEnabled(bool const enabled)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    if (enabled && !isEnabled()) {
+        m_pages.clear();
+        m_pageIndexes.clear();
+        m_sinceEnabled.start();
+        m_cpuMsWhenEnabled = processCpuTimeMs();
+    }
+
+    m_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+void
+StageProfiler::setCurrentPage(QString const& page)
+{
+    threadContext().page = page;
+}
+
+QString
+StageProfiler::currentPage()
+{
+    return threadContext().page;
+}
+
+void
+StageProfiler::record(
+    QString const& page, char const* stage,
+    double const wall_ms, double const self_wall_ms,
+    double const cpu_ms, double const self_cpu_ms)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    std::map<QString, size_t>::iterator page_it(m_pageIndexes.find(page));
+    if (page_it == m_pageIndexes.end()) {
+        page_it = m_pageIndexes.insert(std::make_pair(page, m_pages.size())).first;
+        m_pages.push_back(PageRecord(page));
+    }
+    std::vector<StageRecord>& stages = m_pages[page_it->second].stages;
+
+    QString const stage_name(QString::fromLatin1(stage));
+    std::vector<StageRecord>::iterator stage_it(stages.begin());
+    while (stage_it != stages.end() && stage_it->stage != stage_name) {
+        ++stage_it;
+    }
+    if (stage_it == stages.end()) {
+        stages.push_back(StageRecord(stage_name));
+        stage_it = stages.end() - 1;
+    }
+
+    ++stage_it->calls;
+    stage_it->wallMs += wall_ms;
+    stage_it->selfWallMs += self_wall_ms;
+    stage_it->cpuMs += cpu_ms;
+    stage_it->selfCpuMs += self_cpu_ms;
+}
+
+bool
+StageProfiler::writeReport(QString const& file_path) const
+{
+    QJsonObject report;
+    report["format_version"] = 1;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        report["wall_ms"] = m_sinceEnabled.isValid() ? m_sinceEnabled.nsecsElapsed() * 1e-6 : 0.0;
+        report["process_cpu_ms"] = processCpuTimeMs() - m_cpuMsWhenEnabled;
+
+        // Only the process as a whole, as pages are processed concurrently,
+        // and the peak is never reset.
+        report["peak_rss_kb"] = double(peakRssKb());
+
+        // Totals per stage, in the order of the first appearance.
+        std::vector<StageRecord> total_stages;
+
+        QJsonArray pages;
+        for (PageRecord const& page : m_pages) {
+            double page_wall_ms = 0.0;
+            double page_cpu_ms = 0.0;
+            QJsonArray stages;
+
+            for (StageRecord const& rec : page.stages) {
+                // The self times of all stages add up to the time spent in the outermost ones.
+                page_wall_ms += rec.selfWallMs;
+                page_cpu_ms += rec.selfCpuMs;
+
+                stages.append(stageToJson(
+                                  rec.stage, rec.calls, rec.wallMs, rec.selfWallMs, rec.cpuMs, rec.selfCpuMs
+                              ));
+
+                std::vector<StageRecord>::iterator it(total_stages.begin());
+                while (it != total_stages.end() && it->stage != rec.stage) {
+                    ++it;
+                }
+                if (it == total_stages.end()) {
+                    total_stages.push_back(StageRecord(rec.stage));
+                    it = total_stages.end() - 1;
+                }
+                it->calls += rec.calls;
+                it->wallMs += rec.wallMs;
+                it->selfWallMs += rec.selfWallMs;
+                it->cpuMs += rec.cpuMs;
+                it->selfCpuMs += rec.selfCpuMs;
+            }
+
+            QJsonObject page_obj;
+            page_obj["page"] = page.page;
+            page_obj["wall_ms"] = page_wall_ms;
+            page_obj["cpu_ms"] = page_cpu_ms;
+            page_obj["stages"] = stages;
+            pages.append(page_obj);
+        }
+
+        QJsonArray stage_totals;
+        for (StageRecord const& rec : total_stages) {
+            stage_totals.append(stageToJson(
+                                    rec.stage, rec.calls, rec.wallMs, rec.selfWallMs, rec.cpuMs, rec.selfCpuMs
+                                ));
+        }
+
+        report["stages"] = stage_totals;
+        report["pages"] = pages;
+    }
+
+    QFile file(file_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QByteArray const json(QJsonDocument(report).toJson());
+    return file.write(json) == json.size();
+}
+
+double
+StageProfiler::threadCpuTimeMs()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+    return fileTimeToMs(kernel) + fileTimeToMs(user);
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0.0;
+    }
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+#else
+    return 0.0;
+#endif
+}
+
+double
+StageProfiler::processCpuTimeMs()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+    return fileTimeToMs(kernel) + fileTimeToMs(user);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    return timevalToMs(usage.ru_utime) + timevalToMs(usage.ru_stime);
+#endif
+}
+
+qint64
+StageProfiler::peakRssKb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return qint64(counters.PeakWorkingSetSize) >> 10;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // Reported in bytes rather than kilobytes.
+    return qint64(usage.ru_maxrss) >> 10;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+ScopedStageTimer::ScopedStageTimer(char const* stage)
+    :   m_stage(stage),
+        m_pParent(0),
+        m_startCpuMs(0.0),
+        m_nestedWallMs(0.0),
+        m_nestedCpuMs(0.0),
+        m_active(StageProfiler::instance().isEnabled())
+{
+    if (!m_active) {
+        return;
+    }
+
+    ThreadContext& ctx = threadContext();
+    m_pParent = ctx.innermostTimer;
+    ctx.innermostTimer = this;
+
+    m_startCpuMs = StageProfiler::threadCpuTimeMs();
+    m_wallTimer.start();
+}
+
+ScopedStageTimer::~ScopedStageTimer()
+{
+    if (!m_active) {
+        return;
+    }
+
+    double const wall_ms = m_wallTimer.nsecsElapsed() * 1e-6;
+    double const cpu_ms = StageProfiler::threadCpuTimeMs() - m_startCpuMs;
+
+    ThreadContext& ctx = threadContext();
+    ctx.innermostTimer = m_pParent;
+    if (m_pParent) {
+        m_pParent->m_nestedWallMs += wall_ms;
+        m_pParent->m_nestedCpuMs += cpu_ms;
+    }
+
+    StageProfiler::instance().record(
+        ctx.page, m_stage, wall_ms, wall_ms - m_nestedWallMs,
+        cpu_ms, cpu_ms - m_nestedCpuMs
+    );
+}
@@ -0,0 +1,149 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STAGEPROFILER_H_
+#define STAGEPROFILER_H_
+
+#include "NonCopyable.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <map>
+#include <vector>
+
+/**
+ * \brief Collects the time spent in processing stages, per page.
+ *
+ * Stages are timed with ScopedStageTimer and attributed to the page
+ * set with setCurrentPage() on the same thread.  Stages may nest:
+ * besides the total time of a stage, the "self" time excluding the
+ * nested stages is recorded.  CPU time is that of the calling thread,
+ * so work done by OpenMP threads a stage spawns isn't counted.
+ *
+ * Profiling is disabled by default, in which case a ScopedStageTimer
+ * costs a single atomic load.
+ *
+ * \note All methods may be called from any thread, even concurrently.
+ */
+class StageProfiler
+{
+    DECLARE_NON_COPYABLE(StageProfiler)
+public:
+    static StageProfiler& instance();
+
+    bool isEnabled() const
+    {
+        return m_enabled.loadAcquire() != 0;
+    }
+
+    /**
+     * \brief Enables or disables profiling.
+     *
+     * Enabling it discards the data collected so far.
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * \brief Sets the page the stages timed on the calling thread
+     *        are attributed to.
+     */
+    static void setCurrentPage(QString const& page);
+
+    static QString currentPage();
+
+    void record(QString const& page, char const* stage,
+                double wall_ms, double self_wall_ms,
+                double cpu_ms, double self_cpu_ms);
+
+    /**
+     * \brief Writes the collected data as JSON.
+     *
+     * \return true on success.
+     */
+    bool writeReport(QString const& file_path) const;
+
+    /** \brief CPU time consumed by the calling thread. */
+    static double threadCpuTimeMs();
+
+    /** \brief CPU time consumed by the process, all threads included. */
+    static double processCpuTimeMs();
+
+    /** \brief The peak resident set size of the process, in kilobytes. */
+    static qint64 peakRssKb();
+private:
+    struct StageRecord
+    {
+        QString stage;
+        int calls;
+        double wallMs;
+        double selfWallMs;
+        double cpuMs;
+        double selfCpuMs;
+
+        explicit StageRecord(QString const& stage_name);
+    };
+
+    struct PageRecord
+    {
+        QString page;
+
+        /** In the order of the first call. */
+        std::vector<StageRecord> stages;
+
+        explicit PageRecord(QString const& page_name) : page(page_name) {}
+    };
+
+    StageProfiler();
+
+    QAtomicInt m_enabled;
+    mutable QMutex m_mutex;
+    QElapsedTimer m_sinceEnabled;
+    double m_cpuMsWhenEnabled;
+
+    /** In the order of the first record. */
+    std::vector<PageRecord> m_pages;
+    std::map<QString, size_t> m_pageIndexes;
+};
+
+/**
+ * \brief Times the scope it's declared in as a stage of StageProfiler.
+ *
+ * \code
+ * ScopedStageTimer const timer("output.binarize");
+ * \endcode
+ * The stage name must be a string literal or otherwise outlive the timer.
+ */
+class ScopedStageTimer
+{
+    DECLARE_NON_COPYABLE(ScopedStageTimer)
+public:
+    explicit ScopedStageTimer(char const* stage);
+
+    ~ScopedStageTimer();
+private:
+    char const* m_stage;
+    ScopedStageTimer* m_pParent;
+    QElapsedTimer m_wallTimer;
+    double m_startCpuMs;
+    double m_nestedWallMs;
+    double m_nestedCpuMs;
+    bool m_active;
+};
+
+#endif
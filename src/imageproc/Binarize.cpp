@@ -21,6 +21,8 @@
 #include "BinaryThreshold.h"
 #include "Grayscale.h"
 #include "IntegralImage.h"
+#include "BinarizeKernels.h"
+#include "CpuFeatures.h"
 #include <QImage>
 #include <QRect>
 #include <QDebug>
@@ -52,6 +54,105 @@ BinaryImage binarizeMokji(
     return BinaryImage(src, threshold);
 }
 
+namespace
+{
+
+/**
+ * Window statistics for one row of pixels, as consumed by the kernels.
+ */
+class WindowStatsRow
+{
+public:
+    explicit WindowStatsRow(int width)
+        :   m_sums(width), m_sqsums(width), m_areas(width) {}
+
+    /**
+     * Computes the statistics of windows with the given vertical extent
+     * and horizontal extents of [x - left_half, x + right_half), clipped
+     * to image boundaries.
+     */
+    void compute(
+        IntegralImage<uint32_t> const& integral_image,
+        IntegralImage<uint64_t> const& integral_sqimage,
+        int top, int bottom, int left_half, int right_half);
+
+    detail::binarize::WindowStats stats() const
+    {
+        detail::binarize::WindowStats const stats = {
+            &m_sums[0], &m_sqsums[0], &m_areas[0]
+        };
+        return stats;
+    }
+private:
+    std::vector<double> m_sums;
+    std::vector<double> m_sqsums;
+    std::vector<double> m_areas;
+};
+
+void
+WindowStatsRow::compute(
+    IntegralImage<uint32_t> const& integral_image,
+    IntegralImage<uint64_t> const& integral_sqimage,
+    int const top, int const bottom, int const left_half, int const right_half)
+{
+    int const w = static_cast<int>(m_sums.size());
+    int const height = bottom - top;
+
+    uint32_t const* const sum_top = integral_image.partialSumsRow(top);
+    uint32_t const* const sum_bottom = integral_image.partialSumsRow(bottom);
+    uint64_t const* const sqsum_top = integral_sqimage.partialSumsRow(top);
+    uint64_t const* const sqsum_bottom = integral_sqimage.partialSumsRow(bottom);
+
+    for (int x = 0; x < w; ++x) {
+        int const left = std::max(0, x - left_half);
+        int const right = std::min(w, x + right_half); // exclusive
+        int const area = height * (right - left);
+        assert(area > 0); // because window_size > 0 and w > 0 and h > 0
+
+        // Same as IntegralImage::sum(), including the order of operations,
+        // which matters for uint32_t sums that have wrapped around.
+        uint32_t sum = sum_bottom[right];
+        sum -= sum_top[right];
+        sum += sum_top[left];
+        sum -= sum_bottom[left];
+
+        uint64_t sqsum = sqsum_bottom[right];
+        sqsum -= sqsum_top[right];
+        sqsum += sqsum_top[left];
+        sqsum -= sqsum_bottom[left];
+
+        m_sums[x] = sum;
+        m_sqsums[x] = static_cast<double>(sqsum);
+        m_areas[x] = area;
+    }
+}
+
+/**
+ * Packs a row of black[x] flags into a row of a BinaryImage.
+ */
+void packRow(uint8_t const* black, uint32_t* bw_line, int const width)
+{
+    int const full_words = width >> 5;
+    for (int i = 0; i < full_words; ++i, black += 32) {
+        uint32_t word = 0;
+        for (int bit = 0; bit < 32; ++bit) {
+            word = (word << 1) | black[bit];
+        }
+        bw_line[i] = word;
+    }
+
+    int const remaining = width & 31;
+    if (remaining) {
+        uint32_t word = 0;
+        for (int bit = 0; bit < remaining; ++bit) {
+            word = (word << 1) | black[bit];
+        }
+        bw_line[full_words] = word << (32 - remaining);
+    }
+}
+
+} // anonymous namespace
+
 BinaryImage binarizeSauvola(QImage const& src, QSize const window_size)
 {
     if (window_size.isEmpty()) {
@@ -87,6 +188,11 @@ BinaryImage binarizeSauvola(QImage const& src, QSize const window_size)
     int const window_left_half = window_size.width() >> 1;
     int const window_right_half = window_size.width() - window_left_half;
 
+    detail::binarize::Kernels const& kernels =
+        detail::binarize::kernels(CpuFeatures::simdLevel());
+    WindowStatsRow stats_row(w);
+    std::vector<uint8_t> black(w);
+
     BinaryImage bw_img(w, h);
     uint32_t* bw_line = bw_img.data();
     int const bw_wpl = bw_img.wordsPerLine();
@@ -96,36 +202,12 @@ BinaryImage binarizeSauvola(QImage const& src, QSize const window_size)
         int const top = std::max(0, y - window_lower_half);
         int const bottom = std::min(h, y + window_upper_half); // exclusive
 
-        for (int x = 0; x < w; ++x) {
-            int const left = std::max(0, x - window_left_half);
-            int const right = std::min(w, x + window_right_half); // exclusive
-            int const area = (bottom - top) * (right - left);
-            assert(area > 0); // because window_size > 0 and w > 0 and h > 0
-
-            QRect const rect(left, top, right - left, bottom - top);
-            long double const window_sum = integral_image.sum(rect);
-            long double const window_sqsum = integral_sqimage.sum(rect);
-
-            long double const r_area = 1.0 / area;
-            long double const mean = window_sum * r_area;
-            long double const sqmean = window_sqsum * r_area;
-
-            long double const variance = sqmean - mean * mean;
-            long double const deviation = sqrt(fabs(variance));
-
-            long double const k = 0.34;
-            long double const threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
-
-            uint32_t const msb = uint32_t(1) << 31;
-            uint32_t const mask = msb >> (x & 31);
-            if (int(gray_line[x]) < threshold) {
-                // black
-                bw_line[x >> 5] |= mask;
-            } else {
-                // white
-                bw_line[x >> 5] &= ~mask;
-            }
-        }
+        stats_row.compute(
+            integral_image, integral_sqimage,
+            top, bottom, window_left_half, window_right_half
+        );
+        kernels.sauvolaRow(stats_row.stats(), gray_line, &black[0], w, 0.34);
+        packRow(&black[0], bw_line, w);
 
         gray_line += gray_bpl;
         bw_line += bw_wpl;
@@ -174,64 +256,50 @@ BinaryImage binarizeWolf(
     int const window_left_half = window_size.width() >> 1;
     int const window_right_half = window_size.width() - window_left_half;
 
+    detail::binarize::Kernels const& kernels =
+        detail::binarize::kernels(CpuFeatures::simdLevel());
+    WindowStatsRow stats_row(w);
+
     std::vector<float> means(w * h, 0);
     std::vector<float> deviations(w * h, 0);
 
-    long double max_deviation = 0;
+    double max_deviation = 0;
 
     for (int y = 0; y < h; ++y) {
         int const top = std::max(0, y - window_lower_half);
         int const bottom = std::min(h, y + window_upper_half); // exclusive
 
-        for (int x = 0; x < w; ++x) {
-            int const left = std::max(0, x - window_left_half);
-            int const right = std::min(w, x + window_right_half); // exclusive
-            int const area = (bottom - top) * (right - left);
-            assert(area > 0); // because window_size > 0 and w > 0 and h > 0
-
-            QRect const rect(left, top, right - left, bottom - top);
-            long double const window_sum = integral_image.sum(rect);
-            long double const window_sqsum = integral_sqimage.sum(rect);
-
-            long double const r_area = 1.0 / area;
-            long double const mean = window_sum * r_area;
-            long double const sqmean = window_sqsum * r_area;
-
-            long double const variance = sqmean - mean * mean;
-            long double const deviation = sqrt(fabs(variance));
-            max_deviation = std::max(max_deviation, deviation);
-            means[w * y + x] = mean;
-            deviations[w * y + x] = deviation;
-        }
+        stats_row.compute(
+            integral_image, integral_sqimage,
+            top, bottom, window_left_half, window_right_half
+        );
+        double const row_max_deviation = kernels.meanDeviationRow(
+            stats_row.stats(), &means[w * y], &deviations[w * y], w
+        );
+        max_deviation = std::max(max_deviation, row_max_deviation);
     }
 
     // TODO: integral images can be disposed at this point.
 
+    detail::binarize::WolfParams params;
+    params.k = 0.3;
+    params.maxDeviation = max_deviation;
+    params.minGrayLevel = min_gray_level;
+    params.lowerBound = lower_bound;
+    params.upperBound = upper_bound;
+
+    std::vector<uint8_t> black(w);
+
     BinaryImage bw_img(w, h);
     uint32_t* bw_line = bw_img.data();
     int const bw_wpl = bw_img.wordsPerLine();
 
     gray_line = gray.bits();
     for (int y = 0; y < h; ++y, gray_line += gray_bpl, bw_line += bw_wpl) {
-        for (int x = 0; x < w; ++x) {
-            float const mean = means[y * w + x];
-            float const deviation = deviations[y * w + x];
-            long double const k = 0.3;
-            long double const a = 1.0 - deviation / max_deviation;
-            long double const threshold = mean - k * a * (mean - min_gray_level);
-
-            uint32_t const msb = uint32_t(1) << 31;
-            uint32_t const mask = msb >> (x & 31);
-            if (gray_line[x] < lower_bound ||
-                    (gray_line[x] <= upper_bound &&
-                     int(gray_line[x]) < threshold)) {
-                // black
-                bw_line[x >> 5] |= mask;
-            } else {
-                // white
-                bw_line[x >> 5] &= ~mask;
-            }
-        }
+        kernels.wolfRow(
+            &means[w * y], &deviations[w * y], gray_line, &black[0], w, params
+        );
+        packRow(&black[0], bw_line, w);
     }
 
     return bw_img;
@@ -0,0 +1,88 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BinarizeKernels.h"
+
+namespace imageproc
+{
+
+namespace detail
+{
+
+namespace binarize
+{
+
+namespace
+{
+
+void sauvolaRowScalar(
+    WindowStats const& stats, uint8_t const* gray,
+    uint8_t* black, int const count, double const k)
+{
+    sauvolaRange(stats, gray, black, 0, count, k);
+}
+
+double meanDeviationRowScalar(
+    WindowStats const& stats, float* means,
+    float* deviations, int const count)
+{
+    return meanDeviationRange(stats, means, deviations, 0, count);
+}
+
+void wolfRowScalar(
+    float const* means, float const* deviations,
+    uint8_t const* gray, uint8_t* black, int const count,
+    WolfParams const& params)
+{
+    wolfRange(means, deviations, gray, black, 0, count, params);
+}
+
+Kernels const scalarKernels = {
+    &sauvolaRowScalar,
+    &meanDeviationRowScalar,
+    &wolfRowScalar
+};
+
+} // anonymous namespace
+
+Kernels const&
+kernels(CpuFeatures::SimdLevel const level)
+{
+    switch (level) {
+    case CpuFeatures::SIMD_AVX2:
+#ifdef IMAGEPROC_HAVE_AVX2_KERNELS
+        return avx2Kernels;
+#endif
+    // fall through
+    case CpuFeatures::SIMD_SSE2:
+#ifdef IMAGEPROC_HAVE_SSE2_KERNELS
+        return sse2Kernels;
+#endif
+    // fall through
+    case CpuFeatures::SIMD_NONE:
+        break;
+    }
+
+    return scalarKernels;
+}
+
+} // namespace binarize
+
+} // namespace detail
+
+} // namespace imageproc
@@ -0,0 +1,160 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_BINARIZEKERNELS_H_
+#define IMAGEPROC_BINARIZEKERNELS_H_
+
+#include "CpuFeatures.h"
+#include <math.h>
+#include <stdint.h>
+
+namespace imageproc
+{
+
+namespace detail
+{
+
+namespace binarize
+{
+
+/**
+ * \brief Statistics of pixel windows centered at consecutive pixels of a row.
+ *
+ * sums[i] and sqsums[i] are the sum of gray levels and the sum of their
+ * squares in the i-th window, while areas[i] is the number of pixels in it.
+ * All of these are integers, represented exactly as doubles.
+ */
+struct WindowStats
+{
+    double const* sums;
+    double const* sqsums;
+    double const* areas;
+};
+
+struct WolfParams
+{
+    double k;
+    double maxDeviation;
+    double minGrayLevel;
+    int lowerBound;
+    int upperBound;
+};
+
+/**
+ * \brief Row kernels for Sauvola's and Wolf's binarization.
+ *
+ * Each one processes \p count pixels and sets black[i] to 1 for pixels
+ * that become black and to 0 for those that become white.  Vectorized
+ * implementations perform exactly the same IEEE double operations,
+ * in the same order, as the scalar ones below, so the results are
+ * bit-exact across all of them.
+ */
+struct Kernels
+{
+    void (*sauvolaRow)(
+        WindowStats const& stats, uint8_t const* gray,
+        uint8_t* black, int count, double k);
+
+    /**
+     * Writes the mean and the standard deviation of every window,
+     * returning the maximum deviation (before rounding to float).
+     */
+    double (*meanDeviationRow)(
+        WindowStats const& stats, float* means,
+        float* deviations, int count);
+
+    void (*wolfRow)(
+        float const* means, float const* deviations,
+        uint8_t const* gray, uint8_t* black, int count,
+        WolfParams const& params);
+};
+
+Kernels const& kernels(CpuFeatures::SimdLevel level);
+
+/*
+ * The scalar implementations below are also used for the tails of rows
+ * by the vectorized kernels.  They are static, so that each translation
+ * unit gets its own copy, compiled with its own code generation flags.
+ * Otherwise the linker could pick a copy containing AVX2 instructions
+ * for use on CPUs not supporting them.
+ */
+
+static inline void sauvolaRange(
+    WindowStats const& stats, uint8_t const* gray,
+    uint8_t* black, int const begin, int const end, double const k)
+{
+    for (int x = begin; x < end; ++x) {
+        double const r_area = 1.0 / stats.areas[x];
+        double const mean = stats.sums[x] * r_area;
+        double const sqmean = stats.sqsums[x] * r_area;
+        double const variance = sqmean - mean * mean;
+        double const deviation = sqrt(fabs(variance));
+        double const threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
+        black[x] = double(gray[x]) < threshold ? 1 : 0;
+    }
+}
+
+static inline double meanDeviationRange(
+    WindowStats const& stats, float* means, float* deviations,
+    int const begin, int const end)
+{
+    double max_deviation = 0.0;
+    for (int x = begin; x < end; ++x) {
+        double const r_area = 1.0 / stats.areas[x];
+        double const mean = stats.sums[x] * r_area;
+        double const sqmean = stats.sqsums[x] * r_area;
+        double const variance = sqmean - mean * mean;
+        double const deviation = sqrt(fabs(variance));
+        max_deviation = deviation > max_deviation ? deviation : max_deviation;
+        means[x] = static_cast<float>(mean);
+        deviations[x] = static_cast<float>(deviation);
+    }
+    return max_deviation;
+}
+
+static inline void wolfRange(
+    float const* means, float const* deviations,
+    uint8_t const* gray, uint8_t* black,
+    int const begin, int const end, WolfParams const& params)
+{
+    for (int x = begin; x < end; ++x) {
+        double const mean = means[x];
+        double const deviation = deviations[x];
+        double const a = 1.0 - deviation / params.maxDeviation;
+        double const threshold = mean - params.k * a * (mean - params.minGrayLevel);
+        int const level = gray[x];
+        black[x] = (level < params.lowerBound ||
+                    (level <= params.upperBound && double(level) < threshold)) ? 1 : 0;
+    }
+}
+
+#ifdef IMAGEPROC_HAVE_SSE2_KERNELS
+extern Kernels const sse2Kernels;
+#endif
+
+#ifdef IMAGEPROC_HAVE_AVX2_KERNELS
+extern Kernels const avx2Kernels;
+#endif
+
+} // namespace binarize
+
+} // namespace detail
+
+} // namespace imageproc
+
+#endif
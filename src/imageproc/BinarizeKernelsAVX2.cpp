@@ -0,0 +1,169 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * \file
+ * Built only when IMAGEPROC_HAVE_AVX2_KERNELS is defined, with AVX2
+ * code generation enabled for this file alone.  FMA instructions must
+ * not be enabled here, as they would make the results differ from
+ * the scalar code.
+ */
+
+#include "BinarizeKernels.h"
+#include <immintrin.h>
+#include <string.h>
+
+namespace imageproc
+{
+
+namespace detail
+{
+
+namespace binarize
+{
+
+namespace
+{
+
+inline __m256d loadGray4(uint8_t const* gray)
+{
+    int32_t packed;
+    memcpy(&packed, gray, sizeof(packed));
+    return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+}
+
+inline void storeMask4(uint8_t* black, __m256d const mask)
+{
+    int const bits = _mm256_movemask_pd(mask);
+    black[0] = static_cast<uint8_t>(bits & 1);
+    black[1] = static_cast<uint8_t>((bits >> 1) & 1);
+    black[2] = static_cast<uint8_t>((bits >> 2) & 1);
+    black[3] = static_cast<uint8_t>((bits >> 3) & 1);
+}
+
+/** \see meanDeviation2() in BinarizeKernelsSSE2.cpp */
+inline void meanDeviation4(
+    WindowStats const& stats, int const x, __m256d& mean, __m256d& deviation)
+{
+    __m256d const sign_bit = _mm256_set1_pd(-0.0);
+    __m256d const r_area = _mm256_div_pd(
+        _mm256_set1_pd(1.0), _mm256_loadu_pd(stats.areas + x)
+    );
+    mean = _mm256_mul_pd(_mm256_loadu_pd(stats.sums + x), r_area);
+    __m256d const sqmean = _mm256_mul_pd(_mm256_loadu_pd(stats.sqsums + x), r_area);
+    __m256d const variance = _mm256_sub_pd(sqmean, _mm256_mul_pd(mean, mean));
+    deviation = _mm256_sqrt_pd(_mm256_andnot_pd(sign_bit, variance));
+}
+
+void sauvolaRowAVX2(
+    WindowStats const& stats, uint8_t const* gray,
+    uint8_t* black, int const count, double const k)
+{
+    __m256d const one = _mm256_set1_pd(1.0);
+    __m256d const vk = _mm256_set1_pd(k);
+    __m256d const v128 = _mm256_set1_pd(128.0);
+
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m256d mean, deviation;
+        meanDeviation4(stats, x, mean, deviation);
+
+        __m256d factor = _mm256_sub_pd(_mm256_div_pd(deviation, v128), one);
+        factor = _mm256_add_pd(one, _mm256_mul_pd(vk, factor));
+        __m256d const threshold = _mm256_mul_pd(mean, factor);
+
+        storeMask4(black + x, _mm256_cmp_pd(loadGray4(gray + x), threshold, _CMP_LT_OQ));
+    }
+
+    sauvolaRange(stats, gray, black, x, count, k);
+}
+
+double meanDeviationRowAVX2(
+    WindowStats const& stats, float* means,
+    float* deviations, int const count)
+{
+    __m256d max_deviation = _mm256_setzero_pd();
+
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m256d mean, deviation;
+        meanDeviation4(stats, x, mean, deviation);
+        max_deviation = _mm256_max_pd(max_deviation, deviation);
+
+        _mm_storeu_ps(means + x, _mm256_cvtpd_ps(mean));
+        _mm_storeu_ps(deviations + x, _mm256_cvtpd_ps(deviation));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, max_deviation);
+    double result = meanDeviationRange(stats, means, deviations, x, count);
+    for (int i = 0; i < 4; ++i) {
+        result = lanes[i] > result ? lanes[i] : result;
+    }
+    return result;
+}
+
+void wolfRowAVX2(
+    float const* means, float const* deviations,
+    uint8_t const* gray, uint8_t* black, int const count,
+    WolfParams const& params)
+{
+    __m256d const one = _mm256_set1_pd(1.0);
+    __m256d const vk = _mm256_set1_pd(params.k);
+    __m256d const max_deviation = _mm256_set1_pd(params.maxDeviation);
+    __m256d const min_gray_level = _mm256_set1_pd(params.minGrayLevel);
+    __m256d const lower_bound = _mm256_set1_pd(params.lowerBound);
+    __m256d const upper_bound = _mm256_set1_pd(params.upperBound);
+
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m256d const mean = _mm256_cvtps_pd(_mm_loadu_ps(means + x));
+        __m256d const deviation = _mm256_cvtps_pd(_mm_loadu_ps(deviations + x));
+
+        __m256d const a = _mm256_sub_pd(one, _mm256_div_pd(deviation, max_deviation));
+        __m256d const threshold = _mm256_sub_pd(
+            mean, _mm256_mul_pd(_mm256_mul_pd(vk, a), _mm256_sub_pd(mean, min_gray_level))
+        );
+
+        __m256d const level = loadGray4(gray + x);
+        __m256d const is_black = _mm256_or_pd(
+            _mm256_cmp_pd(level, lower_bound, _CMP_LT_OQ),
+            _mm256_and_pd(
+                _mm256_cmp_pd(level, upper_bound, _CMP_LE_OQ),
+                _mm256_cmp_pd(level, threshold, _CMP_LT_OQ)
+            )
+        );
+        storeMask4(black + x, is_black);
+    }
+
+    wolfRange(means, deviations, gray, black, x, count, params);
+}
+
+} // anonymous namespace
+
+Kernels const avx2Kernels = {
+    &sauvolaRowAVX2,
+    &meanDeviationRowAVX2,
+    &wolfRowAVX2
+};
+
+} // namespace binarize
+
+} // namespace detail
+
+} // namespace imageproc
@@ -0,0 +1,164 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * \file
+ * Built only when IMAGEPROC_HAVE_SSE2_KERNELS is defined, with SSE2
+ * code generation enabled for this file alone.
+ */
+
+#include "BinarizeKernels.h"
+#include <emmintrin.h>
+
+namespace imageproc
+{
+
+namespace detail
+{
+
+namespace binarize
+{
+
+namespace
+{
+
+inline __m128d loadGray2(uint8_t const* gray)
+{
+    return _mm_set_pd(gray[1], gray[0]);
+}
+
+inline __m128 loadFloat2(float const* p)
+{
+    return _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p)));
+}
+
+inline void storeMask2(uint8_t* black, __m128d const mask)
+{
+    int const bits = _mm_movemask_pd(mask);
+    black[0] = static_cast<uint8_t>(bits & 1);
+    black[1] = static_cast<uint8_t>((bits >> 1) & 1);
+}
+
+/**
+ * Computes the window mean and deviation exactly the same way
+ * the scalar code does it.
+ */
+inline void meanDeviation2(
+    WindowStats const& stats, int const x, __m128d& mean, __m128d& deviation)
+{
+    __m128d const sign_bit = _mm_set1_pd(-0.0);
+    __m128d const r_area = _mm_div_pd(_mm_set1_pd(1.0), _mm_loadu_pd(stats.areas + x));
+    mean = _mm_mul_pd(_mm_loadu_pd(stats.sums + x), r_area);
+    __m128d const sqmean = _mm_mul_pd(_mm_loadu_pd(stats.sqsums + x), r_area);
+    __m128d const variance = _mm_sub_pd(sqmean, _mm_mul_pd(mean, mean));
+    deviation = _mm_sqrt_pd(_mm_andnot_pd(sign_bit, variance));
+}
+
+void sauvolaRowSSE2(
+    WindowStats const& stats, uint8_t const* gray,
+    uint8_t* black, int const count, double const k)
+{
+    __m128d const one = _mm_set1_pd(1.0);
+    __m128d const vk = _mm_set1_pd(k);
+    __m128d const v128 = _mm_set1_pd(128.0);
+
+    int x = 0;
+    for (; x + 2 <= count; x += 2) {
+        __m128d mean, deviation;
+        meanDeviation2(stats, x, mean, deviation);
+
+        __m128d factor = _mm_sub_pd(_mm_div_pd(deviation, v128), one);
+        factor = _mm_add_pd(one, _mm_mul_pd(vk, factor));
+        __m128d const threshold = _mm_mul_pd(mean, factor);
+
+        storeMask2(black + x, _mm_cmplt_pd(loadGray2(gray + x), threshold));
+    }
+
+    sauvolaRange(stats, gray, black, x, count, k);
+}
+
+double meanDeviationRowSSE2(
+    WindowStats const& stats, float* means,
+    float* deviations, int const count)
+{
+    __m128d max_deviation = _mm_setzero_pd();
+
+    int x = 0;
+    for (; x + 2 <= count; x += 2) {
+        __m128d mean, deviation;
+        meanDeviation2(stats, x, mean, deviation);
+        max_deviation = _mm_max_pd(max_deviation, deviation);
+
+        _mm_storel_pi(reinterpret_cast<__m64*>(means + x), _mm_cvtpd_ps(mean));
+        _mm_storel_pi(reinterpret_cast<__m64*>(deviations + x), _mm_cvtpd_ps(deviation));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, max_deviation);
+    double const tail_max = meanDeviationRange(stats, means, deviations, x, count);
+
+    double result = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    return tail_max > result ? tail_max : result;
+}
+
+void wolfRowSSE2(
+    float const* means, float const* deviations,
+    uint8_t const* gray, uint8_t* black, int const count,
+    WolfParams const& params)
+{
+    __m128d const one = _mm_set1_pd(1.0);
+    __m128d const vk = _mm_set1_pd(params.k);
+    __m128d const max_deviation = _mm_set1_pd(params.maxDeviation);
+    __m128d const min_gray_level = _mm_set1_pd(params.minGrayLevel);
+    __m128d const lower_bound = _mm_set1_pd(params.lowerBound);
+    __m128d const upper_bound = _mm_set1_pd(params.upperBound);
+
+    int x = 0;
+    for (; x + 2 <= count; x += 2) {
+        __m128d const mean = _mm_cvtps_pd(loadFloat2(means + x));
+        __m128d const deviation = _mm_cvtps_pd(loadFloat2(deviations + x));
+
+        __m128d const a = _mm_sub_pd(one, _mm_div_pd(deviation, max_deviation));
+        __m128d const threshold = _mm_sub_pd(
+            mean, _mm_mul_pd(_mm_mul_pd(vk, a), _mm_sub_pd(mean, min_gray_level))
+        );
+
+        __m128d const level = loadGray2(gray + x);
+        __m128d const is_black = _mm_or_pd(
+            _mm_cmplt_pd(level, lower_bound),
+            _mm_and_pd(_mm_cmple_pd(level, upper_bound), _mm_cmplt_pd(level, threshold))
+        );
+        storeMask2(black + x, is_black);
+    }
+
+    wolfRange(means, deviations, gray, black, x, count, params);
+}
+
+} // anonymous namespace
+
+Kernels const sse2Kernels = {
+    &sauvolaRowSSE2,
+    &meanDeviationRowSSE2,
+    &wolfRowSSE2
+};
+
+} // namespace binarize
+
+} // namespace detail
+
+} // namespace imageproc
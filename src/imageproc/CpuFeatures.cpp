@@ -0,0 +1,108 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CpuFeatures.h"
+#include <QAtomicInt>
+#if defined(IMAGEPROC_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace imageproc
+{
+
+namespace
+{
+
+CpuFeatures::SimdLevel detectSimdLevel()
+{
+#if defined(IMAGEPROC_SIMD_X86) && defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    int const max_leaf = regs[0];
+
+    __cpuid(regs, 1);
+    bool const sse2 = (regs[3] & (1 << 26)) != 0;
+    bool const osxsave = (regs[2] & (1 << 27)) != 0;
+    bool const avx = (regs[2] & (1 << 28)) != 0;
+    // The OS must be saving the YMM registers on context switches.
+    bool const ymm_enabled = osxsave && avx && (_xgetbv(0) & 6) == 6;
+
+    bool avx2 = false;
+    if (max_leaf >= 7 && ymm_enabled) {
+        __cpuidex(regs, 7, 0);
+        avx2 = (regs[1] & (1 << 5)) != 0;
+    }
+#elif defined(IMAGEPROC_SIMD_X86)
+    __builtin_cpu_init();
+    bool const sse2 = __builtin_cpu_supports("sse2");
+    bool const avx2 = __builtin_cpu_supports("avx2");
+#else
+    bool const sse2 = false;
+    bool const avx2 = false;
+#endif
+
+#if defined(IMAGEPROC_HAVE_AVX2_KERNELS)
+    if (avx2) {
+        return CpuFeatures::SIMD_AVX2;
+    }
+#else
+    (void)avx2;
+#endif
+#if defined(IMAGEPROC_HAVE_SSE2_KERNELS)
+    if (sse2) {
+        return CpuFeatures::SIMD_SSE2;
+    }
+#else
+    (void)sse2;
+#endif
+
+    return CpuFeatures::SIMD_NONE;
+}
+
+/** -1 means not limited by setSimdLevel(). */
+QAtomicInt g_levelLimit(-1);
+
+} // anonymous namespace
+
+CpuFeatures::SimdLevel
+CpuFeatures::supportedSimdLevel()
+{
+    // Thread-safe in C++11.
+    static SimdLevel const level = detectSimdLevel();
+    return level;
+}
+
+CpuFeatures::SimdLevel
+CpuFeatures::simdLevel()
+{
+    SimdLevel const supported = supportedSimdLevel();
+    int const limit = g_levelLimit.loadAcquire();
+    if (limit >= 0 && limit < supported) {
+        return static_cast<SimdLevel>(limit);
+    }
+    return supported;
+}
+
+void
+CpuFeatures::setSimdLevel(SimdLevel const level)
+{
+    g_levelLimit.storeRelease(level);
+}
+
+} // namespace imageproc
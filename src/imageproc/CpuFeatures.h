@@ -0,0 +1,65 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_CPUFEATURES_H_
+#define IMAGEPROC_CPUFEATURES_H_
+
+namespace imageproc
+{
+
+/**
+ * \brief Selects the SIMD instruction set for the functions having
+ *        several implementations.
+ *
+ * All the implementations of a function produce identical results,
+ * so the choice only affects speed.  SIMD_NONE also disables the
+ * shortcuts that are not SIMD as such, leaving just the reference code.
+ */
+class CpuFeatures
+{
+public:
+    enum SimdLevel {
+        SIMD_NONE,
+        SIMD_SSE2,
+        SIMD_AVX2
+    };
+
+    /**
+     * \brief The best level supported both by the CPU and by this build.
+     */
+    static SimdLevel supportedSimdLevel();
+
+    /**
+     * \brief The level that should be used.
+     *
+     * Equals supportedSimdLevel() unless limited by setSimdLevel().
+     */
+    static SimdLevel simdLevel();
+
+    /**
+     * \brief Limits the level to be used.
+     *
+     * Levels above supportedSimdLevel() are clamped.  This is mostly
+     * useful for testing and benchmarking the different implementations.
+     */
+    static void setSimdLevel(SimdLevel level);
+};
+
+} // namespace imageproc
+
+#endif
@@ -22,6 +22,7 @@
 #include "BitOps.h"
 #include <QImage>
 #include <QColor>
+#include <QRgba64>
 #include <QtGlobal>
 #include <stdexcept>
 #include <algorithm>
@@ -32,22 +33,143 @@
 namespace imageproc
 {
 
-static QImage monoMsbToGrayscale(QImage const& src)
+namespace
 {
-    int const width = src.width();
-    int const height = src.height();
 
-    QImage dst(width, height, QImage::Format_Indexed8);
-    dst.setColorTable(createGrayscalePalette());
-    if (width > 0 && height > 0 && dst.isNull()) {
-        throw std::bad_alloc();
+/**
+ * \brief Converts lines of a QImage to gray levels, the way qGray(src.pixel(x, y))
+ *        would, but without going through QImage::pixel().
+ *
+ * The conversion function is picked by the image format once per image.
+ * Palette based formats are converted through lookup tables built from
+ * the color table.  Formats that have no specialized conversion are
+ * reported by isSupported().
+ *
+ * The only exception to matching qGray(src.pixel(x, y)) are mono images,
+ * which are mapped to pure black and white.  Note that pixel() returns
+ * premultiplied pixels as they are stored, and so do the converters.
+ */
+class GrayLineConverter
+{
+public:
+    explicit GrayLineConverter(QImage const& src);
+
+    bool isSupported() const
+    {
+        return m_pConvert != 0;
     }
 
-    uint8_t const* src_line = src.bits();
-    uint8_t* dst_line = dst.bits();
-    int const src_bpl = src.bytesPerLine();
-    int const dst_bpl = dst.bytesPerLine();
+    void operator()(uint8_t const* src_line, uint8_t* dst_line, int width) const
+    {
+        m_pConvert(*this, src_line, dst_line, width);
+    }
+private:
+    typedef void (*ConvertFunc)(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    void initMonoLut(QImage const& src, bool msb_first);
+
+    void initPaletteLut(QImage const& src);
+
+    static void convertMono(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    static void convertIndexed(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    static void convertRgb32(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    static void convertRgb888(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    static void convertRgb16(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    static void convertRgba8888(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+    static void convertGrayscale8(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+
+#if QT_VERSION >= 0x050C00
+    static void convertRgba64(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+#endif
+
+#if QT_VERSION >= 0x050D00
+    static void convertGrayscale16(
+        GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int width);
+#endif
+
+    ConvertFunc m_pConvert;
+
+    /**
+     * For palette based formats, maps a color index to a gray level.
+     */
+    uint8_t m_paletteLut[256];
+
+    /**
+     * For mono formats, maps a byte to the gray levels of its 8 pixels.
+     */
+    uint8_t m_monoLut[256][8];
+};
+
+GrayLineConverter::GrayLineConverter(QImage const& src)
+    :   m_pConvert(0)
+{
+    switch (src.format()) {
+    case QImage::Format_Mono:
+        initMonoLut(src, true);
+        m_pConvert = &convertMono;
+        break;
+    case QImage::Format_MonoLSB:
+        initMonoLut(src, false);
+        m_pConvert = &convertMono;
+        break;
+    case QImage::Format_Indexed8:
+        initPaletteLut(src);
+        m_pConvert = &convertIndexed;
+        break;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        m_pConvert = &convertRgb32;
+        break;
+    case QImage::Format_RGB888:
+        m_pConvert = &convertRgb888;
+        break;
+    case QImage::Format_RGB16:
+        m_pConvert = &convertRgb16;
+        break;
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        m_pConvert = &convertRgba8888;
+        break;
+    case QImage::Format_Grayscale8:
+        m_pConvert = &convertGrayscale8;
+        break;
+#if QT_VERSION >= 0x050C00
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+        m_pConvert = &convertRgba64;
+        break;
+#endif
+#if QT_VERSION >= 0x050D00
+    case QImage::Format_Grayscale16:
+        m_pConvert = &convertGrayscale16;
+        break;
+#endif
+    default:
+        break;
+    }
+}
 
+void
+GrayLineConverter::initMonoLut(QImage const& src, bool const msb_first)
+{
     uint8_t bin2gray[2] = { 0, 0xff };
     if (src.colorCount() >= 2) {
         if (qGray(src.color(0)) > qGray(src.color(1))) {
@@ -57,92 +179,126 @@ static QImage monoMsbToGrayscale(QImage const& src)
         }
     }
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width;) {
-            uint8_t const b = src_line[x / 8];
-            for (int i = 7; i >= 0 && x < width; --i, ++x) {
-                dst_line[x] = bin2gray[(b >> i) & 1];
-            }
+    for (int byte = 0; byte < 256; ++byte) {
+        for (int i = 0; i < 8; ++i) {
+            int const bit = msb_first ? 7 - i : i;
+            m_monoLut[byte][i] = bin2gray[(byte >> bit) & 1];
         }
-
-        src_line += src_bpl;
-        dst_line += dst_bpl;
     }
+}
 
-    dst.setDotsPerMeterX(src.dotsPerMeterX());
-    dst.setDotsPerMeterY(src.dotsPerMeterY());
+void
+GrayLineConverter::initPaletteLut(QImage const& src)
+{
+    // QImage::pixel() returns 0 for indices outside of the color table.
+    memset(m_paletteLut, 0, sizeof(m_paletteLut));
 
-    return dst;
+    int const num_colors = std::min(src.colorCount(), 256);
+    for (int i = 0; i < num_colors; ++i) {
+        m_paletteLut[i] = static_cast<uint8_t>(qGray(src.color(i)));
+    }
 }
 
-static QImage monoLsbToGrayscale(QImage const& src)
+void
+GrayLineConverter::convertMono(
+    GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int const width)
 {
-    int const width = src.width();
-    int const height = src.height();
-
-    QImage dst(width, height, QImage::Format_Indexed8);
-    dst.setColorTable(createGrayscalePalette());
-    if (width > 0 && height > 0 && dst.isNull()) {
-        throw std::bad_alloc();
+    int const num_full_bytes = width >> 3;
+    for (int i = 0; i < num_full_bytes; ++i) {
+        memcpy(dst_line + (i << 3), self.m_monoLut[src_line[i]], 8);
     }
 
-    uint8_t const* src_line = src.bits();
-    uint8_t* dst_line = dst.bits();
-    int const src_bpl = src.bytesPerLine();
-    int const dst_bpl = dst.bytesPerLine();
+    int const remainder = width & 7;
+    if (remainder) {
+        memcpy(dst_line + (num_full_bytes << 3), self.m_monoLut[src_line[num_full_bytes]], remainder);
+    }
+}
 
-    uint8_t bin2gray[2] = { 0, 0xff };
-    if (src.colorCount() >= 2) {
-        if (qGray(src.color(0)) > qGray(src.color(1))) {
-            // if color 0 is lighter than color 1
-            bin2gray[0] = 0xff;
-            bin2gray[1] = 0;
-        }
+void
+GrayLineConverter::convertIndexed(
+    GrayLineConverter const& self, uint8_t const* src_line, uint8_t* dst_line, int const width)
+{
+    for (int x = 0; x < width; ++x) {
+        dst_line[x] = self.m_paletteLut[src_line[x]];
     }
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width;) {
-            uint8_t const b = src_line[x / 8];
-            for (int i = 0; i < 8 && x < width; ++i, ++x) {
-                dst_line[x] = bin2gray[(b >> i) & 1];
-            }
-        }
+void
+GrayLineConverter::convertRgb32(
+    GrayLineConverter const&, uint8_t const* src_line, uint8_t* dst_line, int const width)
+{
+    QRgb const* const src = reinterpret_cast<QRgb const*>(src_line);
+    for (int x = 0; x < width; ++x) {
+        dst_line[x] = static_cast<uint8_t>(qGray(src[x]));
+    }
+}
 
-        src_line += src_bpl;
-        dst_line += dst_bpl;
+void
+GrayLineConverter::convertRgb888(
+    GrayLineConverter const&, uint8_t const* src_line, uint8_t* dst_line, int const width)
+{
+    for (int x = 0; x < width; ++x, src_line += 3) {
+        dst_line[x] = static_cast<uint8_t>(qGray(src_line[0], src_line[1], src_line[2]));
     }
+}
 
-    dst.setDotsPerMeterX(src.dotsPerMeterX());
-    dst.setDotsPerMeterY(src.dotsPerMeterY());
+void
+GrayLineConverter::convertRgb16(
+    GrayLineConverter const&, uint8_t const* src_line, uint8_t* dst_line, int const width)
+{
+    uint16_t const* const src = reinterpret_cast<uint16_t const*>(src_line);
+    for (int x = 0; x < width; ++x) {
+        // Expands 5 and 6 bit components the way QImage does.
+        unsigned const c = src[x];
+        int const r = ((c >> 8) & 0xf8) | ((c >> 13) & 0x07);
+        int const g = ((c >> 3) & 0xfc) | ((c >> 9) & 0x03);
+        int const b = ((c << 3) & 0xf8) | ((c >> 2) & 0x07);
+        dst_line[x] = static_cast<uint8_t>(qGray(r, g, b));
+    }
+}
 
-    return dst;
+void
+GrayLineConverter::convertRgba8888(
+    GrayLineConverter const&, uint8_t const* src_line, uint8_t* dst_line, int const width)
+{
+    for (int x = 0; x < width; ++x, src_line += 4) {
+        dst_line[x] = static_cast<uint8_t>(qGray(src_line[0], src_line[1], src_line[2]));
+    }
 }
 
-static QImage rgbToGrayscale(QImage const& src)
+void
+GrayLineConverter::convertGrayscale8(
+    GrayLineConverter const&, uint8_t const* src_line, uint8_t* dst_line, int const width)
 {
-    int const width = src.width();
-    int const height = src.height();
+    memcpy(dst_line, src_line, width);
+}
 
-    QImage dst(width, height, QImage::Format_Indexed8);
-    dst.setColorTable(createGrayscalePalette());
-    if (width > 0 && height > 0 && dst.isNull()) {
-        throw std::bad_alloc();
+#if QT_VERSION >= 0x050C00
+void
+GrayLineConverter::convertRgba64(
+    GrayLineConverter const&, uint8_t const* src_line, uint8_t* dst_line, int const width)
+{
+    QRgba64 const* const src = reinterpret_cast<QRgba64 const*>(src_line);
+    for (int x = 0; x < width; ++x) {
+        dst_line[x] = static_cast<uint8_t>(qGray(src[x].toArgb32()));
     }
+}
+#endif
 
-    #pragma omp parallel for
-    for (int y = 0; y < height; ++y) {
-        uint8_t* dst_line = dst.scanLine(y);
-        const QRgb* src_line = reinterpret_cast<const QRgb*>(src.scanLine(y));
-        for (int x = 0; x < width; ++x) {
-            dst_line[x] = static_cast<uint8_t>(qGray(*src_line++));
-        }
+#if QT_VERSION >= 0x050D00
+void
+GrayLineConverter::convertGrayscale16(
+    GrayLineConverter const&, uint8_t const* src_line, uint8_t* dst_line, int const width)
+{
+    uint16_t const* const src = reinterpret_cast<uint16_t const*>(src_line);
+    for (int x = 0; x < width; ++x) {
+        uint16_t const v = src[x];
+        dst_line[x] = static_cast<uint8_t>(qGray(qRgba64(v, v, v, 0xffff).toArgb32()));
     }
-
-    dst.setDotsPerMeterX(src.dotsPerMeterX());
-    dst.setDotsPerMeterY(src.dotsPerMeterY());
-
-    return dst;
 }
+#endif
+
+} // anonymous namespace
 
 static QImage anyToGrayscale(QImage const& src)
 {
@@ -155,13 +311,25 @@ static QImage anyToGrayscale(QImage const& src)
         throw std::bad_alloc();
     }
 
+    uint8_t* const dst_data = dst.bits(); // never call .bits() inside omp
     int const dst_bpl = dst.bytesPerLine();
 
-    #pragma omp parallel for
-    for (int y = 0; y < height; ++y) {
-        uint8_t* dst_line = dst.bits() + y * dst_bpl;
-        for (int x = 0; x < width; ++x) {
-            dst_line[x] = static_cast<uint8_t>(qGray(src.pixel(x, y)));
+    GrayLineConverter const converter(src);
+    if (converter.isSupported()) {
+        uint8_t const* const src_data = src.constBits();
+        int const src_bpl = src.bytesPerLine();
+
+        #pragma omp parallel for
+        for (int y = 0; y < height; ++y) {
+            converter(src_data + y * src_bpl, dst_data + y * dst_bpl, width);
+        }
+    } else {
+        #pragma omp parallel for
+        for (int y = 0; y < height; ++y) {
+            uint8_t* dst_line = dst_data + y * dst_bpl;
+            for (int x = 0; x < width; ++x) {
+                dst_line[x] = static_cast<uint8_t>(qGray(src.pixel(x, y)));
+            }
         }
     }
 
@@ -190,14 +358,6 @@ QImage toGrayscale(QImage const& src)
     }
 
     switch (src.format()) {
-    case QImage::Format_Mono:
-        return monoMsbToGrayscale(src);
-    case QImage::Format_MonoLSB:
-        return monoLsbToGrayscale(src);
-    case QImage::Format_RGB32:
-    case QImage::Format_ARGB32:
-    case QImage::Format_ARGB32_Premultiplied:
-        return rgbToGrayscale(src);
     case QImage::Format_Indexed8:
         if (src.isGrayscale()) {
             if (src.colorCount() == 256) {
@@ -74,6 +74,20 @@ public:
      *       undefined.
      */
     T sum(QRect const& rect) const;
+
+    /**
+     * \brief Returns the partial sums for the rows above row \p y.
+     *
+     * Element x of the returned array is the sum of values in
+     * QRect(0, 0, x, y).  That is, the valid range for \p y is
+     * [0, height] and the valid range for x is [0, width].
+     * This allows computing sums over many rectangles sharing
+     * the same top and bottom edges without calling sum() each time.
+     */
+    T const* partialSumsRow(int y) const
+    {
+        return m_pData + y * m_width;
+    }
 private:
     void init(int width, int height);
 
@@ -17,7 +17,6 @@
 */
 
 #include "PolynomialSurface.h"
-#include "AlignedArray.h"
 #include "BinaryImage.h"
 #include "GrayImage.h"
 #include "Grayscale.h"
@@ -131,58 +130,15 @@ PolynomialSurface::render(QSize const& size) const
     }
 
     GrayImage image(size);
-    int const width = size.width();
     int const height = size.height();
     int const bpl = image.stride();
-    int const num_coeffs = m_coeffs.size();
-
-    // Pretend that both x and y positions of pixels
-    // lie in range of [0, 1].
-    double const xscale = calcScale(width);
-    double const yscale = calcScale(height);
-
-    AlignedArray<float, 4> vert_matrix(num_coeffs * height);
-    float* out = &vert_matrix[0];
-    for (int y = 0; y < height; ++y) {
-        double const y_adjusted = y * yscale;
-        double pow = 1.0;
-        int pos = 0;
-        for (int i = 0; i <= m_vertDegree; ++i) {
-            for (int j = 0; j <= m_horDegree; ++j, ++pos, ++out) {
-                *out = static_cast<float>(m_coeffs[pos] * pow);
-            }
-            pow *= y_adjusted;
-        }
-    }
-
-    AlignedArray<float, 4> hor_matrix(num_coeffs * width);
-    out = &hor_matrix[0];
-    for (int x = 0; x < width; ++x) {
-        double const x_adjusted = x * xscale;
-        for (int i = 0; i <= m_vertDegree; ++i) {
-            double pow = 1.0;
-            for (int j = 0; j <= m_horDegree; ++j, ++out) {
-                *out = static_cast<float>(pow);
-                pow *= x_adjusted;
-            }
-        }
-    }
+    RowRenderer const renderer(*this, size);
 
     unsigned char* image_data = image.data(); // never call .data() inside omp
 
-    #pragma omp parallel for schedule(static) shared(image, vert_matrix, hor_matrix)
+    #pragma omp parallel for schedule(static) shared(image, renderer)
     for (int y = 0; y < height; ++y) {
-        unsigned char* line = image_data + y * bpl;
-        float const* vert_line = &vert_matrix[0] + y * num_coeffs;
-        float const* hor_line = &hor_matrix[0];
-        for (int x = 0; x < width; ++x, hor_line += num_coeffs) {
-            float sum = 0; // for rounding purposes.
-            for (int i = 0; i < num_coeffs; ++i) {
-                sum += hor_line[i] * vert_line[i];
-            }
-            int const isum = (int)(sum * 255.0 + 0.5f);
-            line[x] = isum <= 0 ? 0 : (isum >= 255 ? 255 : (unsigned char) isum);
-        }
+        renderer.renderRow(y, image_data + y * bpl);
     }
 
     return image;
@@ -387,4 +343,74 @@ PolynomialSurface::fixSquareMatrixRankDeficiency(MatT<double>& mat)
     }
 }
 
+/*==================== PolynomialSurface::RowRenderer ======================*/
+
+PolynomialSurface::RowRenderer::RowRenderer(
+    PolynomialSurface const& surface, QSize const& size)
+    :   m_coeffs(surface.m_coeffs),
+        m_xs(std::max(size.width(), 0)),
+        // Pretend that both x and y positions of pixels
+        // lie in range of [0, 1].
+        m_yscale(calcScale(size.height())),
+        m_horDegree(surface.m_horDegree),
+        m_vertDegree(surface.m_vertDegree)
+{
+    double const xscale = calcScale(size.width());
+    for (int x = 0; x < size.width(); ++x) {
+        m_xs[x] = static_cast<float>(x * xscale);
+    }
+}
+
+void
+PolynomialSurface::RowRenderer::renderRow(int const y, uint8_t* const out) const
+{
+    int const width = m_xs.size();
+    int const num_row_coeffs = m_horDegree + 1;
+
+    // Sum the terms having the same power of x.
+    std::vector<float> row_coeffs(num_row_coeffs);
+    {
+        std::vector<double> sums(num_row_coeffs, 0.0);
+        double const y_adjusted = y * m_yscale;
+        double pow = 1.0;
+        int pos = 0;
+        for (int i = 0; i <= m_vertDegree; ++i) {
+            for (int j = 0; j <= m_horDegree; ++j, ++pos) {
+                sums[j] += m_coeffs[pos] * pow;
+            }
+            pow *= y_adjusted;
+        }
+        for (int j = 0; j <= m_horDegree; ++j) {
+            row_coeffs[j] = static_cast<float>(sums[j]);
+        }
+    }
+
+    // Horner's scheme, applied to a block of pixels at a time,
+    // which keeps the innermost loops simple enough to be vectorized.
+    int const BLOCK_SIZE = 256;
+    float block[BLOCK_SIZE];
+
+    for (int block_x = 0; block_x < width; block_x += BLOCK_SIZE) {
+        int const block_width = std::min(BLOCK_SIZE, width - block_x);
+        float const* const block_xs = &m_xs[block_x];
+
+        float const top_coeff = row_coeffs[m_horDegree];
+        for (int i = 0; i < block_width; ++i) {
+            block[i] = top_coeff;
+        }
+        for (int j = m_horDegree - 1; j >= 0; --j) {
+            float const coeff = row_coeffs[j];
+            for (int i = 0; i < block_width; ++i) {
+                block[i] = block[i] * block_xs[i] + coeff;
+            }
+        }
+
+        uint8_t* const block_out = out + block_x;
+        for (int i = 0; i < block_width; ++i) {
+            int const isum = (int)(block[i] * 255.0f + 0.5f);
+            block_out[i] = isum <= 0 ? 0 : (isum >= 255 ? 255 : (uint8_t) isum);
+        }
+    }
+}
+
 } // namespace imagproc
@@ -22,6 +22,7 @@
 #include "MatT.h"
 #include "VecT.h"
 #include <QSize>
+#include <vector>
 #include <stdint.h>
 
 namespace imageproc
@@ -85,6 +86,53 @@ public:
      * The surface will be stretched / shrunk to fit the new size.
      */
     GrayImage render(QSize const& size) const;
+
+    int horDegree() const { return m_horDegree; }
+
+    int vertDegree() const { return m_vertDegree; }
+
+    /**
+     * \brief The coefficients, the one of x^j * y^i being at
+     *        i * (horDegree() + 1) + j.
+     *
+     * Positions of pixels are scaled to [0, 1], and the values
+     * of the surface to [0, 1] as well.
+     */
+    VecT<double> const& coefficients() const { return m_coeffs; }
+
+    /**
+     * \brief Renders the surface row by row, without a full size image.
+     *
+     * Along a single row, the surface is a polynomial of x alone, whose
+     * coefficients are calculated once per row.  Evaluating it costs
+     * hor_degree multiply-adds per pixel, and nothing per pixel has
+     * to be precomputed for the whole image.
+     *
+     * A renderer may be shared by threads rendering different rows.
+     */
+    class RowRenderer
+    {
+    public:
+        /**
+         * \param surface The surface to render.  It's copied.
+         * \param size The size the surface is stretched to, as in render().
+         */
+        RowRenderer(PolynomialSurface const& surface, QSize const& size);
+
+        /**
+         * \brief Renders row \p y, which has to be in [0, size.height()),
+         *        into \p out, which must have room for size.width() pixels.
+         *
+         * The result matches the corresponding row of render(size).
+         */
+        void renderRow(int y, uint8_t* out) const;
+    private:
+        VecT<double> m_coeffs;
+        std::vector<float> m_xs;
+        double m_yscale;
+        int m_horDegree;
+        int m_vertDegree;
+    };
 private:
     void maybeReduceDegrees(int num_data_points);
 
@@ -18,13 +18,13 @@
 
 #include "SkewFinder.h"
 #include "BinaryImage.h"
-#include "BWColor.h"
 #include "BitOps.h"
-#include "Shear.h"
 #include "ReduceThreshold.h"
 #include "Constants.h"
 #include <QDebug>
 #include <stdexcept>
+#include <vector>
+#include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
 
@@ -113,20 +113,33 @@ SkewFinder::findSkew(BinaryImage const& image) const
         coarse_reduced.reduce(i == 0 ? 1 : 2);
     }
 
-    BinaryImage skewed(coarse_reduced.image().size());
     double const coarse_step = 1.0; // degrees
 
-    // Coarse linear search.
-    int num_coarse_scores = 0;
+    std::vector<double> coarse_angles;
+    for (double angle = -m_maxAngle; angle <= m_maxAngle; angle += coarse_step) {
+        coarse_angles.push_back(angle);
+    }
+
+    // Coarse linear search.  The angles are scored in parallel,
+    // while the scores are accumulated in order, so that the result
+    // doesn't depend on the number of threads.
+    int const num_coarse_scores = coarse_angles.size();
+    std::vector<double> coarse_scores(num_coarse_scores);
+    BinaryImage const& coarse_image = coarse_reduced.image();
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_coarse_scores; ++i) {
+        coarse_scores[i] = process(coarse_image, coarse_angles[i]);
+    }
+
     double sum_coarse_scores = 0.0;
     double best_coarse_score = 0.0;
     double best_coarse_angle = -m_maxAngle;
-    for (double angle = -m_maxAngle; angle <= m_maxAngle; angle += coarse_step) {
-        double const score = process(coarse_reduced, skewed, angle);
+    for (int i = 0; i < num_coarse_scores; ++i) {
+        double const score = coarse_scores[i];
         sum_coarse_scores += score;
-        ++num_coarse_scores;
         if (score > best_coarse_score) {
-            best_coarse_angle = angle;
+            best_coarse_angle = coarse_angles[i];
             best_coarse_score = score;
         }
     }
@@ -144,24 +157,20 @@ SkewFinder::findSkew(BinaryImage const& image) const
         fine_reduced.reduce(i == 0 ? 1 : 2);
     }
 
-    if (m_coarseReduction != m_fineReduction) {
-        skewed = BinaryImage(fine_reduced.image().size());
-    }
-
     // Fine binary search.
     double angle_plus = best_coarse_angle + 0.5 * coarse_step;
     double angle_minus = best_coarse_angle - 0.5 * coarse_step;
-    double score_plus = process(fine_reduced, skewed, angle_plus);
-    double score_minus = process(fine_reduced, skewed, angle_minus);
+    double score_plus = process(fine_reduced, angle_plus);
+    double score_minus = process(fine_reduced, angle_minus);
     double const fine_score1 = score_plus;
     double const fine_score2 = score_minus;
     while (angle_plus - angle_minus > m_accuracy) {
         if (score_plus > score_minus) {
             angle_minus = 0.5 * (angle_plus + angle_minus);
-            score_minus = process(fine_reduced, skewed, angle_minus);
+            score_minus = process(fine_reduced, angle_minus);
         } else if (score_plus < score_minus) {
             angle_plus = 0.5 * (angle_plus + angle_minus);
-            score_plus = process(fine_reduced, skewed, angle_plus);
+            score_plus = process(fine_reduced, angle_plus);
         } else {
             // This protects us from unreasonably low m_accuracy.
             break;
@@ -197,39 +206,106 @@ SkewFinder::findSkew(BinaryImage const& image) const
 }
 
 double
-SkewFinder::process(BinaryImage const& src, BinaryImage& dst, double const angle) const
+SkewFinder::process(BinaryImage const& src, double const angle) const
 {
     double const tg = tan(angle * constants::DEG2RAD);
-    double const x_center = 0.5 * dst.width();
-    vShearFromTo(src, dst, tg / m_resolutionRatio, x_center, WHITE);
-    return calcScore(dst);
+    double const x_center = 0.5 * src.width();
+    std::vector<int> projection;
+    projectSheared(src, tg / m_resolutionRatio, x_center, projection);
+    return calcScore(projection);
 }
 
-double
-SkewFinder::calcScore(BinaryImage const& image)
+/**
+ * Does the same as counting black pixels in each line of
+ * vShear(src, shear, x_origin, WHITE), without building the sheared image.
+ * The image is split into the same blocks of columns vShearFromTo() would
+ * shift as a whole, and black pixels of each block are counted in source
+ * lines, then credited to the lines they would be shifted to.
+ */
+void
+SkewFinder::projectSheared(
+    BinaryImage const& src, double const shear,
+    double const x_origin, std::vector<int>& projection)
 {
-    int const width = image.width();
-    int const height = image.height();
-    uint32_t const* line = image.data();
-    int const wpl = image.wordsPerLine();
-    int const last_word_idx = (width - 1) >> 5;
-    uint32_t const last_word_mask = ~uint32_t(0) << (31 - ((width - 1) & 31));
+    int const width = src.width();
+    int const height = src.height();
+    uint32_t const* const data = src.data();
+    int const wpl = src.wordsPerLine();
+
+    projection.assign(height, 0);
+
+    struct Block
+    {
+        int shift;
+        int firstWord;
+        int lastWord;
+        uint32_t firstMask;
+        uint32_t lastMask;
+    };
+    std::vector<Block> blocks;
+
+    // Same as in vShearFromTo(), including the way shift is accumulated,
+    // so that we end up with exactly the same blocks.
+    // shift = floor(0.5 + shear * (x + 0.5 - x_origin));
+    double shift = 0.5 + shear * (0.5 - x_origin);
+    int shift1 = (int)floor(shift);
+    int x1 = 0;
+    int x2 = 0;
+    for (;;) {
+        ++x2;
+        shift += shear;
+        int const shift2 = (int)floor(shift);
+        if (shift1 != shift2 || x2 == width) {
+            if (abs(shift1) < height) {
+                Block block;
+                block.shift = shift1;
+                block.firstWord = x1 >> 5;
+                block.lastWord = (x2 - 1) >> 5;
+                block.firstMask = ~uint32_t(0) >> (x1 & 31);
+                block.lastMask = ~uint32_t(0) << (31 - ((x2 - 1) & 31));
+                if (block.firstWord == block.lastWord) {
+                    block.firstMask &= block.lastMask;
+                }
+                blocks.push_back(block);
+            }
+
+            if (x2 == width) {
+                break;
+            }
+
+            x1 = x2;
+            shift1 = shift2;
+        }
+    }
 
-    double score = 0.0;
-    int last_line_black_pixels = 0;
+    uint32_t const* line = data;
     for (int y = 0; y < height; ++y, line += wpl) {
-        int num_black_pixels = 0;
-        int i = 0;
-        for (; i != last_word_idx; ++i) {
-            num_black_pixels += countNonZeroBits(line[i]);
+        for (Block const& block : blocks) {
+            int const dst_y = y + block.shift;
+            if (dst_y < 0 || dst_y >= height) {
+                continue;
+            }
+
+            int num_black_pixels = countNonZeroBits(line[block.firstWord] & block.firstMask);
+            if (block.lastWord != block.firstWord) {
+                for (int i = block.firstWord + 1; i < block.lastWord; ++i) {
+                    num_black_pixels += countNonZeroBits(line[i]);
+                }
+                num_black_pixels += countNonZeroBits(line[block.lastWord] & block.lastMask);
+            }
+            projection[dst_y] += num_black_pixels;
         }
-        num_black_pixels += countNonZeroBits(line[i] & last_word_mask);
+    }
+}
 
-        if (y != 0) {
-            double const diff = num_black_pixels - last_line_black_pixels;
-            score += diff * diff;
-        }
-        last_line_black_pixels = num_black_pixels;
+double
+SkewFinder::calcScore(std::vector<int> const& projection)
+{
+    double score = 0.0;
+    int const height = projection.size();
+    for (int y = 1; y < height; ++y) {
+        double const diff = projection[y] - projection[y - 1];
+        score += diff * diff;
     }
 
     return score;
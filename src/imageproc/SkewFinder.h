@@ -20,6 +20,7 @@
 #define IMAGEPROC_SKEWFINDER_H_
 
 #include "NonCopyable.h"
+#include <vector>
 
 namespace imageproc
 {
@@ -146,9 +147,13 @@ public:
 private:
     static double const LOW_SCORE;
 
-    double process(BinaryImage const& src, BinaryImage& dst, double angle) const;
+    double process(BinaryImage const& src, double angle) const;
 
-    static double calcScore(BinaryImage const& image);
+    static void projectSheared(
+        BinaryImage const& src, double shear,
+        double x_origin, std::vector<int>& projection);
+
+    static double calcScore(std::vector<int> const& projection);
 
     double m_maxAngle;
     double m_accuracy;
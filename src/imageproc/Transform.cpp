@@ -19,6 +19,7 @@
 #include "Transform.h"
 #include "Grayscale.h"
 #include "GrayImage.h"
+#include "CpuFeatures.h"
 #include <QImage>
 #include <QRect>
 #include <QSizeF>
@@ -33,6 +34,10 @@
 #include <stdint.h>
 #include <math.h>
 #include <assert.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace imageproc
 {
@@ -54,11 +59,128 @@ struct YLess {
     }
 };
 
+/**
+ * \brief Computes (sum + area / 2) / area using a multiplication.
+ *
+ * The result is exact for areas up to 64 * 64 and sums up to 255 * area,
+ * which was verified exhaustively.
+ */
+class AreaDivider
+{
+public:
+    explicit AreaDivider(unsigned const area)
+        :   m_halfArea(area >> 1),
+            m_multiplier((uint64_t(1) << 40) / area + 1) {}
+
+    unsigned divide(unsigned const sum) const
+    {
+        return static_cast<unsigned>((uint64_t(sum + m_halfArea) * m_multiplier) >> 40);
+    }
+private:
+    unsigned m_halfArea;
+    uint64_t m_multiplier;
+};
+
+/**
+ * \brief Sums the color channels of a block of up to 3x3 ARGB pixels.
+ *
+ * Pixel (i, j) has the weight of wx[i] * wy[j].  The weights along
+ * each axis may not add up to more than 64.
+ *
+ * \param sums Receives blue, green, red and alpha sums, in this order.
+ */
+static inline void sumChannels(
+    uint32_t const* src, int const src_stride,
+    unsigned const* wx, int const nx, unsigned const* wy, int const ny,
+    unsigned sums[4])
+{
+#ifdef TRANSFORM_USE_SSE2
+    __m128i const zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (int j = 0; j < ny; ++j, src += src_stride) {
+        // Weighted channel sums of a row fit 16 bits.
+        __m128i row = zero;
+        for (int i = 0; i < nx; ++i) {
+            __m128i const px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(src[i])), zero);
+            row = _mm_add_epi16(row, _mm_mullo_epi16(px, _mm_set1_epi16(static_cast<short>(wx[i]))));
+        }
+        // Widen to 32 bits and multiply by the row weight.
+        acc = _mm_add_epi32(
+            acc, _mm_madd_epi16(_mm_unpacklo_epi16(row, zero), _mm_set1_epi32(static_cast<int>(wy[j])))
+        );
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), acc);
+#else
+    sums[0] = sums[1] = sums[2] = sums[3] = 0;
+    for (int j = 0; j < ny; ++j, src += src_stride) {
+        unsigned row[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < nx; ++i) {
+            uint32_t const argb = src[i];
+            row[0] += (argb & 0xFF) * wx[i];
+            row[1] += ((argb >> 8) & 0xFF) * wx[i];
+            row[2] += ((argb >> 16) & 0xFF) * wx[i];
+            row[3] += (argb >> 24) * wx[i];
+        }
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += row[c] * wy[j];
+        }
+    }
+#endif
+}
+
+/**
+ * \brief Computes the weights of source pixels along one axis.
+ *
+ * \param src32_begin The beginning of the area, in 1/32 pixel units.
+ * \param src32_end The end of the area (exclusive), in 1/32 pixel units.
+ *        The area may not be longer than 64 units.
+ * \param weights Receives the weights of up to 3 pixels, starting from
+ *        the one at (src32_begin >> 5).
+ * \return The number of pixels the area touches.
+ */
+static inline int axisWeights(int const src32_begin, int const src32_end, unsigned weights[3])
+{
+    int const first = src32_begin >> 5;
+    int const count = ((src32_end - 1) >> 5) - first + 1;
+    assert(count >= 1 && count <= 3);
+
+    for (int i = 0; i < count; ++i) {
+        int const pixel32_begin = (first + i) << 5;
+        int const begin = std::max(src32_begin, pixel32_begin);
+        int const end = std::min(src32_end, pixel32_begin + 32);
+        weights[i] = end - begin;
+    }
+
+    return count;
+}
+
 class Gray
 {
 public:
     Gray() : m_grayLevel(0) {}
 
+    /**
+     * \brief Mixes a block of up to 3x3 pixels fully inside the source image.
+     *
+     * Gives the same result as adding each pixel with the weight of
+     * wx[i] * wy[j] and then calling result().
+     */
+    static uint8_t mixBlock(
+        uint8_t const* src, int const src_stride,
+        unsigned const* wx, int const nx, unsigned const* wy, int const ny,
+        AreaDivider const& divider)
+    {
+        unsigned sum = 0;
+        for (int j = 0; j < ny; ++j, src += src_stride) {
+            unsigned row = 0;
+            for (int i = 0; i < nx; ++i) {
+                row += src[i] * wx[i];
+            }
+            sum += row * wy[j];
+        }
+        return static_cast<uint8_t>(divider.divide(sum));
+    }
+
     inline void add(uint8_t const gray_level, unsigned const area)
     {
         m_grayLevel += gray_level * area;
@@ -79,6 +201,18 @@ class RGB32
 public:
     RGB32() : m_red(0), m_green(0), m_blue(0) {}
 
+    /** \see Gray::mixBlock() */
+    static uint32_t mixBlock(
+        uint32_t const* src, int const src_stride,
+        unsigned const* wx, int const nx, unsigned const* wy, int const ny,
+        AreaDivider const& divider)
+    {
+        unsigned sums[4];
+        sumChannels(src, src_stride, wx, nx, wy, ny, sums);
+        return 0xFF000000 | (divider.divide(sums[2]) << 16)
+               | (divider.divide(sums[1]) << 8) | divider.divide(sums[0]);
+    }
+
     inline void add(uint32_t rgb, unsigned const area)
     {
         m_blue += (rgb & 0xFF) * area;
@@ -110,6 +244,18 @@ class ARGB32
 public:
     ARGB32() : m_alpha(0), m_red(0), m_green(0), m_blue(0) {}
 
+    /** \see Gray::mixBlock() */
+    static uint32_t mixBlock(
+        uint32_t const* src, int const src_stride,
+        unsigned const* wx, int const nx, unsigned const* wy, int const ny,
+        AreaDivider const& divider)
+    {
+        unsigned sums[4];
+        sumChannels(src, src_stride, wx, nx, wy, ny, sums);
+        return (divider.divide(sums[3]) << 24) | (divider.divide(sums[2]) << 16)
+               | (divider.divide(sums[1]) << 8) | divider.divide(sums[0]);
+    }
+
     inline void add(uint32_t argb, unsigned const area)
     {
         m_blue += (argb & 0xFF) * area;
@@ -163,6 +309,213 @@ static QSizeF calcSrcUnitSize(QTransform const& xform, QSizeF const& min)
            );
 }
 
+/**
+ * \brief Computes a single destination pixel by mixing the source pixels
+ *        it maps to, taking pixels outside of the source image into account.
+ */
+template<typename StorageUnit, typename Mixer>
+static StorageUnit transformPixel(
+    StorageUnit const* const src_data, int const src_stride,
+    int const sw, int const sh,
+    double const f_sx32_center, double const f_sy32_center,
+    int const src32_unit_w, int const src32_unit_h,
+    StorageUnit const outside_color, int const outside_flags)
+{
+    int src32_left = (int)f_sx32_center - (src32_unit_w >> 1);
+    int src32_top = (int)f_sy32_center - (src32_unit_h >> 1);
+    int src32_right = src32_left + src32_unit_w;
+    int src32_bottom = src32_top + src32_unit_h;
+    int src_left = src32_left >> 5;
+    int src_right = (src32_right - 1) >> 5; // inclusive
+    int src_top = src32_top >> 5;
+    int src_bottom = (src32_bottom - 1) >> 5; // inclusive
+    assert(src_bottom >= src_top);
+    assert(src_right >= src_left);
+
+    if (src_bottom < 0 || src_right < 0 || src_left >= sw || src_top >= sh) {
+        // Completely outside of src image.
+        if (outside_flags & OutsidePixels::COLOR) {
+            return outside_color;
+        } else {
+            int const src_x = qBound<int>(0, (src_left + src_right) >> 1, sw - 1);
+            int const src_y = qBound<int>(0, (src_top + src_bottom) >> 1, sh - 1);
+            return src_data[src_y * src_stride + src_x];
+        }
+    }
+
+    /*
+     * Note that (intval / 32) is not the same as (intval >> 5).
+     * The former rounds towards zero, while the latter rounds towards
+     * negative infinity.
+     * Likewise, (intval % 32) is not the same as (intval & 31).
+     * The following expression:
+     * top_fraction = 32 - (src32_top & 31);
+     * works correctly with both positive and negative src32_top.
+     */
+
+    unsigned background_area = 0;
+
+    if (src_top < 0) {
+        unsigned const top_fraction = 32 - (src32_top & 31);
+        unsigned const hor_fraction = src32_right - src32_left;
+        background_area += top_fraction * hor_fraction;
+        unsigned const full_pixels_ver = -1 - src_top;
+        background_area += hor_fraction * (full_pixels_ver << 5);
+        src_top = 0;
+        src32_top = 0;
+    }
+    if (src_bottom >= sh) {
+        unsigned const bottom_fraction = src32_bottom - (src_bottom << 5);
+        unsigned const hor_fraction = src32_right - src32_left;
+        background_area += bottom_fraction * hor_fraction;
+        unsigned const full_pixels_ver = src_bottom - sh;
+        background_area += hor_fraction * (full_pixels_ver << 5);
+        src_bottom = sh - 1; // inclusive
+        src32_bottom = sh << 5; // exclusive
+    }
+    if (src_left < 0) {
+        unsigned const left_fraction = 32 - (src32_left & 31);
+        unsigned const vert_fraction = src32_bottom - src32_top;
+        background_area += left_fraction * vert_fraction;
+        unsigned const full_pixels_hor = -1 - src_left;
+        background_area += vert_fraction * (full_pixels_hor << 5);
+        src_left = 0;
+        src32_left = 0;
+    }
+    if (src_right >= sw) {
+        unsigned const right_fraction = src32_right - (src_right << 5);
+        unsigned const vert_fraction = src32_bottom - src32_top;
+        background_area += right_fraction * vert_fraction;
+        unsigned const full_pixels_hor = src_right - sw;
+        background_area += vert_fraction * (full_pixels_hor << 5);
+        src_right = sw - 1; // inclusive
+        src32_right = sw << 5; // exclusive
+    }
+    assert(src_bottom >= src_top);
+    assert(src_right >= src_left);
+
+    Mixer mixer;
+    if (outside_flags & OutsidePixels::WEAK) {
+        background_area = 0;
+    } else {
+        mixer.add(outside_color, background_area);
+    }
+
+    unsigned const left_fraction = 32 - (src32_left & 31);
+    unsigned const top_fraction = 32 - (src32_top & 31);
+    unsigned const right_fraction = src32_right - (src_right << 5);
+    unsigned const bottom_fraction = src32_bottom - (src_bottom << 5);
+
+    assert(left_fraction + right_fraction + (src_right - src_left - 1) * 32 == static_cast<unsigned>(src32_right - src32_left));
+    assert(top_fraction + bottom_fraction + (src_bottom - src_top - 1) * 32 == static_cast<unsigned>(src32_bottom - src32_top));
+
+    unsigned const src_area = (src32_bottom - src32_top) * (src32_right - src32_left);
+    if (src_area == 0) {
+        if ((outside_flags & OutsidePixels::COLOR)) {
+            return outside_color;
+        } else {
+            int const src_x = qBound<int>(0, (src_left + src_right) >> 1, sw - 1);
+            int const src_y = qBound<int>(0, (src_top + src_bottom) >> 1, sh - 1);
+            return src_data[src_y * src_stride + src_x];
+        }
+    }
+
+    StorageUnit const* src_line = &src_data[src_top * src_stride];
+
+    if (src_top == src_bottom) {
+        if (src_left == src_right) {
+            // dst pixel maps to a single src pixel
+            StorageUnit const c = src_line[src_left];
+            if (background_area == 0) {
+                // common case optimization
+                return c;
+            }
+            mixer.add(c, src_area);
+        } else {
+            // dst pixel maps to a horizontal line of src pixels
+            unsigned const vert_fraction = src32_bottom - src32_top;
+            unsigned const left_area = vert_fraction * left_fraction;
+            unsigned const middle_area = vert_fraction << 5;
+            unsigned const right_area = vert_fraction * right_fraction;
+
+            mixer.add(src_line[src_left], left_area);
+
+            for (int sx = src_left + 1; sx < src_right; ++sx) {
+                mixer.add(src_line[sx], middle_area);
+            }
+
+            mixer.add(src_line[src_right], right_area);
+        }
+    } else if (src_left == src_right) {
+        // dst pixel maps to a vertical line of src pixels
+        unsigned const hor_fraction = src32_right - src32_left;
+        unsigned const top_area = hor_fraction * top_fraction;
+        unsigned const middle_area = hor_fraction << 5;
+        unsigned const bottom_area =  hor_fraction * bottom_fraction;
+
+        src_line += src_left;
+        mixer.add(*src_line, top_area);
+
+        src_line += src_stride;
+
+        for (int sy = src_top + 1; sy < src_bottom; ++sy) {
+            mixer.add(*src_line, middle_area);
+            src_line += src_stride;
+        }
+
+        mixer.add(*src_line, bottom_area);
+    } else {
+        // dst pixel maps to a block of src pixels
+        unsigned const top_area = top_fraction << 5;
+        unsigned const bottom_area = bottom_fraction << 5;
+        unsigned const left_area = left_fraction << 5;
+        unsigned const right_area = right_fraction << 5;
+        unsigned const topleft_area = top_fraction * left_fraction;
+        unsigned const topright_area = top_fraction * right_fraction;
+        unsigned const bottomleft_area = bottom_fraction * left_fraction;
+        unsigned const bottomright_area = bottom_fraction * right_fraction;
+
+        // process the top-left corner
+        mixer.add(src_line[src_left], topleft_area);
+
+        // process the top line (without corners)
+        for (int sx = src_left + 1; sx < src_right; ++sx) {
+            mixer.add(src_line[sx], top_area);
+        }
+
+        // process the top-right corner
+        mixer.add(src_line[src_right], topright_area);
+
+        src_line += src_stride;
+
+        // process middle lines
+        for (int sy = src_top + 1; sy < src_bottom; ++sy) {
+            mixer.add(src_line[src_left], left_area);
+
+            for (int sx = src_left + 1; sx < src_right; ++sx) {
+                mixer.add(src_line[sx], 32 * 32);
+            }
+
+            mixer.add(src_line[src_right], right_area);
+
+            src_line += src_stride;
+        }
+
+        // process bottom-left corner
+        mixer.add(src_line[src_left], bottomleft_area);
+
+        // process the bottom line (without corners)
+        for (int sx = src_left + 1; sx < src_right; ++sx) {
+            mixer.add(src_line[sx], bottom_area);
+        }
+
+        // process the bottom-right corner
+        mixer.add(src_line[src_right], bottomright_area);
+    }
+
+    return mixer.result(src_area + background_area);
+}
+
 template<typename StorageUnit, typename Mixer>
 static void transformGeneric(
     StorageUnit const* const src_data, int const src_stride, QSize const src_size,
@@ -187,213 +540,72 @@ static void transformGeneric(
     int const src32_unit_w = std::max<int>(1, qRound(src32_unit_size.width()));
     int const src32_unit_h = std::max<int>(1, qRound(src32_unit_size.height()));
 
-    #pragma omp parallel for schedule(static) shared(inv_xform)
-    for (int dy = 0; dy < dh; ++dy) {
-        StorageUnit* dst_line = dst_data + dy * dst_stride;
-        double const f_dy_center = dy + 0.5;
-        double const f_sx32_base = f_dy_center * inv_xform.m21() + inv_xform.dx();
-        double const f_sy32_base = f_dy_center * inv_xform.m22() + inv_xform.dy();
-
-        for (int dx = 0; dx < dw; ++dx) {
-            double const f_dx_center = dx + 0.5;
-            double const f_sx32_center = f_sx32_base + f_dx_center * inv_xform.m11();
-            double const f_sy32_center = f_sy32_base + f_dx_center * inv_xform.m12();
-            int src32_left = (int)f_sx32_center - (src32_unit_w >> 1);
-            int src32_top = (int)f_sy32_center - (src32_unit_h >> 1);
-            int src32_right = src32_left + src32_unit_w;
-            int src32_bottom = src32_top + src32_unit_h;
-            int src_left = src32_left >> 5;
-            int src_right = (src32_right - 1) >> 5; // inclusive
-            int src_top = src32_top >> 5;
-            int src_bottom = (src32_bottom - 1) >> 5; // inclusive
-            assert(src_bottom >= src_top);
-            assert(src_right >= src_left);
-
-            if (src_bottom < 0 || src_right < 0 || src_left >= sw || src_top >= sh) {
-                // Completely outside of src image.
-                if (outside_flags & OutsidePixels::COLOR) {
-                    dst_line[dx] = outside_color;
-                } else {
-                    int const src_x = qBound<int>(0, (src_left + src_right) >> 1, sw - 1);
-                    int const src_y = qBound<int>(0, (src_top + src_bottom) >> 1, sh - 1);
-                    dst_line[dx] = src_data[src_y * src_stride + src_x];
-                }
-                continue;
-            }
-
-            /*
-             * Note that (intval / 32) is not the same as (intval >> 5).
-             * The former rounds towards zero, while the latter rounds towards
-             * negative infinity.
-             * Likewise, (intval % 32) is not the same as (intval & 31).
-             * The following expression:
-             * top_fraction = 32 - (src32_top & 31);
-             * works correctly with both positive and negative src32_top.
-             */
-
-            unsigned background_area = 0;
-
-            if (src_top < 0) {
-                unsigned const top_fraction = 32 - (src32_top & 31);
-                unsigned const hor_fraction = src32_right - src32_left;
-                background_area += top_fraction * hor_fraction;
-                unsigned const full_pixels_ver = -1 - src_top;
-                background_area += hor_fraction * (full_pixels_ver << 5);
-                src_top = 0;
-                src32_top = 0;
-            }
-            if (src_bottom >= sh) {
-                unsigned const bottom_fraction = src32_bottom - (src_bottom << 5);
-                unsigned const hor_fraction = src32_right - src32_left;
-                background_area += bottom_fraction * hor_fraction;
-                unsigned const full_pixels_ver = src_bottom - sh;
-                background_area += hor_fraction * (full_pixels_ver << 5);
-                src_bottom = sh - 1; // inclusive
-                src32_bottom = sh << 5; // exclusive
-            }
-            if (src_left < 0) {
-                unsigned const left_fraction = 32 - (src32_left & 31);
-                unsigned const vert_fraction = src32_bottom - src32_top;
-                background_area += left_fraction * vert_fraction;
-                unsigned const full_pixels_hor = -1 - src_left;
-                background_area += vert_fraction * (full_pixels_hor << 5);
-                src_left = 0;
-                src32_left = 0;
-            }
-            if (src_right >= sw) {
-                unsigned const right_fraction = src32_right - (src_right << 5);
-                unsigned const vert_fraction = src32_bottom - src32_top;
-                background_area += right_fraction * vert_fraction;
-                unsigned const full_pixels_hor = src_right - sw;
-                background_area += vert_fraction * (full_pixels_hor << 5);
-                src_right = sw - 1; // inclusive
-                src32_right = sw << 5; // exclusive
-            }
-            assert(src_bottom >= src_top);
-            assert(src_right >= src_left);
-
-            Mixer mixer;
-            if (outside_flags & OutsidePixels::WEAK) {
-                background_area = 0;
-            } else {
-                mixer.add(outside_color, background_area);
-            }
-
-            unsigned const left_fraction = 32 - (src32_left & 31);
-            unsigned const top_fraction = 32 - (src32_top & 31);
-            unsigned const right_fraction = src32_right - (src_right << 5);
-            unsigned const bottom_fraction = src32_bottom - (src_bottom << 5);
-
-            assert(left_fraction + right_fraction + (src_right - src_left - 1) * 32 == static_cast<unsigned>(src32_right - src32_left));
-            assert(top_fraction + bottom_fraction + (src_bottom - src_top - 1) * 32 == static_cast<unsigned>(src32_bottom - src32_top));
-
-            unsigned const src_area = (src32_bottom - src32_top) * (src32_right - src32_left);
-            if (src_area == 0) {
-                if ((outside_flags & OutsidePixels::COLOR)) {
-                    dst_line[dx] = outside_color;
-                } else {
-                    int const src_x = qBound<int>(0, (src_left + src_right) >> 1, sw - 1);
-                    int const src_y = qBound<int>(0, (src_top + src_bottom) >> 1, sh - 1);
-                    dst_line[dx] = src_data[src_y * src_stride + src_x];
-                }
-                continue;
-            }
-
-            StorageUnit const* src_line = &src_data[src_top * src_stride];
-
-            if (src_top == src_bottom) {
-                if (src_left == src_right) {
-                    // dst pixel maps to a single src pixel
-                    StorageUnit const c = src_line[src_left];
-                    if (background_area == 0) {
-                        // common case optimization
-                        dst_line[dx] = c;
+    // Unless we are downscaling by more than 2 times, a destination pixel
+    // maps to at most 3x3 source pixels.  Those not affected by the outside
+    // area are mixed by Mixer::mixBlock(), which gives the same results
+    // as transformPixel() but is considerably faster.  With SIMD_NONE,
+    // transformPixel() is used for everything, serving as a reference.
+    bool const block_mixing = CpuFeatures::simdLevel() != CpuFeatures::SIMD_NONE
+                              && src32_unit_w <= 64 && src32_unit_h <= 64;
+    AreaDivider const divider(block_mixing ? src32_unit_w * src32_unit_h : 1);
+    int const sw32 = sw << 5;
+    int const sh32 = sh << 5;
+
+    // We go tile by tile, so that when rotating, the source pixels
+    // a tile maps to are still in cache when we get to the next row.
+    int const tile_w = 256;
+    int const tile_h = 32;
+    int const tiles_hor = (dw + tile_w - 1) / tile_w;
+    int const tiles_ver = (dh + tile_h - 1) / tile_h;
+    int const num_tiles = tiles_hor * tiles_ver;
+
+    #pragma omp parallel for schedule(dynamic) shared(inv_xform)
+    for (int tile = 0; tile < num_tiles; ++tile) {
+        int const tile_left = (tile % tiles_hor) * tile_w;
+        int const tile_top = (tile / tiles_hor) * tile_h;
+        int const tile_right = std::min(dw, tile_left + tile_w);
+        int const tile_bottom = std::min(dh, tile_top + tile_h);
+
+        for (int dy = tile_top; dy < tile_bottom; ++dy) {
+            StorageUnit* dst_line = dst_data + dy * dst_stride;
+            double const f_dy_center = dy + 0.5;
+            double const f_sx32_base = f_dy_center * inv_xform.m21() + inv_xform.dx();
+            double const f_sy32_base = f_dy_center * inv_xform.m22() + inv_xform.dy();
+
+            for (int dx = tile_left; dx < tile_right; ++dx) {
+                double const f_dx_center = dx + 0.5;
+                double const f_sx32_center = f_sx32_base + f_dx_center * inv_xform.m11();
+                double const f_sy32_center = f_sy32_base + f_dx_center * inv_xform.m12();
+
+                if (block_mixing) {
+                    int const src32_left = (int)f_sx32_center - (src32_unit_w >> 1);
+                    int const src32_top = (int)f_sy32_center - (src32_unit_h >> 1);
+                    int const src32_right = src32_left + src32_unit_w;
+                    int const src32_bottom = src32_top + src32_unit_h;
+                    if (src32_left >= 0 && src32_top >= 0 && src32_right <= sw32 && src32_bottom <= sh32) {
+                        unsigned wx[3];
+                        unsigned wy[3];
+                        int const nx = axisWeights(src32_left, src32_right, wx);
+                        int const ny = axisWeights(src32_top, src32_bottom, wy);
+                        StorageUnit const* const src = src_data
+                                                       + (src32_top >> 5) * src_stride + (src32_left >> 5);
+                        if (nx == 1 && ny == 1) {
+                            // Same as in transformPixel(), copy the pixel as is.
+                            dst_line[dx] = *src;
+                        } else {
+                            dst_line[dx] = Mixer::mixBlock(src, src_stride, wx, nx, wy, ny, divider);
+                        }
                         continue;
                     }
-                    mixer.add(c, src_area);
-                } else {
-                    // dst pixel maps to a horizontal line of src pixels
-                    unsigned const vert_fraction = src32_bottom - src32_top;
-                    unsigned const left_area = vert_fraction * left_fraction;
-                    unsigned const middle_area = vert_fraction << 5;
-                    unsigned const right_area = vert_fraction * right_fraction;
-
-                    mixer.add(src_line[src_left], left_area);
-
-                    for (int sx = src_left + 1; sx < src_right; ++sx) {
-                        mixer.add(src_line[sx], middle_area);
-                    }
-
-                    mixer.add(src_line[src_right], right_area);
-                }
-            } else if (src_left == src_right) {
-                // dst pixel maps to a vertical line of src pixels
-                unsigned const hor_fraction = src32_right - src32_left;
-                unsigned const top_area = hor_fraction * top_fraction;
-                unsigned const middle_area = hor_fraction << 5;
-                unsigned const bottom_area =  hor_fraction * bottom_fraction;
-
-                src_line += src_left;
-                mixer.add(*src_line, top_area);
-
-                src_line += src_stride;
-
-                for (int sy = src_top + 1; sy < src_bottom; ++sy) {
-                    mixer.add(*src_line, middle_area);
-                    src_line += src_stride;
                 }
 
-                mixer.add(*src_line, bottom_area);
-            } else {
-                // dst pixel maps to a block of src pixels
-                unsigned const top_area = top_fraction << 5;
-                unsigned const bottom_area = bottom_fraction << 5;
-                unsigned const left_area = left_fraction << 5;
-                unsigned const right_area = right_fraction << 5;
-                unsigned const topleft_area = top_fraction * left_fraction;
-                unsigned const topright_area = top_fraction * right_fraction;
-                unsigned const bottomleft_area = bottom_fraction * left_fraction;
-                unsigned const bottomright_area = bottom_fraction * right_fraction;
-
-                // process the top-left corner
-                mixer.add(src_line[src_left], topleft_area);
-
-                // process the top line (without corners)
-                for (int sx = src_left + 1; sx < src_right; ++sx) {
-                    mixer.add(src_line[sx], top_area);
-                }
-
-                // process the top-right corner
-                mixer.add(src_line[src_right], topright_area);
-
-                src_line += src_stride;
-
-                // process middle lines
-                for (int sy = src_top + 1; sy < src_bottom; ++sy) {
-                    mixer.add(src_line[src_left], left_area);
-
-                    for (int sx = src_left + 1; sx < src_right; ++sx) {
-                        mixer.add(src_line[sx], 32 * 32);
-                    }
-
-                    mixer.add(src_line[src_right], right_area);
-
-                    src_line += src_stride;
-                }
-
-                // process bottom-left corner
-                mixer.add(src_line[src_left], bottomleft_area);
-
-                // process the bottom line (without corners)
-                for (int sx = src_left + 1; sx < src_right; ++sx) {
-                    mixer.add(src_line[sx], bottom_area);
-                }
-
-                // process the bottom-right corner
-                mixer.add(src_line[src_right], bottomright_area);
+                dst_line[dx] = transformPixel<StorageUnit, Mixer>(
+                                   src_data, src_stride, sw, sh,
+                                   f_sx32_center, f_sy32_center,
+                                   src32_unit_w, src32_unit_h,
+                                   outside_color, outside_flags
+                               );
             }
-
-            dst_line[dx] = mixer.result(src_area + background_area);
         }
     }
 }
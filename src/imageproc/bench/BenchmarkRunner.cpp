@@ -0,0 +1,108 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BenchmarkRunner.h"
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTextStream>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <stdio.h>
+
+namespace imageproc
+{
+
+namespace bench
+{
+
+BenchmarkRunner::BenchmarkRunner(
+    int const iterations, QString const& filter, bool const list_only)
+    :   m_iterations(std::max(1, iterations)),
+        m_filter(filter),
+        m_listOnly(list_only)
+{
+}
+
+bool
+BenchmarkRunner::matches(QString const& name, QString const& input) const
+{
+    return (name + '/' + input).contains(m_filter, Qt::CaseInsensitive);
+}
+
+void
+BenchmarkRunner::run(
+    QString const& name, QString const& input, QSize const& size,
+    Op const& op, Op const& setup)
+{
+    if (!matches(name, input)) {
+        return;
+    }
+
+    QTextStream err(stderr);
+    if (m_listOnly) {
+        err << name << '/' << input << endl;
+        return;
+    }
+
+    err << name << '/' << input << "... " << flush;
+
+    // The untimed run, to get the caches and the memory allocator warm.
+    if (setup) {
+        setup();
+    }
+    op();
+
+    std::vector<double> times_ms;
+    times_ms.reserve(m_iterations);
+    for (int i = 0; i < m_iterations; ++i) {
+        if (setup) {
+            setup();
+        }
+        QElapsedTimer timer;
+        timer.start();
+        op();
+        times_ms.push_back(timer.nsecsElapsed() * 1e-6);
+    }
+
+    std::sort(times_ms.begin(), times_ms.end());
+    size_t const mid = times_ms.size() / 2;
+    double const median_ms = times_ms.size() % 2
+                             ? times_ms[mid] : (times_ms[mid - 1] + times_ms[mid]) * 0.5;
+    double const mean_ms = std::accumulate(times_ms.begin(), times_ms.end(), 0.0) / times_ms.size();
+    double const megapixels = double(size.width()) * size.height() * 1e-6;
+
+    QJsonObject result;
+    result["name"] = name;
+    result["input"] = input;
+    result["width"] = size.width();
+    result["height"] = size.height();
+    result["iterations"] = m_iterations;
+    result["min_ms"] = times_ms.front();
+    result["median_ms"] = median_ms;
+    result["mean_ms"] = mean_ms;
+    result["max_ms"] = times_ms.back();
+    result["megapixels_per_sec"] = median_ms > 0.0 ? megapixels * 1000.0 / median_ms : 0.0;
+    m_results.append(result);
+
+    err << QString::number(median_ms, 'f', 2) << " ms" << endl;
+}
+
+} // namespace bench
+
+} // namespace imageproc
@@ -0,0 +1,89 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_BENCH_BENCHMARKRUNNER_H_
+#define IMAGEPROC_BENCH_BENCHMARKRUNNER_H_
+
+#include "NonCopyable.h"
+#include <QString>
+#include <QSize>
+#include <QJsonArray>
+#include <boost/function.hpp>
+
+namespace imageproc
+{
+
+namespace bench
+{
+
+/**
+ * \brief Times operations and collects the results as JSON objects.
+ *
+ * Each benchmark is identified by the operation name and the name of
+ * its input, like "binarizeWolf" and "text_300dpi".  A benchmark is
+ * skipped if "name/input" doesn't contain the filter string.
+ */
+class BenchmarkRunner
+{
+    DECLARE_NON_COPYABLE(BenchmarkRunner)
+public:
+    typedef boost::function<void()> Op;
+
+    /**
+     * \param iterations The number of timed runs of each operation.
+     *        They are preceded by a single untimed run.
+     * \param filter Only benchmarks matching it will be run.
+     * \param list_only If set, matching benchmarks are printed
+     *        instead of being run.
+     */
+    BenchmarkRunner(int iterations, QString const& filter, bool list_only);
+
+    /**
+     * \brief Tells whether the benchmark matches the filter.
+     */
+    bool matches(QString const& name, QString const& input) const;
+
+    /**
+     * \brief Runs a benchmark, if it matches the filter.
+     *
+     * \param name The operation name.
+     * \param input The input name.
+     * \param size The dimensions of the input, for computing throughput.
+     * \param op The operation to time.
+     * \param setup Prepares the state \p op works on, if necessary.
+     *        It's called before each run of \p op and isn't timed.
+     */
+    void run(QString const& name, QString const& input, QSize const& size,
+             Op const& op, Op const& setup = Op());
+
+    QJsonArray const& results() const
+    {
+        return m_results;
+    }
+private:
+    int m_iterations;
+    QString m_filter;
+    bool m_listOnly;
+    QJsonArray m_results;
+};
+
+} // namespace bench
+
+} // namespace imageproc
+
+#endif
@@ -0,0 +1,329 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SyntheticPages.h"
+#include "GrayImage.h"
+#include <QRect>
+#include <QtGlobal>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+namespace imageproc
+{
+
+namespace bench
+{
+
+namespace
+{
+
+/**
+ * A xorshift generator.  Unlike rand(), it gives the same sequence
+ * on every platform.
+ */
+class Random
+{
+public:
+    explicit Random(uint32_t seed) : m_state(seed ? seed : 1) {}
+
+    uint32_t next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    /** Returns a number in [0, limit). */
+    int below(int limit)
+    {
+        return static_cast<int>(next() % static_cast<uint32_t>(limit));
+    }
+private:
+    uint32_t m_state;
+};
+
+double const PI = 3.14159265358979323846;
+
+/** The skew of the generated text, as tan(0.7 degrees). */
+double const TEXT_SKEW = 0.0122;
+
+void fillPaper(GrayImage& img, Random& rng)
+{
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y, line += img.stride()) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = static_cast<uint8_t>(235 + (rng.next() & 15));
+        }
+    }
+}
+
+void fillRect(GrayImage& img, QRect const& rect, int const level)
+{
+    QRect const r(rect.intersected(img.rect()));
+    uint8_t* line = img.data() + r.top() * img.stride();
+    for (int y = r.top(); y <= r.bottom(); ++y, line += img.stride()) {
+        for (int x = r.left(); x <= r.right(); ++x) {
+            line[x] = static_cast<uint8_t>(level);
+        }
+    }
+}
+
+/**
+ * Draws something resembling a letter: a combination of stems and bars,
+ * possibly with an ascender or a descender.
+ */
+void drawGlyph(
+    GrayImage& img, int const x, int const baseline,
+    int const width, int const x_height, int const stroke, Random& rng)
+{
+    int const level = 20 + rng.below(40);
+    uint32_t const shape = rng.next();
+    int const top = baseline - x_height;
+
+    int stem_top = top;
+    int stem_bottom = baseline;
+    if ((shape & 0x30) == 0x10) {
+        stem_top -= x_height * 7 / 10; // ascender
+    } else if ((shape & 0x30) == 0x20) {
+        stem_bottom += x_height * 6 / 10; // descender
+    }
+
+    if (shape & 0x01) {
+        fillRect(img, QRect(x, stem_top, stroke, stem_bottom - stem_top), level);
+    }
+    if (shape & 0x02) {
+        fillRect(img, QRect(x + width - stroke, top, stroke, x_height), level);
+    }
+    if (shape & 0x04) {
+        fillRect(img, QRect(x, top, width, stroke), level);
+    }
+    if (shape & 0x08) {
+        fillRect(img, QRect(x, top + (x_height - stroke) / 2, width, stroke), level);
+    }
+    if ((shape & 0x40) || !(shape & 0x0F)) {
+        fillRect(img, QRect(x, baseline - stroke, width, stroke), level);
+    }
+}
+
+/**
+ * Fills \p area with lines of text, ragged on the right.
+ */
+void drawText(GrayImage& img, QRect const& area, int const dpi, Random& rng)
+{
+    int const line_height = dpi / 6;
+    int const x_height = line_height * 2 / 5;
+    int const stroke = std::max(1, dpi / 100);
+
+    for (int baseline = area.top() + line_height; baseline <= area.bottom(); baseline += line_height) {
+        if (rng.below(12) == 0) {
+            continue; // paragraph break
+        }
+
+        int x = area.left();
+        if (rng.below(6) == 0) {
+            x += x_height * 2; // indent
+        }
+        int const line_end = area.right() - rng.below(std::max(1, area.width() / 8));
+
+        while (x < line_end) {
+            int const word_len = 1 + rng.below(8);
+            for (int i = 0; i < word_len && x < line_end; ++i) {
+                int const width = x_height * (5 + rng.below(4)) / 10;
+                int const shift = static_cast<int>((x - area.left()) * TEXT_SKEW);
+                drawGlyph(img, x, baseline + shift, width, x_height, stroke, rng);
+                x += width + stroke * 2;
+            }
+            x += x_height * 6 / 10;
+        }
+    }
+}
+
+/** Adds dark specks of 1 to 3 pixels, for despeckling to remove. */
+void addSpecks(GrayImage& img, Random& rng)
+{
+    int const count = img.width() * img.height() / 20000;
+    for (int i = 0; i < count; ++i) {
+        int const size = 1 + rng.below(3);
+        int const x = rng.below(img.width());
+        int const y = rng.below(img.height());
+        fillRect(img, QRect(x, y, size, size), 40 + rng.below(60));
+    }
+}
+
+/** A table of sin(i * 2 * pi / period + phase) * amplitude. */
+std::vector<double> waveTable(int const size, double const period, double const phase, double const amplitude)
+{
+    std::vector<double> table(size);
+    for (int i = 0; i < size; ++i) {
+        table[i] = sin(i * 2.0 * PI / period + phase) * amplitude;
+    }
+    return table;
+}
+
+} // anonymous namespace
+
+QString
+SyntheticPages::kindName(Kind const kind)
+{
+    switch (kind) {
+    case TEXT:
+        return "text";
+    case HALFTONE:
+        return "halftone";
+    case PHOTO:
+        return "photo";
+    }
+
+    return QString();
+}
+
+QSize
+SyntheticPages::pageSize(int const dpi)
+{
+    // US Letter.
+    return QSize(dpi * 17 / 2, dpi * 11);
+}
+
+QImage
+SyntheticPages::generate(Kind const kind, int const dpi)
+{
+    switch (kind) {
+    case TEXT:
+        return generateText(dpi);
+    case HALFTONE:
+        return generateHalftone(dpi);
+    case PHOTO:
+        return generatePhoto(dpi);
+    }
+
+    return QImage();
+}
+
+QImage
+SyntheticPages::generateText(int const dpi)
+{
+    Random rng(1000 + dpi);
+    GrayImage img(pageSize(dpi));
+    fillPaper(img, rng);
+
+    QRect const area(img.rect().adjusted(dpi, dpi, -dpi, -dpi));
+    drawText(img, area, dpi, rng);
+    addSpecks(img, rng);
+
+    return img.toQImage();
+}
+
+QImage
+SyntheticPages::generateHalftone(int const dpi)
+{
+    Random rng(2000 + dpi);
+    GrayImage img(pageSize(dpi));
+    fillPaper(img, rng);
+
+    QRect const page_area(img.rect().adjusted(dpi, dpi, -dpi, -dpi));
+    QRect const header(page_area.left(), page_area.top(), page_area.width(), dpi);
+    drawText(img, header, dpi, rng);
+
+    // A 45 degree clustered-dot screen with 85 lines per inch.
+    QRect const picture(page_area.adjusted(0, header.height() + dpi / 4, 0, 0));
+    double const period = dpi / 85.0;
+    double const scale = 1.0 / (period * sqrt(2.0));
+    std::vector<double> const tone_x(waveTable(picture.width(), picture.width() / 1.3, 0.4, 0.3));
+    std::vector<double> const tone_y(waveTable(picture.height(), picture.height() / 1.7, 1.1, 0.25));
+
+    uint8_t* line = img.data() + picture.top() * img.stride();
+    for (int y = 0; y < picture.height(); ++y, line += img.stride()) {
+        for (int x = 0; x < picture.width(); ++x) {
+            double const darkness = qBound(0.02, 0.5 + tone_x[x] + tone_y[y], 0.98);
+            double const u = (x + y) * scale;
+            double const v = (x - y) * scale;
+            double const du = u - floor(u) - 0.5;
+            double const dv = v - floor(v) - 0.5;
+            bool const ink = du * du + dv * dv < darkness / PI;
+            line[picture.left() + x] = static_cast<uint8_t>(
+                (ink ? 30 : 230) + (rng.next() & 15)
+            );
+        }
+    }
+
+    return img.toQImage();
+}
+
+QImage
+SyntheticPages::generatePhoto(int const dpi)
+{
+    Random rng(3000 + dpi);
+    QSize const size(pageSize(dpi));
+    int const w = size.width();
+    int const h = size.height();
+
+    std::vector<double> const red_x(waveTable(w, w / 1.1, 0.0, 60.0));
+    std::vector<double> const red_y(waveTable(h, h / 2.3, 0.5, 40.0));
+    std::vector<double> const green_x(waveTable(w, w / 2.7, 1.0, 50.0));
+    std::vector<double> const green_y(waveTable(h, h / 0.9, 2.0, 50.0));
+    std::vector<double> const blue_x(waveTable(w, w / 0.8, 2.5, 40.0));
+    std::vector<double> const blue_y(waveTable(h, h / 3.1, 3.0, 60.0));
+
+    // A few discs, for sharp edges.
+    int const num_discs = 12;
+    std::vector<QRect> discs;
+    std::vector<uint32_t> disc_colors;
+    for (int i = 0; i < num_discs; ++i) {
+        int const r = dpi / 4 + rng.below(dpi);
+        discs.push_back(QRect(rng.below(w) - r, rng.below(h) - r, r * 2, r * 2));
+        disc_colors.push_back(0xFF000000 | (rng.next() & 0x00FFFFFF));
+    }
+
+    QImage img(size, QImage::Format_RGB32);
+    for (int y = 0; y < h; ++y) {
+        uint32_t* line = reinterpret_cast<uint32_t*>(img.scanLine(y));
+        for (int x = 0; x < w; ++x) {
+            int const noise = static_cast<int>(rng.next() & 7) - 4;
+            int const r = qBound(0, qRound(128 + red_x[x] + red_y[y]) + noise, 255);
+            int const g = qBound(0, qRound(128 + green_x[x] + green_y[y]) + noise, 255);
+            int const b = qBound(0, qRound(128 + blue_x[x] + blue_y[y]) + noise, 255);
+            line[x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        }
+
+        for (int i = 0; i < num_discs; ++i) {
+            QRect const& disc = discs[i];
+            int const dy = 2 * y - (disc.top() + disc.bottom());
+            int const diameter = disc.width();
+            if (std::abs(dy) >= diameter) {
+                continue;
+            }
+            int const half_chord = static_cast<int>(sqrt(double(diameter * diameter - dy * dy))) / 2;
+            int const cx = (disc.left() + disc.right()) / 2;
+            int const left = std::max(0, cx - half_chord);
+            int const right = std::min(w - 1, cx + half_chord);
+            for (int x = left; x <= right; ++x) {
+                line[x] = disc_colors[i];
+            }
+        }
+    }
+
+    return img;
+}
+
+} // namespace bench
+
+} // namespace imageproc
@@ -0,0 +1,72 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_BENCH_SYNTHETICPAGES_H_
+#define IMAGEPROC_BENCH_SYNTHETICPAGES_H_
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+namespace imageproc
+{
+
+namespace bench
+{
+
+/**
+ * \brief Generates scan-like page images for benchmarking.
+ *
+ * The images only depend on the parameters, so that runs made
+ * on different machines or at different commits are comparable.
+ * Pages are US Letter sized and slightly skewed, like real scans.
+ */
+class SyntheticPages
+{
+public:
+    enum Kind {
+        /** Lines of glyph-like shapes on a noisy paper background. */
+        TEXT,
+        /** A clustered-dot halftone picture with a text header. */
+        HALFTONE,
+        /** A continuous-tone color picture. */
+        PHOTO
+    };
+
+    static QString kindName(Kind kind);
+
+    static QSize pageSize(int dpi);
+
+    /**
+     * \return A grayscale (Format_Indexed8) image for TEXT and HALFTONE,
+     *         or a Format_RGB32 one for PHOTO.
+     */
+    static QImage generate(Kind kind, int dpi);
+private:
+    static QImage generateText(int dpi);
+
+    static QImage generateHalftone(int dpi);
+
+    static QImage generatePhoto(int dpi);
+};
+
+} // namespace bench
+
+} // namespace imageproc
+
+#endif
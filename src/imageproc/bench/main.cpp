@@ -0,0 +1,379 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BenchmarkRunner.h"
+#include "SyntheticPages.h"
+#include "CpuFeatures.h"
+#include "BinaryImage.h"
+#include "BinaryThreshold.h"
+#include "GrayImage.h"
+#include "Binarize.h"
+#include "Morphology.h"
+#include "SEDM.h"
+#include "SeedFill.h"
+#include "ConnectivityMap.h"
+#include "Connectivity.h"
+#include "Transform.h"
+#include "Scale.h"
+#include "GaussBlur.h"
+#include "SavGolFilter.h"
+#include "SkewFinder.h"
+#include "Despeckle.h"
+#include "TaskStatus.h"
+#include "Dpi.h"
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTransform>
+#include <QColor>
+#include <QDateTime>
+#include <QFile>
+#include <QThread>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QTextStream>
+#include <stdio.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace imageproc;
+using namespace imageproc::bench;
+
+namespace
+{
+
+class NeverCancelled : public TaskStatus
+{
+public:
+    virtual void cancel() {}
+
+    virtual bool isCancelled() const
+    {
+        return false;
+    }
+
+    virtual void throwIfCancelled() const {}
+};
+
+/**
+ * Keeps the results of the operations around, so that they
+ * are not optimized away.
+ */
+struct Outputs
+{
+    QImage qimage;
+    GrayImage gray;
+    BinaryImage binary;
+    BinaryImage despeckled;
+    Skew skew;
+};
+
+/**
+ * All the operations, in the order they are run.
+ * Benchmarks marked as bitonal only run on TEXT and HALFTONE pages.
+ */
+struct Operation
+{
+    char const* name;
+    bool bitonal;
+};
+
+Operation const OPERATIONS[] = {
+    { "binarizeOtsu", false },
+    { "binarizeSauvola", false },
+    { "binarizeWolf", false },
+    { "transform", false },
+    { "transformToGray", false },
+    { "scaleToGray_down", false },
+    { "scaleToGray_up", false },
+    { "gaussBlur", false },
+    { "savGolFilter", false },
+    { "dilateBrick", true },
+    { "erodeBrick", true },
+    { "openBrick", true },
+    { "dilateGray", true },
+    { "SEDM", true },
+    { "seedFill", true },
+    { "seedFillGray", true },
+    { "ConnectivityMap", true },
+    { "SkewFinder", true },
+    { "despeckle", true }
+};
+
+/**
+ * Returns an image of the same size as \p mask, white except the
+ * one pixel wide border copied from \p mask.  Filling it from
+ * the border is how the background gets detected.
+ */
+GrayImage borderSeed(GrayImage const& mask)
+{
+    int const w = mask.width();
+    int const h = mask.height();
+    GrayImage seed(mask.size());
+    seed.fill(0xff);
+
+    uint8_t const* mask_line = mask.data();
+    uint8_t* seed_line = seed.data();
+    for (int y = 0; y < h; ++y) {
+        if (y == 0 || y == h - 1) {
+            memcpy(seed_line, mask_line, w);
+        } else {
+            seed_line[0] = mask_line[0];
+            seed_line[w - 1] = mask_line[w - 1];
+        }
+        mask_line += mask.stride();
+        seed_line += seed.stride();
+    }
+
+    return seed;
+}
+
+void runPageBenchmarks(
+    BenchmarkRunner& runner, SyntheticPages::Kind const kind, int const dpi)
+{
+    QString const input(QString("%1_%2dpi").arg(SyntheticPages::kindName(kind)).arg(dpi));
+    bool const bitonal_page = kind != SyntheticPages::PHOTO;
+
+    bool wanted = false;
+    for (Operation const& op : OPERATIONS) {
+        if ((bitonal_page || !op.bitonal) && runner.matches(op.name, input)) {
+            wanted = true;
+            break;
+        }
+    }
+    if (!wanted) {
+        return;
+    }
+
+    QImage const page(SyntheticPages::generate(kind, dpi));
+    GrayImage const gray(page);
+    BinaryImage const binary(gray, BinaryThreshold::otsuThreshold(gray));
+    QSize const size(page.size());
+    QSize const window(dpi / 10 | 1, dpi / 10 | 1);
+    Outputs out;
+
+    QTransform rotation;
+    rotation.rotate(1.3);
+    QRect const rotated_rect(rotation.mapRect(QRectF(page.rect())).toAlignedRect());
+    OutsidePixels const outside(OutsidePixels::assumeColor(Qt::white));
+
+    runner.run("binarizeOtsu", input, size, [&]() {
+        out.binary = binarizeOtsu(gray);
+    });
+    runner.run("binarizeSauvola", input, size, [&]() {
+        out.binary = binarizeSauvola(gray, window);
+    });
+    runner.run("binarizeWolf", input, size, [&]() {
+        out.binary = binarizeWolf(gray, window);
+    });
+    runner.run("transform", input, size, [&]() {
+        out.qimage = transform(page, rotation, rotated_rect, outside);
+    });
+    runner.run("transformToGray", input, size, [&]() {
+        out.gray = transformToGray(page, rotation, rotated_rect, outside);
+    });
+    runner.run("scaleToGray_down", input, size, [&]() {
+        out.gray = scaleToGray(gray, size * 0.5);
+    });
+    runner.run("scaleToGray_up", input, size, [&]() {
+        out.gray = scaleToGray(gray, size * 1.5);
+    });
+    runner.run("gaussBlur", input, size, [&]() {
+        out.gray = gaussBlur(gray, 3.0f, 3.0f);
+    });
+    runner.run("savGolFilter", input, size, [&]() {
+        out.qimage = savGolFilter(gray, QSize(7, 7), 4, 4);
+    });
+
+    if (!bitonal_page) {
+        return;
+    }
+
+    runner.run("dilateBrick", input, size, [&]() {
+        out.binary = dilateBrick(binary, Brick(QSize(3, 3)));
+    });
+    runner.run("erodeBrick", input, size, [&]() {
+        out.binary = erodeBrick(binary, Brick(QSize(3, 3)));
+    });
+    runner.run("openBrick", input, size, [&]() {
+        out.binary = openBrick(binary, QSize(dpi / 20, 1));
+    });
+    runner.run("dilateGray", input, size, [&]() {
+        out.gray = dilateGray(gray, Brick(QSize(5, 5)));
+    });
+    runner.run("SEDM", input, size, [&]() {
+        SEDM const sedm(binary);
+    });
+
+    BinaryImage const seed(erodeBrick(binary, Brick(QSize(3, 3))));
+    runner.run("seedFill", input, size, [&]() {
+        out.binary = seedFill(seed, binary, CONN8);
+    });
+
+    GrayImage const gray_seed(borderSeed(gray));
+    runner.run("seedFillGray", input, size, [&]() {
+        out.gray = seedFillGray(gray_seed, gray, CONN8);
+    });
+    runner.run("ConnectivityMap", input, size, [&]() {
+        ConnectivityMap const cmap(binary, CONN8);
+    });
+    runner.run("SkewFinder", input, size, [&]() {
+        SkewFinder finder;
+        finder.setResolutionRatio(1.0);
+        out.skew = finder.findSkew(binary);
+    });
+
+    NeverCancelled const status;
+    runner.run(
+        "despeckle", input, size,
+        [&]() {
+            Despeckle::despeckleInPlace(out.despeckled, Dpi(dpi, dpi), Despeckle::NORMAL, status);
+        },
+        [&]() {
+            out.despeckled = binary;
+            out.despeckled.data(); // Detach, so that copying isn't timed.
+        }
+    );
+}
+
+QString simdLevelName(CpuFeatures::SimdLevel const level)
+{
+    switch (level) {
+    case CpuFeatures::SIMD_NONE:
+        return "none";
+    case CpuFeatures::SIMD_SSE2:
+        return "sse2";
+    case CpuFeatures::SIMD_AVX2:
+        return "avx2";
+    }
+
+    return QString();
+}
+
+void printUsage()
+{
+    QTextStream(stderr)
+            << "Usage: imageproc_bench [options]" << endl
+            << "  --dpi=<300|600|...>    Resolution of the pages.  May be repeated." << endl
+            << "                         Default: 300 and 600." << endl
+            << "  --iterations=<n>       Timed runs per benchmark.  Default: 5." << endl
+            << "  --filter=<substring>   Only run benchmarks whose \"name/input\"" << endl
+            << "                         contains this string." << endl
+            << "  --simd=<none|sse2|avx2>  Limit the instruction set used." << endl
+            << "  --label=<text>         Stored in the output, to identify the run." << endl
+            << "  --output=<file>        Write JSON there instead of the standard output." << endl
+            << "  --list                 Only print the names of the benchmarks." << endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QList<int> dpis;
+    int iterations = 5;
+    QString filter;
+    QString label;
+    QString output_file;
+    bool list_only = false;
+
+    QStringList const args(app.arguments().mid(1));
+    for (QString const& arg : args) {
+        QString const value(arg.section('=', 1));
+        if (arg.startsWith("--dpi=")) {
+            dpis.push_back(value.toInt());
+        } else if (arg.startsWith("--iterations=")) {
+            iterations = value.toInt();
+        } else if (arg.startsWith("--filter=")) {
+            filter = value;
+        } else if (arg.startsWith("--label=")) {
+            label = value;
+        } else if (arg.startsWith("--output=")) {
+            output_file = value;
+        } else if (arg.startsWith("--simd=")) {
+            if (value == "none") {
+                CpuFeatures::setSimdLevel(CpuFeatures::SIMD_NONE);
+            } else if (value == "sse2") {
+                CpuFeatures::setSimdLevel(CpuFeatures::SIMD_SSE2);
+            } else if (value == "avx2") {
+                CpuFeatures::setSimdLevel(CpuFeatures::SIMD_AVX2);
+            } else {
+                printUsage();
+                return 1;
+            }
+        } else if (arg == "--list") {
+            list_only = true;
+        } else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (dpis.isEmpty()) {
+        dpis << 300 << 600;
+    }
+    for (int const dpi : dpis) {
+        if (dpi < 50 || dpi > 2400) {
+            printUsage();
+            return 1;
+        }
+    }
+
+    BenchmarkRunner runner(iterations, filter, list_only);
+    SyntheticPages::Kind const kinds[] = {
+        SyntheticPages::TEXT, SyntheticPages::HALFTONE, SyntheticPages::PHOTO
+    };
+    for (int const dpi : dpis) {
+        for (SyntheticPages::Kind const kind : kinds) {
+            runPageBenchmarks(runner, kind, dpi);
+        }
+    }
+
+    if (list_only) {
+        return 0;
+    }
+
+    QJsonObject report;
+    report["format_version"] = 1;
+    report["label"] = label;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["qt_version"] = QString(qVersion());
+    report["simd_level"] = simdLevelName(CpuFeatures::simdLevel());
+    report["ideal_thread_count"] = QThread::idealThreadCount();
+#ifdef _OPENMP
+    report["openmp_threads"] = omp_get_max_threads();
+#else
+    report["openmp_threads"] = 0;
+#endif
+    report["results"] = runner.results();
+
+    QByteArray const json(QJsonDocument(report).toJson());
+    if (output_file.isEmpty()) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    } else {
+        QFile file(output_file);
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            QTextStream(stderr) << "Failed to write " << output_file << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
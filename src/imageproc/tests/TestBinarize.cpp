@@ -18,12 +18,21 @@
 
 #include "Binarize.h"
 #include "BinaryImage.h"
+#include "CpuFeatures.h"
+#include "Grayscale.h"
+#include "IntegralImage.h"
 #include "Utils.h"
 #include <QImage>
+#include <QRect>
 #include <QSize>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
 
 namespace imageproc
 {
@@ -33,7 +42,376 @@ namespace tests
 
 using namespace utils;
 
+namespace
+{
+
+/**
+ * A grayscale image resembling a scanned page: a gradient background
+ * with noise and some dark strokes.  Its width is deliberately not
+ * a multiple of any vector size.
+ */
+QImage makePageLikeImage(int const w, int const h)
+{
+    QImage img(w, h, QImage::Format_Indexed8);
+    img.setColorTable(createGrayscalePalette());
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t* line = img.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            int level = 160 + (x + y) * 80 / (w + h) + (rand() % 21) - 10;
+            if ((y / 7) % 3 == 0 && (x / 5) % 4 != 0) {
+                level -= 120;
+            }
+            line[x] = static_cast<uint8_t>(std::max(0, std::min(255, level)));
+        }
+    }
+
+    return img;
+}
+
+/**
+ * An image made of flat blocks of a few gray levels.  Most windows
+ * are uniform or nearly so, which is where computing the variance
+ * as sqmean - mean * mean loses the most precision.
+ */
+QImage makeBlocksImage(int const w, int const h)
+{
+    static int const levels[] = { 0, 17, 128, 200, 255 };
+
+    QImage img(w, h, QImage::Format_Indexed8);
+    img.setColorTable(createGrayscalePalette());
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t* line = img.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            line[x] = static_cast<uint8_t>(levels[(x / 23 + y / 19 * 3) % 5]);
+        }
+    }
+
+    return img;
+}
+
+/**
+ * Per-pixel window statistics, computed the way binarizeSauvola()
+ * and binarizeWolf() used to compute them: in long double, one window
+ * at a time.  The current code works in double, so this is the reference
+ * its output is checked against.
+ */
+class ReferenceWindowStats
+{
+public:
+    ReferenceWindowStats(QImage const& gray, QSize window_size);
+
+    long double mean(int x, int y) const { return m_means[y * m_width + x]; }
+
+    long double deviation(int x, int y) const { return m_deviations[y * m_width + x]; }
+private:
+    int m_width;
+    std::vector<long double> m_means;
+    std::vector<long double> m_deviations;
+};
+
+ReferenceWindowStats::ReferenceWindowStats(QImage const& gray, QSize const window_size)
+    :   m_width(gray.width()),
+        m_means(gray.width() * gray.height()),
+        m_deviations(gray.width() * gray.height())
+{
+    int const w = gray.width();
+    int const h = gray.height();
+
+    IntegralImage<uint32_t> integral_image(w, h);
+    IntegralImage<uint64_t> integral_sqimage(w, h);
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t const* gray_line = gray.scanLine(y);
+        integral_image.beginRow();
+        integral_sqimage.beginRow();
+        for (int x = 0; x < w; ++x) {
+            uint32_t const pixel = gray_line[x];
+            integral_image.push(pixel);
+            integral_sqimage.push(pixel * pixel);
+        }
+    }
+
+    int const window_lower_half = window_size.height() >> 1;
+    int const window_upper_half = window_size.height() - window_lower_half;
+    int const window_left_half = window_size.width() >> 1;
+    int const window_right_half = window_size.width() - window_left_half;
+
+    for (int y = 0; y < h; ++y) {
+        int const top = std::max(0, y - window_lower_half);
+        int const bottom = std::min(h, y + window_upper_half); // exclusive
+
+        for (int x = 0; x < w; ++x) {
+            int const left = std::max(0, x - window_left_half);
+            int const right = std::min(w, x + window_right_half); // exclusive
+            int const area = (bottom - top) * (right - left);
+
+            QRect const rect(left, top, right - left, bottom - top);
+            long double const window_sum = integral_image.sum(rect);
+            long double const window_sqsum = integral_sqimage.sum(rect);
+
+            long double const r_area = 1.0 / area;
+            long double const mean = window_sum * r_area;
+            long double const sqmean = window_sqsum * r_area;
+
+            long double const variance = sqmean - mean * mean;
+            m_means[y * w + x] = mean;
+            m_deviations[y * w + x] = sqrt(fabs(variance));
+        }
+    }
+}
+
+std::vector<long double>
+referenceSauvolaThresholds(QImage const& gray, QSize const window_size)
+{
+    int const w = gray.width();
+    int const h = gray.height();
+    ReferenceWindowStats const stats(gray, window_size);
+
+    std::vector<long double> thresholds(w * h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            long double const mean = stats.mean(x, y);
+            long double const deviation = stats.deviation(x, y);
+            long double const k = 0.34;
+            thresholds[y * w + x] = mean * (1.0 + k * (deviation / 128.0 - 1.0));
+        }
+    }
+
+    return thresholds;
+}
+
+std::vector<long double>
+referenceWolfThresholds(QImage const& gray, QSize const window_size)
+{
+    int const w = gray.width();
+    int const h = gray.height();
+    ReferenceWindowStats const stats(gray, window_size);
+
+    long double max_deviation = 0;
+    uint32_t min_gray_level = 255;
+    for (int y = 0; y < h; ++y) {
+        uint8_t const* gray_line = gray.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            max_deviation = std::max(max_deviation, stats.deviation(x, y));
+            min_gray_level = std::min<uint32_t>(min_gray_level, gray_line[x]);
+        }
+    }
+
+    std::vector<long double> thresholds(w * h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            // Means and deviations used to be stored as floats.
+            float const mean = stats.mean(x, y);
+            float const deviation = stats.deviation(x, y);
+            long double const k = 0.3;
+            long double const a = 1.0 - deviation / max_deviation;
+            thresholds[y * w + x] = mean - k * a * (mean - min_gray_level);
+        }
+    }
+
+    return thresholds;
+}
+
+/**
+ * The largest distance between a gray level and its reference threshold
+ * at which the current code may classify a pixel differently.
+ * A pixel that close to its threshold is decided by rounding error
+ * in either version.
+ */
+long double const BORDERLINE_DISTANCE = 1e-4;
+
+/**
+ * Checks \p bw against thresholding \p gray the way the reference code did:
+ * black if gray < lower_bound or if gray <= upper_bound and gray < threshold.
+ * Pixels may only differ if their gray level is within BORDERLINE_DISTANCE
+ * of their reference threshold.
+ *
+ * \return The number of differing pixels.
+ */
+int checkAgainstReference(
+    BinaryImage const& bw, QImage const& gray,
+    std::vector<long double> const& thresholds,
+    int const lower_bound = 0, int const upper_bound = 255)
+{
+    int const w = gray.width();
+    int const h = gray.height();
+    int differences = 0;
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t const* gray_line = gray.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            int const level = gray_line[x];
+            long double const threshold = thresholds[y * w + x];
+            bool const forced = level < lower_bound || level > upper_bound;
+            bool const reference_black = level < lower_bound ||
+                (level <= upper_bound && level < threshold);
+            if ((bw.getPixel(x, y) == BLACK) == reference_black) {
+                continue;
+            }
+
+            ++differences;
+            BOOST_CHECK(!forced);
+            BOOST_CHECK(fabsl(level - threshold) < BORDERLINE_DISTANCE);
+        }
+    }
+
+    return differences;
+}
+
+/**
+ * Restores the SIMD level when going out of scope.
+ */
+class SimdLevelGuard
+{
+public:
+    ~SimdLevelGuard()
+    {
+        CpuFeatures::setSimdLevel(CpuFeatures::supportedSimdLevel());
+    }
+};
+
+} // anonymous namespace
+
 BOOST_AUTO_TEST_SUITE(BinarizeTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_sauvola_dark_square)
+{
+    int const w = 61;
+    int const h = 43;
+    QImage img(w, h, QImage::Format_Indexed8);
+    img.setColorTable(createGrayscalePalette());
+    img.fill(220);
+    for (int y = 15; y < 25; ++y) {
+        for (int x = 20; x < 35; ++x) {
+            img.setPixel(x, y, 30);
+        }
+    }
+
+    BinaryImage bw(binarizeSauvola(img, QSize(31, 31)));
+    BOOST_CHECK(bw.getPixel(25, 20) == BLACK);
+    BOOST_CHECK(bw.getPixel(5, 5) == WHITE);
+    BOOST_CHECK(bw.getPixel(50, 35) == WHITE);
+}
+
+BOOST_AUTO_TEST_CASE(test_sauvola_simd_matches_scalar)
+{
+    SimdLevelGuard const guard;
+    QImage const img(makePageLikeImage(203, 97));
+    QSize const window(31, 17);
+
+    CpuFeatures::setSimdLevel(CpuFeatures::SIMD_NONE);
+    BinaryImage const scalar(binarizeSauvola(img, window));
+
+    CpuFeatures::setSimdLevel(CpuFeatures::SIMD_SSE2);
+    BOOST_CHECK(binarizeSauvola(img, window) == scalar);
+
+    CpuFeatures::setSimdLevel(CpuFeatures::SIMD_AVX2);
+    BOOST_CHECK(binarizeSauvola(img, window) == scalar);
+}
+
+BOOST_AUTO_TEST_CASE(test_wolf_simd_matches_scalar)
+{
+    SimdLevelGuard const guard;
+    QImage const img(makePageLikeImage(203, 97));
+    QSize const window(31, 17);
+
+    CpuFeatures::setSimdLevel(CpuFeatures::SIMD_NONE);
+    BinaryImage const scalar(binarizeWolf(img, window));
+
+    CpuFeatures::setSimdLevel(CpuFeatures::SIMD_SSE2);
+    BOOST_CHECK(binarizeWolf(img, window) == scalar);
+
+    CpuFeatures::setSimdLevel(CpuFeatures::SIMD_AVX2);
+    BOOST_CHECK(binarizeWolf(img, window) == scalar);
+}
+
+BOOST_AUTO_TEST_CASE(test_simd_narrow_images)
+{
+    // Images narrower than a vector only go through the scalar tails.
+    SimdLevelGuard const guard;
+    for (int w = 1; w <= 9; ++w) {
+        QImage const img(makePageLikeImage(w, 11));
+
+        CpuFeatures::setSimdLevel(CpuFeatures::SIMD_NONE);
+        BinaryImage const sauvola(binarizeSauvola(img, QSize(5, 5)));
+        BinaryImage const wolf(binarizeWolf(img, QSize(5, 5)));
+
+        CpuFeatures::setSimdLevel(CpuFeatures::SIMD_AVX2);
+        BOOST_CHECK(binarizeSauvola(img, QSize(5, 5)) == sauvola);
+        BOOST_CHECK(binarizeWolf(img, QSize(5, 5)) == wolf);
+    }
+}
+BOOST_AUTO_TEST_CASE(test_sauvola_matches_long_double_reference)
+{
+    SimdLevelGuard const guard;
+    QSize const windows[] = { QSize(5, 5), QSize(31, 17), QSize(200, 200) };
+    QImage const images[] = {
+        makePageLikeImage(203, 97), makePageLikeImage(640, 480),
+        makeBlocksImage(203, 97), makeBlocksImage(640, 480)
+    };
+
+    for (QImage const& img : images) {
+        QImage const gray(toGrayscale(img));
+        for (QSize const& window : windows) {
+            std::vector<long double> const thresholds(
+                referenceSauvolaThresholds(gray, window)
+            );
+
+            CpuFeatures::setSimdLevel(CpuFeatures::SIMD_NONE);
+            int const differences = checkAgainstReference(
+                binarizeSauvola(img, window), gray, thresholds
+            );
+            BOOST_TEST_MESSAGE(
+                "Sauvola: " << differences << " borderline pixels out of "
+                << gray.width() * gray.height() << " differ"
+            );
+
+            // The SIMD versions are bit-exact with the scalar one,
+            // so they are covered as well.
+            CpuFeatures::setSimdLevel(CpuFeatures::SIMD_AVX2);
+            checkAgainstReference(binarizeSauvola(img, window), gray, thresholds);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_wolf_matches_long_double_reference)
+{
+    SimdLevelGuard const guard;
+    QSize const windows[] = { QSize(5, 5), QSize(31, 17), QSize(200, 200) };
+    QImage const images[] = {
+        makePageLikeImage(203, 97), makePageLikeImage(640, 480),
+        makeBlocksImage(203, 97), makeBlocksImage(640, 480)
+    };
+
+    for (QImage const& img : images) {
+        QImage const gray(toGrayscale(img));
+        for (QSize const& window : windows) {
+            std::vector<long double> const thresholds(
+                referenceWolfThresholds(gray, window)
+            );
+
+            CpuFeatures::setSimdLevel(CpuFeatures::SIMD_NONE);
+            int const differences = checkAgainstReference(
+                binarizeWolf(img, window), gray, thresholds, 1, 254
+            );
+            BOOST_TEST_MESSAGE(
+                "Wolf: " << differences << " borderline pixels out of "
+                << gray.width() * gray.height() << " differ"
+            );
+            checkAgainstReference(
+                binarizeWolf(img, window, 40, 180), gray, thresholds, 40, 180
+            );
+
+            CpuFeatures::setSimdLevel(CpuFeatures::SIMD_AVX2);
+            checkAgainstReference(
+                binarizeWolf(img, window), gray, thresholds, 1, 254
+            );
+        }
+    }
+}
+
 #if 0
 BOOST_AUTO_TEST_CASE(test)
 {
@@ -19,10 +19,13 @@
 #include "Grayscale.h"
 #include "Utils.h"
 #include <QImage>
+#include <QVector>
+#include <QColor>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
 #include <stdlib.h>
+#include <stdint.h>
 
 namespace imageproc
 {
@@ -32,6 +35,32 @@ namespace tests
 
 using namespace utils;
 
+static QImage referenceGrayscale(QImage const& src)
+{
+    QImage gray(src.width(), src.height(), QImage::Format_Indexed8);
+    gray.setColorTable(createGrayscalePalette());
+
+    for (int y = 0; y < src.height(); ++y) {
+        for (int x = 0; x < src.width(); ++x) {
+            gray.setPixel(x, y, qGray(src.pixel(x, y)));
+        }
+    }
+
+    return gray;
+}
+
+static QImage randomArgb32Image(int const w, int const h)
+{
+    QImage argb32(w, h, QImage::Format_ARGB32);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            argb32.setPixel(x, y, qRgba(rand() & 0xff, rand() & 0xff, rand() & 0xff, rand() & 0xff));
+        }
+    }
+
+    return argb32;
+}
+
 BOOST_AUTO_TEST_SUITE(GrayscaleTestSuite);
 
 BOOST_AUTO_TEST_CASE(test_null_image)
@@ -81,6 +110,69 @@ BOOST_AUTO_TEST_CASE(test_argb32_to_grayscale)
     BOOST_CHECK(toGrayscale(argb32) == gray);
 }
 
+BOOST_AUTO_TEST_CASE(test_indexed8_to_grayscale)
+{
+    int const w = 50;
+    int const h = 64;
+
+    // The palette is shorter than the range of indices that are used.
+    QVector<QRgb> palette;
+    for (int i = 0; i < 200; ++i) {
+        palette.push_back(qRgb(rand() & 0xff, rand() & 0xff, rand() & 0xff));
+    }
+
+    QImage indexed(w, h, QImage::Format_Indexed8);
+    indexed.setColorTable(palette);
+    for (int y = 0; y < h; ++y) {
+        uint8_t* line = indexed.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            line[x] = static_cast<uint8_t>(rand() & 0xff);
+        }
+    }
+
+    BOOST_CHECK(toGrayscale(indexed) == referenceGrayscale(indexed));
+}
+
+BOOST_AUTO_TEST_CASE(test_color_formats_to_grayscale)
+{
+    static QImage::Format const formats[] = {
+        QImage::Format_Mono,
+        QImage::Format_MonoLSB,
+        QImage::Format_RGB32,
+        QImage::Format_ARGB32,
+        QImage::Format_ARGB32_Premultiplied,
+        QImage::Format_RGB888,
+        QImage::Format_RGB16,
+        QImage::Format_RGBX8888,
+        QImage::Format_RGBA8888,
+        QImage::Format_RGBA8888_Premultiplied,
+        QImage::Format_Grayscale8,
+        QImage::Format_RGB666,
+        QImage::Format_ARGB4444_Premultiplied,
+#if QT_VERSION >= 0x050C00
+        QImage::Format_RGBX64,
+        QImage::Format_RGBA64,
+        QImage::Format_RGBA64_Premultiplied,
+#endif
+#if QT_VERSION >= 0x050D00
+        QImage::Format_Grayscale16,
+#endif
+    };
+
+    // An odd width makes the lines of formats with less than 4 bytes
+    // per pixel end with padding.
+    QImage const argb32(randomArgb32Image(51, 64));
+
+    for (QImage::Format const format : formats) {
+        QImage const src(argb32.convertToFormat(format));
+        BOOST_REQUIRE(src.format() == format);
+        BOOST_CHECK_MESSAGE(
+            toGrayscale(src) == referenceGrayscale(src),
+            "format " << int(format)
+        );
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
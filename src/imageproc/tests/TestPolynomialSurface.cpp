@@ -0,0 +1,161 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PolynomialSurface.h"
+#include "GrayImage.h"
+#include <QSize>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+BOOST_AUTO_TEST_SUITE(PolynomialSurfaceTestSuite);
+
+static GrayImage makeGradient(QSize const& size)
+{
+    GrayImage image(size);
+    uint8_t* line = image.data();
+    for (int y = 0; y < size.height(); ++y, line += image.stride()) {
+        for (int x = 0; x < size.width(); ++x) {
+            line[x] = static_cast<uint8_t>(40 + 2 * x + y);
+        }
+    }
+    return image;
+}
+
+BOOST_AUTO_TEST_CASE(test_render_approximates_source)
+{
+    GrayImage const src(makeGradient(QSize(50, 40)));
+    PolynomialSurface const surface(3, 3, src);
+    GrayImage const rendered(surface.render(src.size()));
+
+    uint8_t const* src_line = src.data();
+    uint8_t const* rendered_line = rendered.data();
+    for (int y = 0; y < src.height(); ++y) {
+        for (int x = 0; x < src.width(); ++x) {
+            BOOST_REQUIRE(abs(int(src_line[x]) - int(rendered_line[x])) <= 1);
+        }
+        src_line += src.stride();
+        rendered_line += rendered.stride();
+    }
+}
+
+/**
+ * Renders the surface the way render() did before it went row by row:
+ * the terms depending on y alone and on x alone are tabulated for
+ * the whole image, then multiplied and summed per pixel in float.
+ */
+static GrayImage referenceRender(PolynomialSurface const& surface, QSize const& size)
+{
+    GrayImage image(size);
+    int const width = size.width();
+    int const height = size.height();
+    int const hor_degree = surface.horDegree();
+    int const vert_degree = surface.vertDegree();
+    VecT<double> const& coeffs = surface.coefficients();
+    int const num_coeffs = coeffs.size();
+
+    double const xscale = width <= 1 ? 0.0 : 1.0 / (width - 1);
+    double const yscale = height <= 1 ? 0.0 : 1.0 / (height - 1);
+
+    std::vector<float> vert_matrix(num_coeffs * height);
+    float* out = &vert_matrix[0];
+    for (int y = 0; y < height; ++y) {
+        double const y_adjusted = y * yscale;
+        double pow = 1.0;
+        int pos = 0;
+        for (int i = 0; i <= vert_degree; ++i) {
+            for (int j = 0; j <= hor_degree; ++j, ++pos, ++out) {
+                *out = static_cast<float>(coeffs[pos] * pow);
+            }
+            pow *= y_adjusted;
+        }
+    }
+
+    std::vector<float> hor_matrix(num_coeffs * width);
+    out = &hor_matrix[0];
+    for (int x = 0; x < width; ++x) {
+        double const x_adjusted = x * xscale;
+        for (int i = 0; i <= vert_degree; ++i) {
+            double pow = 1.0;
+            for (int j = 0; j <= hor_degree; ++j, ++out) {
+                *out = static_cast<float>(pow);
+                pow *= x_adjusted;
+            }
+        }
+    }
+
+    uint8_t* line = image.data();
+    for (int y = 0; y < height; ++y, line += image.stride()) {
+        float const* vert_line = &vert_matrix[0] + y * num_coeffs;
+        float const* hor_line = &hor_matrix[0];
+        for (int x = 0; x < width; ++x, hor_line += num_coeffs) {
+            float sum = 0;
+            for (int i = 0; i < num_coeffs; ++i) {
+                sum += hor_line[i] * vert_line[i];
+            }
+            int const isum = (int)(sum * 255.0 + 0.5f);
+            line[x] = isum <= 0 ? 0 : (isum >= 255 ? 255 : (uint8_t) isum);
+        }
+    }
+
+    return image;
+}
+
+BOOST_AUTO_TEST_CASE(test_render_matches_tabulated_reference)
+{
+    GrayImage const src(makeGradient(QSize(50, 40)));
+    PolynomialSurface const surface(4, 3, src);
+
+    // Wider than a block of the row renderer, and not a multiple of it.
+    QSize const size(601, 37);
+    GrayImage const reference(referenceRender(surface, size));
+    GrayImage const rendered(surface.render(size));
+    PolynomialSurface::RowRenderer const renderer(surface, size);
+
+    // Horner's scheme in float rounds differently from summing
+    // the tabulated terms, which may move a pixel by one level.
+    int const tolerance = 1;
+
+    std::vector<uint8_t> row(size.width());
+    uint8_t const* reference_line = reference.data();
+    uint8_t const* rendered_line = rendered.data();
+    for (int y = 0; y < size.height(); ++y) {
+        renderer.renderRow(y, &row[0]);
+        for (int x = 0; x < size.width(); ++x) {
+            BOOST_REQUIRE(abs(int(row[x]) - int(reference_line[x])) <= tolerance);
+            BOOST_REQUIRE(abs(int(rendered_line[x]) - int(reference_line[x])) <= tolerance);
+        }
+        reference_line += reference.stride();
+        rendered_line += rendered.stride();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -18,9 +18,11 @@
 
 #include "Transform.h"
 #include "Grayscale.h"
+#include "CpuFeatures.h"
 #include "Utils.h"
 #include <QImage>
 #include <QSize>
+#include <QTransform>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -66,6 +68,78 @@ BOOST_AUTO_TEST_CASE(test_random_image)
     BOOST_CHECK(transformToGray(img, null_xform, img.rect(), outside_pixels) == img);
 }
 
+static QImage randomImage(QSize const& size, QImage::Format const format)
+{
+    QImage img(size, format);
+    for (int y = 0; y < img.height(); ++y) {
+        uint32_t* line = reinterpret_cast<uint32_t*>(img.scanLine(y));
+        for (int x = 0; x < img.width(); ++x) {
+            uint32_t const argb = (uint32_t(rand() & 0xFFFF) << 16) | (rand() & 0xFFFF);
+            line[x] = format == QImage::Format_RGB32 ? argb | 0xFF000000 : argb;
+        }
+    }
+    return img;
+}
+
+/**
+ * Transforms the image both with and without SIMD and checks
+ * the results are identical.
+ */
+static bool simdMatchesGeneric(
+    QImage const& src, QTransform const& xform, OutsidePixels const outside_pixels)
+{
+    QRect const dst_rect(xform.mapRect(QRectF(src.rect())).toAlignedRect().adjusted(-2, -2, 2, 2));
+
+    CpuFeatures::setSimdLevel(CpuFeatures::SIMD_NONE);
+    QImage const generic(transform(src, xform, dst_rect, outside_pixels));
+    CpuFeatures::setSimdLevel(CpuFeatures::supportedSimdLevel());
+    QImage const simd(transform(src, xform, dst_rect, outside_pixels));
+
+    return generic == simd;
+}
+
+BOOST_AUTO_TEST_CASE(test_simd_matches_generic)
+{
+    QImage::Format const formats[] = {
+        QImage::Format_Indexed8, QImage::Format_RGB32, QImage::Format_ARGB32
+    };
+    OutsidePixels const outside[] = {
+        OutsidePixels::assumeColor(QColor(0x12, 0x34, 0x56, 0x78)),
+        OutsidePixels::assumeWeakNearest()
+    };
+
+    for (QImage::Format const format : formats) {
+        QImage src;
+        if (format == QImage::Format_Indexed8) {
+            src = randomImage(QSize(97, 61), QImage::Format_RGB32);
+            src = GrayImage(src).toQImage();
+        } else {
+            src = randomImage(QSize(97, 61), format);
+        }
+
+        for (OutsidePixels const& outside_pixels : outside) {
+            // Small rotations, like in deskewing.
+            for (double angle = -3.0; angle <= 3.0; angle += 0.7) {
+                QTransform xform;
+                xform.rotate(angle);
+                BOOST_CHECK(simdMatchesGeneric(src, xform, outside_pixels));
+            }
+
+            // Scaling, including the case of a destination pixel
+            // mapping to more than 3x3 source pixels.
+            double const scales[] = { 0.3, 0.5, 0.6, 0.75, 1.3, 2.0 };
+            for (double const scale : scales) {
+                QTransform xform;
+                xform.scale(scale, scale * 0.9);
+                xform.rotate(1.5);
+                BOOST_CHECK(simdMatchesGeneric(src, xform, outside_pixels));
+            }
+        }
+    }
+
+    CpuFeatures::setSimdLevel(CpuFeatures::supportedSimdLevel());
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests